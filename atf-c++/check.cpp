@@ -83,18 +83,68 @@ impl::check_result::termsig(void)
     return atf_check_result_termsig(&m_result);
 }
 
+void
+impl::check_result::materialize(void) const
+{
+    atf_error_t err = atf_check_result_materialize(&m_result);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+}
+
 const std::string
 impl::check_result::stdout_path(void) const
 {
+    materialize();
     return atf_check_result_stdout(&m_result);
 }
 
 const std::string
 impl::check_result::stderr_path(void) const
 {
+    materialize();
     return atf_check_result_stderr(&m_result);
 }
 
+const std::string
+impl::check_result::stdout_data(void) const
+{
+    std::size_t length;
+    const char* data = atf_check_result_stdout_data(&m_result, &length);
+    return std::string(data, length);
+}
+
+const std::string
+impl::check_result::stderr_data(void) const
+{
+    std::size_t length;
+    const char* data = atf_check_result_stderr_data(&m_result, &length);
+    return std::string(data, length);
+}
+
+// ------------------------------------------------------------------------
+// The "pending" class.
+// ------------------------------------------------------------------------
+
+impl::pending::pending(const atf_check_pending_t* p) :
+    m_valid(true)
+{
+    std::memcpy(&m_pending, p, sizeof(m_pending));
+}
+
+impl::pending::~pending(void)
+{
+    if (m_valid)
+        atf_check_pending_fini(&m_pending);
+}
+
+bool
+impl::pending::done(void)
+    const
+{
+    PRE(m_valid);
+    return atf_check_pending_done(&m_pending);
+}
+
 // ------------------------------------------------------------------------
 // Free functions.
 // ------------------------------------------------------------------------
@@ -152,3 +202,84 @@ impl::exec(const atf::process::argv_array& argva)
 
     return std::auto_ptr< impl::check_result >(new impl::check_result(&result));
 }
+
+std::auto_ptr< impl::check_result >
+impl::exec(const atf::process::argv_array& argva, const std::string& input)
+{
+    atf_check_result_t result;
+
+    atf_error_t err = atf_check_exec_array_stdin(argva.exec_argv(),
+                                                 input.data(), input.length(),
+                                                 &result);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+
+    return std::auto_ptr< impl::check_result >(new impl::check_result(&result));
+}
+
+std::auto_ptr< impl::pending >
+impl::launch(const atf::process::argv_array& argva)
+{
+    atf_check_pending_t pending;
+
+    atf_error_t err = atf_check_launch_array(argva.exec_argv(), &pending);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+
+    return std::auto_ptr< impl::pending >(new impl::pending(&pending));
+}
+
+std::auto_ptr< impl::check_result >
+impl::wait(pending& p)
+{
+    PRE(p.m_valid);
+
+    atf_check_result_t result;
+
+    atf_error_t err = atf_check_wait(&p.m_pending, &result);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+    p.m_valid = false;
+
+    return std::auto_ptr< impl::check_result >(new impl::check_result(&result));
+}
+
+std::size_t
+impl::wait_any(const std::vector< pending* >& pendings)
+{
+    std::vector< atf_check_pending_t* > cpendings;
+    bool any_valid = false;
+    for (std::vector< pending* >::const_iterator iter = pendings.begin();
+         iter != pendings.end(); iter++) {
+        if (*iter != NULL && (*iter)->m_valid) {
+            cpendings.push_back(&(*iter)->m_pending);
+            any_valid = true;
+        } else
+            cpendings.push_back(NULL);
+    }
+    PRE(any_valid);
+
+    std::size_t index;
+    atf_error_t err = atf_check_wait_any(&cpendings[0], cpendings.size(),
+                                         &index);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+
+    return index;
+}
+
+void
+impl::wait_all(const std::vector< pending* >& pendings)
+{
+    std::vector< atf_check_pending_t* > cpendings;
+    for (std::vector< pending* >::const_iterator iter = pendings.begin();
+         iter != pendings.end(); iter++)
+        cpendings.push_back(*iter != NULL && (*iter)->m_valid ?
+                            &(*iter)->m_pending : NULL);
+    if (cpendings.empty())
+        return;
+
+    atf_error_t err = atf_check_wait_all(&cpendings[0], cpendings.size());
+    if (atf_is_error(err))
+        throw_atf_error(err);
+}
@@ -43,6 +43,8 @@ class argv_array;
 
 namespace check {
 
+class pending;
+
 // ------------------------------------------------------------------------
 // The "check_result" class.
 // ------------------------------------------------------------------------
@@ -70,8 +72,16 @@ class check_result {
     //!
     check_result(const atf_check_result_t* result);
 
+    //!
+    //! \brief Writes the output of the command to files if not yet done.
+    //!
+    void materialize(void) const;
+
     friend check_result test_constructor(const char* const*);
     friend std::auto_ptr< check_result > exec(const atf::process::argv_array&);
+    friend std::auto_ptr< check_result > exec(const atf::process::argv_array&,
+                                              const std::string&);
+    friend std::auto_ptr< check_result > wait(pending&);
 
 public:
     //!
@@ -108,6 +118,57 @@ public:
     //! \brief Returns the path to file contaning command's stderr.
     //!
     const std::string stderr_path(void) const;
+
+    //!
+    //! \brief Returns the command's stdout.
+    //!
+    const std::string stdout_data(void) const;
+
+    //!
+    //! \brief Returns the command's stderr.
+    //!
+    const std::string stderr_data(void) const;
+};
+
+// ------------------------------------------------------------------------
+// The "pending" class.
+// ------------------------------------------------------------------------
+
+//!
+//! \brief A command that has been started but not yet waited for.
+//!
+//! Destroying a pending object that has not been waited for kills the
+//! command.
+//!
+class pending {
+    // Non-copyable.
+    pending(const pending&);
+    pending& operator=(const pending&);
+
+    //!
+    //! \brief Internal representation of the command.
+    //!
+    atf_check_pending_t m_pending;
+
+    //!
+    //! \brief Whether m_pending is still owned by this object.
+    //!
+    bool m_valid;
+
+    pending(const atf_check_pending_t*);
+
+    friend std::auto_ptr< pending > launch(const atf::process::argv_array&);
+    friend std::auto_ptr< check_result > wait(pending&);
+    friend std::size_t wait_any(const std::vector< pending* >&);
+    friend void wait_all(const std::vector< pending* >&);
+
+public:
+    ~pending(void);
+
+    //!
+    //! \brief Returns whether wait() can be called without blocking.
+    //!
+    bool done(void) const;
 };
 
 // ------------------------------------------------------------------------
@@ -121,6 +182,12 @@ bool build_cpp(const std::string&, const std::string&,
 bool build_cxx_o(const std::string&, const std::string&,
                  const atf::process::argv_array&);
 std::auto_ptr< check_result > exec(const atf::process::argv_array&);
+std::auto_ptr< check_result > exec(const atf::process::argv_array&,
+                                   const std::string&);
+std::auto_ptr< pending > launch(const atf::process::argv_array&);
+std::auto_ptr< check_result > wait(pending&);
+std::size_t wait_any(const std::vector< pending* >&);
+void wait_all(const std::vector< pending* >&);
 
 // Useful for testing only.
 check_result test_constructor(void);
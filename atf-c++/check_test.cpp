@@ -360,6 +360,44 @@ ATF_TEST_CASE_BODY(exec_stdout_stderr)
     check_lines(err2, "stderr", "result2");
 }
 
+ATF_TEST_CASE(exec_stdin);
+ATF_TEST_CASE_HEAD(exec_stdin)
+{
+    set_md_var("descr", "Tests that exec feeds the given data to the "
+               "stdin of the child process");
+}
+ATF_TEST_CASE_BODY(exec_stdin)
+{
+    std::vector< std::string > argv;
+    argv.push_back("cat");
+
+    atf::process::argv_array argva(argv);
+    std::auto_ptr< atf::check::check_result > r =
+        atf::check::exec(argva, "Line 1\nLine 2\n");
+    ATF_REQUIRE(r->exited());
+    ATF_REQUIRE_EQ(r->exitcode(), EXIT_SUCCESS);
+    ATF_REQUIRE_EQ("Line 1\nLine 2\n", r->stdout_data());
+}
+
+ATF_TEST_CASE(exec_stdout_stderr_data);
+ATF_TEST_CASE_HEAD(exec_stdout_stderr_data)
+{
+    set_md_var("descr", "Tests that exec provides the stdout and stderr "
+               "streams of the child process in memory");
+}
+ATF_TEST_CASE_BODY(exec_stdout_stderr_data)
+{
+    std::auto_ptr< atf::check::check_result > r =
+        do_exec(this, "stdout-stderr", "result");
+    ATF_REQUIRE(r->exited());
+    ATF_REQUIRE_EQ(r->exitcode(), EXIT_SUCCESS);
+
+    ATF_REQUIRE_EQ("Line 1 to stdout for result\n"
+                   "Line 2 to stdout for result\n", r->stdout_data());
+    ATF_REQUIRE_EQ("Line 1 to stderr for result\n"
+                   "Line 2 to stderr for result\n", r->stderr_data());
+}
+
 ATF_TEST_CASE(exec_unknown);
 ATF_TEST_CASE_HEAD(exec_unknown)
 {
@@ -377,6 +415,79 @@ ATF_TEST_CASE_BODY(exec_unknown)
     ATF_REQUIRE_EQ(r->exitcode(), 127);
 }
 
+ATF_TEST_CASE(launch_wait);
+ATF_TEST_CASE_HEAD(launch_wait)
+{
+    set_md_var("descr", "Tests that launch runs commands concurrently and "
+               "that wait_any and wait_all collect their results");
+}
+ATF_TEST_CASE_BODY(launch_wait)
+{
+    std::vector< std::string > slow_argv;
+    slow_argv.push_back("sleep");
+    slow_argv.push_back("60");
+    std::auto_ptr< atf::check::pending > slow =
+        atf::check::launch(atf::process::argv_array(slow_argv));
+
+    std::vector< std::string > fast_argv;
+    fast_argv.push_back("sh");
+    fast_argv.push_back("-c");
+    fast_argv.push_back("echo out; echo err 1>&2; exit 2");
+    std::auto_ptr< atf::check::pending > fast =
+        atf::check::launch(atf::process::argv_array(fast_argv));
+
+    std::vector< atf::check::pending* > pendings;
+    pendings.push_back(slow.get());
+    pendings.push_back(fast.get());
+    ATF_REQUIRE_EQ(1, atf::check::wait_any(pendings));
+    ATF_REQUIRE(!slow->done());
+
+    std::auto_ptr< atf::check::check_result > r = atf::check::wait(*fast);
+    ATF_REQUIRE(r->exited());
+    ATF_REQUIRE_EQ(2, r->exitcode());
+    ATF_REQUIRE_EQ("out\n", r->stdout_data());
+    ATF_REQUIRE_EQ("err\n", r->stderr_data());
+
+    std::vector< std::string > other_argv;
+    other_argv.push_back("sh");
+    other_argv.push_back("-c");
+    other_argv.push_back("exit 4");
+    std::auto_ptr< atf::check::pending > other =
+        atf::check::launch(atf::process::argv_array(other_argv));
+
+    // The fast command has already been waited for, so it is ignored.
+    pendings[0] = other.get();
+    atf::check::wait_all(pendings);
+    ATF_REQUIRE(other->done());
+    r = atf::check::wait(*other);
+    ATF_REQUIRE(r->exited());
+    ATF_REQUIRE_EQ(4, r->exitcode());
+
+    // Destroying the slow command kills it.
+    slow.reset(NULL);
+}
+
+ATF_TEST_CASE(wait_any_none);
+ATF_TEST_CASE_HEAD(wait_any_none)
+{
+    set_md_var("descr", "Tests that wait_any rejects a set of commands that "
+               "have all been waited for already");
+}
+ATF_TEST_CASE_BODY(wait_any_none)
+{
+    std::vector< std::string > argv;
+    argv.push_back("true");
+    std::auto_ptr< atf::check::pending > p =
+        atf::check::launch(atf::process::argv_array(argv));
+    (void)atf::check::wait(*p);
+
+    std::vector< atf::check::pending* > pendings;
+    pendings.push_back(NULL);
+    pendings.push_back(p.get());
+    expect_signal(SIGABRT, "wait_any has nothing to wait for");
+    (void)atf::check::wait_any(pendings);
+}
+
 // ------------------------------------------------------------------------
 // Main.
 // ------------------------------------------------------------------------
@@ -390,5 +501,9 @@ ATF_INIT_TEST_CASES(tcs)
     ATF_ADD_TEST_CASE(tcs, exec_cleanup);
     ATF_ADD_TEST_CASE(tcs, exec_exitstatus);
     ATF_ADD_TEST_CASE(tcs, exec_stdout_stderr);
+    ATF_ADD_TEST_CASE(tcs, exec_stdin);
+    ATF_ADD_TEST_CASE(tcs, exec_stdout_stderr_data);
     ATF_ADD_TEST_CASE(tcs, exec_unknown);
+    ATF_ADD_TEST_CASE(tcs, launch_wait);
+    ATF_ADD_TEST_CASE(tcs, wait_any_none);
 }
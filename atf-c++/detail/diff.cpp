@@ -0,0 +1,260 @@
+// Copyright (c) 2007 The NetBSD Foundation, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+// CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+// IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "atf-c++/detail/diff.hpp"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "atf-c++/detail/sanity.hpp"
+
+namespace impl = atf::diff;
+#define IMPL_NAME "atf::diff"
+
+const std::size_t impl::default_max_cost = 10000000;
+
+//!
+//! \brief Number of unchanged lines printed around every change.
+//!
+static const std::size_t context = 3;
+
+//!
+//! \brief A text split in lines.
+//!
+//! Every line keeps its terminating newline character, if any, so that a
+//! missing newline at the end of a text is a difference like any other.
+//! Lines are also numbered so that equal lines have equal identifiers,
+//! which makes comparing them cheap.
+//!
+struct lines {
+    std::vector< std::string > m_text;
+    std::vector< std::size_t > m_ids;
+};
+
+static
+void
+split_lines(const std::string& text,
+            std::map< std::string, std::size_t >& ids, lines& out)
+{
+    std::string::size_type pos = 0;
+    while (pos < text.length()) {
+        std::string::size_type end = text.find('\n', pos);
+        end = (end == std::string::npos) ? text.length() : end + 1;
+
+        const std::string line = text.substr(pos, end - pos);
+        const std::map< std::string, std::size_t >::const_iterator iter =
+            ids.insert(std::make_pair(line, ids.size())).first;
+        out.m_text.push_back(line);
+        out.m_ids.push_back((*iter).second);
+
+        pos = end;
+    }
+}
+
+//!
+//! \brief Computes a minimal edit script between two sequences of lines.
+//!
+//! Implements the greedy algorithm described in "An O(ND) Difference
+//! Algorithm and Its Variations" by Eugene W. Myers, keeping the furthest
+//! reaching paths of every round to recover the script afterwards.  The
+//! script is appended to ops as one character per line: ' ' for a common
+//! line, '-' for a removed line and '+' for an added line.
+//!
+//! Returns false without touching ops if more than max_cost steps are
+//! needed, which bounds both the time and the memory used.
+//!
+static
+bool
+myers(const std::vector< std::size_t >& a, const std::size_t aoff,
+      const std::size_t n, const std::vector< std::size_t >& b,
+      const std::size_t boff, const std::size_t m, const std::size_t max_cost,
+      std::string& ops)
+{
+    const long max = static_cast< long >(n + m);
+    std::vector< long > v(2 * max + 3, 0);
+    std::vector< std::vector< long > > trace;
+    std::size_t cost = 0;
+
+    long d;
+    bool found = false;
+    for (d = 0; !found && d <= max; d++) {
+        for (long k = -d; !found && k <= d; k += 2) {
+            long x;
+            if (k == -d || (k != d && v[max + k - 1] < v[max + k + 1]))
+                x = v[max + k + 1];
+            else
+                x = v[max + k - 1] + 1;
+            long y = x - k;
+
+            while (x < static_cast< long >(n) && y < static_cast< long >(m) &&
+                   a[aoff + x] == b[boff + y]) {
+                x++;
+                y++;
+                cost++;
+            }
+            v[max + k] = x;
+
+            found = x >= static_cast< long >(n) && y >= static_cast< long >(m);
+        }
+
+        cost += 2 * d + 1;
+        if (cost > max_cost)
+            return false;
+        trace.push_back(std::vector< long >(v.begin() + max - d,
+                                            v.begin() + max + d + 1));
+    }
+    INV(found);
+    d--;
+
+    std::string reversed;
+    long x = static_cast< long >(n);
+    long y = static_cast< long >(m);
+    for (; d > 0; d--) {
+        const std::vector< long >& prev = trace[d - 1];
+        const long k = x - y;
+
+        // Slot i of the trace of round d - 1 holds diagonal i - (d - 1).
+        long prev_k;
+        if (k == -d || (k != d && prev[k - 1 + d - 1] < prev[k + 1 + d - 1]))
+            prev_k = k + 1;
+        else
+            prev_k = k - 1;
+        const long prev_x = prev[prev_k + d - 1];
+        const long prev_y = prev_x - prev_k;
+
+        while (x > prev_x && y > prev_y) {
+            reversed += ' ';
+            x--;
+            y--;
+        }
+        reversed += (x == prev_x) ? '+' : '-';
+        x = prev_x;
+        y = prev_y;
+    }
+    INV(x == y);
+    reversed.append(x, ' ');
+
+    ops.append(reversed.rbegin(), reversed.rend());
+    return true;
+}
+
+static
+void
+print_range(std::ostream& os, const std::size_t start,
+            const std::size_t length)
+{
+    // Empty ranges are identified by the line preceding them, as diff does.
+    if (length == 1)
+        os << start + 1;
+    else
+        os << (length == 0 ? start : start + 1) << "," << length;
+}
+
+static
+void
+print_line(std::ostream& os, const char op, const std::string& line)
+{
+    os << op << line;
+    if (line.empty() || line[line.length() - 1] != '\n')
+        os << "\n\\ No newline at end of file\n";
+}
+
+bool
+impl::unified(std::ostream& os, const std::string& label1,
+              const std::string& text1, const std::string& label2,
+              const std::string& text2, const std::size_t max_cost)
+{
+    if (text1 == text2)
+        return false;
+
+    std::map< std::string, std::size_t > ids;
+    lines a, b;
+    split_lines(text1, ids, a);
+    split_lines(text2, ids, b);
+    const std::size_t n = a.m_ids.size();
+    const std::size_t m = b.m_ids.size();
+
+    std::size_t prefix = 0;
+    while (prefix < n && prefix < m && a.m_ids[prefix] == b.m_ids[prefix])
+        prefix++;
+    std::size_t suffix = 0;
+    while (suffix < n - prefix && suffix < m - prefix &&
+           a.m_ids[n - suffix - 1] == b.m_ids[m - suffix - 1])
+        suffix++;
+
+    std::string ops(prefix, ' ');
+    if (!myers(a.m_ids, prefix, n - prefix - suffix, b.m_ids, prefix,
+               m - prefix - suffix, max_cost, ops)) {
+        ops.append(n - prefix - suffix, '-');
+        ops.append(m - prefix - suffix, '+');
+    }
+    ops.append(suffix, ' ');
+
+    // Positions in both texts before every operation.
+    std::vector< std::size_t > apos(ops.length() + 1, 0);
+    std::vector< std::size_t > bpos(ops.length() + 1, 0);
+    for (std::size_t i = 0; i < ops.length(); i++) {
+        apos[i + 1] = apos[i] + (ops[i] != '+' ? 1 : 0);
+        bpos[i + 1] = bpos[i] + (ops[i] != '-' ? 1 : 0);
+    }
+    INV(apos[ops.length()] == n && bpos[ops.length()] == m);
+
+    os << "--- " << label1 << "\n+++ " << label2 << "\n";
+
+    std::size_t i = ops.find_first_not_of(' ');
+    while (i != std::string::npos) {
+        // Extend the hunk while the next change is close enough for their
+        // contexts to overlap.
+        std::size_t last = ops.find_first_of(' ', i);
+        std::size_t next = ops.find_first_not_of(' ', last);
+        while (last != std::string::npos && next != std::string::npos &&
+               next - last <= 2 * context) {
+            last = ops.find_first_of(' ', next);
+            next = ops.find_first_not_of(' ', last);
+        }
+        if (last == std::string::npos)
+            last = ops.length();
+
+        const std::size_t start = i - std::min(i, context);
+        const std::size_t end = std::min(ops.length(), last + context);
+
+        os << "@@ -";
+        print_range(os, apos[start], apos[end] - apos[start]);
+        os << " +";
+        print_range(os, bpos[start], bpos[end] - bpos[start]);
+        os << " @@\n";
+        for (std::size_t j = start; j < end; j++) {
+            if (ops[j] == '+')
+                print_line(os, '+', b.m_text[bpos[j]]);
+            else
+                print_line(os, ops[j], a.m_text[apos[j]]);
+        }
+
+        i = next;
+    }
+
+    return true;
+}
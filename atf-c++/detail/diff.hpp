@@ -0,0 +1,61 @@
+// Copyright (c) 2007 The NetBSD Foundation, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+// CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+// IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#if !defined(ATF_CXX_DETAIL_DIFF_HPP)
+#define ATF_CXX_DETAIL_DIFF_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace atf {
+namespace diff {
+
+//!
+//! \brief Default limit on the work spent looking for a minimal diff.
+//!
+extern const std::size_t default_max_cost;
+
+//!
+//! \brief Prints the differences between two texts in unified format.
+//!
+//! The output resembles that of diff -u, with three lines of context and
+//! with the given labels in place of the file names.  Nothing is printed
+//! if the texts are equal.  Returns whether the texts differ.
+//!
+//! The lines common to the beginning and the end of both texts are
+//! skipped before comparing the rest with Myers' algorithm.  If doing so
+//! exceeds max_cost steps, the differing part is reported as one block of
+//! removed lines followed by one block of added lines: the result is then
+//! correct but not minimal.
+//!
+bool unified(std::ostream&, const std::string&, const std::string&,
+             const std::string&, const std::string&,
+             const std::size_t = default_max_cost);
+
+} // namespace diff
+} // namespace atf
+
+#endif // !defined(ATF_CXX_DETAIL_DIFF_HPP)
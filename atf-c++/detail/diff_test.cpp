@@ -0,0 +1,210 @@
+// Copyright (c) 2007 The NetBSD Foundation, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+// CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+// IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "atf-c++/detail/diff.hpp"
+
+#include <sstream>
+#include <string>
+
+#include <atf-c++.hpp>
+
+// ------------------------------------------------------------------------
+// Auxiliary functions.
+// ------------------------------------------------------------------------
+
+static
+std::string
+do_unified(const std::string& text1, const std::string& text2,
+           const std::size_t max_cost = atf::diff::default_max_cost)
+{
+    std::ostringstream out;
+    const bool differ = atf::diff::unified(out, "old", text1, "new", text2,
+                                           max_cost);
+    ATF_REQUIRE_EQ(differ, !out.str().empty());
+    return out.str();
+}
+
+static
+std::string
+numbered_lines(const int first, const int last)
+{
+    std::ostringstream out;
+    for (int i = first; i <= last; i++)
+        out << "line " << i << "\n";
+    return out.str();
+}
+
+// ------------------------------------------------------------------------
+// Test cases for the free functions.
+// ------------------------------------------------------------------------
+
+ATF_TEST_CASE(unified__equal);
+ATF_TEST_CASE_HEAD(unified__equal)
+{
+    set_md_var("descr", "Tests that unified prints nothing for equal texts");
+}
+ATF_TEST_CASE_BODY(unified__equal)
+{
+    ATF_REQUIRE_EQ("", do_unified("", ""));
+    ATF_REQUIRE_EQ("", do_unified("foo\nbar\n", "foo\nbar\n"));
+}
+
+ATF_TEST_CASE(unified__change);
+ATF_TEST_CASE_HEAD(unified__change)
+{
+    set_md_var("descr", "Tests unified with lines that are removed, added "
+               "and replaced");
+}
+ATF_TEST_CASE_BODY(unified__change)
+{
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -1,3 +1,3 @@\n"
+                   " a\n-b\n+x\n c\n",
+                   do_unified("a\nb\nc\n", "a\nx\nc\n"));
+
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -1,4 +1,3 @@\n"
+                   " a\n-b\n c\n d\n",
+                   do_unified("a\nb\nc\nd\n", "a\nc\nd\n"));
+
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -1,2 +1,3 @@\n"
+                   " a\n b\n+c\n",
+                   do_unified("a\nb\n", "a\nb\nc\n"));
+}
+
+ATF_TEST_CASE(unified__empty);
+ATF_TEST_CASE_HEAD(unified__empty)
+{
+    set_md_var("descr", "Tests unified when one of the texts is empty");
+}
+ATF_TEST_CASE_BODY(unified__empty)
+{
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -0,0 +1,2 @@\n"
+                   "+foo\n+bar\n",
+                   do_unified("", "foo\nbar\n"));
+
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -1 +0,0 @@\n"
+                   "-foo\n",
+                   do_unified("foo\n", ""));
+}
+
+ATF_TEST_CASE(unified__no_newline);
+ATF_TEST_CASE_HEAD(unified__no_newline)
+{
+    set_md_var("descr", "Tests that unified reports a missing newline at "
+               "the end of a text");
+}
+ATF_TEST_CASE_BODY(unified__no_newline)
+{
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -1,2 +1,2 @@\n"
+                   " foo\n-bar\n+bar\n\\ No newline at end of file\n",
+                   do_unified("foo\nbar\n", "foo\nbar"));
+}
+
+ATF_TEST_CASE(unified__hunks);
+ATF_TEST_CASE_HEAD(unified__hunks)
+{
+    set_md_var("descr", "Tests that unified only prints the context around "
+               "changes and merges changes close to each other");
+}
+ATF_TEST_CASE_BODY(unified__hunks)
+{
+    const std::string text1 = numbered_lines(1, 20);
+
+    std::string text2 = text1;
+    text2.replace(text2.find("line 2\n"), 7, "changed 2\n");
+    text2.replace(text2.find("line 17\n"), 8, "changed 17\n");
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -1,5 +1,5 @@\n"
+                   " line 1\n-line 2\n+changed 2\n line 3\n line 4\n"
+                   " line 5\n"
+                   "@@ -14,7 +14,7 @@\n"
+                   " line 14\n line 15\n line 16\n-line 17\n+changed 17\n"
+                   " line 18\n line 19\n line 20\n",
+                   do_unified(text1, text2));
+
+    text2 = text1;
+    text2.replace(text2.find("line 10\n"), 8, "");
+    text2.replace(text2.find("line 16\n"), 8, "");
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -7,13 +7,11 @@\n"
+                   " line 7\n line 8\n line 9\n-line 10\n line 11\n"
+                   " line 12\n line 13\n line 14\n line 15\n-line 16\n"
+                   " line 17\n line 18\n line 19\n",
+                   do_unified(text1, text2));
+}
+
+ATF_TEST_CASE(unified__max_cost);
+ATF_TEST_CASE_HEAD(unified__max_cost)
+{
+    set_md_var("descr", "Tests that unified falls back to reporting the "
+               "whole differing block when the diff is too expensive");
+}
+ATF_TEST_CASE_BODY(unified__max_cost)
+{
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -1,5 +1,5 @@\n"
+                   " a\n-b\n-c\n-d\n+c\n+d\n+e\n f\n",
+                   do_unified("a\nb\nc\nd\nf\n", "a\nc\nd\ne\nf\n", 0));
+}
+
+ATF_TEST_CASE(unified__large);
+ATF_TEST_CASE_HEAD(unified__large)
+{
+    set_md_var("descr", "Tests unified with large texts that share most of "
+               "their lines");
+}
+ATF_TEST_CASE_BODY(unified__large)
+{
+    const std::string text1 = numbered_lines(1, 200000);
+    const std::string text2 = numbered_lines(1, 99999) + "changed\n" +
+        numbered_lines(100001, 200000);
+    ATF_REQUIRE_EQ("--- old\n+++ new\n"
+                   "@@ -99997,7 +99997,7 @@\n"
+                   " line 99997\n line 99998\n line 99999\n"
+                   "-line 100000\n+changed\n"
+                   " line 100001\n line 100002\n line 100003\n",
+                   do_unified(text1, text2));
+}
+
+// ------------------------------------------------------------------------
+// Main.
+// ------------------------------------------------------------------------
+
+ATF_INIT_TEST_CASES(tcs)
+{
+    // Add the test cases for the free functions.
+    ATF_ADD_TEST_CASE(tcs, unified__change);
+    ATF_ADD_TEST_CASE(tcs, unified__empty);
+    ATF_ADD_TEST_CASE(tcs, unified__equal);
+    ATF_ADD_TEST_CASE(tcs, unified__hunks);
+    ATF_ADD_TEST_CASE(tcs, unified__large);
+    ATF_ADD_TEST_CASE(tcs, unified__max_cost);
+    ATF_ADD_TEST_CASE(tcs, unified__no_newline);
+}
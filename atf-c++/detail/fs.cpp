@@ -469,17 +469,14 @@ impl::have_prog_in_path(const std::string& prog)
     // there something is broken in the user's environment.
     if (!atf::env::has("PATH"))
         throw std::runtime_error("PATH not defined in the environment");
-    std::vector< std::string > dirs =
-        atf::text::split(atf::env::get("PATH"), ":");
 
-    bool found = false;
-    for (std::vector< std::string >::const_iterator iter = dirs.begin();
-         !found && iter != dirs.end(); iter++) {
-        const path& dir = path(*iter);
-
-        if (is_executable(dir / prog))
-            found = true;
-    }
+    atf_fs_path_t found_path;
+    bool found;
+    atf_error_t err = atf_fs_find_prog(prog.c_str(), &found_path, &found);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+    if (found)
+        atf_fs_path_fini(&found_path);
     return found;
 }
 
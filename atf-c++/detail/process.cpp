@@ -227,6 +227,63 @@ impl::stream_redirect_path::stream_redirect_path(const fs::path& p)
     m_inited = true;
 }
 
+impl::stream_ring::stream_ring(const std::size_t size, const int tee_fd)
+{
+    atf_error_t err = atf_process_stream_init_ring(&m_sb, size, tee_fd);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+    m_inited = true;
+}
+
+impl::stream_inline::stream_inline(const std::string& data) :
+    m_data(data)
+{
+    atf_error_t err = atf_process_stream_init_inline(&m_sb, m_data.data(),
+                                                     m_data.length());
+    if (atf_is_error(err))
+        throw_atf_error(err);
+    m_inited = true;
+}
+
+// ------------------------------------------------------------------------
+// The "ring" type.
+// ------------------------------------------------------------------------
+
+impl::ring::ring(void)
+{
+    atf_error_t err = atf_process_ring_init(&m_ring);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+}
+
+impl::ring::~ring(void)
+{
+    atf_process_ring_fini(&m_ring);
+}
+
+std::string
+impl::ring::data(void)
+    const
+{
+    std::size_t length;
+    const char* data = atf_process_ring_data(&m_ring, &length);
+    return std::string(data, length);
+}
+
+unsigned long long
+impl::ring::dropped(void)
+    const
+{
+    return atf_process_ring_dropped(&m_ring);
+}
+
+bool
+impl::ring::truncated(void)
+    const
+{
+    return atf_process_ring_truncated(&m_ring);
+}
+
 // ------------------------------------------------------------------------
 // The "status" type.
 // ------------------------------------------------------------------------
@@ -296,6 +353,8 @@ impl::child::~child(void)
         INV(!atf_is_error(err));
         atf_process_status_fini(&s);
     }
+
+    atf_process_child_fini(&m_child);
 }
 
 impl::status
@@ -311,6 +370,55 @@ impl::child::wait(void)
     return status(s);
 }
 
+//!
+//! \brief Waits for the child for at most the given number of milliseconds.
+//!
+//! Returns a null pointer if the child did not terminate in time, in which
+//! case it can be waited for again later.  A negative timeout waits forever.
+//!
+std::unique_ptr< impl::status >
+impl::child::wait_for(const int timeout)
+{
+    atf_process_status_t s;
+    bool done;
+
+    atf_error_t err = atf_process_child_wait_for(&m_child, timeout, &done, &s);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+
+    if (!done)
+        return std::unique_ptr< status >();
+
+    m_waited = true;
+    return std::unique_ptr< status >(new status(s));
+}
+
+//!
+//! \brief Collects the output of the ring streams of the child.
+//!
+//! Must be called at most once, either before or after waiting for the
+//! child; the output is discarded on destruction otherwise.
+//!
+void
+impl::child::drain(ring& out, ring& err)
+{
+    atf_error_t error = atf_process_child_drain(&m_child, &out.m_ring,
+                                                &err.m_ring);
+    if (atf_is_error(error))
+        throw_atf_error(error);
+}
+
+//!
+//! \brief Sends a signal to the child and all of its descendants.
+//!
+void
+impl::child::kill_tree(const int signo)
+{
+    atf_error_t err = atf_process_child_kill_tree(&m_child, signo);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+}
+
 pid_t
 impl::child::pid(void)
     const
@@ -318,6 +426,18 @@ impl::child::pid(void)
     return atf_process_child_pid(&m_child);
 }
 
+int
+impl::child::stdin_fd(void)
+{
+    return atf_process_child_stdin(&m_child);
+}
+
+void
+impl::child::close_stdin(void)
+{
+    atf_process_child_close_stdin(&m_child);
+}
+
 int
 impl::child::stdout_fd(void)
 {
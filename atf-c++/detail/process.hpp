@@ -33,6 +33,7 @@ extern "C" {
 #include <atf-c/error.h>
 }
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -110,9 +111,15 @@ class stream_capture : basic_stream {
     // Allow access to the getters.
     template< class OutStream, class ErrStream > friend
     child fork(void (*)(void*), const OutStream&, const ErrStream&, void*);
+    template< class InStream, class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const InStream&, const OutStream&,
+               const ErrStream&, void*);
     template< class OutStream, class ErrStream > friend
     status exec(const atf::fs::path&, const argv_array&,
                 const OutStream&, const ErrStream&, void (*)(void));
+    template< class InStream, class OutStream, class ErrStream > friend
+    status exec(const atf::fs::path&, const argv_array&, const InStream&,
+                const OutStream&, const ErrStream&, void (*)(void));
 
 public:
     stream_capture(void);
@@ -122,9 +129,15 @@ class stream_connect : basic_stream {
     // Allow access to the getters.
     template< class OutStream, class ErrStream > friend
     child fork(void (*)(void*), const OutStream&, const ErrStream&, void*);
+    template< class InStream, class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const InStream&, const OutStream&,
+               const ErrStream&, void*);
     template< class OutStream, class ErrStream > friend
     status exec(const atf::fs::path&, const argv_array&,
                 const OutStream&, const ErrStream&, void (*)(void));
+    template< class InStream, class OutStream, class ErrStream > friend
+    status exec(const atf::fs::path&, const argv_array&, const InStream&,
+                const OutStream&, const ErrStream&, void (*)(void));
 
 public:
     stream_connect(const int, const int);
@@ -134,9 +147,15 @@ class stream_inherit : basic_stream {
     // Allow access to the getters.
     template< class OutStream, class ErrStream > friend
     child fork(void (*)(void*), const OutStream&, const ErrStream&, void*);
+    template< class InStream, class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const InStream&, const OutStream&,
+               const ErrStream&, void*);
     template< class OutStream, class ErrStream > friend
     status exec(const atf::fs::path&, const argv_array&,
                 const OutStream&, const ErrStream&, void (*)(void));
+    template< class InStream, class OutStream, class ErrStream > friend
+    status exec(const atf::fs::path&, const argv_array&, const InStream&,
+                const OutStream&, const ErrStream&, void (*)(void));
 
 public:
     stream_inherit(void);
@@ -146,9 +165,15 @@ class stream_redirect_fd : basic_stream {
     // Allow access to the getters.
     template< class OutStream, class ErrStream > friend
     child fork(void (*)(void*), const OutStream&, const ErrStream&, void*);
+    template< class InStream, class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const InStream&, const OutStream&,
+               const ErrStream&, void*);
     template< class OutStream, class ErrStream > friend
     status exec(const atf::fs::path&, const argv_array&,
                 const OutStream&, const ErrStream&, void (*)(void));
+    template< class InStream, class OutStream, class ErrStream > friend
+    status exec(const atf::fs::path&, const argv_array&, const InStream&,
+                const OutStream&, const ErrStream&, void (*)(void));
 
 public:
     stream_redirect_fd(const int);
@@ -158,14 +183,75 @@ class stream_redirect_path : basic_stream {
     // Allow access to the getters.
     template< class OutStream, class ErrStream > friend
     child fork(void (*)(void*), const OutStream&, const ErrStream&, void*);
+    template< class InStream, class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const InStream&, const OutStream&,
+               const ErrStream&, void*);
     template< class OutStream, class ErrStream > friend
     status exec(const atf::fs::path&, const argv_array&,
                 const OutStream&, const ErrStream&, void (*)(void));
+    template< class InStream, class OutStream, class ErrStream > friend
+    status exec(const atf::fs::path&, const argv_array&, const InStream&,
+                const OutStream&, const ErrStream&, void (*)(void));
 
 public:
     stream_redirect_path(const fs::path&);
 };
 
+class stream_ring : basic_stream {
+    // Allow access to the getters.  Not usable with exec because the
+    // output has to be collected with child::drain.
+    template< class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const OutStream&, const ErrStream&, void*);
+    template< class InStream, class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const InStream&, const OutStream&,
+               const ErrStream&, void*);
+
+public:
+    stream_ring(const std::size_t, const int = -1);
+};
+
+class stream_inline : basic_stream {
+    // The C stream only references the data, so keep our own copy.
+    const std::string m_data;
+
+    // Allow access to the getters.  Only valid for the stdin stream.
+    template< class InStream, class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const InStream&, const OutStream&,
+               const ErrStream&, void*);
+    template< class InStream, class OutStream, class ErrStream > friend
+    status exec(const atf::fs::path&, const argv_array&, const InStream&,
+                const OutStream&, const ErrStream&, void (*)(void));
+
+    // Non-copyable.
+    stream_inline(const stream_inline&);
+    stream_inline& operator=(const stream_inline&);
+
+public:
+    explicit stream_inline(const std::string&);
+};
+
+// ------------------------------------------------------------------------
+// The "ring" type.
+// ------------------------------------------------------------------------
+
+class ring {
+    atf_process_ring_t m_ring;
+
+    friend class child;
+
+    // Non-copyable.
+    ring(const ring&);
+    ring& operator=(const ring&);
+
+public:
+    ring(void);
+    ~ring(void);
+
+    std::string data(void) const;
+    unsigned long long dropped(void) const;
+    bool truncated(void) const;
+};
+
 // ------------------------------------------------------------------------
 // The "status" type.
 // ------------------------------------------------------------------------
@@ -178,6 +264,10 @@ class status {
     status exec(const atf::fs::path&, const argv_array&,
                 const OutStream&, const ErrStream&, void (*)(void));
 
+    template< class InStream, class OutStream, class ErrStream > friend
+    status exec(const atf::fs::path&, const argv_array&, const InStream&,
+                const OutStream&, const ErrStream&, void (*)(void));
+
     status(atf_process_status_t&);
 
 public:
@@ -201,6 +291,9 @@ class child {
 
     template< class OutStream, class ErrStream > friend
     child fork(void (*)(void*), const OutStream&, const ErrStream&, void*);
+    template< class InStream, class OutStream, class ErrStream > friend
+    child fork(void (*)(void*), const InStream&, const OutStream&,
+               const ErrStream&, void*);
 
     child(atf_process_child_t& c);
 
@@ -208,8 +301,13 @@ public:
     ~child(void);
 
     status wait(void);
+    std::unique_ptr< status > wait_for(const int);
+    void kill_tree(const int);
+    void drain(ring&, ring&);
 
     pid_t pid(void) const;
+    int stdin_fd(void);
+    void close_stdin(void);
     int stdout_fd(void);
     int stderr_fd(void);
 };
@@ -232,7 +330,7 @@ fork(void (*start)(void*), const OutStream& outsb,
     atf_process_child_t c;
 
     detail::flush_streams();
-    atf_error_t err = atf_process_fork(&c, start, outsb.get_sb(),
+    atf_error_t err = atf_process_fork(&c, start, NULL, outsb.get_sb(),
                                        errsb.get_sb(), v);
     if (atf_is_error(err))
         throw_atf_error(err);
@@ -240,6 +338,22 @@ fork(void (*start)(void*), const OutStream& outsb,
     return child(c);
 }
 
+template< class InStream, class OutStream, class ErrStream >
+child
+fork(void (*start)(void*), const InStream& insb, const OutStream& outsb,
+     const ErrStream& errsb, void* v)
+{
+    atf_process_child_t c;
+
+    detail::flush_streams();
+    atf_error_t err = atf_process_fork(&c, start, insb.get_sb(),
+                                       outsb.get_sb(), errsb.get_sb(), v);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+
+    return child(c);
+}
+
 template< class OutStream, class ErrStream >
 status
 exec(const atf::fs::path& prog, const argv_array& argv,
@@ -248,9 +362,32 @@ exec(const atf::fs::path& prog, const argv_array& argv,
 {
     atf_process_status_t s;
 
+    detail::flush_streams();
+    atf_error_t err = atf_process_exec_array(&s, prog.c_path(),
+                                             argv.exec_argv(), NULL,
+                                             outsb.get_sb(),
+                                             errsb.get_sb(),
+                                             prehook);
+    if (atf_is_error(err))
+        throw_atf_error(err);
+
+    return status(s);
+}
+
+// The hook is mandatory in this variant to keep calls with a NULL hook
+// from being confused with the variant above.
+template< class InStream, class OutStream, class ErrStream >
+status
+exec(const atf::fs::path& prog, const argv_array& argv,
+     const InStream& insb, const OutStream& outsb, const ErrStream& errsb,
+     void (*prehook)(void))
+{
+    atf_process_status_t s;
+
     detail::flush_streams();
     atf_error_t err = atf_process_exec_array(&s, prog.c_path(),
                                              argv.exec_argv(),
+                                             insb.get_sb(),
                                              outsb.get_sb(),
                                              errsb.get_sb(),
                                              prehook);
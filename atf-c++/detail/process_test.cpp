@@ -25,11 +25,21 @@
 
 #include "atf-c++/detail/process.hpp"
 
+extern "C" {
+#include <signal.h>
+#include <unistd.h>
+}
+
 #include <cstdlib>
 #include <cstring>
+#include <iostream>
 
 #include <atf-c++.hpp>
 
+extern "C" {
+#include "atf-c/defs.h"
+}
+
 #include "atf-c++/detail/test_helpers.hpp"
 
 // TODO: Testing the fork function is a huge task and I'm afraid of
@@ -304,6 +314,99 @@ ATF_TEST_CASE_BODY(argv_array_iter)
     }
 }
 
+// ------------------------------------------------------------------------
+// Tests for the "child" type.
+// ------------------------------------------------------------------------
+
+static
+void
+child_pause(void* v ATF_DEFS_ATTRIBUTE_UNUSED)
+{
+    for (;;)
+        ::pause();
+}
+
+ATF_TEST_CASE(child_wait_for);
+ATF_TEST_CASE_HEAD(child_wait_for)
+{
+    set_md_var("descr", "Tests waiting for a child with a timeout");
+}
+ATF_TEST_CASE_BODY(child_wait_for)
+{
+    atf::process::child c = atf::process::fork(child_pause,
+                                               atf::process::stream_inherit(),
+                                               atf::process::stream_inherit(),
+                                               NULL);
+    ATF_REQUIRE(c.wait_for(10).get() == NULL);
+
+    c.kill_tree(SIGKILL);
+    std::unique_ptr< atf::process::status > s = c.wait_for(-1);
+    ATF_REQUIRE(s.get() != NULL);
+    ATF_REQUIRE(s->signaled());
+    ATF_REQUIRE_EQ(SIGKILL, s->termsig());
+}
+
+static
+void
+child_print(void* v ATF_DEFS_ATTRIBUTE_UNUSED)
+{
+    for (int i = 0; i < 1000; i++)
+        std::cout << "line " << i << "\n";
+    std::cerr << "error\n";
+    std::exit(EXIT_SUCCESS);
+}
+
+ATF_TEST_CASE(child_drain);
+ATF_TEST_CASE_HEAD(child_drain)
+{
+    set_md_var("descr", "Tests collecting the output of a child through "
+               "ring streams");
+}
+ATF_TEST_CASE_BODY(child_drain)
+{
+    atf::process::child c = atf::process::fork(child_print,
+                                               atf::process::stream_ring(9),
+                                               atf::process::stream_ring(64),
+                                               NULL);
+    atf::process::ring out, err;
+    c.drain(out, err);
+    const atf::process::status s = c.wait();
+    ATF_REQUIRE(s.exited());
+
+    ATF_REQUIRE_EQ("line 999\n", out.data());
+    ATF_REQUIRE(out.truncated());
+    ATF_REQUIRE_EQ("error\n", err.data());
+    ATF_REQUIRE(!err.truncated());
+    ATF_REQUIRE_EQ(0, err.dropped());
+}
+
+static
+void
+child_copy_stdin(void* v ATF_DEFS_ATTRIBUTE_UNUSED)
+{
+    std::cout << std::cin.rdbuf();
+    std::exit(EXIT_SUCCESS);
+}
+
+ATF_TEST_CASE(child_stdin);
+ATF_TEST_CASE_HEAD(child_stdin)
+{
+    set_md_var("descr", "Tests feeding inline data to the stdin of a child");
+}
+ATF_TEST_CASE_BODY(child_stdin)
+{
+    atf::process::child c = atf::process::fork(
+        child_copy_stdin, atf::process::stream_inline("first\nsecond\n"),
+        atf::process::stream_ring(64), atf::process::stream_inherit(), NULL);
+    atf::process::ring out, err;
+    c.drain(out, err);
+    const atf::process::status s = c.wait();
+    ATF_REQUIRE(s.exited());
+    ATF_REQUIRE_EQ(EXIT_SUCCESS, s.exitstatus());
+
+    ATF_REQUIRE_EQ("first\nsecond\n", out.data());
+}
+
 // ------------------------------------------------------------------------
 // Tests cases for the free functions.
 // ------------------------------------------------------------------------
@@ -348,6 +451,11 @@ ATF_INIT_TEST_CASES(tcs)
     ATF_ADD_TEST_CASE(tcs, argv_array_init_varargs);
     ATF_ADD_TEST_CASE(tcs, argv_array_iter);
 
+    // Add the test cases for the "child" type.
+    ATF_ADD_TEST_CASE(tcs, child_drain);
+    ATF_ADD_TEST_CASE(tcs, child_stdin);
+    ATF_ADD_TEST_CASE(tcs, child_wait_for);
+
     // Add the test cases for the free functions.
     ATF_ADD_TEST_CASE(tcs, exec_failure);
     ATF_ADD_TEST_CASE(tcs, exec_success);
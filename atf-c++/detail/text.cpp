@@ -25,10 +25,6 @@
 
 #include "atf-c++/detail/text.hpp"
 
-extern "C" {
-#include <regex.h>
-}
-
 #include <cctype>
 #include <cstring>
 
@@ -50,32 +46,206 @@ impl::duplicate(const char* str)
     return copy;
 }
 
+//!
+//! \brief Finds the longest literal that any match of an ERE must contain.
+//!
+//! This is deliberately conservative: only runs of ordinary characters
+//! outside of groups and bracket expressions are considered, characters
+//! made optional by a quantifier are dropped, and nothing is returned for
+//! expressions with a top-level alternation.
+//!
+static
+std::string
+required_literal(const std::string& regex)
+{
+    static const char* specials = ".[]()*+?{}|^$\\";
+
+    std::string longest, current;
+    int depth = 0;
+    std::string::size_type i = 0;
+    while (i < regex.length()) {
+        const char ch = regex[i];
+
+        if (ch == '|' && depth == 0)
+            return "";
+
+        if (ch == '[') {
+            // Skip the bracket expression, in which a closing bracket
+            // right after the opening one (or its negation) is literal
+            // and character classes, equivalence classes and collating
+            // symbols may contain closing brackets of their own.
+            i++;
+            if (i < regex.length() && regex[i] == '^')
+                i++;
+            if (i < regex.length() && regex[i] == ']')
+                i++;
+            while (i < regex.length() && regex[i] != ']') {
+                if (regex[i] == '[' && i + 1 < regex.length() &&
+                    std::strchr(":=.", regex[i + 1]) != NULL) {
+                    const char delim[] = { regex[i + 1], ']', '\0' };
+                    const std::string::size_type end =
+                        regex.find(delim, i + 2);
+                    if (end == std::string::npos)
+                        return "";
+                    i = end + 2;
+                } else
+                    i++;
+            }
+            i++;
+            current.clear();
+            continue;
+        }
+
+        if (ch == '{') {
+            // Skip the bounds of the interval expression.
+            while (i < regex.length() && regex[i] != '}')
+                i++;
+            i++;
+            current.clear();
+            continue;
+        }
+
+        if (ch == '(')
+            depth++;
+        else if (ch == ')' && depth > 0)
+            depth--;
+
+        if (ch == '\\') {
+            current.clear();
+            i += 2;
+            continue;
+        }
+
+        // Bytes of multibyte characters are skipped because a quantifier
+        // following them applies to the whole character.
+        if (depth > 0 || std::strchr(specials, ch) != NULL ||
+            (static_cast< unsigned char >(ch) & 0x80) != 0) {
+            current.clear();
+            i++;
+            continue;
+        }
+
+        const char next = i + 1 < regex.length() ? regex[i + 1] : '\0';
+        if (next == '*' || next == '?' || next == '{') {
+            current.clear();
+        } else {
+            current += ch;
+            if (current.length() > longest.length())
+                longest = current;
+            if (next == '+')
+                current.clear();
+        }
+        i++;
+    }
+
+    return longest;
+}
+
+impl::regex::regex(const std::string& pattern) :
+    m_empty(pattern.empty())
+{
+    if (!m_empty) {
+        if (::regcomp(&m_preg, pattern.c_str(), REG_EXTENDED) != 0)
+            throw std::runtime_error("Invalid regular expression '" +
+                                     pattern + "'");
+        m_literal = required_literal(pattern);
+    }
+}
+
+impl::regex::~regex(void)
+{
+    if (!m_empty)
+        ::regfree(&m_preg);
+}
+
+const std::string&
+impl::regex::literal(void)
+    const
+{
+    return m_literal;
+}
+
 bool
-impl::match(const std::string& str, const std::string& regex)
+impl::regex::match(const std::string& str)
+    const
+{
+    if (m_empty)
+        return str.empty();
+
+    if (str.find(m_literal) == std::string::npos)
+        return false;
+
+    const int res = ::regexec(&m_preg, str.c_str(), 0, NULL, 0);
+    if (res != 0 && res != REG_NOMATCH)
+        throw std::runtime_error("Failed to match regular expression");
+
+    return res == 0;
+}
+
+std::vector< bool >
+impl::grep_lines(const std::vector< std::string >& regexps,
+                 const std::string& text)
 {
-    bool found;
+    std::vector< bool > found(regexps.size(), false);
 
-    // Special case: regcomp does not like empty regular expressions.
-    if (regex.empty()) {
-        found = str.empty();
-    } else {
-        ::regex_t preg;
+    // The compiled expressions are not copyable, so they are held through
+    // pointers and released by hand.
+    std::vector< regex* > compiled(regexps.size(), NULL);
+    try {
+        std::vector< regex* >::size_type missing = 0;
+        for (std::vector< std::string >::size_type i = 0; i < regexps.size();
+             i++) {
+            compiled[i] = new regex(regexps[i]);
 
-        if (::regcomp(&preg, regex.c_str(), REG_EXTENDED) != 0)
-            throw std::runtime_error("Invalid regular expression '" + regex +
-                                     "'");
+            // An expression whose literal does not appear anywhere in the
+            // text cannot match any of its lines.
+            const std::string& literal = compiled[i]->literal();
+            if (!literal.empty() && text.find(literal) == std::string::npos) {
+                delete compiled[i];
+                compiled[i] = NULL;
+            } else
+                missing++;
+        }
 
-        const int res = ::regexec(&preg, str.c_str(), 0, NULL, 0);
-        regfree(&preg);
-        if (res != 0 && res != REG_NOMATCH)
-            throw std::runtime_error("Invalid regular expression " + regex);
+        std::string::size_type pos = 0;
+        while (missing > 0 && pos < text.length()) {
+            std::string::size_type end = text.find('\n', pos);
+            if (end == std::string::npos)
+                end = text.length();
+            const std::string line = text.substr(pos, end - pos);
 
-        found = res == 0;
+            for (std::vector< regex* >::size_type i = 0; i < compiled.size();
+                 i++) {
+                if (compiled[i] != NULL && compiled[i]->match(line)) {
+                    found[i] = true;
+                    delete compiled[i];
+                    compiled[i] = NULL;
+                    missing--;
+                }
+            }
+
+            pos = end + 1;
+        }
+    } catch (...) {
+        for (std::vector< regex* >::iterator iter = compiled.begin();
+             iter != compiled.end(); iter++)
+            delete *iter;
+        throw;
     }
 
+    for (std::vector< regex* >::iterator iter = compiled.begin();
+         iter != compiled.end(); iter++)
+        delete *iter;
+
     return found;
 }
 
+bool
+impl::match(const std::string& str, const std::string& regex)
+{
+    return impl::regex(regex).match(str);
+}
+
 std::string
 impl::to_lower(const std::string& str)
 {
@@ -27,6 +27,7 @@
 #define ATF_CXX_DETAIL_TEXT_HPP
 
 extern "C" {
+#include <regex.h>
 #include <stdint.h>
 }
 
@@ -38,6 +39,45 @@ extern "C" {
 namespace atf {
 namespace text {
 
+//!
+//! \brief A compiled extended regular expression.
+//!
+//! Compiling a regular expression is much more expensive than matching it,
+//! so this should be used instead of match() to try the same expression
+//! against many strings.
+//!
+//! A literal string that must appear in any match is extracted from the
+//! expression, when possible, so that strings lacking it are rejected
+//! without running the matcher at all.
+//!
+class regex {
+    // Non-copyable.
+    regex(const regex&);
+    regex& operator=(const regex&);
+
+    //!
+    //! \brief Whether the expression is empty.
+    //!
+    //! regcomp does not accept empty regular expressions, so they are
+    //! handled separately: they only match empty strings.
+    //!
+    bool m_empty;
+
+    //!
+    //! \brief A literal that appears in any match; possibly empty.
+    //!
+    std::string m_literal;
+
+    ::regex_t m_preg;
+
+public:
+    regex(const std::string&);
+    ~regex(void);
+
+    const std::string& literal(void) const;
+    bool match(const std::string&) const;
+};
+
 //!
 //! \brief Duplicates a C string using the new[] allocator.
 //!
@@ -72,6 +112,16 @@ join(const T& words, const std::string& separator)
     return str;
 }
 
+//!
+//! \brief Looks for several regular expressions in the lines of a text.
+//!
+//! The regular expressions are compiled once and the text is scanned only
+//! once, whatever their number, with every expression being tried only
+//! until it first matches.  Returns whether each of them matched any line.
+//!
+std::vector< bool > grep_lines(const std::vector< std::string >&,
+                               const std::string&);
+
 //!
 //! \brief Checks if the string matches a regular expression.
 //!
@@ -155,6 +155,104 @@ ATF_TEST_CASE_BODY(match)
     ATF_REQUIRE(!match("hello", "^ [a-z]+$"));
 }
 
+ATF_TEST_CASE(regex);
+ATF_TEST_CASE_HEAD(regex)
+{
+    set_md_var("descr", "Tests the regex class");
+}
+ATF_TEST_CASE_BODY(regex)
+{
+    using atf::text::regex;
+
+    ATF_REQUIRE_THROW(std::runtime_error, regex("["));
+
+    {
+        const regex re("^[a-z]+ bar$");
+        ATF_REQUIRE(re.match("foo bar"));
+        ATF_REQUIRE(!re.match("foo baz"));
+        ATF_REQUIRE(!re.match("Foo bar"));
+        ATF_REQUIRE(re.match("x bar"));
+    }
+
+    {
+        const regex re("");
+        ATF_REQUIRE(re.match(""));
+        ATF_REQUIRE(!re.match("foo"));
+    }
+
+    // Literals that any match must contain.
+    ATF_REQUIRE_EQ("hello", regex("hello").literal());
+    ATF_REQUIRE_EQ("hello", regex("^hello$").literal());
+    ATF_REQUIRE_EQ("world", regex("a.world").literal());
+    ATF_REQUIRE_EQ("abc", regex("x*abcd?e").literal());
+    ATF_REQUIRE_EQ("ab", regex("ab+cd").literal());
+    ATF_REQUIRE_EQ("foo", regex("foo(bar|bazbazbaz)").literal());
+    ATF_REQUIRE_EQ("foo", regex("[a]b]foo").literal());
+    ATF_REQUIRE_EQ("bar", regex("fo\\.bar").literal());
+    ATF_REQUIRE_EQ("", regex("foo|bar").literal());
+    ATF_REQUIRE_EQ("", regex("a{2}").literal());
+    ATF_REQUIRE_EQ("", regex("[a-z]+").literal());
+    ATF_REQUIRE_EQ("", regex("[[:digit:]xyz]").literal());
+    ATF_REQUIRE_EQ("", regex("[[=a=]xyz]").literal());
+    ATF_REQUIRE_EQ("", regex("[[.].]xyz]").literal());
+    ATF_REQUIRE_EQ("abc", regex("[[:alpha:]]abc").literal());
+
+    {
+        const regex re("[[:digit:]xyz]");
+        ATF_REQUIRE(re.match("5"));
+        ATF_REQUIRE(re.match("y"));
+        ATF_REQUIRE(!re.match("a"));
+    }
+
+    {
+        const regex re("ab+c?d");
+        ATF_REQUIRE(re.match("abbbd"));
+        ATF_REQUIRE(re.match("xabcd"));
+        ATF_REQUIRE(!re.match("acd"));
+    }
+}
+
+ATF_TEST_CASE(grep_lines);
+ATF_TEST_CASE_HEAD(grep_lines)
+{
+    set_md_var("descr", "Tests the grep_lines function");
+}
+ATF_TEST_CASE_BODY(grep_lines)
+{
+    using atf::text::grep_lines;
+
+    std::vector< std::string > regexps;
+    regexps.push_back("^foo");
+    regexps.push_back("bar$");
+    regexps.push_back("^foo bar$");
+    regexps.push_back("baz");
+    regexps.push_back("^$");
+    regexps.push_back("o b");
+
+    std::vector< bool > found = grep_lines(regexps, "foo\nabar\nfoo\n");
+    ATF_REQUIRE_EQ(6, found.size());
+    ATF_REQUIRE(found[0]);
+    ATF_REQUIRE(found[1]);
+    ATF_REQUIRE(!found[2]);
+    ATF_REQUIRE(!found[3]);
+    ATF_REQUIRE(!found[4]);
+    ATF_REQUIRE(!found[5]);
+
+    found = grep_lines(regexps, "x\n\nfoo bar");
+    ATF_REQUIRE(found[0]);
+    ATF_REQUIRE(found[1]);
+    ATF_REQUIRE(found[2]);
+    ATF_REQUIRE(!found[3]);
+    ATF_REQUIRE(found[4]);
+    ATF_REQUIRE(found[5]);
+
+    ATF_REQUIRE_EQ(6, grep_lines(regexps, "").size());
+    ATF_REQUIRE(grep_lines(std::vector< std::string >(), "foo\n").empty());
+
+    regexps.push_back("[");
+    ATF_REQUIRE_THROW(std::runtime_error, grep_lines(regexps, "foo\n"));
+}
+
 ATF_TEST_CASE(split);
 ATF_TEST_CASE_HEAD(split)
 {
@@ -374,8 +472,10 @@ ATF_INIT_TEST_CASES(tcs)
 {
     // Add the test cases for the free functions.
     ATF_ADD_TEST_CASE(tcs, duplicate);
+    ATF_ADD_TEST_CASE(tcs, grep_lines);
     ATF_ADD_TEST_CASE(tcs, join);
     ATF_ADD_TEST_CASE(tcs, match);
+    ATF_ADD_TEST_CASE(tcs, regex);
     ATF_ADD_TEST_CASE(tcs, split);
     ATF_ADD_TEST_CASE(tcs, split_delims);
     ATF_ADD_TEST_CASE(tcs, trim);
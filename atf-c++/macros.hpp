@@ -72,6 +72,18 @@
     atfu_tc_ ## name::atfu_tc_ ## name(void) : atf::tests::tc(#name, true) {} \
     }
 
+#define ATF_BENCHMARK(name) \
+    namespace { \
+    class atfu_tc_ ## name : public atf::tests::bench { \
+        void head(void); \
+        void bench_body(const std::size_t) const; \
+    public: \
+        atfu_tc_ ## name(void); \
+    }; \
+    static atfu_tc_ ## name* atfu_tcptr_ ## name; \
+    atfu_tc_ ## name::atfu_tc_ ## name(void) : atf::tests::bench(#name) {} \
+    }
+
 #define ATF_TEST_CASE_NAME(name) atfu_tc_ ## name
 #define ATF_TEST_CASE_USE(name) (atfu_tcptr_ ## name) = NULL
 
@@ -89,6 +101,14 @@
     atfu_tc_ ## name::cleanup(void) \
         const
 
+#define ATF_BENCHMARK_HEAD(name) \
+    ATF_TEST_CASE_HEAD(name)
+
+#define ATF_BENCHMARK_BODY(name, iterations) \
+    void \
+    atfu_tc_ ## name::bench_body(const std::size_t iterations) \
+        const
+
 #define ATF_FAIL(reason) atf::tests::tc::fail(reason)
 
 #define ATF_SKIP(reason) atf::tests::tc::skip(reason)
@@ -34,6 +34,7 @@ extern "C" {
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
 }
@@ -41,9 +42,11 @@ extern "C" {
 #include <algorithm>
 #include <cctype>
 #include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -52,9 +55,27 @@ extern "C" {
 #include <vector>
 
 extern "C" {
+#include "atf-c/bench.h"
+#include "atf-c/detail/process.h"
+#include "atf-c/detail/rusage.h"
+#include "atf-c/detail/vars.h"
 #include "atf-c/error.h"
 #include "atf-c/tc.h"
 #include "atf-c/utils.h"
+
+// No prototype in header for this one, it's a little sketchy (internal).
+atf_error_t atf_tc_set_config_var(atf_tc_t *, const char *, const char *);
+
+// No prototype in header for this one, it's a little sketchy (internal).
+void atf_tc_set_report_rusage(const bool);
+
+// No prototype in header for this one, it's a little sketchy (internal).
+void atf_tc_set_cgroup_root(const char *);
+
+// No prototype in header for this one, it's a little sketchy (internal).
+atf_error_t atf_tc_init_config(atf_tc_t *, const char *, atf_tc_head_t,
+                               atf_tc_body_t, atf_tc_cleanup_t,
+                               atf_vars_t *);
 }
 
 #include "atf-c++/detail/application.hpp"
@@ -62,6 +83,7 @@ extern "C" {
 #include "atf-c++/detail/env.hpp"
 #include "atf-c++/detail/exceptions.hpp"
 #include "atf-c++/detail/fs.hpp"
+#include "atf-c++/detail/process.hpp"
 #include "atf-c++/detail/sanity.hpp"
 #include "atf-c++/detail/text.hpp"
 
@@ -113,6 +135,64 @@ detail::atf_tp_writer::tc_meta_data(const std::string& name,
     m_os.flush();
 }
 
+// ------------------------------------------------------------------------
+// The "json_tp_writer" class.
+// ------------------------------------------------------------------------
+
+static std::string
+json_string(const std::string& str)
+{
+    std::ostringstream ss;
+
+    ss << '"';
+    for (std::string::const_iterator iter = str.begin(); iter != str.end();
+         iter++) {
+        const unsigned char ch = *iter;
+
+        if (ch == '"' || ch == '\\')
+            ss << '\\' << ch;
+        else if (ch == '\n')
+            ss << "\\n";
+        else if (ch == '\t')
+            ss << "\\t";
+        else if (ch < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            ss << buf;
+        } else
+            ss << ch;
+    }
+    ss << '"';
+
+    return ss.str();
+}
+
+detail::json_tp_writer::json_tp_writer(std::ostream& os) :
+    m_os(os)
+{
+}
+
+void
+detail::json_tp_writer::start_tc(const std::string& ident)
+{
+    m_os << "{\"ident\":" << json_string(ident);
+}
+
+void
+detail::json_tp_writer::end_tc(void)
+{
+    m_os << "}\n";
+    m_os.flush();
+}
+
+void
+detail::json_tp_writer::tc_meta_data(const std::string& name,
+                                     const std::string& value)
+{
+    PRE(name != "ident");
+    m_os << "," << json_string(name) << ":" << json_string(value);
+}
+
 // ------------------------------------------------------------------------
 // Free helper functions.
 // ------------------------------------------------------------------------
@@ -167,6 +247,8 @@ public:
     {
         std::map< atf_tc_t*, impl::tc* >::iterator iter = wraps.find(tc);
         INV(iter != wraps.end());
+        if (dynamic_cast< impl::bench* >((*iter).second) != NULL)
+            atf_bench_head(tc);
         (*iter).second->head();
     }
 
@@ -179,6 +261,24 @@ public:
         (*iter).second->body();
     }
 
+    static void
+    wrap_bench(const atf_tc_t *tc, const size_t iterations)
+    {
+        std::map< const atf_tc_t*, const impl::tc* >::const_iterator iter =
+            cwraps.find(tc);
+        INV(iter != cwraps.end());
+        const impl::bench* b = dynamic_cast< const impl::bench* >(
+            (*iter).second);
+        INV(b != NULL);
+        b->bench_body(iterations);
+    }
+
+    static void
+    run_bench(const impl::bench* b)
+    {
+        atf_bench_run(&b->pimpl->m_tc, wrap_bench);
+    }
+
     static void
     wrap_cleanup(const atf_tc_t *tc)
     {
@@ -187,6 +287,43 @@ public:
         INV(iter != cwraps.end());
         (*iter).second->cleanup();
     }
+
+    static void
+    init(impl::tc* tc, atf_vars_t* config)
+    {
+        wraps[&tc->pimpl->m_tc] = tc;
+        cwraps[&tc->pimpl->m_tc] = tc;
+
+        atf_error_t err = atf_tc_init_config(&tc->pimpl->m_tc,
+            tc->pimpl->m_ident.c_str(), wrap_head, wrap_body,
+            tc->pimpl->m_has_cleanup ? wrap_cleanup : NULL, config);
+        if (atf_is_error(err))
+            throw_atf_error(err);
+    }
+
+    // Accessors that do not need the head of the test case, unlike the
+    // equivalent meta-data queries.
+    static const std::string&
+    ident(const impl::tc* tc)
+    {
+        return tc->pimpl->m_ident;
+    }
+
+    static bool
+    has_cleanup(const impl::tc* tc)
+    {
+        return tc->pimpl->m_has_cleanup;
+    }
+
+    static void
+    set_config_var(impl::tc* tc, const std::string& name,
+                   const std::string& value)
+    {
+        atf_error_t err = atf_tc_set_config_var(&tc->pimpl->m_tc,
+                                                name.c_str(), value.c_str());
+        if (atf_is_error(err))
+            throw_atf_error(err);
+    }
 };
 
 impl::tc::tc(const std::string& ident, const bool has_cleanup) :
@@ -202,14 +339,15 @@ impl::tc::~tc(void)
     atf_tc_fini(&pimpl->m_tc);
 }
 
-void
-impl::tc::init(const vars_map& config)
+static atf_vars_t*
+new_config(const impl::vars_map& config)
 {
     atf_error_t err;
 
-    auto_array< const char * > array(new const char*[(config.size() * 2) + 1]);
+    atf::auto_array< const char * > array(
+        new const char*[(config.size() * 2) + 1]);
     const char **ptr = array.get();
-    for (vars_map::const_iterator iter = config.begin();
+    for (impl::vars_map::const_iterator iter = config.begin();
          iter != config.end(); iter++) {
          *ptr = (*iter).first.c_str();
          *(ptr + 1) = (*iter).second.c_str();
@@ -217,14 +355,24 @@ impl::tc::init(const vars_map& config)
     }
     *ptr = NULL;
 
-    wraps[&pimpl->m_tc] = this;
-    cwraps[&pimpl->m_tc] = this;
-
-    err = atf_tc_init(&pimpl->m_tc, pimpl->m_ident.c_str(), pimpl->wrap_head,
-        pimpl->wrap_body, pimpl->m_has_cleanup ? pimpl->wrap_cleanup : NULL,
-        array.get());
+    atf_vars_t* c;
+    err = atf_vars_new_charpp(&c, array.get());
     if (atf_is_error(err))
-        throw_atf_error(err);
+        atf::throw_atf_error(err);
+    return c;
+}
+
+void
+impl::tc::init(const vars_map& config)
+{
+    atf_vars_t* c = new_config(config);
+    try {
+        tc_impl::init(this, c);
+    } catch (...) {
+        atf_vars_unref(c);
+        throw;
+    }
+    atf_vars_unref(c);
 }
 
 bool
@@ -399,6 +547,22 @@ impl::tc::expect_timeout(const std::string& reason)
     atf_tc_expect_timeout("%s", reason.c_str());
 }
 
+// ------------------------------------------------------------------------
+// The "bench" class.
+// ------------------------------------------------------------------------
+
+impl::bench::bench(const std::string& ident) :
+    tc(ident, false)
+{
+}
+
+void
+impl::bench::body(void)
+    const
+{
+    tc_impl::run_bench(this);
+}
+
 // ------------------------------------------------------------------------
 // Test program main code.
 // ------------------------------------------------------------------------
@@ -427,6 +591,19 @@ parse_vflag(const std::string& str, atf::tests::vars_map& vars)
     }
 }
 
+static long
+parse_jflag(const std::string& str)
+{
+    char* end;
+
+    errno = 0;
+    const long jobs = std::strtol(str.c_str(), &end, 10);
+    if (str.empty() || *end != '\0' || errno != 0 || jobs < 1)
+        throw usage_error("Invalid number of jobs `%s'; must be a positive "
+                          "integer", str.c_str());
+    return jobs;
+}
+
 static atf::fs::path
 handle_srcdir(const char* argv0, const std::string& srcdir_arg)
 {
@@ -454,18 +631,27 @@ init_tcs(void (*add_tcs)(tc_vector&), tc_vector& tcs,
          const atf::tests::vars_map& vars)
 {
     add_tcs(tcs);
-    for (tc_vector::iterator iter = tcs.begin(); iter != tcs.end(); iter++) {
-        impl::tc* tc = *iter;
 
-        tc->init(vars);
+    // All test cases share a single copy of the configuration.
+    atf_vars_t* config = new_config(vars);
+    try {
+        for (tc_vector::iterator iter = tcs.begin(); iter != tcs.end();
+             iter++) {
+            impl::tc* tc = *iter;
+
+            impl::tc_impl::init(tc, config);
+        }
+    } catch (...) {
+        atf_vars_unref(config);
+        throw;
     }
+    atf_vars_unref(config);
 }
 
-static int
-list_tcs(const tc_vector& tcs)
+template< class Writer >
+static void
+write_tcs(const tc_vector& tcs, Writer& writer)
 {
-    detail::atf_tp_writer writer(std::cout);
-
     for (tc_vector::const_iterator iter = tcs.begin();
          iter != tcs.end(); iter++) {
         const impl::vars_map vars = (*iter)->get_md_vars();
@@ -485,24 +671,174 @@ list_tcs(const tc_vector& tcs)
 
         writer.end_tc();
     }
+}
 
-    return EXIT_SUCCESS;
+static void
+list_tcs(const tc_vector& tcs, const std::string& format, std::ostream& os)
+{
+    if (format == "json") {
+        detail::json_tp_writer writer(os);
+        write_tcs(tcs, writer);
+    } else {
+        INV(format == "atf");
+        detail::atf_tp_writer writer(os);
+        write_tcs(tcs, writer);
+    }
+}
+
+static atf::fs::path
+list_cache_file(const std::string& cachedir, const std::string& format)
+{
+    return atf::fs::path(cachedir) / (Program_Name + "." + format);
+}
+
+//!
+//! \brief Computes the key that identifies a cached listing.
+//!
+//! The key captures the identity of the test program binary (its device,
+//! inode, modification time and size) and the configuration variables
+//! given to it, as any of these may change the output of the test case
+//! heads.  The modification time includes nanoseconds where available, so
+//! that a binary rebuilt within the same second with the same size is
+//! noticed.
+//!
+static std::string
+list_cache_key(const impl::vars_map& vars)
+{
+    const impl::vars_map::const_iterator srcdir = vars.find("srcdir");
+    INV(srcdir != vars.end());
+    const atf::fs::path exe = atf::fs::path((*srcdir).second) / Program_Name;
+
+    struct stat sb;
+    if (::stat(exe.c_str(), &sb) == -1)
+        throw atf::system_error(IMPL_NAME "::list_cache_key",
+                                "Cannot stat " + exe.str(), errno);
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    const long mtime_nsec = static_cast< long >(sb.st_mtim.tv_nsec);
+#else
+    const long mtime_nsec = 0;
+#endif
+
+    std::ostringstream key;
+    key << "exe=" << exe.str() << " dev=" << static_cast< long long >(sb.st_dev)
+        << " ino=" << static_cast< long long >(sb.st_ino)
+        << " mtime=" << static_cast< long long >(sb.st_mtime) << "."
+        << std::setfill('0') << std::setw(9) << mtime_nsec
+        << std::setfill(' ')
+        << " size=" << static_cast< long long >(sb.st_size);
+    for (impl::vars_map::const_iterator iter = vars.begin(); iter != vars.end();
+         iter++)
+        key << " " << (*iter).first << "=" << (*iter).second;
+    return key.str();
+}
+
+//!
+//! \brief Prints a cached listing if it is still valid.
+//!
+//! The first line of a cache file holds the key it was generated for, and
+//! the rest of the file holds the listing itself.  Returns true only if
+//! the cache file exists and its key matches the current one.
+//!
+static bool
+list_from_cache(const atf::fs::path& cachefile, const impl::vars_map& vars)
+{
+    std::ifstream is(cachefile.c_str());
+    if (!is)
+        return false;
+
+    std::string line;
+    if (!std::getline(is, line) || line != list_cache_key(vars))
+        return false;
+
+    std::cout << is.rdbuf();
+    std::cout.flush();
+    return true;
+}
+
+//!
+//! \brief Stores the listing in the cache.
+//!
+//! The cache file is replaced atomically so that concurrent invocations of
+//! the test program never see a partially-written listing.  It gets the
+//! permissions of a regular file, instead of the owner-only ones given by
+//! mkstemp, so that a cache directory can be shared.
+//!
+static void
+list_to_cache(const tc_vector& tcs, const std::string& format,
+              const atf::fs::path& cachefile, const impl::vars_map& vars)
+{
+    const std::string key = list_cache_key(vars);
+
+    const std::string tmpl = cachefile.str() + ".XXXXXX";
+    std::vector< char > tmpfile(tmpl.begin(), tmpl.end());
+    tmpfile.push_back('\0');
+    const int fd = ::mkstemp(&tmpfile[0]);
+    if (fd == -1)
+        throw atf::system_error(IMPL_NAME "::list_to_cache",
+                                "Cannot create temporary file for " +
+                                cachefile.str(), errno);
+    const mode_t mask = ::umask(0);
+    (void)::umask(mask);
+    if (::fchmod(fd, 0644 & ~mask) == -1) {
+        const int original_errno = errno;
+        ::close(fd);
+        ::unlink(&tmpfile[0]);
+        throw atf::system_error(IMPL_NAME "::list_to_cache",
+                                "Cannot set the permissions of " +
+                                std::string(&tmpfile[0]), original_errno);
+    }
+    ::close(fd);
+
+    std::ofstream os(&tmpfile[0]);
+    os << key << "\n";
+    list_tcs(tcs, format, os);
+    os.close();
+    if (!os || ::rename(&tmpfile[0], cachefile.c_str()) == -1) {
+        const int original_errno = errno;
+        ::unlink(&tmpfile[0]);
+        throw atf::system_error(IMPL_NAME "::list_to_cache",
+                                "Cannot update listing cache " +
+                                cachefile.str(), original_errno);
+    }
+}
+
+static void
+warn_list_cache_error(const std::runtime_error& e)
+{
+    std::cerr << Program_Name << ": WARNING: Cannot use listing cache: "
+              << e.what() << "\n";
 }
 
 static impl::tc*
-find_tc(tc_vector tcs, const std::string& name)
+find_tc(const tc_vector& tcs, const std::string& name)
 {
-    std::vector< std::string > ids;
-    for (tc_vector::iterator iter = tcs.begin();
+    for (tc_vector::const_iterator iter = tcs.begin();
          iter != tcs.end(); iter++) {
         impl::tc* tc = *iter;
 
-        if (tc->get_md_var("ident") == name)
+        if (impl::tc_impl::ident(tc) == name)
             return tc;
     }
     throw usage_error("Unknown test case `%s'", name.c_str());
 }
 
+static void
+parse_fflag(const std::string& file, std::vector< std::string >& tcargs)
+{
+    std::ifstream is(file.c_str());
+    if (!is)
+        throw usage_error("Cannot open test case list `%s'", file.c_str());
+
+    std::string line;
+    while (!std::getline(is, line).fail()) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        tcargs.push_back(line);
+    }
+    if (is.bad())
+        throw usage_error("Failed to read test case list `%s'", file.c_str());
+}
+
 static std::pair< std::string, tc_part >
 process_tcarg(const std::string& tcarg)
 {
@@ -523,13 +859,9 @@ process_tcarg(const std::string& tcarg)
     }
 }
 
-static int
-run_tc(tc_vector& tcs, const std::string& tcarg, const atf::fs::path& resfile)
+static void
+warn_if_not_controlled(void)
 {
-    const std::pair< std::string, tc_part > fields = process_tcarg(tcarg);
-
-    impl::tc* tc = find_tc(tcs, fields.first);
-
     if (!atf::env::has("__RUNNING_INSIDE_ATF_RUN") || atf::env::get(
         "__RUNNING_INSIDE_ATF_RUN") != "internal-yes-value")
     {
@@ -539,13 +871,42 @@ run_tc(tc_vector& tcs, const std::string& tcarg, const atf::fs::path& resfile)
             "control is being applied; you may get unexpected failures; see "
             "atf-test-case(4)\n";
     }
+}
+
+static bool report_rusage = false;
+
+// Runs the cleanup routine of a test case.  If -u was given, the resources
+// consumed by the cleanup routine are appended to the results file, where
+// the body already left its own.
+static void
+cleanup_tc(impl::tc* tc, const std::string& resfile)
+{
+    atf_rusage_t ru;
+
+    atf_rusage_start(&ru);
+    tc->run_cleanup();
+    if (report_rusage) {
+        atf_error_t err = atf_rusage_append(&ru, "cleanup", resfile.c_str());
+        if (atf_is_error(err))
+            atf::throw_atf_error(err);
+    }
+}
+
+static int
+run_tc(tc_vector& tcs, const std::string& tcarg, const atf::fs::path& resfile)
+{
+    const std::pair< std::string, tc_part > fields = process_tcarg(tcarg);
+
+    impl::tc* tc = find_tc(tcs, fields.first);
+
+    warn_if_not_controlled();
 
     switch (fields.second) {
     case BODY:
         tc->run(resfile.str());
         break;
     case CLEANUP:
-        tc->run_cleanup();
+        cleanup_tc(tc, resfile.str());
         break;
     default:
         UNREACHABLE;
@@ -553,13 +914,363 @@ run_tc(tc_vector& tcs, const std::string& tcarg, const atf::fs::path& resfile)
     return EXIT_SUCCESS;
 }
 
+struct batch_part {
+    impl::tc* m_tc;
+    tc_part m_part;
+    std::string m_resfile;
+    atf::tests::vars_map m_config;
+    bool m_detach_stdin;
+    std::string m_workdir;
+
+    batch_part(void) :
+        m_tc(NULL),
+        m_part(BODY),
+        m_detach_stdin(false)
+    {
+    }
+};
+
+static void run_batch_part(void*) ATF_DEFS_ATTRIBUTE_NORETURN;
+
+//!
+//! \brief Runs a single test case part in a subprocess of the test program.
+//!
+//! This is the entry point of the child process spawned for every test case
+//! part in batch, parallel and server modes.  No exception may escape it:
+//! it would otherwise unwind into the code of the parent that forked it and
+//! the child would go on running the rest of the test cases as a second
+//! copy of the test program.
+//!
+static void
+run_batch_part(void* v)
+{
+    const batch_part* bp = static_cast< const batch_part* >(v);
+
+    try {
+        if (bp->m_detach_stdin) {
+            const int fd = ::open("/dev/null", O_RDONLY);
+            if (fd == -1)
+                throw atf::system_error(IMPL_NAME "::run_batch_part",
+                                        "Cannot open /dev/null", errno);
+            if (fd != STDIN_FILENO) {
+                ::dup2(fd, STDIN_FILENO);
+                ::close(fd);
+            }
+        }
+
+        if (!bp->m_workdir.empty()) {
+            if (::chdir(bp->m_workdir.c_str()) == -1)
+                throw atf::system_error(IMPL_NAME "::run_batch_part",
+                                        "Cannot enter work directory " +
+                                        bp->m_workdir, errno);
+            atf::env::set("TMPDIR", bp->m_workdir);
+        }
+
+        for (atf::tests::vars_map::const_iterator iter = bp->m_config.begin();
+             iter != bp->m_config.end(); iter++)
+            impl::tc_impl::set_config_var(bp->m_tc, (*iter).first,
+                                          (*iter).second);
+
+        switch (bp->m_part) {
+        case BODY:
+            bp->m_tc->run(bp->m_resfile);
+            break;
+        case CLEANUP:
+            cleanup_tc(bp->m_tc, bp->m_resfile);
+            break;
+        default:
+            UNREACHABLE;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << Program_Name << ": ERROR: " << e.what() << "\n";
+        std::cerr.flush();
+        ::_exit(EXIT_FAILURE);
+    } catch (...) {
+        std::cerr << Program_Name << ": ERROR: Unknown exception while "
+                  << "running a test case\n";
+        std::cerr.flush();
+        ::_exit(EXIT_FAILURE);
+    }
+    std::exit(EXIT_SUCCESS);
+}
+
+static void
+write_status_record(std::ostream& os, const std::string& tcarg,
+                    const atf::process::status& s)
+{
+    if (s.exited())
+        os << tcarg << " exited " << s.exitstatus() << "\n";
+    else if (s.signaled())
+        os << tcarg << " signaled " << s.termsig() << "\n";
+    else
+        os << tcarg << " unknown\n";
+    os.flush();
+    if (!os)
+        throw std::runtime_error("Failed to write status record for " + tcarg);
+}
+
+static void
+write_status_record(std::ostream& os, const std::string& tcarg,
+                    const atf_process_status_t& s)
+{
+    if (atf_process_status_exited(&s))
+        os << tcarg << " exited " << atf_process_status_exitstatus(&s) << "\n";
+    else if (atf_process_status_signaled(&s))
+        os << tcarg << " signaled " << atf_process_status_termsig(&s) << "\n";
+    else
+        os << tcarg << " unknown\n";
+    os.flush();
+    if (!os)
+        throw std::runtime_error("Failed to write status record for " + tcarg);
+}
+
+// Creates the work directory of a test case part, or reuses it if it
+// already exists so that the cleanup runs in the same place as the body.
+static void
+make_workdir(const std::string& workdir)
+{
+    if (::mkdir(workdir.c_str(), 0755) == -1 && errno != EEXIST)
+        throw atf::system_error(IMPL_NAME "::make_workdir",
+                                "Cannot create work directory " + workdir,
+                                errno);
+}
+
+// Runs a collection of test case parts, each in its own subprocess forked
+// from the already-initialized test program.  See the C version of this
+// code in atf-c/detail/tp_main.c for details on the layout of resdir.
+static int
+run_batch(tc_vector& tcs, const std::vector< std::string >& tcargs,
+          const atf::fs::path& resdir_arg)
+{
+    const atf::fs::path resdir = resdir_arg.is_absolute() ? resdir_arg :
+        resdir_arg.to_absolute();
+
+    for (std::vector< std::string >::const_iterator iter = tcargs.begin();
+         iter != tcargs.end(); iter++)
+        (void)find_tc(tcs, process_tcarg(*iter).first);
+
+    const atf::fs::path statuspath = resdir / "status";
+    std::ofstream statusf(statuspath.c_str());
+    if (!statusf)
+        throw std::runtime_error("Cannot create status file '" +
+                                 statuspath.str() + "'");
+
+    warn_if_not_controlled();
+
+    bool success = true;
+    for (std::vector< std::string >::const_iterator iter = tcargs.begin();
+         iter != tcargs.end(); iter++) {
+        const std::pair< std::string, tc_part > fields = process_tcarg(*iter);
+
+        batch_part bp;
+        bp.m_tc = find_tc(tcs, fields.first);
+        bp.m_part = fields.second;
+        bp.m_resfile = (resdir / (fields.first + ".result")).str();
+        bp.m_workdir = (resdir / (fields.first + ".work")).str();
+        make_workdir(bp.m_workdir);
+
+        atf::process::child c = atf::process::fork(
+            run_batch_part, atf::process::stream_inherit(),
+            atf::process::stream_inherit(), static_cast< void* >(&bp));
+        const atf::process::status s = c.wait();
+        if (!s.exited() || s.exitstatus() != EXIT_SUCCESS)
+            success = false;
+
+        write_status_record(statusf, *iter, s);
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Starts the subprocess for a part of a job in parallel mode.
+static void
+start_job(batch_part& bp, impl::tc* tc, const tc_part part,
+          const atf::fs::path& resdir, atf_process_child_t& child)
+{
+    const std::string tcname = impl::tc_impl::ident(tc);
+
+    bp.m_tc = tc;
+    bp.m_part = part;
+    bp.m_resfile = (resdir / (tcname + ".result")).str();
+    bp.m_workdir = (resdir / (tcname + ".work")).str();
+    make_workdir(bp.m_workdir);
+
+    atf::process::detail::flush_streams();
+    atf_error_t err = atf_process_fork(&child, run_batch_part, NULL, NULL,
+                                       NULL, static_cast< void* >(&bp));
+    if (atf_is_error(err))
+        atf::throw_atf_error(err);
+}
+
+// Runs the given test cases, or all of them if none is given, concurrently
+// with up to 'jobs' test cases running at any given time.  See the C
+// version of this code in atf-c/detail/tp_main.c for details.
+static int
+run_parallel(tc_vector& tcs, const std::vector< std::string >& tcargs,
+             const atf::fs::path& resdir_arg, const long jobs)
+{
+    const atf::fs::path resdir = resdir_arg.is_absolute() ? resdir_arg :
+        resdir_arg.to_absolute();
+
+    tc_vector torun;
+    if (tcargs.empty())
+        torun = tcs;
+    else {
+        for (std::vector< std::string >::const_iterator iter = tcargs.begin();
+             iter != tcargs.end(); iter++) {
+            if ((*iter).find(':') != std::string::npos)
+                throw usage_error("Cannot specify test case parts with -j");
+            torun.push_back(find_tc(tcs, *iter));
+        }
+    }
+
+    const atf::fs::path statuspath = resdir / "status";
+    std::ofstream statusf(statuspath.c_str());
+    if (!statusf)
+        throw std::runtime_error("Cannot create status file '" +
+                                 statuspath.str() + "'");
+
+    warn_if_not_controlled();
+
+    const std::size_t nslots = std::max(std::size_t(1),
+        std::min(static_cast< std::size_t >(jobs), torun.size()));
+    std::vector< atf_process_child_t > children(nslots);
+    std::vector< atf_process_child_t* > running(nslots,
+        static_cast< atf_process_child_t* >(NULL));
+    std::vector< batch_part > parts(nslots);
+
+    bool success = true;
+    std::size_t next = 0, active = 0;
+    while (next < torun.size() || active > 0) {
+        for (std::size_t slot = 0; slot < nslots && next < torun.size();
+             slot++) {
+            if (running[slot] != NULL)
+                continue;
+
+            start_job(parts[slot], torun[next], BODY, resdir, children[slot]);
+            running[slot] = &children[slot];
+            next++;
+            active++;
+        }
+
+        std::size_t slot;
+        atf_process_status_t s;
+        atf_error_t err;
+        while (atf_is_error(err = atf_process_child_wait_any(
+            &running[0], nslots, &slot, &s))) {
+            if (!atf_error_is(err, "libc") ||
+                atf_libc_error_code(err) != EINTR)
+                atf::throw_atf_error(err);
+            atf_error_free(err);
+        }
+        running[slot] = NULL;
+        active--;
+
+        if (!atf_process_status_exited(&s) ||
+            atf_process_status_exitstatus(&s) != EXIT_SUCCESS)
+            success = false;
+
+        batch_part& bp = parts[slot];
+        const std::string tcname = impl::tc_impl::ident(bp.m_tc);
+        write_status_record(statusf, bp.m_part == BODY ? tcname :
+                            tcname + ":cleanup", s);
+        atf_process_status_fini(&s);
+
+        if (bp.m_part == BODY && impl::tc_impl::has_cleanup(bp.m_tc)) {
+            start_job(bp, bp.m_tc, CLEANUP, resdir, children[slot]);
+            running[slot] = &children[slot];
+            active++;
+        }
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Serves a single request received in server mode.  See the C version of
+// this code in atf-c/detail/tp_main.c for details on the request format
+// and on where the test case runs.
+static void
+serve_request(tc_vector& tcs, const std::string& request, std::ostream& os)
+{
+    const std::vector< std::string > fields = atf::text::split(request, "\t");
+    INV(!fields.empty());
+    const std::string& tcarg = fields[0];
+
+    batch_part bp;
+    // The request stream is our stdin; the test case must not consume it.
+    bp.m_detach_stdin = true;
+    try {
+        if (fields.size() < 2)
+            throw usage_error("Request does not provide a results file");
+        const std::pair< std::string, tc_part > tcfields =
+            process_tcarg(tcarg);
+        bp.m_tc = find_tc(tcs, tcfields.first);
+        bp.m_part = tcfields.second;
+        for (std::vector< std::string >::size_type i = 2; i < fields.size();
+             i++)
+            parse_vflag(fields[i], bp.m_config);
+
+        const atf::fs::path resfile(fields[1]);
+        const atf::fs::path respath = resfile.is_absolute() ? resfile :
+            resfile.to_absolute();
+        bp.m_resfile = respath.str();
+        bp.m_workdir = (respath.branch_path() / (tcfields.first +
+                                                 ".work")).str();
+        make_workdir(bp.m_workdir);
+    } catch (const std::runtime_error& e) {
+        os << tcarg << " error " << e.what() << "\n";
+        os.flush();
+        if (!os)
+            throw std::runtime_error("Failed to write status record for " +
+                                     tcarg);
+        return;
+    }
+
+    // The reply stream is our stdout; keep the test case from writing to it
+    // by sending its output to stderr instead.
+    atf::process::child c = atf::process::fork(
+        run_batch_part, atf::process::stream_connect(STDOUT_FILENO,
+                                                     STDERR_FILENO),
+        atf::process::stream_inherit(), static_cast< void* >(&bp));
+    write_status_record(os, tcarg, c.wait());
+}
+
+// Serves requests to run test cases, read from stdin, until the end of the
+// stream is reached.  See the C version of this code in
+// atf-c/detail/tp_main.c for details.
+static int
+run_server(tc_vector& tcs)
+{
+    warn_if_not_controlled();
+
+    std::string line;
+    while (!std::getline(std::cin, line).fail()) {
+        if (line.empty())
+            continue;
+        serve_request(tcs, line, std::cout);
+    }
+    if (std::cin.bad())
+        throw std::runtime_error("Failed to read request");
+
+    return EXIT_SUCCESS;
+}
+
 static int
 safe_main(int argc, char** argv, void (*add_tcs)(tc_vector&))
 {
     const char* argv0 = argv[0];
 
     bool lflag = false;
+    std::string cachedir;
+    std::string format = "atf";
+    std::string fflag;
+    std::vector< std::string > batch_tcargs;
     atf::fs::path resfile("/dev/stdout");
+    bool rflag = false;
+    bool Sflag = false;
+    bool uflag = false;
+    const char* gflag = NULL;
+    long jobs = 0;
     std::string srcdir_arg;
     atf::tests::vars_map vars;
 
@@ -568,20 +1279,51 @@ safe_main(int argc, char** argv, void (*add_tcs)(tc_vector&))
 
     old_opterr = opterr;
     ::opterr = 0;
-    while ((ch = ::getopt(argc, argv, GETOPT_POSIX ":lr:s:v:")) != -1) {
+    while ((ch = ::getopt(argc, argv, GETOPT_POSIX ":C:f:F:g:j:lr:s:Suv:")) != -1) {
         switch (ch) {
+        case 'C':
+            cachedir = ::optarg;
+            break;
+
+        case 'f':
+            fflag = ::optarg;
+            break;
+
+        case 'F':
+            format = ::optarg;
+            if (format != "atf" && format != "json")
+                throw usage_error("Unknown listing format `%s'", ::optarg);
+            break;
+
+        case 'g':
+            gflag = ::optarg;
+            break;
+
+        case 'j':
+            jobs = parse_jflag(::optarg);
+            break;
+
         case 'l':
             lflag = true;
             break;
 
         case 'r':
             resfile = atf::fs::path(::optarg);
+            rflag = true;
             break;
 
         case 's':
             srcdir_arg = ::optarg;
             break;
 
+        case 'S':
+            Sflag = true;
+            break;
+
+        case 'u':
+            uflag = true;
+            break;
+
         case 'v':
             parse_vflag(::optarg, vars);
             break;
@@ -605,22 +1347,82 @@ safe_main(int argc, char** argv, void (*add_tcs)(tc_vector&))
     ::optreset = 1;
 #endif
 
+    if (!lflag && (!cachedir.empty() || format != "atf"))
+        throw usage_error("Cannot use -C or -F without -l");
+
+    if (uflag) {
+        report_rusage = true;
+        atf_tc_set_report_rusage(true);
+    }
+    if (gflag != NULL)
+        atf_tc_set_cgroup_root(gflag);
+
     vars["srcdir"] = handle_srcdir(argv0, srcdir_arg).str();
 
     int errcode;
 
     tc_vector tcs;
     if (lflag) {
-        if (argc > 0)
+        if (argc > 0 || !fflag.empty())
             throw usage_error("Cannot provide test case names with -l");
+        if (Sflag)
+            throw usage_error("Cannot use -l and -S at the same time");
+        if (jobs > 0)
+            throw usage_error("Cannot use -l and -j at the same time");
+
+        bool hit = false;
+        if (!cachedir.empty()) {
+            try {
+                hit = list_from_cache(list_cache_file(cachedir, format),
+                                      vars);
+            } catch (const std::runtime_error& e) {
+                warn_list_cache_error(e);
+            }
+        }
+
+        if (!hit) {
+            init_tcs(add_tcs, tcs, vars);
+            if (!cachedir.empty()) {
+                try {
+                    list_to_cache(tcs, format,
+                                  list_cache_file(cachedir, format), vars);
+                } catch (const std::runtime_error& e) {
+                    warn_list_cache_error(e);
+                }
+            }
+            list_tcs(tcs, format, std::cout);
+        }
+        errcode = EXIT_SUCCESS;
+    } else if (Sflag) {
+        if (argc > 0 || !fflag.empty())
+            throw usage_error("Cannot provide test case names with -S");
+        if (jobs > 0)
+            throw usage_error("Cannot use -S and -j at the same time");
+
+        init_tcs(add_tcs, tcs, vars);
+        errcode = run_server(tcs);
+    } else if (!fflag.empty() || argc > 1 || jobs > 0) {
+        if (!fflag.empty())
+            parse_fflag(fflag, batch_tcargs);
+        for (int i = 0; i < argc; i++)
+            batch_tcargs.push_back(argv[i]);
+        if (batch_tcargs.empty() && jobs == 0)
+            throw usage_error("Must provide a test case name");
+        if (!rflag && jobs > 0)
+            throw usage_error("Running test cases in parallel requires -r "
+                              "to name a results directory");
+        if (!rflag)
+            throw usage_error("Running more than one test case requires -r "
+                              "to name a results directory");
 
         init_tcs(add_tcs, tcs, vars);
-        errcode = list_tcs(tcs);
+        if (jobs > 0)
+            errcode = run_parallel(tcs, batch_tcargs, resfile, jobs);
+        else
+            errcode = run_batch(tcs, batch_tcargs, resfile);
     } else {
         if (argc == 0)
             throw usage_error("Must provide a test case name");
-        else if (argc > 1)
-            throw usage_error("Cannot provide more than one test case name");
         INV(argc == 1);
 
         init_tcs(add_tcs, tcs, vars);
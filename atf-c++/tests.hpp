@@ -26,6 +26,7 @@
 #if !defined(ATF_CXX_TESTS_HPP)
 #define ATF_CXX_TESTS_HPP
 
+#include <cstddef>
 #include <map>
 #include <memory>
 #include <string>
@@ -52,6 +53,17 @@ public:
     void tc_meta_data(const std::string&, const std::string&);
 };
 
+class json_tp_writer {
+    std::ostream& m_os;
+
+public:
+    json_tp_writer(std::ostream&);
+
+    void start_tc(const std::string&);
+    void end_tc(void);
+    void tc_meta_data(const std::string&, const std::string&);
+};
+
 bool match(const std::string&, const std::string&);
 
 } // namespace
@@ -119,6 +131,22 @@ public:
     static void expect_timeout(const std::string&);
 };
 
+// ------------------------------------------------------------------------
+// The "bench" class.
+// ------------------------------------------------------------------------
+
+class bench : public tc {
+    void body(void) const;
+
+protected:
+    virtual void bench_body(const std::size_t) const = 0;
+
+    friend struct tc_impl;
+
+public:
+    bench(const std::string&);
+};
+
 } // namespace tests
 } // namespace atf
 
@@ -179,6 +179,68 @@ ATF_TEST_CASE_BODY(atf_tp_writer)
 #undef RESET
 }
 
+// ------------------------------------------------------------------------
+// Tests for the "json_tp_writer" class.
+// ------------------------------------------------------------------------
+
+ATF_TEST_CASE(json_tp_writer);
+ATF_TEST_CASE_HEAD(json_tp_writer)
+{
+    set_md_var("descr", "Verifies the json listing writer");
+}
+ATF_TEST_CASE_BODY(json_tp_writer)
+{
+    std::ostringstream expss;
+    std::ostringstream ss;
+
+#define RESET \
+    expss.str(""); \
+    ss.str("")
+
+#define CHECK \
+    check_equal(*this, ss.str(), expss.str())
+
+    {
+        RESET;
+
+        atf::tests::detail::json_tp_writer w(ss);
+        CHECK;
+    }
+
+    {
+        RESET;
+
+        atf::tests::detail::json_tp_writer w(ss);
+
+        w.start_tc("test1");
+        expss << "{\"ident\":\"test1\"";
+        CHECK;
+
+        w.end_tc();
+        expss << "}\n";
+        CHECK;
+
+        w.start_tc("test2");
+        expss << "{\"ident\":\"test2\"";
+        CHECK;
+
+        w.tc_meta_data("descr", "second test case");
+        expss << ",\"descr\":\"second test case\"";
+        CHECK;
+
+        w.tc_meta_data("X-custom", "a \"quoted\"\tvalue\\");
+        expss << ",\"X-custom\":\"a \\\"quoted\\\"\\tvalue\\\\\"";
+        CHECK;
+
+        w.end_tc();
+        expss << "}\n";
+        CHECK;
+    }
+
+#undef CHECK
+#undef RESET
+}
+
 // ------------------------------------------------------------------------
 // Main.
 // ------------------------------------------------------------------------
@@ -187,4 +249,7 @@ ATF_INIT_TEST_CASES(tcs)
 {
     // Add tests for the "atf_tp_writer" class.
     ATF_ADD_TEST_CASE(tcs, atf_tp_writer);
+
+    // Add tests for the "json_tp_writer" class.
+    ATF_ADD_TEST_CASE(tcs, json_tp_writer);
 }
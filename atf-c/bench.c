@@ -0,0 +1,372 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include "atf-c/bench.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "atf-c/detail/dynstr.h"
+#include "atf-c/detail/sanity.h"
+#include "atf-c/error.h"
+#include "atf-c/tc.h"
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+void atf_tc_add_result_record(const char *);
+
+/* The largest iteration count that calibration will ever pick. */
+#define MAX_ITERATIONS ((size_t)1000000000)
+
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+struct params {
+    long m_repetitions;
+    long m_warmup;
+    long long m_target_time;  /* In nanoseconds. */
+};
+
+struct stats {
+    double m_min;
+    double m_median;
+    double m_p99;
+    double m_mean;
+    double m_stddev;
+};
+
+/** Reads a non-negative integer configuration variable. */
+static
+long
+get_long_param(const atf_tc_t *tc, const char *name, const long defval,
+               const long minval)
+{
+    const long val = atf_tc_get_config_var_as_long_wd(tc, name, defval);
+    if (val < minval)
+        atf_tc_fail("Configuration variable %s must be at least %ld; "
+                    "found %ld", name, minval, val);
+    return val;
+}
+
+/** Loads the benchmark settings from the configuration variables.
+ *
+ * bench.repetitions sets the number of timed runs, bench.warmup the number
+ * of untimed runs done before them, and bench.target_time the minimum
+ * duration of every run in milliseconds. */
+static
+void
+params_init(struct params *p, const atf_tc_t *tc)
+{
+    p->m_repetitions = get_long_param(tc, "bench.repetitions", 10, 1);
+    p->m_warmup = get_long_param(tc, "bench.warmup", 1, 0);
+    p->m_target_time = (long long)get_long_param(tc, "bench.target_time",
+                                                 10, 1) * 1000000;
+}
+
+static
+long long
+now_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+        UNREACHABLE;
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Runs the benchmark body once and returns its duration. */
+static
+long long
+run_timed(const atf_tc_t *tc, atf_bench_body_t body, const size_t iterations)
+{
+    const long long start = now_ns();
+    body(tc, iterations);
+    return now_ns() - start;
+}
+
+/** Finds the number of iterations to run for every repetition.
+ *
+ * The count grows until a single run of the body takes at least the target
+ * time.  Every step extrapolates from the duration of the previous run, but
+ * never grows the count more than a hundredfold, so that a body with a
+ * large fixed cost cannot make the next run take too long. */
+static
+size_t
+calibrate(const atf_tc_t *tc, atf_bench_body_t body,
+          const long long target_time)
+{
+    size_t iterations = 1;
+
+    for (;;) {
+        const long long elapsed = run_timed(tc, body, iterations);
+        double scale;
+        size_t next;
+
+        if (elapsed >= target_time || iterations >= MAX_ITERATIONS)
+            break;
+
+        scale = elapsed > 0 ? 1.2 * target_time / elapsed : 100.0;
+        if (scale > 100.0)
+            scale = 100.0;
+        next = (size_t)(iterations * scale);
+        if (next <= iterations)
+            next = iterations + 1;
+        iterations = next < MAX_ITERATIONS ? next : MAX_ITERATIONS;
+    }
+
+    return iterations;
+}
+
+static
+int
+compare_doubles(const void *a, const void *b)
+{
+    const double da = *(const double *)a;
+    const double db = *(const double *)b;
+
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/** Computes the square root of a non-negative number.
+ *
+ * Newton's method is good enough for a standard deviation and saves us
+ * from pulling libm into every test program. */
+static
+double
+square_root(const double x)
+{
+    double r;
+
+    if (x <= 0.0)
+        return 0.0;
+
+    r = x >= 1.0 ? x : 1.0;
+    for (;;) {
+        const double next = (r + x / r) / 2.0;
+        if (next >= r)
+            break;
+        r = next;
+    }
+    return r;
+}
+
+/** Computes the statistics of a set of samples.
+ *
+ * The samples are sorted in place.  The 99th percentile uses the
+ * nearest-rank method, so it is the maximum for fewer than 100 samples. */
+static
+void
+compute_stats(double *samples, const size_t nsamples, struct stats *s)
+{
+    double sum, sqsum;
+    size_t i;
+
+    PRE(nsamples > 0);
+
+    qsort(samples, nsamples, sizeof(double), compare_doubles);
+
+    s->m_min = samples[0];
+    if (nsamples % 2 == 1)
+        s->m_median = samples[nsamples / 2];
+    else
+        s->m_median = (samples[nsamples / 2 - 1] + samples[nsamples / 2]) /
+            2.0;
+    s->m_p99 = samples[(nsamples * 99 + 99) / 100 - 1];
+
+    sum = 0.0;
+    for (i = 0; i < nsamples; i++)
+        sum += samples[i];
+    s->m_mean = sum / nsamples;
+
+    sqsum = 0.0;
+    for (i = 0; i < nsamples; i++)
+        sqsum += (samples[i] - s->m_mean) * (samples[i] - s->m_mean);
+    s->m_stddev = nsamples > 1 ? square_root(sqsum / (nsamples - 1)) : 0.0;
+}
+
+/** Appends the statistics to the extended results record.
+ *
+ * All times are in nanoseconds per iteration. */
+static
+atf_error_t
+add_result_record(const size_t iterations, const long repetitions,
+                  const struct stats *s)
+{
+    atf_error_t err;
+    atf_dynstr_t str;
+
+    err = atf_dynstr_init_fmt(&str,
+        "bench.iterations: %zu\n"
+        "bench.repetitions: %ld\n"
+        "bench.min: %.1f\n"
+        "bench.median: %.1f\n"
+        "bench.p99: %.1f\n"
+        "bench.mean: %.1f\n"
+        "bench.stddev: %.1f\n",
+        iterations, repetitions, s->m_min, s->m_median, s->m_p99,
+        s->m_mean, s->m_stddev);
+    if (atf_is_error(err))
+        return err;
+
+    atf_tc_add_result_record(atf_dynstr_cstring(&str));
+    atf_dynstr_fini(&str);
+    return atf_no_error();
+}
+
+/** Appends the results of the benchmark to a sidecar file.
+ *
+ * Every benchmark takes a single line holding a JSON object, written with
+ * a single call so that several benchmarks can share the same file. */
+static
+atf_error_t
+write_sidecar(const char *path, const atf_tc_t *tc, const size_t iterations,
+              const double *samples, const long repetitions,
+              const struct stats *s)
+{
+    atf_error_t err;
+    atf_dynstr_t str;
+    long i;
+    ssize_t ret;
+    int fd;
+
+    err = atf_dynstr_init_fmt(&str, "{\"ident\":\"%s\",\"iterations\":%zu,"
+        "\"repetitions\":%ld,\"min_ns\":%.1f,\"median_ns\":%.1f,"
+        "\"p99_ns\":%.1f,\"mean_ns\":%.1f,\"stddev_ns\":%.1f,"
+        "\"samples_ns\":[", atf_tc_get_ident(tc), iterations, repetitions,
+        s->m_min, s->m_median, s->m_p99, s->m_mean, s->m_stddev);
+    if (atf_is_error(err))
+        goto out;
+
+    for (i = 0; !atf_is_error(err) && i < repetitions; i++)
+        err = atf_dynstr_append_fmt(&str, "%s%.1f", i == 0 ? "" : ",",
+                                    samples[i]);
+    if (!atf_is_error(err))
+        err = atf_dynstr_append_fmt(&str, "]}\n");
+    if (atf_is_error(err))
+        goto out_str;
+
+    fd = open(path, O_WRONLY | O_APPEND | O_CREAT,
+              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1) {
+        err = atf_libc_error(errno, "Cannot open '%s'", path);
+        goto out_str;
+    }
+
+    while ((ret = write(fd, atf_dynstr_cstring(&str),
+                        atf_dynstr_length(&str))) == -1 && errno == EINTR)
+        continue; /* Retry. */
+    if (ret == -1)
+        err = atf_libc_error(errno, "Cannot write to '%s'", path);
+    close(fd);
+
+out_str:
+    atf_dynstr_fini(&str);
+out:
+    return err;
+}
+
+static
+void
+fail_on_error(atf_error_t err)
+{
+    if (atf_is_error(err)) {
+        char buf[1024];
+
+        atf_error_format(err, buf, sizeof(buf));
+        atf_error_free(err);
+        atf_tc_fail("%s", buf);
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Free functions.
+ * --------------------------------------------------------------------- */
+
+/** Marks a test case as a benchmark.
+ *
+ * The property has the X- prefix of user-defined properties so that
+ * kyua(1) accepts it. */
+void
+atf_bench_head(atf_tc_t *tc)
+{
+    atf_tc_set_md_var(tc, "X-benchmark", "true");
+}
+
+/** Runs a benchmark and reports its results.
+ *
+ * The body is called with the number of iterations it has to perform,
+ * which is calibrated so that every call takes at least the target time.
+ * After the warmup calls, every repetition yields one sample: the average
+ * time of an iteration in that call.  The statistics of the samples are
+ * printed to stdout, added to the extended results record (see -u), and
+ * appended to the file named by bench.output, if any. */
+void
+atf_bench_run(const atf_tc_t *tc, atf_bench_body_t body)
+{
+    atf_error_t err;
+    struct params p;
+    struct stats s;
+    size_t iterations;
+    double *samples, *sorted;
+    long i;
+
+    params_init(&p, tc);
+
+    iterations = calibrate(tc, body, p.m_target_time);
+    for (i = 0; i < p.m_warmup; i++)
+        body(tc, iterations);
+
+    samples = malloc(sizeof(double) * p.m_repetitions * 2);
+    if (samples == NULL)
+        fail_on_error(atf_no_memory_error());
+    sorted = samples + p.m_repetitions;
+
+    for (i = 0; i < p.m_repetitions; i++)
+        samples[i] = (double)run_timed(tc, body, iterations) / iterations;
+
+    memcpy(sorted, samples, sizeof(double) * p.m_repetitions);
+    compute_stats(sorted, p.m_repetitions, &s);
+
+    printf("%s: %zu iterations x %ld repetitions: min %.1f ns, median "
+           "%.1f ns, p99 %.1f ns, mean %.1f ns, stddev %.1f ns per "
+           "iteration\n", atf_tc_get_ident(tc), iterations, p.m_repetitions,
+           s.m_min, s.m_median, s.m_p99, s.m_mean, s.m_stddev);
+    fflush(stdout);
+
+    err = add_result_record(iterations, p.m_repetitions, &s);
+    if (!atf_is_error(err) && atf_tc_has_config_var(tc, "bench.output"))
+        err = write_sidecar(atf_tc_get_config_var(tc, "bench.output"), tc,
+                            iterations, samples, p.m_repetitions, &s);
+    free(samples);
+    fail_on_error(err);
+}
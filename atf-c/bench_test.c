@@ -0,0 +1,171 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include "atf-c/bench.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atf-c.h>
+
+#include "atf-c/detail/test_helpers.h"
+
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+static size_t body_calls;
+static size_t body_last_iterations;
+static bool body_iterations_decreased;
+
+static
+void
+counting_body(const atf_tc_t *tc ATF_DEFS_ATTRIBUTE_UNUSED,
+              const size_t iterations)
+{
+    volatile size_t i;
+
+    if (iterations < body_last_iterations)
+        body_iterations_decreased = true;
+    body_last_iterations = iterations;
+    body_calls++;
+
+    for (i = 0; i < iterations; i++)
+        continue;
+}
+
+static
+void
+init_bench_tc(atf_tc_t *tc, const char *const *config)
+{
+    body_calls = 0;
+    body_last_iterations = 0;
+    body_iterations_decreased = false;
+
+    RE(atf_tc_init(tc, "the_bench", atf_bench_head, NULL, NULL, config));
+}
+
+/* ---------------------------------------------------------------------
+ * Test cases for the free functions.
+ * --------------------------------------------------------------------- */
+
+ATF_TC(head);
+ATF_TC_HEAD(head, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that benchmarks are marked as such "
+                      "in their meta-data");
+}
+ATF_TC_BODY(head, tcin)
+{
+    atf_tc_t tc;
+
+    init_bench_tc(&tc, NULL);
+    ATF_REQUIRE(atf_tc_has_md_var(&tc, "X-benchmark"));
+    ATF_REQUIRE_STREQ("true", atf_tc_get_md_var(&tc, "X-benchmark"));
+    atf_tc_fini(&tc);
+}
+
+ATF_TC(run);
+ATF_TC_HEAD(run, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that atf_bench_run calibrates the "
+                      "iteration count and runs the requested warmup and "
+                      "repetitions");
+}
+ATF_TC_BODY(run, tcin)
+{
+    const char *const config[] = {
+        "bench.repetitions", "7",
+        "bench.warmup", "2",
+        "bench.target_time", "1",
+        "bench.output", "out.json",
+        NULL };
+    atf_tc_t tc;
+
+    init_bench_tc(&tc, config);
+    atf_bench_run(&tc, counting_body);
+    atf_tc_fini(&tc);
+
+    /* At least one calibration call, then the warmup and repetitions. */
+    ATF_REQUIRE(body_calls >= 1 + 2 + 7);
+    ATF_REQUIRE(!body_iterations_decreased);
+    ATF_REQUIRE(body_last_iterations > 1);
+
+    ATF_REQUIRE(atf_utils_grep_file("^\\{\"ident\":\"the_bench\","
+                                    "\"iterations\":%zu,\"repetitions\":7,",
+                                    "out.json", body_last_iterations));
+    ATF_REQUIRE(atf_utils_grep_file("\"samples_ns\":\\[[0-9.]+(,[0-9.]+){6}"
+                                    "\\]\\}$", "out.json"));
+}
+
+ATF_TC(run_append);
+ATF_TC_HEAD(run_append, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that the results of several "
+                      "benchmarks can be stored in the same file");
+}
+ATF_TC_BODY(run_append, tcin)
+{
+    const char *const config[] = {
+        "bench.repetitions", "1",
+        "bench.target_time", "1",
+        "bench.output", "out.json",
+        NULL };
+    atf_tc_t tc;
+    char *line;
+    int fd, count;
+
+    init_bench_tc(&tc, config);
+    atf_bench_run(&tc, counting_body);
+    atf_bench_run(&tc, counting_body);
+    atf_tc_fini(&tc);
+
+    fd = open("out.json", O_RDONLY);
+    ATF_REQUIRE(fd != -1);
+    count = 0;
+    while ((line = atf_utils_readline(fd)) != NULL) {
+        ATF_REQUIRE(atf_utils_grep_string("\"stddev_ns\":0\\.0,", line));
+        free(line);
+        count++;
+    }
+    close(fd);
+    ATF_REQUIRE_EQ(2, count);
+}
+
+/* ---------------------------------------------------------------------
+ * Main.
+ * --------------------------------------------------------------------- */
+
+ATF_TP_ADD_TCS(tp)
+{
+    ATF_TP_ADD_TC(tp, head);
+    ATF_TP_ADD_TC(tp, run);
+    ATF_TP_ADD_TC(tp, run_append);
+
+    return atf_no_error();
+}
@@ -29,6 +29,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -112,32 +113,146 @@ const_execvp(const char *file, const char *const *argv)
 #undef UNCONST
 }
 
+/** Growable buffer holding the output of a child in memory.
+ *
+ * The child writes its output to an anonymous file rather than to a pipe,
+ * so that any process it leaves behind can keep writing to it once the
+ * child is done without getting EPIPE; the contents of the file are only
+ * loaded into the buffer once the child terminates.
+ *
+ * The data is always followed by a nul character so that textual output
+ * can be handled as a C string, but it may contain nul characters too. */
+struct capture {
+    int m_fd;
+    char *m_data;
+    size_t m_length;
+    size_t m_capacity;
+};
+
+static
+atf_error_t
+capture_init(struct capture *c, const char *name)
+{
+    atf_error_t err;
+
+    c->m_data = malloc(1);
+    if (c->m_data == NULL)
+        return atf_no_memory_error();
+    c->m_data[0] = '\0';
+    c->m_length = 0;
+    c->m_capacity = 1;
+
+    err = atf_process_create_anon_fd(name, &c->m_fd);
+    if (atf_is_error(err))
+        free(c->m_data);
+    return err;
+}
+
+static
+void
+capture_fini(struct capture *c)
+{
+    close(c->m_fd);
+    free(c->m_data);
+}
+
+/** Appends to the buffer whatever the child has written so far.
+ *
+ * The file offset is shared with the processes that write to the file, so
+ * it must not be touched here. */
+static
+atf_error_t
+capture_read(struct capture *c)
+{
+    for (;;) {
+        ssize_t n;
+
+        if (c->m_capacity - c->m_length < 4096 + 1) {
+            const size_t capacity = c->m_capacity * 2 + 4096;
+            char *aux;
+
+            aux = realloc(c->m_data, capacity);
+            if (aux == NULL)
+                return atf_no_memory_error();
+            c->m_data = aux;
+            c->m_capacity = capacity;
+        }
+
+        n = pread(c->m_fd, c->m_data + c->m_length,
+                  c->m_capacity - c->m_length - 1, c->m_length);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return atf_libc_error(errno, "Failed to read output of child");
+        } else if (n == 0)
+            break;
+        c->m_length += n;
+        c->m_data[c->m_length] = '\0';
+    }
+
+    return atf_no_error();
+}
+
 static
 atf_error_t
-init_sb(const atf_fs_path_t *path, atf_process_stream_t *sb)
+capture_to_file(const struct capture *c, const atf_fs_path_t *path)
 {
     atf_error_t err;
+    const char *ptr;
+    size_t len;
+    int fd;
+
+    fd = open(atf_fs_path_cstring(path), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return atf_libc_error(errno, "Cannot create %s",
+                              atf_fs_path_cstring(path));
+
+    err = atf_no_error();
+    ptr = c->m_data;
+    len = c->m_length;
+    while (len > 0) {
+        const ssize_t ret = write(fd, ptr, len);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            err = atf_libc_error(errno, "Cannot write %s",
+                                 atf_fs_path_cstring(path));
+            break;
+        }
+        ptr += ret;
+        len -= ret;
+    }
+
+    close(fd);
+    return err;
+}
 
-    if (path == NULL)
+static
+atf_error_t
+init_sb(const struct capture *c, atf_process_stream_t *sb)
+{
+    atf_error_t err;
+
+    if (c == NULL)
         err = atf_process_stream_init_inherit(sb);
     else
-        err = atf_process_stream_init_redirect_path(sb, path);
+        err = atf_process_stream_init_redirect_fd(sb, c->m_fd);
 
     return err;
 }
 
 static
 atf_error_t
-init_sbs(const atf_fs_path_t *outfile, atf_process_stream_t *outsb,
-         const atf_fs_path_t *errfile, atf_process_stream_t *errsb)
+init_sbs(const struct capture *outcap, atf_process_stream_t *outsb,
+         const struct capture *errcap, atf_process_stream_t *errsb)
 {
     atf_error_t err;
 
-    err = init_sb(outfile, outsb);
+    err = init_sb(outcap, outsb);
     if (atf_is_error(err))
         goto out;
 
-    err = init_sb(errfile, errsb);
+    err = init_sb(errcap, errsb);
     if (atf_is_error(err)) {
         atf_process_stream_fini(outsb);
         goto out;
@@ -148,6 +263,7 @@ out:
 }
 
 struct exec_data {
+    const char *m_prog;
     const char *const *m_argv;
 };
 
@@ -159,34 +275,103 @@ exec_child(void *v)
 {
     struct exec_data *ea = v;
 
-    const_execvp(ea->m_argv[0], ea->m_argv);
+    const_execvp(ea->m_prog, ea->m_argv);
     fprintf(stderr, "execvp(%s) failed: %s\n", ea->m_argv[0], strerror(errno));
     exit(127);
 }
 
+/** Kills a child and its descendants, discarding their exit status. */
+static
+void
+kill_and_reap(atf_process_child_t *child)
+{
+    atf_process_status_t status;
+    atf_error_t err;
+
+    (void)atf_process_child_kill_tree(child, SIGKILL);
+    err = atf_process_child_wait(child, &status);
+    if (atf_is_error(err))
+        atf_error_free(err);
+    else
+        atf_process_status_fini(&status);
+}
+
+/** Loads the output of a terminated child into memory. */
 static
 atf_error_t
-fork_and_wait(const char *const *argv, const atf_fs_path_t *outfile,
-              const atf_fs_path_t *errfile, atf_process_status_t *status)
+capture_read_both(struct capture *outcap, struct capture *errcap)
+{
+    atf_error_t err;
+
+    err = capture_read(outcap);
+    if (!atf_is_error(err))
+        err = capture_read(errcap);
+    return err;
+}
+
+/** Starts a command.
+ *
+ * The input of the command comes from insb, or is inherited from the
+ * caller if it is NULL.  The output of the command is captured in the
+ * files of the given buffers if they are not NULL, in which case the
+ * caller must read them once the command terminates, or is inherited from
+ * the caller otherwise. */
+static
+atf_error_t
+start_command(const char *const *argv, const atf_process_stream_t *insb,
+              const struct capture *outcap, const struct capture *errcap,
+              atf_process_child_t *child)
 {
     atf_error_t err;
-    atf_process_child_t child;
     atf_process_stream_t outsb, errsb;
-    struct exec_data ea = { argv };
+    atf_fs_path_t prog;
+    struct exec_data ea;
 
-    err = init_sbs(outfile, &outsb, errfile, &errsb);
+    PRE((outcap == NULL) == (errcap == NULL));
+
+    err = atf_process_resolve_prog(argv[0], &prog);
     if (atf_is_error(err))
         goto out;
+    ea.m_prog = atf_fs_path_cstring(&prog);
+    ea.m_argv = argv;
 
-    err = atf_process_fork(&child, exec_child, &outsb, &errsb, &ea);
+    err = init_sbs(outcap, &outsb, errcap, &errsb);
     if (atf_is_error(err))
-        goto out_sbs;
+        goto out_prog;
 
-    err = atf_process_child_wait(&child, status);
+    err = atf_process_spawn(child, ea.m_prog, argv, exec_child, insb, &outsb,
+                            &errsb, &ea);
 
-out_sbs:
     atf_process_stream_fini(&errsb);
     atf_process_stream_fini(&outsb);
+out_prog:
+    atf_fs_path_fini(&prog);
+out:
+    return err;
+}
+
+/** Runs a command and waits for its termination.
+ *
+ * The input of the command comes from insb, or is inherited from the
+ * caller if it is NULL.  The output of the command is stored in the given
+ * buffers, or inherited from the caller if they are NULL. */
+static
+atf_error_t
+fork_and_wait(const char *const *argv, const atf_process_stream_t *insb,
+              struct capture *outcap, struct capture *errcap,
+              atf_process_status_t *status)
+{
+    atf_error_t err;
+    atf_process_child_t child;
+
+    err = start_command(argv, insb, outcap, errcap, &child);
+    if (atf_is_error(err))
+        goto out;
+
+    err = atf_process_child_wait(&child, status);
+    if (!atf_is_error(err) && outcap != NULL)
+        err = capture_read_both(outcap, errcap);
+
 out:
     return err;
 }
@@ -268,7 +453,7 @@ check_build_run(const char *const *argv, bool *success)
 
     print_array(argv, ">");
 
-    err = fork_and_wait(argv, NULL, NULL, &status);
+    err = fork_and_wait(argv, NULL, NULL, NULL, &status);
     if (atf_is_error(err))
         goto out;
 
@@ -286,38 +471,38 @@ out:
 
 struct atf_check_result_impl {
     atf_list_t m_argv;
-    atf_fs_path_t m_dir;
-    atf_fs_path_t m_stdout;
-    atf_fs_path_t m_stderr;
+    struct capture m_stdout;
+    struct capture m_stderr;
     atf_process_status_t m_status;
+
+    /* The output is only written to files if the caller asks for their
+     * paths; the fields below are valid if m_materialized is true. */
+    bool m_materialized;
+    atf_fs_path_t m_dir;
+    atf_fs_path_t m_stdout_path;
+    atf_fs_path_t m_stderr_path;
 };
 
 static
 atf_error_t
-atf_check_result_init(atf_check_result_t *r, const char *const *argv,
-                      const atf_fs_path_t *dir)
+atf_check_result_init(atf_check_result_t *r, const char *const *argv)
 {
     atf_error_t err;
 
     r->pimpl = malloc(sizeof(struct atf_check_result_impl));
     if (r->pimpl == NULL)
         return atf_no_memory_error();
+    r->pimpl->m_materialized = false;
 
     err = array_to_list(argv, &r->pimpl->m_argv);
     if (atf_is_error(err))
-        goto out;
+        goto err_pimpl;
 
-    err = atf_fs_path_copy(&r->pimpl->m_dir, dir);
+    err = capture_init(&r->pimpl->m_stdout, "atf-stdout");
     if (atf_is_error(err))
         goto err_argv;
 
-    err = atf_fs_path_init_fmt(&r->pimpl->m_stdout, "%s/stdout",
-                               atf_fs_path_cstring(dir));
-    if (atf_is_error(err))
-        goto err_dir;
-
-    err = atf_fs_path_init_fmt(&r->pimpl->m_stderr, "%s/stderr",
-                               atf_fs_path_cstring(dir));
+    err = capture_init(&r->pimpl->m_stderr, "atf-stderr");
     if (atf_is_error(err))
         goto err_stdout;
 
@@ -325,11 +510,11 @@ atf_check_result_init(atf_check_result_t *r, const char *const *argv,
     goto out;
 
 err_stdout:
-    atf_fs_path_fini(&r->pimpl->m_stdout);
-err_dir:
-    atf_fs_path_fini(&r->pimpl->m_dir);
+    capture_fini(&r->pimpl->m_stdout);
 err_argv:
     atf_list_fini(&r->pimpl->m_argv);
+err_pimpl:
+    free(r->pimpl);
 out:
     return err;
 }
@@ -339,27 +524,122 @@ atf_check_result_fini(atf_check_result_t *r)
 {
     atf_process_status_fini(&r->pimpl->m_status);
 
-    cleanup_tmpdir(&r->pimpl->m_dir, &r->pimpl->m_stdout,
-                   &r->pimpl->m_stderr);
-    atf_fs_path_fini(&r->pimpl->m_stdout);
-    atf_fs_path_fini(&r->pimpl->m_stderr);
-    atf_fs_path_fini(&r->pimpl->m_dir);
+    if (r->pimpl->m_materialized) {
+        cleanup_tmpdir(&r->pimpl->m_dir, &r->pimpl->m_stdout_path,
+                       &r->pimpl->m_stderr_path);
+        atf_fs_path_fini(&r->pimpl->m_stdout_path);
+        atf_fs_path_fini(&r->pimpl->m_stderr_path);
+        atf_fs_path_fini(&r->pimpl->m_dir);
+    }
 
+    capture_fini(&r->pimpl->m_stderr);
+    capture_fini(&r->pimpl->m_stdout);
     atf_list_fini(&r->pimpl->m_argv);
 
     free(r->pimpl);
 }
 
+/** Writes the captured output to files in a new temporary directory. */
+static
+atf_error_t
+materialize(struct atf_check_result_impl *pimpl)
+{
+    atf_error_t err;
+
+    err = create_tmpdir(&pimpl->m_dir);
+    if (atf_is_error(err))
+        goto out;
+
+    err = atf_fs_path_init_fmt(&pimpl->m_stdout_path, "%s/stdout",
+                               atf_fs_path_cstring(&pimpl->m_dir));
+    if (atf_is_error(err))
+        goto err_dir;
+
+    err = atf_fs_path_init_fmt(&pimpl->m_stderr_path, "%s/stderr",
+                               atf_fs_path_cstring(&pimpl->m_dir));
+    if (atf_is_error(err))
+        goto err_stdout;
+
+    err = capture_to_file(&pimpl->m_stdout, &pimpl->m_stdout_path);
+    if (atf_is_error(err))
+        goto err_files;
+
+    err = capture_to_file(&pimpl->m_stderr, &pimpl->m_stderr_path);
+    if (atf_is_error(err))
+        goto err_files;
+
+    pimpl->m_materialized = true;
+    INV(!atf_is_error(err));
+    goto out;
+
+err_files:
+    (void)unlink(atf_fs_path_cstring(&pimpl->m_stdout_path));
+    (void)unlink(atf_fs_path_cstring(&pimpl->m_stderr_path));
+    atf_fs_path_fini(&pimpl->m_stderr_path);
+err_stdout:
+    atf_fs_path_fini(&pimpl->m_stdout_path);
+err_dir:
+    (void)rmdir(atf_fs_path_cstring(&pimpl->m_dir));
+    atf_fs_path_fini(&pimpl->m_dir);
+out:
+    return err;
+}
+
+/** Writes the captured output to files if not yet done.
+ *
+ * This must be called before requesting the paths of the files with
+ * atf_check_result_stdout and atf_check_result_stderr. */
+atf_error_t
+atf_check_result_materialize(const atf_check_result_t *r)
+{
+    if (r->pimpl->m_materialized)
+        return atf_no_error();
+    else
+        return materialize(r->pimpl);
+}
+
+/** Returns the path to a file holding the stdout of the command.
+ *
+ * The file only exists once atf_check_result_materialize has succeeded,
+ * and NULL is returned until then, so callers that can work with the
+ * output in memory should use atf_check_result_stdout_data instead. */
 const char *
 atf_check_result_stdout(const atf_check_result_t *r)
 {
-    return atf_fs_path_cstring(&r->pimpl->m_stdout);
+    if (!r->pimpl->m_materialized)
+        return NULL;
+    return atf_fs_path_cstring(&r->pimpl->m_stdout_path);
 }
 
+/** Returns the path to a file holding the stderr of the command.
+ *
+ * See atf_check_result_stdout for details. */
 const char *
 atf_check_result_stderr(const atf_check_result_t *r)
 {
-    return atf_fs_path_cstring(&r->pimpl->m_stderr);
+    if (!r->pimpl->m_materialized)
+        return NULL;
+    return atf_fs_path_cstring(&r->pimpl->m_stderr_path);
+}
+
+/** Returns the stdout of the command and stores its length in length.
+ *
+ * The data is followed by a nul character but may contain others. */
+const char *
+atf_check_result_stdout_data(const atf_check_result_t *r, size_t *length)
+{
+    *length = r->pimpl->m_stdout.m_length;
+    return r->pimpl->m_stdout.m_data;
+}
+
+/** Returns the stderr of the command and stores its length in length.
+ *
+ * See atf_check_result_stdout_data for details. */
+const char *
+atf_check_result_stderr_data(const atf_check_result_t *r, size_t *length)
+{
+    *length = r->pimpl->m_stderr.m_length;
+    return r->pimpl->m_stderr.m_data;
 }
 
 bool
@@ -386,6 +666,109 @@ atf_check_result_termsig(const atf_check_result_t *r)
     return atf_process_status_termsig(&r->pimpl->m_status);
 }
 
+/* ---------------------------------------------------------------------
+ * The "atf_check_pending" type.
+ * --------------------------------------------------------------------- */
+
+struct atf_check_pending_impl {
+    atf_check_result_t m_result;
+    atf_process_child_t m_child;
+
+    /* Whether m_result is complete and the child has been reaped. */
+    bool m_done;
+};
+
+/** Discards a command that has not been waited for.
+ *
+ * The command is killed, together with its descendants, if it is still
+ * running. */
+void
+atf_check_pending_fini(atf_check_pending_t *p)
+{
+    if (!p->pimpl->m_done)
+        kill_and_reap(&p->pimpl->m_child);
+    atf_check_result_fini(&p->pimpl->m_result);
+    free(p->pimpl);
+}
+
+/** Checks whether a command has terminated and all of its output has been
+ * collected, in which case atf_check_wait does not block. */
+bool
+atf_check_pending_done(const atf_check_pending_t *p)
+{
+    return p->pimpl->m_done;
+}
+
+static
+struct atf_check_pending_impl *
+find_pending(atf_check_pending_t *const *pending, const size_t n,
+             const atf_process_child_t *child)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (pending[i] != NULL && &pending[i]->pimpl->m_child == child)
+            return pending[i]->pimpl;
+    }
+    UNREACHABLE;
+    return NULL;
+}
+
+/** Collects the output and the termination of several commands at once.
+ *
+ * Runs until all of the commands are done if all is true, or until at
+ * least one of them is otherwise; in the latter case, the termination of
+ * those that have already exited is collected as well.  NULL entries are
+ * ignored. */
+static
+atf_error_t
+collect_pending(atf_check_pending_t *const *pending, const size_t n,
+                const bool all)
+{
+    atf_error_t err;
+    atf_process_mux_t mux;
+    atf_process_mux_event_t ev;
+    size_t i;
+    int timeout;
+
+    err = atf_process_mux_init(&mux);
+    if (atf_is_error(err))
+        goto out;
+
+    timeout = -1;
+    for (i = 0; !atf_is_error(err) && i < n; i++) {
+        if (pending[i] == NULL)
+            continue;
+        else if (pending[i]->pimpl->m_done) {
+            if (!all)
+                timeout = 0;
+        } else
+            err = atf_process_mux_add(&mux, &pending[i]->pimpl->m_child);
+    }
+
+    while (!atf_is_error(err) && atf_process_mux_size(&mux) > 0) {
+        struct atf_check_pending_impl *p;
+        struct atf_check_result_impl *r;
+
+        err = atf_process_mux_wait(&mux, timeout, &ev);
+        if (atf_is_error(err) || ev.m_type == atf_process_mux_event_timeout)
+            break;
+
+        INV(ev.m_type == atf_process_mux_event_exited);
+        p = find_pending(pending, n, ev.m_child);
+        r = p->m_result.pimpl;
+        r->m_status = ev.m_status;
+        p->m_done = true;
+        err = capture_read_both(&r->m_stdout, &r->m_stderr);
+        if (!all)
+            timeout = 0;
+    }
+
+    atf_process_mux_fini(&mux);
+out:
+    return err;
+}
+
 /* ---------------------------------------------------------------------
  * Free functions.
  * --------------------------------------------------------------------- */
@@ -453,33 +836,157 @@ out:
     return err;
 }
 
+static
 atf_error_t
-atf_check_exec_array(const char *const *argv, atf_check_result_t *r)
+exec_array(const char *const *argv, const atf_process_stream_t *insb,
+           atf_check_result_t *r)
 {
     atf_error_t err;
-    atf_fs_path_t dir;
 
-    err = create_tmpdir(&dir);
+    err = atf_check_result_init(r, argv);
     if (atf_is_error(err))
         goto out;
 
-    err = atf_check_result_init(r, argv, &dir);
+    err = fork_and_wait(argv, insb, &r->pimpl->m_stdout, &r->pimpl->m_stderr,
+                        &r->pimpl->m_status);
     if (atf_is_error(err)) {
-        atf_error_t err2 = atf_fs_rmdir(&dir);
-        INV(!atf_is_error(err2));
+        atf_check_result_fini(r);
         goto out;
     }
 
-    err = fork_and_wait(argv, &r->pimpl->m_stdout, &r->pimpl->m_stderr,
-                        &r->pimpl->m_status);
-    if (atf_is_error(err)) {
-        atf_check_result_fini(r);
+    INV(!atf_is_error(err));
+out:
+    return err;
+}
+
+atf_error_t
+atf_check_exec_array(const char *const *argv, atf_check_result_t *r)
+{
+    return exec_array(argv, NULL, r);
+}
+
+/** Runs a command feeding the given data to its standard input.
+ *
+ * The data is not retained by the result, so the caller may release it
+ * as soon as this returns. */
+atf_error_t
+atf_check_exec_array_stdin(const char *const *argv, const void *data,
+                           const size_t length, atf_check_result_t *r)
+{
+    atf_error_t err;
+    atf_process_stream_t insb;
+
+    err = atf_process_stream_init_inline(&insb, data, length);
+    if (atf_is_error(err))
+        goto out;
+
+    err = exec_array(argv, &insb, r);
+
+    atf_process_stream_fini(&insb);
+out:
+    return err;
+}
+
+/** Starts a command without waiting for it.
+ *
+ * The command runs concurrently with the caller, and with any other
+ * command started in the same way, until it is collected with
+ * atf_check_wait or discarded with atf_check_pending_fini.  Its output is
+ * captured in anonymous files and loaded into memory once it terminates.
+ * Every pending command holds a few file descriptors, so callers with many
+ * commands to run should start them in batches. */
+atf_error_t
+atf_check_launch_array(const char *const *argv, atf_check_pending_t *p)
+{
+    atf_error_t err;
+
+    p->pimpl = malloc(sizeof(struct atf_check_pending_impl));
+    if (p->pimpl == NULL) {
+        err = atf_no_memory_error();
         goto out;
     }
+    p->pimpl->m_done = false;
+
+    err = atf_check_result_init(&p->pimpl->m_result, argv);
+    if (atf_is_error(err))
+        goto err_pimpl;
+
+    err = start_command(argv, NULL, &p->pimpl->m_result.pimpl->m_stdout,
+                        &p->pimpl->m_result.pimpl->m_stderr,
+                        &p->pimpl->m_child);
+    if (atf_is_error(err))
+        goto err_result;
 
     INV(!atf_is_error(err));
+    goto out;
 
-    atf_fs_path_fini(&dir);
+err_result:
+    atf_check_result_fini(&p->pimpl->m_result);
+err_pimpl:
+    free(p->pimpl);
 out:
     return err;
 }
+
+/** Waits for a command started by atf_check_launch_array.
+ *
+ * On success, the pending command is released and its result is stored in
+ * r.  On failure, the pending command remains valid. */
+atf_error_t
+atf_check_wait(atf_check_pending_t *p, atf_check_result_t *r)
+{
+    atf_error_t err;
+
+    if (!p->pimpl->m_done) {
+        err = collect_pending(&p, 1, true);
+        if (atf_is_error(err))
+            return err;
+        INV(p->pimpl->m_done);
+    }
+
+    *r = p->pimpl->m_result;
+    free(p->pimpl);
+    return atf_no_error();
+}
+
+/** Waits until all the given commands are done.
+ *
+ * The output of all of them is collected concurrently, and their results
+ * can then be obtained with atf_check_wait without blocking.  Entries in
+ * the pending array may be NULL, in which case they are ignored. */
+atf_error_t
+atf_check_wait_all(atf_check_pending_t *const *pending, const size_t n)
+{
+    return collect_pending(pending, n, true);
+}
+
+/** Waits until any of the given commands is done.
+ *
+ * On success, index is set to the position in the array of a command
+ * whose result can be obtained with atf_check_wait without blocking.
+ * Entries in the pending array may be NULL, in which case they are
+ * ignored, but at least one must not be. */
+atf_error_t
+atf_check_wait_any(atf_check_pending_t *const *pending, const size_t n,
+                   size_t *index)
+{
+    atf_error_t err;
+    size_t i;
+
+    for (i = 0; i < n && pending[i] == NULL; i++)
+        continue;
+    PRE(i < n);
+
+    err = collect_pending(pending, n, false);
+    if (atf_is_error(err))
+        return err;
+
+    for (i = 0; i < n; i++) {
+        if (pending[i] != NULL && pending[i]->pimpl->m_done) {
+            *index = i;
+            return atf_no_error();
+        }
+    }
+    UNREACHABLE;
+    return atf_no_error();
+}
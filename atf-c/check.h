@@ -27,6 +27,7 @@
 #define ATF_C_CHECK_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include <atf-c/error_fwd.h>
 
@@ -46,11 +47,34 @@ void atf_check_result_fini(atf_check_result_t *);
 /* Getters */
 const char *atf_check_result_stdout(const atf_check_result_t *);
 const char *atf_check_result_stderr(const atf_check_result_t *);
+const char *atf_check_result_stdout_data(const atf_check_result_t *,
+                                         size_t *);
+const char *atf_check_result_stderr_data(const atf_check_result_t *,
+                                         size_t *);
 bool atf_check_result_exited(const atf_check_result_t *);
 int atf_check_result_exitcode(const atf_check_result_t *);
 bool atf_check_result_signaled(const atf_check_result_t *);
 int atf_check_result_termsig(const atf_check_result_t *);
 
+/* Output files */
+atf_error_t atf_check_result_materialize(const atf_check_result_t *);
+
+/* ---------------------------------------------------------------------
+ * The "atf_check_pending" type.
+ * --------------------------------------------------------------------- */
+
+struct atf_check_pending_impl;
+struct atf_check_pending {
+    struct atf_check_pending_impl *pimpl;
+};
+typedef struct atf_check_pending atf_check_pending_t;
+
+/* Construtors and destructors */
+void atf_check_pending_fini(atf_check_pending_t *);
+
+/* Getters */
+bool atf_check_pending_done(const atf_check_pending_t *);
+
 /* ---------------------------------------------------------------------
  * Free functions.
  * --------------------------------------------------------------------- */
@@ -65,5 +89,13 @@ atf_error_t atf_check_build_cxx_o(const char *, const char *,
                                   const char *const [],
                                   bool *);
 atf_error_t atf_check_exec_array(const char *const *, atf_check_result_t *);
+atf_error_t atf_check_exec_array_stdin(const char *const *, const void *,
+                                       const size_t, atf_check_result_t *);
+atf_error_t atf_check_launch_array(const char *const *,
+                                   atf_check_pending_t *);
+atf_error_t atf_check_wait(atf_check_pending_t *, atf_check_result_t *);
+atf_error_t atf_check_wait_all(atf_check_pending_t *const *, const size_t);
+atf_error_t atf_check_wait_any(atf_check_pending_t *const *, const size_t,
+                               size_t *);
 
 #endif /* !defined(ATF_C_CHECK_H) */
@@ -25,6 +25,8 @@
 
 #include "atf-c/check.h"
 
+#include <sys/stat.h>
+
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
@@ -315,6 +317,9 @@ ATF_TC_BODY(exec_array, tc)
     ATF_CHECK(atf_check_result_exited(&result));
     ATF_CHECK(atf_check_result_exitcode(&result) == EXIT_SUCCESS);
 
+    ATF_CHECK(atf_check_result_stdout(&result) == NULL);
+    ATF_CHECK(atf_check_result_stderr(&result) == NULL);
+    RE(atf_check_result_materialize(&result));
     {
         const char *path = atf_check_result_stdout(&result);
         int fd = open(path, O_RDONLY);
@@ -340,6 +345,7 @@ ATF_TC_BODY(exec_cleanup, tc)
     bool exists;
 
     do_exec(tc, "exit-success", &result);
+    RE(atf_check_result_materialize(&result));
     RE(atf_fs_path_init_fmt(&out, "%s", atf_check_result_stdout(&result)));
     RE(atf_fs_path_init_fmt(&err, "%s", atf_check_result_stderr(&result)));
 
@@ -411,6 +417,8 @@ ATF_TC_BODY(exec_stdout_stderr, tc)
     ATF_CHECK(atf_check_result_exited(&result2));
     ATF_CHECK(atf_check_result_exitcode(&result2) == EXIT_SUCCESS);
 
+    RE(atf_check_result_materialize(&result1));
+    RE(atf_check_result_materialize(&result2));
     out1 = atf_check_result_stdout(&result1);
     out2 = atf_check_result_stdout(&result2);
     err1 = atf_check_result_stderr(&result1);
@@ -454,12 +462,118 @@ ATF_TC_BODY(exec_stdout_stderr, tc)
     atf_check_result_fini(&result1);
 }
 
+ATF_TC(exec_stdin);
+ATF_TC_HEAD(exec_stdin, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks that atf_check_exec_array_stdin "
+                      "feeds the given data to the command");
+}
+ATF_TC_BODY(exec_stdin, tc)
+{
+    atf_check_result_t result;
+    const char *argv[] = { "cat", NULL };
+    const char input[] = "first\0second\n";
+    const char *data;
+    size_t length;
+
+    RE(atf_check_exec_array_stdin(argv, input, sizeof(input) - 1, &result));
+    ATF_CHECK(atf_check_result_exited(&result));
+    ATF_CHECK(atf_check_result_exitcode(&result) == EXIT_SUCCESS);
+
+    data = atf_check_result_stdout_data(&result, &length);
+    ATF_CHECK_EQ(sizeof(input) - 1, length);
+    ATF_CHECK(memcmp(input, data, length) == 0);
+
+    atf_check_result_fini(&result);
+}
+
+ATF_TC(exec_late_output);
+ATF_TC_HEAD(exec_late_output, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks that processes left behind by "
+                      "the command can still write to its output once it "
+                      "is done");
+}
+ATF_TC_BODY(exec_late_output, tc)
+{
+    atf_check_result_t result;
+    const char *argv[] = { "/bin/sh", "-c",
+        "(sleep 1; echo late; echo after >file) & echo done", NULL };
+    size_t length;
+    int i;
+
+    RE(atf_check_exec_array(argv, &result));
+    ATF_CHECK(atf_check_result_exited(&result));
+    ATF_CHECK(atf_check_result_exitcode(&result) == EXIT_SUCCESS);
+    ATF_CHECK_STREQ("done\n", atf_check_result_stdout_data(&result,
+                                                             &length));
+    atf_check_result_fini(&result);
+
+    for (i = 0; i < 100 && access("file", F_OK) == -1; i++)
+        usleep(100000);
+    ATF_REQUIRE(atf_utils_compare_file("file", "after\n"));
+}
+
+ATF_TC(exec_stdout_stderr_data);
+ATF_TC_HEAD(exec_stdout_stderr_data, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks that atf_check_exec_array "
+                      "captures the output of the command in memory and "
+                      "only writes it to files when their paths are "
+                      "requested");
+}
+ATF_TC_BODY(exec_stdout_stderr_data, tc)
+{
+    atf_check_result_t result;
+    atf_fs_path_t tmpdir;
+    const char *data;
+    char *cwd;
+    size_t length;
+
+    ATF_REQUIRE(mkdir("tmp", 0755) != -1);
+    cwd = getcwd(NULL, 0);
+    ATF_REQUIRE(cwd != NULL);
+    RE(atf_fs_path_init_fmt(&tmpdir, "%s/tmp", cwd));
+    free(cwd);
+    ATF_REQUIRE(setenv("TMPDIR", atf_fs_path_cstring(&tmpdir), 1) != -1);
+
+    do_exec_with_arg(tc, "stdout-stderr", "result", &result);
+    ATF_CHECK(atf_check_result_exited(&result));
+    ATF_CHECK(atf_check_result_exitcode(&result) == EXIT_SUCCESS);
+
+    data = atf_check_result_stdout_data(&result, &length);
+    ATF_CHECK_STREQ("Line 1 to stdout for result\n"
+                    "Line 2 to stdout for result\n", data);
+    ATF_CHECK_EQ(strlen(data), length);
+    data = atf_check_result_stderr_data(&result, &length);
+    ATF_CHECK_STREQ("Line 1 to stderr for result\n"
+                    "Line 2 to stderr for result\n", data);
+    ATF_CHECK_EQ(strlen(data), length);
+
+    ATF_CHECK(rmdir("tmp") != -1);
+    ATF_REQUIRE(mkdir("tmp", 0755) != -1);
+    RE(atf_check_result_materialize(&result));
+    ATF_CHECK(strncmp(atf_check_result_stdout(&result),
+                      atf_fs_path_cstring(&tmpdir),
+                      strlen(atf_fs_path_cstring(&tmpdir))) == 0);
+    ATF_CHECK(atf_utils_compare_file(atf_check_result_stdout(&result),
+                                     "Line 1 to stdout for result\n"
+                                     "Line 2 to stdout for result\n"));
+    ATF_CHECK(atf_utils_compare_file(atf_check_result_stderr(&result),
+                                     "Line 1 to stderr for result\n"
+                                     "Line 2 to stderr for result\n"));
+
+    atf_check_result_fini(&result);
+    ATF_CHECK(rmdir("tmp") != -1);
+    atf_fs_path_fini(&tmpdir);
+}
+
 ATF_TC(exec_umask);
 ATF_TC_HEAD(exec_umask, tc)
 {
     atf_tc_set_md_var(tc, "descr", "Checks that atf_check_exec_array "
-                      "correctly reports an error if the umask is too "
-                      "restrictive to create temporary files");
+                      "does not need to create temporary files, so that a "
+                      "restrictive umask does not prevent it from working");
 }
 ATF_TC_BODY(exec_umask, tc)
 {
@@ -473,10 +587,10 @@ ATF_TC_BODY(exec_umask, tc)
     argv[2] = NULL;
 
     umask(0222);
-    atf_error_t err = atf_check_exec_array(argv, &result);
-    ATF_CHECK(atf_is_error(err));
-    ATF_CHECK(atf_error_is(err, "invalid_umask"));
-    atf_error_free(err);
+    RE(atf_check_exec_array(argv, &result));
+    ATF_CHECK(atf_check_result_exited(&result));
+    ATF_CHECK(atf_check_result_exitcode(&result) == EXIT_SUCCESS);
+    atf_check_result_fini(&result);
 
     atf_fs_path_fini(&process_helpers);
 }
@@ -500,6 +614,102 @@ ATF_TC_BODY(exec_unknown, tc)
     atf_check_result_fini(&result);
 }
 
+ATF_TC(launch_wait_all);
+ATF_TC_HEAD(launch_wait_all, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks that atf_check_wait_all runs "
+                      "several commands concurrently and collects their "
+                      "output and exit status");
+}
+ATF_TC_BODY(launch_wait_all, tc)
+{
+    /* The commands write more than what fits in a pipe to both of their
+     * output streams, so this hangs unless all of them are drained. */
+    const char *script = "i=0; while [ $i -lt 2000 ]; do "
+        "echo \"stdout line $i of $0\"; echo \"stderr line $i of $0\" 1>&2; "
+        "i=$((i + 1)); done; exit $1";
+    atf_check_pending_t pending[3];
+    atf_check_pending_t *ptrs[3];
+    size_t i;
+
+    for (i = 0; i < 3; i++) {
+        char name[16], code[16];
+        const char *argv[6];
+
+        snprintf(name, sizeof(name), "cmd%zu", i);
+        snprintf(code, sizeof(code), "%zu", i);
+        argv[0] = "sh";
+        argv[1] = "-c";
+        argv[2] = script;
+        argv[3] = name;
+        argv[4] = code;
+        argv[5] = NULL;
+        RE(atf_check_launch_array(argv, &pending[i]));
+        ptrs[i] = &pending[i];
+    }
+
+    RE(atf_check_wait_all(ptrs, 3));
+
+    for (i = 0; i < 3; i++) {
+        atf_check_result_t result;
+        char line[64];
+        const char *data;
+        size_t length;
+
+        ATF_REQUIRE(atf_check_pending_done(&pending[i]));
+        RE(atf_check_wait(&pending[i], &result));
+        ATF_CHECK(atf_check_result_exited(&result));
+        ATF_CHECK_EQ(i, (size_t)atf_check_result_exitcode(&result));
+
+        data = atf_check_result_stdout_data(&result, &length);
+        snprintf(line, sizeof(line), "stdout line 1999 of cmd%zu\n", i);
+        ATF_CHECK(length > strlen(line));
+        ATF_CHECK_STREQ(line, data + length - strlen(line));
+
+        data = atf_check_result_stderr_data(&result, &length);
+        snprintf(line, sizeof(line), "stderr line 1999 of cmd%zu\n", i);
+        ATF_CHECK(length > strlen(line));
+        ATF_CHECK_STREQ(line, data + length - strlen(line));
+
+        atf_check_result_fini(&result);
+    }
+}
+
+ATF_TC(launch_wait_any);
+ATF_TC_HEAD(launch_wait_any, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks that atf_check_wait_any returns "
+                      "as soon as one command is done and that pending "
+                      "commands can be discarded");
+}
+ATF_TC_BODY(launch_wait_any, tc)
+{
+    const char *slow_argv[] = { "sleep", "60", NULL };
+    const char *fast_argv[] = { "sh", "-c", "echo fast; exit 3", NULL };
+    atf_check_pending_t slow, fast;
+    atf_check_pending_t *ptrs[3];
+    atf_check_result_t result;
+    size_t index, length;
+
+    RE(atf_check_launch_array(slow_argv, &slow));
+    RE(atf_check_launch_array(fast_argv, &fast));
+
+    ptrs[0] = &slow;
+    ptrs[1] = NULL;
+    ptrs[2] = &fast;
+    RE(atf_check_wait_any(ptrs, 3, &index));
+    ATF_REQUIRE_EQ(2, index);
+    ATF_CHECK(!atf_check_pending_done(&slow));
+
+    RE(atf_check_wait(&fast, &result));
+    ATF_CHECK(atf_check_result_exited(&result));
+    ATF_CHECK_EQ(3, atf_check_result_exitcode(&result));
+    ATF_CHECK_STREQ("fast\n", atf_check_result_stdout_data(&result, &length));
+    atf_check_result_fini(&result);
+
+    atf_check_pending_fini(&slow);
+}
+
 /* ---------------------------------------------------------------------
  * Main.
  * --------------------------------------------------------------------- */
@@ -514,8 +724,13 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, exec_cleanup);
     ATF_TP_ADD_TC(tp, exec_exitstatus);
     ATF_TP_ADD_TC(tp, exec_stdout_stderr);
+    ATF_TP_ADD_TC(tp, exec_stdin);
+    ATF_TP_ADD_TC(tp, exec_late_output);
+    ATF_TP_ADD_TC(tp, exec_stdout_stderr_data);
     ATF_TP_ADD_TC(tp, exec_umask);
     ATF_TP_ADD_TC(tp, exec_unknown);
+    ATF_TP_ADD_TC(tp, launch_wait_all);
+    ATF_TP_ADD_TC(tp, launch_wait_any);
 
     return atf_no_error();
 }
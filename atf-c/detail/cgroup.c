@@ -0,0 +1,636 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include "atf-c/detail/cgroup.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "atf-c/detail/sanity.h"
+#include "atf-c/detail/text.h"
+#include "atf-c/error.h"
+
+/* How long to wait for the processes left behind in a cgroup to go away
+ * before giving up on its removal. */
+#define DESTROY_RETRIES 100
+#define DESTROY_DELAY_NS 10000000L
+
+/* The controllers that are enabled, if available, in the root given to
+ * atf_cgroup_init. */
+static const char *const controllers[] = { "cpu", "io", "memory", "pids",
+                                           NULL };
+
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+static
+atf_error_t
+parse_memory(const char *str, long long *bytes)
+{
+    char *endptr;
+    long long value, mult;
+
+    errno = 0;
+    value = strtoll(str, &endptr, 10);
+    if (endptr == str || value < 0 || errno == ERANGE)
+        return atf_libc_error(EINVAL, "Invalid memory size '%s'", str);
+
+    switch (*endptr) {
+    case '\0': mult = 1; break;
+    case 'k': case 'K': mult = 1LL << 10; break;
+    case 'm': case 'M': mult = 1LL << 20; break;
+    case 'g': case 'G': mult = 1LL << 30; break;
+    case 't': case 'T': mult = 1LL << 40; break;
+    default:
+        return atf_libc_error(EINVAL, "Invalid memory size '%s'", str);
+    }
+    if ((*endptr != '\0' && *(endptr + 1) != '\0') || value > LLONG_MAX / mult)
+        return atf_libc_error(EINVAL, "Invalid memory size '%s'", str);
+
+    *bytes = value == 0 ? -1 : value * mult;
+    return atf_no_error();
+}
+
+/** Parses a number of CPUs, which may be fractional, into a quota.
+ *
+ * The kernel refuses quotas below one millisecond, so those are rejected
+ * here to report them in terms of the value given by the user. */
+static
+atf_error_t
+parse_cpu(const char *str, long long *quota)
+{
+    char *endptr;
+    double cpus;
+
+    errno = 0;
+    cpus = strtod(str, &endptr);
+    if (endptr == str || *endptr != '\0' || errno == ERANGE ||
+        !(cpus * ATF_CGROUP_CPU_PERIOD >= 1000) ||
+        cpus * ATF_CGROUP_CPU_PERIOD > (double)LLONG_MAX / 2)
+        return atf_libc_error(EINVAL, "Invalid CPU limit '%s'", str);
+
+    *quota = (long long)(cpus * ATF_CGROUP_CPU_PERIOD + 0.5);
+    return atf_no_error();
+}
+
+static
+atf_error_t
+parse_pids(const char *str, long long *pids)
+{
+    atf_error_t err;
+    long value;
+
+    err = atf_text_to_long(str, &value);
+    if (!atf_is_error(err) && value <= 0)
+        err = atf_libc_error(EINVAL, "Invalid process limit '%s'", str);
+    if (!atf_is_error(err))
+        *pids = value;
+    return err;
+}
+
+/** Checks if a whitespace-separated list contains the given word. */
+static
+bool
+has_word(const char *list, const char *word)
+{
+    const size_t len = strlen(word);
+    const char *ptr = list;
+
+    while ((ptr = strstr(ptr, word)) != NULL) {
+        if ((ptr == list || ptr[-1] == ' ' || ptr[-1] == '\n') &&
+            (ptr[len] == '\0' || ptr[len] == ' ' || ptr[len] == '\n'))
+            return true;
+        ptr += len;
+    }
+    return false;
+}
+
+/** Looks up the value of a key in a flat keyed file such as cpu.stat.
+ *
+ * Returns -1 if the key is not present. */
+static
+long long
+keyed_value(const char *contents, const char *key)
+{
+    const size_t len = strlen(key);
+    const char *line;
+
+    for (line = contents; *line != '\0'; ) {
+        const char *next = strchr(line, '\n');
+
+        if (strncmp(line, key, len) == 0 && line[len] == ' ')
+            return strtoll(line + len + 1, NULL, 10);
+        if (next == NULL)
+            break;
+        line = next + 1;
+    }
+    return -1;
+}
+
+/** Adds up the value of a key across all the devices listed in io.stat.
+ *
+ * Every line holds a device number followed by key=value pairs. */
+static
+long long
+io_total(const char *contents, const char *key)
+{
+    const size_t len = strlen(key);
+    const char *ptr;
+    long long total = 0;
+
+    for (ptr = contents; (ptr = strstr(ptr, key)) != NULL; ptr += len) {
+        if ((ptr == contents || ptr[-1] == ' ') && ptr[len] == '=')
+            total += strtoll(ptr + len + 1, NULL, 10);
+    }
+    return total;
+}
+
+static
+atf_error_t
+control_path(const atf_fs_path_t *dir, const char *name, atf_fs_path_t *p)
+{
+    return atf_fs_path_init_fmt(p, "%s/%s", atf_fs_path_cstring(dir), name);
+}
+
+/** Reads a control file of a cgroup.
+ *
+ * found is set to false, and no error is raised, if the file does not
+ * exist because the controller that provides it is not enabled. */
+static
+atf_error_t
+read_control(const atf_fs_path_t *dir, const char *name,
+             atf_dynstr_t *contents, bool *found)
+{
+    atf_error_t err;
+    atf_fs_path_t p;
+    char buf[1024];
+    ssize_t n;
+    int fd;
+
+    err = control_path(dir, name, &p);
+    if (atf_is_error(err))
+        goto out;
+
+    err = atf_dynstr_init(contents);
+    if (atf_is_error(err))
+        goto out_p;
+
+    fd = open(atf_fs_path_cstring(&p), O_RDONLY);
+    if (fd == -1) {
+        if (errno == ENOENT)
+            *found = false;
+        else {
+            err = atf_libc_error(errno, "Cannot open %s",
+                                 atf_fs_path_cstring(&p));
+            atf_dynstr_fini(contents);
+        }
+        goto out_p;
+    }
+    *found = true;
+
+    while (!atf_is_error(err) && (n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n == -1) {
+            if (errno != EINTR)
+                err = atf_libc_error(errno, "Cannot read %s",
+                                     atf_fs_path_cstring(&p));
+        } else
+            err = atf_dynstr_append_fmt(contents, "%.*s", (int)n, buf);
+    }
+    if (atf_is_error(err))
+        atf_dynstr_fini(contents);
+
+    close(fd);
+out_p:
+    atf_fs_path_fini(&p);
+out:
+    return err;
+}
+
+/** Writes a value to a control file of a cgroup.
+ *
+ * Control files take their whole value in a single write, so a short
+ * write is reported as an error rather than retried. */
+static
+atf_error_t
+write_control(const atf_fs_path_t *dir, const char *name, const char *fmt,
+              ...)
+{
+    atf_error_t err;
+    atf_fs_path_t p;
+    char buf[64];
+    va_list ap;
+    int fd, len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    INV(len > 0 && (size_t)len < sizeof(buf));
+
+    err = control_path(dir, name, &p);
+    if (atf_is_error(err))
+        goto out;
+
+    fd = open(atf_fs_path_cstring(&p), O_WRONLY);
+    if (fd == -1) {
+        err = atf_libc_error(errno, "Cannot open %s",
+                             atf_fs_path_cstring(&p));
+        goto out_p;
+    }
+
+    if (write(fd, buf, len) != len)
+        err = atf_libc_error(errno, "Cannot write '%s' to %s", buf,
+                             atf_fs_path_cstring(&p));
+
+    close(fd);
+out_p:
+    atf_fs_path_fini(&p);
+out:
+    return err;
+}
+
+/** Ensures that a control file exists before writing a limit to it.
+ *
+ * Limit files are only present if their controller is enabled, so this
+ * reports which controller is missing instead of a plain ENOENT. */
+static
+atf_error_t
+check_control(const atf_fs_path_t *dir, const char *controller,
+              const char *name)
+{
+    atf_error_t err;
+    atf_dynstr_t contents;
+    bool found;
+
+    err = read_control(dir, name, &contents, &found);
+    if (atf_is_error(err))
+        goto out;
+
+    if (found)
+        atf_dynstr_fini(&contents);
+    else
+        err = atf_libc_error(ENOTSUP, "The %s controller is not available "
+                             "in %s", controller, atf_fs_path_cstring(dir));
+
+out:
+    return err;
+}
+
+/** Enables the controllers we know about in the children of a cgroup.
+ *
+ * Controllers that the cgroup does not provide are silently skipped: their
+ * limits will be reported as unavailable if they are ever requested. */
+static
+atf_error_t
+enable_controllers(const atf_fs_path_t *root)
+{
+    atf_error_t err;
+    atf_dynstr_t available, enabled;
+    const char *const *ctl;
+    bool found;
+
+    err = read_control(root, "cgroup.controllers", &available, &found);
+    if (atf_is_error(err))
+        goto out;
+    if (!found) {
+        err = atf_libc_error(ENOTSUP, "%s is not a cgroup v2 directory",
+                             atf_fs_path_cstring(root));
+        goto out;
+    }
+
+    err = read_control(root, "cgroup.subtree_control", &enabled, &found);
+    if (atf_is_error(err))
+        goto out_available;
+    INV(found);
+
+    for (ctl = controllers; !atf_is_error(err) && *ctl != NULL; ctl++) {
+        if (has_word(atf_dynstr_cstring(&available), *ctl) &&
+            !has_word(atf_dynstr_cstring(&enabled), *ctl))
+            err = write_control(root, "cgroup.subtree_control", "+%s",
+                                *ctl);
+    }
+
+    atf_dynstr_fini(&enabled);
+out_available:
+    atf_dynstr_fini(&available);
+out:
+    return err;
+}
+
+static
+void
+sleep_destroy_delay(void)
+{
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = DESTROY_DELAY_NS;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        ;
+}
+
+/* ---------------------------------------------------------------------
+ * The "atf_cgroup_limits" type.
+ * --------------------------------------------------------------------- */
+
+/** Parses the limits of a cgroup from their textual representation.
+ *
+ * The memory limit is a size in bytes that may carry a K, M, G or T
+ * suffix; zero means no limit.  The CPU limit is a number of CPUs, which
+ * may be fractional.  The processes limit is a positive integer.  NULL
+ * values mean no limit. */
+atf_error_t
+atf_cgroup_limits_parse(atf_cgroup_limits_t *limits, const char *memory,
+                        const char *cpu, const char *pids)
+{
+    atf_error_t err;
+
+    limits->m_memory_max = -1;
+    limits->m_cpu_quota = -1;
+    limits->m_pids_max = -1;
+
+    err = atf_no_error();
+    if (memory != NULL)
+        err = parse_memory(memory, &limits->m_memory_max);
+    if (!atf_is_error(err) && cpu != NULL)
+        err = parse_cpu(cpu, &limits->m_cpu_quota);
+    if (!atf_is_error(err) && pids != NULL)
+        err = parse_pids(pids, &limits->m_pids_max);
+    return err;
+}
+
+bool
+atf_cgroup_limits_any(const atf_cgroup_limits_t *limits)
+{
+    return limits->m_memory_max >= 0 || limits->m_cpu_quota >= 0 ||
+           limits->m_pids_max >= 0;
+}
+
+/* ---------------------------------------------------------------------
+ * The "atf_cgroup_stats" type.
+ * --------------------------------------------------------------------- */
+
+/** Formats the resources consumed by a cgroup.
+ *
+ * Every available property takes a line of the form "cgroup.<name>:
+ * <value>", which is what gets appended to the results file after the
+ * result itself.  Times are printed in seconds. */
+atf_error_t
+atf_cgroup_stats_format(const atf_cgroup_stats_t *stats, atf_dynstr_t *dest)
+{
+    atf_error_t err;
+
+    err = atf_dynstr_init(dest);
+    if (atf_is_error(err))
+        goto out;
+
+#define APPEND_COUNT(name, field) \
+    if (!atf_is_error(err) && stats->field >= 0) \
+        err = atf_dynstr_append_fmt(dest, "cgroup." name ": %lld\n", \
+                                    stats->field);
+#define APPEND_TIME(name, field) \
+    if (!atf_is_error(err) && stats->field >= 0) \
+        err = atf_dynstr_append_fmt(dest, "cgroup." name ": %lld.%06lld\n", \
+                                    stats->field / 1000000, \
+                                    stats->field % 1000000);
+
+    APPEND_COUNT("memory.peak", m_memory_peak);
+    APPEND_COUNT("memory.oom_kills", m_oom_kills);
+    APPEND_TIME("cpu.usage", m_cpu_usage);
+    APPEND_TIME("cpu.user", m_cpu_user);
+    APPEND_TIME("cpu.system", m_cpu_system);
+    APPEND_COUNT("cpu.nr_throttled", m_cpu_nr_throttled);
+    APPEND_TIME("cpu.throttled", m_cpu_throttled);
+    APPEND_COUNT("io.rbytes", m_io_rbytes);
+    APPEND_COUNT("io.wbytes", m_io_wbytes);
+    APPEND_COUNT("io.rios", m_io_rios);
+    APPEND_COUNT("io.wios", m_io_wios);
+
+#undef APPEND_TIME
+#undef APPEND_COUNT
+
+    if (atf_is_error(err))
+        atf_dynstr_fini(dest);
+out:
+    return err;
+}
+
+/* ---------------------------------------------------------------------
+ * The "atf_cgroup" type.
+ * --------------------------------------------------------------------- */
+
+/** Creates a transient cgroup named name below root.
+ *
+ * root must be a cgroup v2 directory delegated to the caller, with no
+ * processes of its own so that its controllers can be enabled for the new
+ * cgroup. */
+atf_error_t
+atf_cgroup_init(atf_cgroup_t *cg, const char *root, const char *name)
+{
+    atf_error_t err;
+    atf_fs_path_t rootpath;
+
+    err = atf_fs_path_init_fmt(&rootpath, "%s", root);
+    if (atf_is_error(err))
+        goto out;
+
+    err = enable_controllers(&rootpath);
+    if (atf_is_error(err))
+        goto out_rootpath;
+
+    err = atf_fs_path_init_fmt(&cg->m_path, "%s/%s", root, name);
+    if (atf_is_error(err))
+        goto out_rootpath;
+
+    if (mkdir(atf_fs_path_cstring(&cg->m_path), 0755) == -1) {
+        err = atf_libc_error(errno, "Cannot create cgroup %s",
+                             atf_fs_path_cstring(&cg->m_path));
+        atf_fs_path_fini(&cg->m_path);
+    }
+
+out_rootpath:
+    atf_fs_path_fini(&rootpath);
+out:
+    return err;
+}
+
+/** Removes a cgroup, killing any process that was left behind in it.
+ *
+ * The object is released even if the cgroup cannot be removed. */
+atf_error_t
+atf_cgroup_destroy(atf_cgroup_t *cg)
+{
+    atf_error_t err;
+    int retries;
+
+    err = atf_no_error();
+    for (retries = 0; rmdir(atf_fs_path_cstring(&cg->m_path)) == -1;
+         retries++) {
+        if (errno != EBUSY || retries == DESTROY_RETRIES) {
+            err = atf_libc_error(errno, "Cannot remove cgroup %s",
+                                 atf_fs_path_cstring(&cg->m_path));
+            break;
+        }
+
+        if (retries == 0) {
+            /* Not available before Linux 5.14; the leftovers will make us
+             * fail below in that case. */
+            atf_error_t err2 = write_control(&cg->m_path, "cgroup.kill",
+                                             "1");
+            if (atf_is_error(err2))
+                atf_error_free(err2);
+        }
+        sleep_destroy_delay();
+    }
+
+    atf_fs_path_fini(&cg->m_path);
+    return err;
+}
+
+const char *
+atf_cgroup_path(const atf_cgroup_t *cg)
+{
+    return atf_fs_path_cstring(&cg->m_path);
+}
+
+atf_error_t
+atf_cgroup_set_limits(const atf_cgroup_t *cg,
+                      const atf_cgroup_limits_t *limits)
+{
+    atf_error_t err;
+
+    err = atf_no_error();
+    if (limits->m_memory_max >= 0) {
+        err = check_control(&cg->m_path, "memory", "memory.max");
+        if (!atf_is_error(err))
+            err = write_control(&cg->m_path, "memory.max", "%lld",
+                                limits->m_memory_max);
+    }
+    if (!atf_is_error(err) && limits->m_cpu_quota >= 0) {
+        err = check_control(&cg->m_path, "cpu", "cpu.max");
+        if (!atf_is_error(err))
+            err = write_control(&cg->m_path, "cpu.max", "%lld %d",
+                                limits->m_cpu_quota, ATF_CGROUP_CPU_PERIOD);
+    }
+    if (!atf_is_error(err) && limits->m_pids_max >= 0) {
+        err = check_control(&cg->m_path, "pids", "pids.max");
+        if (!atf_is_error(err))
+            err = write_control(&cg->m_path, "pids.max", "%lld",
+                                limits->m_pids_max);
+    }
+    return err;
+}
+
+/** Moves a process into a cgroup.
+ *
+ * Only the given process is moved; its existing children stay where they
+ * are, but any child it creates afterwards is born in the cgroup. */
+atf_error_t
+atf_cgroup_attach(const atf_cgroup_t *cg, const pid_t pid)
+{
+    return write_control(&cg->m_path, "cgroup.procs", "%ld", (long)pid);
+}
+
+/** Collects the resources consumed by the processes of a cgroup.
+ *
+ * Must be called before the cgroup is destroyed. */
+atf_error_t
+atf_cgroup_stats(const atf_cgroup_t *cg, atf_cgroup_stats_t *stats)
+{
+    atf_error_t err;
+    atf_dynstr_t contents;
+    bool found;
+
+    stats->m_memory_peak = -1;
+    stats->m_oom_kills = -1;
+    stats->m_cpu_usage = -1;
+    stats->m_cpu_user = -1;
+    stats->m_cpu_system = -1;
+    stats->m_cpu_nr_throttled = -1;
+    stats->m_cpu_throttled = -1;
+    stats->m_io_rbytes = -1;
+    stats->m_io_wbytes = -1;
+    stats->m_io_rios = -1;
+    stats->m_io_wios = -1;
+
+    err = read_control(&cg->m_path, "memory.peak", &contents, &found);
+    if (atf_is_error(err))
+        goto out;
+    if (found) {
+        stats->m_memory_peak = strtoll(atf_dynstr_cstring(&contents), NULL,
+                                       10);
+        atf_dynstr_fini(&contents);
+    }
+
+    err = read_control(&cg->m_path, "memory.events", &contents, &found);
+    if (atf_is_error(err))
+        goto out;
+    if (found) {
+        stats->m_oom_kills = keyed_value(atf_dynstr_cstring(&contents),
+                                         "oom_kill");
+        atf_dynstr_fini(&contents);
+    }
+
+    err = read_control(&cg->m_path, "cpu.stat", &contents, &found);
+    if (atf_is_error(err))
+        goto out;
+    if (found) {
+        const char *str = atf_dynstr_cstring(&contents);
+
+        stats->m_cpu_usage = keyed_value(str, "usage_usec");
+        stats->m_cpu_user = keyed_value(str, "user_usec");
+        stats->m_cpu_system = keyed_value(str, "system_usec");
+        stats->m_cpu_nr_throttled = keyed_value(str, "nr_throttled");
+        stats->m_cpu_throttled = keyed_value(str, "throttled_usec");
+        atf_dynstr_fini(&contents);
+    }
+
+    err = read_control(&cg->m_path, "io.stat", &contents, &found);
+    if (atf_is_error(err))
+        goto out;
+    if (found) {
+        const char *str = atf_dynstr_cstring(&contents);
+
+        stats->m_io_rbytes = io_total(str, "rbytes");
+        stats->m_io_wbytes = io_total(str, "wbytes");
+        stats->m_io_rios = io_total(str, "rios");
+        stats->m_io_wios = io_total(str, "wios");
+        atf_dynstr_fini(&contents);
+    }
+
+    INV(!atf_is_error(err));
+out:
+    return err;
+}
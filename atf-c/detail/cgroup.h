@@ -0,0 +1,100 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#if !defined(ATF_C_DETAIL_CGROUP_H)
+#define ATF_C_DETAIL_CGROUP_H
+
+#include <sys/types.h>
+
+#include <stdbool.h>
+
+#include <atf-c/detail/dynstr.h>
+#include <atf-c/detail/fs.h>
+#include <atf-c/error_fwd.h>
+
+/* ---------------------------------------------------------------------
+ * The "atf_cgroup_limits" type.
+ * --------------------------------------------------------------------- */
+
+/* The limits to apply to a cgroup.  Negative values mean no limit.  The
+ * CPU quota is given in microseconds per period of
+ * ATF_CGROUP_CPU_PERIOD microseconds. */
+struct atf_cgroup_limits {
+    long long m_memory_max;
+    long long m_cpu_quota;
+    long long m_pids_max;
+};
+typedef struct atf_cgroup_limits atf_cgroup_limits_t;
+
+#define ATF_CGROUP_CPU_PERIOD 100000
+
+atf_error_t atf_cgroup_limits_parse(atf_cgroup_limits_t *, const char *,
+                                    const char *, const char *);
+bool atf_cgroup_limits_any(const atf_cgroup_limits_t *);
+
+/* ---------------------------------------------------------------------
+ * The "atf_cgroup_stats" type.
+ * --------------------------------------------------------------------- */
+
+/* The resources consumed by the processes of a cgroup.  Negative values
+ * mean that the corresponding controller is not available.  Times are in
+ * microseconds and sizes in bytes. */
+struct atf_cgroup_stats {
+    long long m_memory_peak;
+    long long m_oom_kills;
+    long long m_cpu_usage;
+    long long m_cpu_user;
+    long long m_cpu_system;
+    long long m_cpu_nr_throttled;
+    long long m_cpu_throttled;
+    long long m_io_rbytes;
+    long long m_io_wbytes;
+    long long m_io_rios;
+    long long m_io_wios;
+};
+typedef struct atf_cgroup_stats atf_cgroup_stats_t;
+
+atf_error_t atf_cgroup_stats_format(const atf_cgroup_stats_t *,
+                                    atf_dynstr_t *);
+
+/* ---------------------------------------------------------------------
+ * The "atf_cgroup" type.
+ * --------------------------------------------------------------------- */
+
+struct atf_cgroup {
+    atf_fs_path_t m_path;
+};
+typedef struct atf_cgroup atf_cgroup_t;
+
+atf_error_t atf_cgroup_init(atf_cgroup_t *, const char *, const char *);
+atf_error_t atf_cgroup_destroy(atf_cgroup_t *);
+
+const char *atf_cgroup_path(const atf_cgroup_t *);
+atf_error_t atf_cgroup_set_limits(const atf_cgroup_t *,
+                                  const atf_cgroup_limits_t *);
+atf_error_t atf_cgroup_attach(const atf_cgroup_t *, const pid_t);
+atf_error_t atf_cgroup_stats(const atf_cgroup_t *, atf_cgroup_stats_t *);
+
+#endif /* !defined(ATF_C_DETAIL_CGROUP_H) */
@@ -0,0 +1,305 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include "atf-c/detail/cgroup.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atf-c.h>
+
+#include "atf-c/detail/test_helpers.h"
+
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+/** Looks for a writable cgroup v2 hierarchy, skipping the test if there is
+ * none. */
+static
+void
+find_cgroup2(char *path, const size_t size)
+{
+    FILE *f;
+    char line[1024];
+    bool found = false;
+
+    f = fopen("/proc/self/mountinfo", "r");
+    if (f == NULL)
+        atf_tc_skip("Cannot open /proc/self/mountinfo");
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        char mountpoint[512];
+
+        if (strstr(line, " - cgroup2 ") != NULL &&
+            sscanf(line, "%*s %*s %*s %*s %511s", mountpoint) == 1 &&
+            access(mountpoint, W_OK) == 0) {
+            snprintf(path, size, "%s", mountpoint);
+            found = true;
+        }
+    }
+    fclose(f);
+
+    if (!found)
+        atf_tc_skip("No writable cgroup v2 hierarchy");
+}
+
+static
+void
+check_limits_error(const char *memory, const char *cpu, const char *pids)
+{
+    atf_cgroup_limits_t limits;
+    atf_error_t err;
+
+    err = atf_cgroup_limits_parse(&limits, memory, cpu, pids);
+    ATF_REQUIRE(atf_is_error(err));
+    ATF_REQUIRE(atf_error_is(err, "libc"));
+    atf_error_free(err);
+}
+
+/* ---------------------------------------------------------------------
+ * Tests for the "atf_cgroup_limits" type.
+ * --------------------------------------------------------------------- */
+
+ATF_TC_WITHOUT_HEAD(limits_parse);
+ATF_TC_BODY(limits_parse, tc)
+{
+    atf_cgroup_limits_t limits;
+
+    RE(atf_cgroup_limits_parse(&limits, NULL, NULL, NULL));
+    ATF_REQUIRE(!atf_cgroup_limits_any(&limits));
+
+    RE(atf_cgroup_limits_parse(&limits, "1024", NULL, NULL));
+    ATF_REQUIRE(atf_cgroup_limits_any(&limits));
+    ATF_REQUIRE_EQ(1024, limits.m_memory_max);
+    ATF_REQUIRE_EQ(-1, limits.m_cpu_quota);
+    ATF_REQUIRE_EQ(-1, limits.m_pids_max);
+
+    RE(atf_cgroup_limits_parse(&limits, "64M", "0.5", "10"));
+    ATF_REQUIRE_EQ(64LL * 1024 * 1024, limits.m_memory_max);
+    ATF_REQUIRE_EQ(ATF_CGROUP_CPU_PERIOD / 2, limits.m_cpu_quota);
+    ATF_REQUIRE_EQ(10, limits.m_pids_max);
+
+    RE(atf_cgroup_limits_parse(&limits, "2g", "2", NULL));
+    ATF_REQUIRE_EQ(2LL * 1024 * 1024 * 1024, limits.m_memory_max);
+    ATF_REQUIRE_EQ(2 * ATF_CGROUP_CPU_PERIOD, limits.m_cpu_quota);
+
+    RE(atf_cgroup_limits_parse(&limits, "0", NULL, NULL));
+    ATF_REQUIRE(!atf_cgroup_limits_any(&limits));
+}
+
+ATF_TC_WITHOUT_HEAD(limits_parse_errors);
+ATF_TC_BODY(limits_parse_errors, tc)
+{
+    check_limits_error("", NULL, NULL);
+    check_limits_error("-1", NULL, NULL);
+    check_limits_error("12X", NULL, NULL);
+    check_limits_error("12KB", NULL, NULL);
+    check_limits_error("99999999999T", NULL, NULL);
+    check_limits_error(NULL, "", NULL);
+    check_limits_error(NULL, "foo", NULL);
+    check_limits_error(NULL, "0.001", NULL);
+    check_limits_error(NULL, "-1", NULL);
+    check_limits_error(NULL, NULL, "0");
+    check_limits_error(NULL, NULL, "10a");
+}
+
+/* ---------------------------------------------------------------------
+ * Tests for the "atf_cgroup_stats" type.
+ * --------------------------------------------------------------------- */
+
+ATF_TC_WITHOUT_HEAD(stats_format);
+ATF_TC_BODY(stats_format, tc)
+{
+    atf_cgroup_stats_t stats;
+    atf_dynstr_t str;
+
+    stats.m_memory_peak = 4096;
+    stats.m_oom_kills = 0;
+    stats.m_cpu_usage = 1500000;
+    stats.m_cpu_user = 250;
+    stats.m_cpu_system = 1499750;
+    stats.m_cpu_nr_throttled = -1;
+    stats.m_cpu_throttled = -1;
+    stats.m_io_rbytes = 1;
+    stats.m_io_wbytes = 2;
+    stats.m_io_rios = 3;
+    stats.m_io_wios = 4;
+
+    RE(atf_cgroup_stats_format(&stats, &str));
+    ATF_REQUIRE_STREQ(
+        "cgroup.memory.peak: 4096\n"
+        "cgroup.memory.oom_kills: 0\n"
+        "cgroup.cpu.usage: 1.500000\n"
+        "cgroup.cpu.user: 0.000250\n"
+        "cgroup.cpu.system: 1.499750\n"
+        "cgroup.io.rbytes: 1\n"
+        "cgroup.io.wbytes: 2\n"
+        "cgroup.io.rios: 3\n"
+        "cgroup.io.wios: 4\n", atf_dynstr_cstring(&str));
+    atf_dynstr_fini(&str);
+}
+
+/* ---------------------------------------------------------------------
+ * Tests for the "atf_cgroup" type.
+ * --------------------------------------------------------------------- */
+
+ATF_TC(fake_cgroup);
+ATF_TC_HEAD(fake_cgroup, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the handling of control files "
+                      "using a plain directory as the cgroup");
+}
+ATF_TC_BODY(fake_cgroup, tc)
+{
+    atf_cgroup_t cg;
+    atf_cgroup_limits_t limits;
+    atf_cgroup_stats_t stats;
+    atf_error_t err;
+    const char *const *file;
+    const char *const files[] = { "cgroup.procs", "io.stat", "memory.events",
+                                  "memory.max", "memory.peak", NULL };
+
+    ATF_REQUIRE(mkdir("root", 0755) != -1);
+    atf_utils_create_file("root/cgroup.controllers", "io memory\n");
+    atf_utils_create_file("root/cgroup.subtree_control", "io\n");
+
+    RE(atf_cgroup_init(&cg, "root", "leaf"));
+    ATF_REQUIRE_STREQ("root/leaf", atf_cgroup_path(&cg));
+    ATF_REQUIRE(atf_utils_compare_file("root/cgroup.subtree_control",
+                                       "+memory"));
+
+    atf_utils_create_file("root/leaf/memory.max", "max\n");
+    RE(atf_cgroup_limits_parse(&limits, "1M", NULL, NULL));
+    RE(atf_cgroup_set_limits(&cg, &limits));
+    ATF_REQUIRE(atf_utils_compare_file("root/leaf/memory.max", "1048576"));
+
+    RE(atf_cgroup_limits_parse(&limits, NULL, "1", NULL));
+    err = atf_cgroup_set_limits(&cg, &limits);
+    ATF_REQUIRE(atf_is_error(err));
+    {
+        char buf[1024];
+        atf_error_format(err, buf, sizeof(buf));
+        ATF_REQUIRE_MATCH("cpu controller is not available in root/leaf",
+                          buf);
+    }
+    atf_error_free(err);
+
+    atf_utils_create_file("root/leaf/cgroup.procs", "%s", "");
+    RE(atf_cgroup_attach(&cg, 1234));
+    ATF_REQUIRE(atf_utils_compare_file("root/leaf/cgroup.procs", "1234"));
+
+    atf_utils_create_file("root/leaf/memory.peak", "8192\n");
+    atf_utils_create_file("root/leaf/memory.events",
+                          "low 0\nhigh 0\nmax 3\noom 1\noom_kill 1\n");
+    atf_utils_create_file("root/leaf/io.stat",
+                          "8:0 rbytes=100 wbytes=200 rios=1 wios=2 dbytes=0 "
+                          "dios=0\n"
+                          "8:16 rbytes=10 wbytes=20 rios=3 wios=4 dbytes=0 "
+                          "dios=0\n");
+    RE(atf_cgroup_stats(&cg, &stats));
+    ATF_REQUIRE_EQ(8192, stats.m_memory_peak);
+    ATF_REQUIRE_EQ(1, stats.m_oom_kills);
+    ATF_REQUIRE_EQ(-1, stats.m_cpu_usage);
+    ATF_REQUIRE_EQ(110, stats.m_io_rbytes);
+    ATF_REQUIRE_EQ(220, stats.m_io_wbytes);
+    ATF_REQUIRE_EQ(4, stats.m_io_rios);
+    ATF_REQUIRE_EQ(6, stats.m_io_wios);
+
+    for (file = files; *file != NULL; file++) {
+        char path[64];
+        snprintf(path, sizeof(path), "root/leaf/%s", *file);
+        ATF_REQUIRE(unlink(path) != -1);
+    }
+    RE(atf_cgroup_destroy(&cg));
+    ATF_REQUIRE(access("root/leaf", F_OK) == -1);
+}
+
+ATF_TC(real_cgroup);
+ATF_TC_HEAD(real_cgroup, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests running a process in a cgroup and "
+                      "collecting its resource usage");
+}
+ATF_TC_BODY(real_cgroup, tc)
+{
+    atf_cgroup_t cg;
+    atf_cgroup_stats_t stats;
+    atf_error_t err;
+    char root[512], name[64];
+    pid_t pid;
+    int status;
+
+    find_cgroup2(root, sizeof(root));
+    snprintf(name, sizeof(name), "atf-cgroup-test-%ld", (long)getpid());
+    err = atf_cgroup_init(&cg, root, name);
+    if (atf_is_error(err)) {
+        char buf[1024];
+        atf_error_format(err, buf, sizeof(buf));
+        atf_error_free(err);
+        atf_tc_skip("Cannot create a cgroup: %s", buf);
+    }
+
+    pid = fork();
+    ATF_REQUIRE(pid != -1);
+    if (pid == 0) {
+        volatile unsigned long i;
+
+        if (atf_is_error(atf_cgroup_attach(&cg, getpid())))
+            exit(EXIT_FAILURE);
+        for (i = 0; i < 100000000; i++)
+            continue;
+        exit(EXIT_SUCCESS);
+    }
+    ATF_REQUIRE(waitpid(pid, &status, 0) != -1);
+    ATF_REQUIRE(WIFEXITED(status));
+    ATF_REQUIRE_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+
+    RE(atf_cgroup_stats(&cg, &stats));
+    ATF_REQUIRE(stats.m_cpu_usage > 0);
+    ATF_REQUIRE(stats.m_cpu_user > 0);
+
+    RE(atf_cgroup_destroy(&cg));
+}
+
+/* ---------------------------------------------------------------------
+ * Main.
+ * --------------------------------------------------------------------- */
+
+ATF_TP_ADD_TCS(tp)
+{
+    ATF_TP_ADD_TC(tp, limits_parse);
+    ATF_TP_ADD_TC(tp, limits_parse_errors);
+    ATF_TP_ADD_TC(tp, stats_format);
+    ATF_TP_ADD_TC(tp, fake_cgroup);
+    ATF_TP_ADD_TC(tp, real_cgroup);
+
+    return atf_no_error();
+}
@@ -32,7 +32,13 @@
 #include <sys/types.h>
 #include <sys/param.h>
 #include <sys/mount.h>
+#if defined(HAVE_SYS_SENDFILE_H)
+#include <sys/sendfile.h>
+#endif
 #include <sys/stat.h>
+#if HAVE_DECL_SYS_COPY_FILE_RANGE
+#include <sys/syscall.h>
+#endif
 #include <sys/wait.h>
 
 #include <dirent.h>
@@ -54,12 +60,46 @@
  * Prototypes for auxiliary functions.
  * --------------------------------------------------------------------- */
 
+/** A program found in the PATH by atf_fs_find_prog.
+ *
+ * The identity of the file is recorded so that the entry can be discarded
+ * if the program is replaced or removed. */
+struct prog_cache_entry {
+    struct prog_cache_entry *m_next;
+
+    char *m_name;
+    char *m_pathvar;
+    char *m_path;
+
+    dev_t m_dev;
+    ino_t m_ino;
+    time_t m_mtime;
+};
+
+struct find_prog_data {
+    const char *m_prog;
+    atf_fs_path_t *m_path;
+    struct stat m_sb;
+    bool m_found;
+};
+
+static struct prog_cache_entry *Prog_Cache = NULL;
+
 static bool check_umask(const mode_t, const mode_t);
 static atf_error_t copy_contents(const atf_fs_path_t *, char **);
+static atf_error_t copy_fd_buffered(const int, const int);
+static atf_error_t copy_fd_kernel(const int, const int, const bool, bool *);
 static mode_t current_umask(void);
 static atf_error_t do_mkdtemp(char *);
+static atf_error_t find_prog_in_dir(const char *, void *);
 static atf_error_t normalize(atf_dynstr_t *, char *);
 static atf_error_t normalize_ap(atf_dynstr_t *, const char *, va_list);
+static struct prog_cache_entry *prog_cache_find(const char *, const char *);
+static bool prog_cache_matches(const struct prog_cache_entry *,
+                               const struct stat *);
+static void prog_cache_store(struct prog_cache_entry *, const char *,
+                             const char *, const atf_fs_path_t *,
+                             const struct stat *);
 static void replace_contents(atf_fs_path_t *, const char *);
 static const char *stat_type_to_string(const int);
 
@@ -189,6 +229,87 @@ copy_contents(const atf_fs_path_t *p, char **buf)
     return err;
 }
 
+/** Copies the rest of a file through a buffer in user space. */
+static
+atf_error_t
+copy_fd_buffered(const int infd, const int outfd)
+{
+    char buf[128 * 1024];
+    ssize_t rlen;
+
+    while ((rlen = read(infd, buf, sizeof(buf))) != 0) {
+        const char *ptr;
+
+        if (rlen == -1) {
+            if (errno == EINTR)
+                continue;
+            return atf_libc_error(errno, "Failed to read file");
+        }
+
+        ptr = buf;
+        while (rlen > 0) {
+            const ssize_t wlen = write(outfd, ptr, rlen);
+            if (wlen == -1) {
+                if (errno == EINTR)
+                    continue;
+                return atf_libc_error(errno, "Failed to write file");
+            }
+            ptr += wlen;
+            rlen -= wlen;
+        }
+    }
+
+    return atf_no_error();
+}
+
+/** Copies the rest of a regular file without leaving the kernel.
+ *
+ * Uses copy_file_range if range is true, or sendfile otherwise.  done is
+ * set to false, without an error, if the call is not supported for the
+ * given descriptors; as both advance the file offsets, the caller can
+ * then carry on with another method from wherever this stopped. */
+static
+atf_error_t
+copy_fd_kernel(const int infd, const int outfd, const bool range, bool *done)
+{
+    const size_t chunk = 1024 * 1024 * 1024;
+    ssize_t len;
+
+    *done = false;
+    for (;;) {
+        if (range) {
+#if HAVE_DECL_SYS_COPY_FILE_RANGE
+            len = syscall(SYS_copy_file_range, infd, NULL, outfd, NULL,
+                          chunk, 0);
+#else
+            len = -1;
+            errno = ENOSYS;
+#endif
+        } else {
+#if defined(HAVE_SYS_SENDFILE_H)
+            len = sendfile(outfd, infd, NULL, chunk);
+#else
+            len = -1;
+            errno = ENOSYS;
+#endif
+        }
+
+        if (len == 0) {
+            *done = true;
+            break;
+        } else if (len == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOSYS || errno == EINVAL || errno == EXDEV ||
+                errno == EBADF || errno == EOPNOTSUPP || errno == EPERM)
+                break;
+            return atf_libc_error(errno, "Failed to copy file");
+        }
+    }
+
+    return atf_no_error();
+}
+
 static
 mode_t
 current_umask(void)
@@ -215,6 +336,35 @@ do_mkdtemp(char *tmpl)
     return err;
 }
 
+static
+atf_error_t
+find_prog_in_dir(const char *dir, void *v)
+{
+    struct find_prog_data *fpd = v;
+    atf_error_t err;
+
+    if (fpd->m_found)
+        return atf_no_error();
+
+    err = atf_fs_path_init_fmt(fpd->m_path, "%s/%s", dir, fpd->m_prog);
+    if (atf_is_error(err))
+        return err;
+
+    /* Like execvp, skip anything that cannot be executed. */
+    if (stat(atf_fs_path_cstring(fpd->m_path), &fpd->m_sb) != -1 &&
+        S_ISREG(fpd->m_sb.st_mode)) {
+        err = atf_fs_eaccess(fpd->m_path, atf_fs_access_x);
+        if (!atf_is_error(err)) {
+            fpd->m_found = true;
+            return err;
+        }
+        atf_error_free(err);
+    }
+    atf_fs_path_fini(fpd->m_path);
+
+    return atf_no_error();
+}
+
 static
 atf_error_t
 do_mkstemp(char *tmpl, int *fdout)
@@ -292,6 +442,70 @@ out:
     return err;
 }
 
+static
+struct prog_cache_entry *
+prog_cache_find(const char *name, const char *pathvar)
+{
+    struct prog_cache_entry *e;
+
+    for (e = Prog_Cache; e != NULL; e = e->m_next) {
+        if (strcmp(e->m_name, name) == 0 &&
+            strcmp(e->m_pathvar, pathvar) == 0)
+            break;
+    }
+    return e;
+}
+
+static
+bool
+prog_cache_matches(const struct prog_cache_entry *e, const struct stat *sb)
+{
+    return e->m_dev == sb->st_dev && e->m_ino == sb->st_ino &&
+           e->m_mtime == sb->st_mtime;
+}
+
+/** Records where a program was found, updating e if it is not NULL.
+ *
+ * The cache is only an optimization, so running out of memory here just
+ * leaves the program out of it. */
+static
+void
+prog_cache_store(struct prog_cache_entry *e, const char *name,
+                 const char *pathvar, const atf_fs_path_t *path,
+                 const struct stat *sb)
+{
+    char *pathcopy;
+
+    pathcopy = strdup(atf_fs_path_cstring(path));
+    if (pathcopy == NULL)
+        return;
+
+    if (e == NULL) {
+        e = malloc(sizeof(*e));
+        if (e == NULL) {
+            free(pathcopy);
+            return;
+        }
+        e->m_name = strdup(name);
+        e->m_pathvar = strdup(pathvar);
+        if (e->m_name == NULL || e->m_pathvar == NULL) {
+            free(e->m_pathvar);
+            free(e->m_name);
+            free(e);
+            free(pathcopy);
+            return;
+        }
+        e->m_next = Prog_Cache;
+        Prog_Cache = e;
+    } else
+        free(e->m_path);
+
+    e->m_path = pathcopy;
+    e->m_dev = sb->st_dev;
+    e->m_ino = sb->st_ino;
+    e->m_mtime = sb->st_mtime;
+}
+
 static
 void
 replace_contents(atf_fs_path_t *p, const char *buf)
@@ -748,6 +962,38 @@ out:
     return err;
 }
 
+/** Copies the rest of a file to another file descriptor.
+ *
+ * Data is read from the current offset of infd to its end, and written
+ * at the current offset of outfd.  When the input is a regular file, the
+ * data is moved by the kernel, with copy_file_range if the output is a
+ * regular file too and with sendfile otherwise, so that it never goes
+ * through user space.  Anything else, or systems without these calls,
+ * fall back to a large intermediate buffer. */
+atf_error_t
+atf_fs_copy_fd(const int infd, const int outfd)
+{
+    atf_error_t err;
+    struct stat insb, outsb;
+    bool done;
+
+    if (fstat(infd, &insb) == -1)
+        return atf_libc_error(errno, "Cannot stat file");
+
+    done = false;
+    err = atf_no_error();
+    if (S_ISREG(insb.st_mode)) {
+        if (fstat(outfd, &outsb) != -1 && S_ISREG(outsb.st_mode))
+            err = copy_fd_kernel(infd, outfd, true, &done);
+        if (!atf_is_error(err) && !done)
+            err = copy_fd_kernel(infd, outfd, false, &done);
+    }
+    if (!atf_is_error(err) && !done)
+        err = copy_fd_buffered(infd, outfd);
+
+    return err;
+}
+
 atf_error_t
 atf_fs_exists(const atf_fs_path_t *p, bool *b)
 {
@@ -766,6 +1012,60 @@ atf_fs_exists(const atf_fs_path_t *p, bool *b)
     return err;
 }
 
+/** Looks for a program in the PATH, as execvp would.
+ *
+ * found is set to false, and path left uninitialized, if there is no
+ * executable file with the given name in any of the directories in the
+ * PATH.  Programs found in absolute directories are cached for the
+ * lifetime of the process, keyed by their name and the value of the PATH,
+ * so that running the same program many times does not walk the PATH
+ * again; an entry is only used while the file it points to keeps its
+ * inode and modification time.  As with the command hashing of shells, a
+ * program that is later created in an earlier directory of the PATH goes
+ * unnoticed until the cached one changes. */
+atf_error_t
+atf_fs_find_prog(const char *prog, atf_fs_path_t *path, bool *found)
+{
+    atf_error_t err;
+    struct prog_cache_entry *e;
+    struct find_prog_data fpd;
+    const char *pathvar;
+
+    PRE(strchr(prog, '/') == NULL);
+
+    *found = false;
+    pathvar = getenv("PATH");
+    if (pathvar == NULL)
+        return atf_no_error();
+
+    e = prog_cache_find(prog, pathvar);
+    if (e != NULL) {
+        struct stat sb;
+
+        if (stat(e->m_path, &sb) != -1 && prog_cache_matches(e, &sb)) {
+            err = atf_fs_path_init_fmt(path, "%s", e->m_path);
+            *found = !atf_is_error(err);
+            return err;
+        }
+    }
+
+    fpd.m_prog = prog;
+    fpd.m_path = path;
+    fpd.m_found = false;
+    err = atf_text_for_each_word(pathvar, ":", find_prog_in_dir, &fpd);
+    if (atf_is_error(err)) {
+        if (fpd.m_found)
+            atf_fs_path_fini(path);
+        return err;
+    }
+
+    *found = fpd.m_found;
+    if (fpd.m_found && atf_fs_path_is_absolute(path))
+        prog_cache_store(e, prog, pathvar, path, &fpd.m_sb);
+
+    return atf_no_error();
+}
+
 atf_error_t
 atf_fs_getcwd(atf_fs_path_t *p)
 {
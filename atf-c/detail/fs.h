@@ -117,8 +117,10 @@ extern const int atf_fs_access_r;
 extern const int atf_fs_access_w;
 extern const int atf_fs_access_x;
 
+atf_error_t atf_fs_copy_fd(const int, const int);
 atf_error_t atf_fs_eaccess(const atf_fs_path_t *, int);
 atf_error_t atf_fs_exists(const atf_fs_path_t *, bool *);
+atf_error_t atf_fs_find_prog(const char *, atf_fs_path_t *, bool *);
 atf_error_t atf_fs_getcwd(atf_fs_path_t *);
 atf_error_t atf_fs_mkdtemp(atf_fs_path_t *);
 atf_error_t atf_fs_mkstemp(atf_fs_path_t *, int *);
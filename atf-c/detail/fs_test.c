@@ -37,6 +37,7 @@
 
 #include <atf-c.h>
 
+#include "atf-c/detail/env.h"
 #include "atf-c/detail/test_helpers.h"
 #include "atf-c/detail/user.h"
 
@@ -558,6 +559,95 @@ ATF_TC_BODY(stat_perms, tc)
  * Test cases for the free functions.
  * --------------------------------------------------------------------- */
 
+static
+void
+fill_pattern(char *buf, const size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        buf[i] = 'a' + (i * 7) % 26;
+}
+
+static
+void
+read_all(const int fd, char *buf, const size_t len)
+{
+    size_t done;
+    ssize_t ret;
+
+    for (done = 0; done < len; done += ret) {
+        ret = read(fd, buf + done, len - done);
+        ATF_REQUIRE(ret > 0);
+    }
+    ATF_REQUIRE_EQ(0, read(fd, buf, 1));
+}
+
+ATF_TC(copy_fd_file);
+ATF_TC_HEAD(copy_fd_file, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the atf_fs_copy_fd function "
+                      "between regular files, starting at their current "
+                      "offsets");
+}
+ATF_TC_BODY(copy_fd_file, tc)
+{
+    static char data[300 * 1024], copy[sizeof(data) - 10 + 4];
+    int infd, outfd;
+
+    fill_pattern(data, sizeof(data));
+    infd = open("in", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ATF_REQUIRE(infd != -1);
+    ATF_REQUIRE_EQ(sizeof(data), write(infd, data, sizeof(data)));
+    ATF_REQUIRE_EQ(10, lseek(infd, 10, SEEK_SET));
+
+    outfd = open("out", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ATF_REQUIRE(outfd != -1);
+    ATF_REQUIRE_EQ(4, write(outfd, "head", 4));
+
+    RE(atf_fs_copy_fd(infd, outfd));
+    close(infd);
+
+    ATF_REQUIRE_EQ(0, lseek(outfd, 0, SEEK_SET));
+    read_all(outfd, copy, sizeof(copy));
+    close(outfd);
+    ATF_REQUIRE(memcmp(copy, "head", 4) == 0);
+    ATF_REQUIRE(memcmp(copy + 4, data + 10, sizeof(data) - 10) == 0);
+}
+
+ATF_TC(copy_fd_pipe);
+ATF_TC_HEAD(copy_fd_pipe, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the atf_fs_copy_fd function "
+                      "from a regular file to a pipe and back");
+}
+ATF_TC_BODY(copy_fd_pipe, tc)
+{
+    /* Small enough to fit in the buffer of a pipe. */
+    char data[4000], copy[sizeof(data)];
+    int fd, fds[2];
+
+    fill_pattern(data, sizeof(data));
+    atf_utils_create_file("in", "%.*s", (int)sizeof(data), data);
+    ATF_REQUIRE(pipe(fds) != -1);
+
+    fd = open("in", O_RDONLY);
+    ATF_REQUIRE(fd != -1);
+    RE(atf_fs_copy_fd(fd, fds[1]));
+    close(fd);
+    close(fds[1]);
+
+    fd = open("out", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ATF_REQUIRE(fd != -1);
+    RE(atf_fs_copy_fd(fds[0], fd));
+    close(fds[0]);
+
+    ATF_REQUIRE_EQ(0, lseek(fd, 0, SEEK_SET));
+    read_all(fd, copy, sizeof(copy));
+    close(fd);
+    ATF_REQUIRE(memcmp(copy, data, sizeof(data)) == 0);
+}
+
 ATF_TC(exists);
 ATF_TC_HEAD(exists, tc)
 {
@@ -712,6 +802,75 @@ ATF_TC_BODY(eaccess, tc)
     atf_fs_path_fini(&p);
 }
 
+static
+void
+check_find_prog(const char *prog, const char *exp)
+{
+    atf_fs_path_t p;
+    bool found;
+
+    RE(atf_fs_find_prog(prog, &p, &found));
+    if (exp == NULL)
+        ATF_REQUIRE(!found);
+    else {
+        ATF_REQUIRE(found);
+        ATF_REQUIRE_STREQ(exp, atf_fs_path_cstring(&p));
+        atf_fs_path_fini(&p);
+    }
+}
+
+ATF_TC(find_prog);
+ATF_TC_HEAD(find_prog, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the atf_fs_find_prog function");
+}
+ATF_TC_BODY(find_prog, tc)
+{
+    atf_fs_path_t cwd;
+    char dir1[1024], dir2[1024], prog1[1100], prog2[1100], path[2100];
+
+    RE(atf_fs_getcwd(&cwd));
+    snprintf(dir1, sizeof(dir1), "%s/dir1", atf_fs_path_cstring(&cwd));
+    snprintf(dir2, sizeof(dir2), "%s/dir2", atf_fs_path_cstring(&cwd));
+    snprintf(prog1, sizeof(prog1), "%s/prog", dir1);
+    snprintf(prog2, sizeof(prog2), "%s/prog", dir2);
+    atf_fs_path_fini(&cwd);
+
+    create_dir("dir1", 0755);
+    create_dir("dir2", 0755);
+    snprintf(path, sizeof(path), "%s:%s", dir1, dir2);
+    RE(atf_env_set("PATH", path));
+
+    check_find_prog("prog", NULL);
+
+    printf("Skipping directories and files that are not executable\n");
+    create_dir("dir1/prog", 0755);
+    create_file("dir2/prog", 0644);
+    check_find_prog("prog", NULL);
+    ATF_REQUIRE(chmod("dir2/prog", 0755) != -1);
+    check_find_prog("prog", prog2);
+
+    printf("Using the cached location while the file is unchanged\n");
+    ATF_REQUIRE(chmod("dir2/prog", 0644) != -1);
+    ATF_REQUIRE(rmdir("dir1/prog") != -1);
+    create_file("dir1/prog", 0755);
+    check_find_prog("prog", prog2);
+
+    printf("Discarding the cached location once the file changes\n");
+    ATF_REQUIRE(unlink("dir2/prog") != -1);
+    check_find_prog("prog", prog1);
+    ATF_REQUIRE(unlink("dir1/prog") != -1);
+    check_find_prog("prog", NULL);
+
+    printf("Keying the cache by the value of the PATH\n");
+    create_file("dir2/prog", 0755);
+    RE(atf_env_set("PATH", dir2));
+    check_find_prog("prog", prog2);
+    create_file("dir1/prog", 0755);
+    RE(atf_env_set("PATH", dir1));
+    check_find_prog("prog", prog1);
+}
+
 ATF_TC(getcwd);
 ATF_TC_HEAD(getcwd, tc)
 {
@@ -1069,8 +1228,11 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, stat_perms);
 
     /* Add the tests for the free functions. */
+    ATF_TP_ADD_TC(tp, copy_fd_file);
+    ATF_TP_ADD_TC(tp, copy_fd_pipe);
     ATF_TP_ADD_TC(tp, eaccess);
     ATF_TP_ADD_TC(tp, exists);
+    ATF_TP_ADD_TC(tp, find_prog);
     ATF_TP_ADD_TC(tp, getcwd);
     ATF_TP_ADD_TC(tp, rmdir_empty);
     ATF_TP_ADD_TC(tp, rmdir_enotempty);
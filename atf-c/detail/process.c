@@ -25,18 +25,36 @@
 
 #include "atf-c/detail/process.h"
 
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
 #include <sys/types.h>
+#if HAVE_DECL_PR_SET_CHILD_SUBREAPER
+#include <sys/prctl.h>
+#endif
+#if HAVE_DECL_SYS_PIDFD_OPEN || HAVE_DECL_SYS_MEMFD_CREATE
+#include <sys/syscall.h>
+#endif
 #include <sys/wait.h>
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#if defined(HAVE_POSIX_SPAWNP)
+#include <spawn.h>
+#endif
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "atf-c/defs.h"
+#include "atf-c/detail/env.h"
 #include "atf-c/detail/sanity.h"
 #include "atf-c/error.h"
 
@@ -44,6 +62,103 @@
  * function; however, we need to access it during testing. */
 atf_error_t atf_process_status_init(atf_process_status_t *, int);
 
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+/* Upper bound for the interval between checks for the termination of a
+ * child when the system cannot notify about it through a descriptor. */
+#define MAX_POLL_DELAY_MS 50
+
+static
+long long
+now_ms(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+        UNREACHABLE;
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/** Computes the deadline for a timeout in milliseconds.
+ *
+ * A negative timeout means no timeout at all, which is represented by a
+ * negative deadline. */
+static
+long long
+deadline_ms(const int timeout)
+{
+    return timeout < 0 ? -1 : now_ms() + timeout;
+}
+
+/** Computes the time left until a deadline in the format of poll(2). */
+static
+int
+remaining_ms(const long long deadline)
+{
+    long long remaining;
+
+    if (deadline < 0)
+        return -1;
+    remaining = deadline - now_ms();
+    return remaining < 0 ? 0 : (int)remaining;
+}
+
+/** Computes how long to sleep before checking again for the termination of
+ * a child, doubling the delay of the next check. */
+static
+int
+next_delay_ms(const int remaining, int *delay)
+{
+    const int current = *delay;
+
+    if (*delay < MAX_POLL_DELAY_MS)
+        *delay *= 2;
+    return (remaining >= 0 && remaining < current) ? remaining : current;
+}
+
+static
+bool
+write_all(const int fd, const void *data, size_t n)
+{
+    const char *ptr = data;
+
+    while (n > 0) {
+        const ssize_t ret = write(fd, ptr, n);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        ptr += ret;
+        n -= ret;
+    }
+    return true;
+}
+
+/** Creates a descriptor from which the given data can be read. */
+static
+atf_error_t
+create_data_fd(const void *data, const size_t length, int *fd)
+{
+    atf_error_t err;
+
+    err = atf_process_create_anon_fd("atf-stdin", fd);
+    if (atf_is_error(err))
+        goto out;
+
+    if (!write_all(*fd, data, length) || lseek(*fd, 0, SEEK_SET) == -1) {
+        err = atf_libc_error(errno, "Failed to store input data");
+        close(*fd);
+        goto out;
+    }
+
+    INV(!atf_is_error(err));
+out:
+    return err;
+}
+
 /* ---------------------------------------------------------------------
  * The "stream_prepare" auxiliary type.
  * --------------------------------------------------------------------- */
@@ -53,6 +168,9 @@ struct stream_prepare {
 
     bool m_pipefds_ok;
     int m_pipefds[2];
+
+    /* Valid if the stream is of the inline type. */
+    int m_datafd;
 };
 typedef struct stream_prepare stream_prepare_t;
 
@@ -66,15 +184,19 @@ stream_prepare_init(stream_prepare_t *sp, const atf_process_stream_t *sb)
 
     sp->m_sb = sb;
     sp->m_pipefds_ok = false;
+    sp->m_datafd = -1;
 
-    if (type == atf_process_stream_type_capture) {
+    if (type == atf_process_stream_type_capture ||
+        type == atf_process_stream_type_ring) {
         if (pipe(sp->m_pipefds) == -1)
             err = atf_libc_error(errno, "Failed to create pipe");
         else {
             err = atf_no_error();
             sp->m_pipefds_ok = true;
         }
-    } else
+    } else if (type == atf_process_stream_type_inline)
+        err = create_data_fd(sb->m_data, sb->m_length, &sp->m_datafd);
+    else
         err = atf_no_error();
 
     return err;
@@ -88,6 +210,8 @@ stream_prepare_fini(stream_prepare_t *sp)
         close(sp->m_pipefds[0]);
         close(sp->m_pipefds[1]);
     }
+    if (sp->m_datafd != -1)
+        close(sp->m_datafd);
 }
 
 /* ---------------------------------------------------------------------
@@ -99,6 +223,8 @@ const int atf_process_stream_type_connect = 2;
 const int atf_process_stream_type_inherit = 3;
 const int atf_process_stream_type_redirect_fd = 4;
 const int atf_process_stream_type_redirect_path = 5;
+const int atf_process_stream_type_ring = 6;
+const int atf_process_stream_type_inline = 7;
 
 static
 bool
@@ -108,7 +234,9 @@ stream_is_valid(const atf_process_stream_t *sb)
            (sb->m_type == atf_process_stream_type_connect) ||
            (sb->m_type == atf_process_stream_type_inherit) ||
            (sb->m_type == atf_process_stream_type_redirect_fd) ||
-           (sb->m_type == atf_process_stream_type_redirect_path);
+           (sb->m_type == atf_process_stream_type_redirect_path) ||
+           (sb->m_type == atf_process_stream_type_ring) ||
+           (sb->m_type == atf_process_stream_type_inline);
 }
 
 atf_error_t
@@ -136,6 +264,22 @@ atf_process_stream_init_connect(atf_process_stream_t *sb,
     return atf_no_error();
 }
 
+/** Initializes an input stream that provides the given data.
+ *
+ * The data is copied when the child is started, so it only has to remain
+ * valid until then, and the child may read it at its own pace. */
+atf_error_t
+atf_process_stream_init_inline(atf_process_stream_t *sb, const void *data,
+                               const size_t length)
+{
+    sb->m_type = atf_process_stream_type_inline;
+    sb->m_data = data;
+    sb->m_length = length;
+
+    POST(stream_is_valid(sb));
+    return atf_no_error();
+}
+
 atf_error_t
 atf_process_stream_init_inherit(atf_process_stream_t *sb)
 {
@@ -167,6 +311,26 @@ atf_process_stream_init_redirect_path(atf_process_stream_t *sb,
     return atf_no_error();
 }
 
+/** Initializes a stream that keeps the last size bytes of the output.
+ *
+ * The output is read as soon as it is produced, so the child never blocks
+ * on a full pipe regardless of what the caller does, and only the most
+ * recent size bytes are retained for atf_process_child_drain.  If tee_fd
+ * is not -1, all the output is also copied to it as it arrives. */
+atf_error_t
+atf_process_stream_init_ring(atf_process_stream_t *sb, const size_t size,
+                             const int tee_fd)
+{
+    PRE(size > 0);
+
+    sb->m_type = atf_process_stream_type_ring;
+    sb->m_ring_size = size;
+    sb->m_tee_fd = tee_fd;
+
+    POST(stream_is_valid(sb));
+    return atf_no_error();
+}
+
 void
 atf_process_stream_fini(atf_process_stream_t *sb)
 {
@@ -216,90 +380,1167 @@ atf_process_status_exitstatus(const atf_process_status_t *s)
 bool
 atf_process_status_signaled(const atf_process_status_t *s)
 {
-    int mutable_status = s->m_status;
-    return WIFSIGNALED(mutable_status);
+    int mutable_status = s->m_status;
+    return WIFSIGNALED(mutable_status);
+}
+
+int
+atf_process_status_termsig(const atf_process_status_t *s)
+{
+    PRE(atf_process_status_signaled(s));
+    int mutable_status = s->m_status;
+    return WTERMSIG(mutable_status);
+}
+
+bool
+atf_process_status_coredump(const atf_process_status_t *s)
+{
+    PRE(atf_process_status_signaled(s));
+#if defined(WCOREDUMP)
+    int mutable_status = s->m_status;
+    return WCOREDUMP(mutable_status);
+#else
+    return false;
+#endif
+}
+
+/* ---------------------------------------------------------------------
+ * The "atf_process_ring" type.
+ * --------------------------------------------------------------------- */
+
+atf_error_t
+atf_process_ring_init(atf_process_ring_t *r)
+{
+    r->m_data = malloc(1);
+    if (r->m_data == NULL)
+        return atf_no_memory_error();
+    r->m_data[0] = '\0';
+    r->m_length = 0;
+    r->m_dropped = 0;
+
+    return atf_no_error();
+}
+
+void
+atf_process_ring_fini(atf_process_ring_t *r)
+{
+    free(r->m_data);
+}
+
+/** Returns the retained output, which is followed by a nul character. */
+const char *
+atf_process_ring_data(const atf_process_ring_t *r, size_t *length)
+{
+    *length = r->m_length;
+    return r->m_data;
+}
+
+/** Returns the number of bytes of output that were not retained. */
+unsigned long long
+atf_process_ring_dropped(const atf_process_ring_t *r)
+{
+    return r->m_dropped;
+}
+
+bool
+atf_process_ring_truncated(const atf_process_ring_t *r)
+{
+    return r->m_dropped > 0;
+}
+
+/* ---------------------------------------------------------------------
+ * The drainer of ring streams.
+ * --------------------------------------------------------------------- */
+
+/*
+ * The output of a child through ring streams is read by a helper process,
+ * the drainer, as soon as it is produced.  This keeps the child from
+ * blocking on a full pipe while the caller is busy doing something else,
+ * without making the caller multithreaded.  The drainer retains the most
+ * recent bytes of each stream in a ring buffer, copies everything it
+ * reads to the tee descriptor if any, and hands the retained data back
+ * through a pipe once the child has closed both of its streams.  For each
+ * of stdout and stderr, in this order, the pipe carries the number of
+ * dropped bytes and the number of retained bytes, as unsigned long longs,
+ * followed by the retained bytes.
+ */
+
+struct ring_buffer {
+    char *m_buf;
+    size_t m_size;
+    size_t m_start;
+    size_t m_length;
+    unsigned long long m_dropped;
+};
+
+static
+void
+ring_buffer_append(struct ring_buffer *rb, const char *data, const size_t n)
+{
+    size_t end, first;
+
+    if (n >= rb->m_size) {
+        rb->m_dropped += rb->m_length + (n - rb->m_size);
+        memcpy(rb->m_buf, data + (n - rb->m_size), rb->m_size);
+        rb->m_start = 0;
+        rb->m_length = rb->m_size;
+        return;
+    }
+
+    if (rb->m_length + n > rb->m_size) {
+        const size_t excess = rb->m_length + n - rb->m_size;
+
+        rb->m_start = (rb->m_start + excess) % rb->m_size;
+        rb->m_length -= excess;
+        rb->m_dropped += excess;
+    }
+
+    end = (rb->m_start + rb->m_length) % rb->m_size;
+    first = rb->m_size - end < n ? rb->m_size - end : n;
+    memcpy(rb->m_buf + end, data, first);
+    memcpy(rb->m_buf, data + first, n - first);
+    rb->m_length += n;
+}
+
+static
+atf_error_t
+read_all(const int fd, void *data, size_t n)
+{
+    char *ptr = data;
+
+    while (n > 0) {
+        const ssize_t ret = read(fd, ptr, n);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            return atf_libc_error(errno, "Failed to read from drainer");
+        } else if (ret == 0)
+            return atf_libc_error(EPIPE, "Drainer terminated unexpectedly");
+        ptr += ret;
+        n -= ret;
+    }
+    return atf_no_error();
+}
+
+struct drainer_stream {
+    int m_fd;
+    int m_tee_fd;
+    struct ring_buffer m_ring;
+};
+
+static
+void
+drainer_stream_init(struct drainer_stream *ds, const atf_process_stream_t *sb,
+                    const int fd)
+{
+    ds->m_ring.m_buf = NULL;
+    ds->m_ring.m_size = 0;
+    ds->m_ring.m_start = 0;
+    ds->m_ring.m_length = 0;
+    ds->m_ring.m_dropped = 0;
+
+    if (atf_process_stream_type(sb) == atf_process_stream_type_ring) {
+        ds->m_fd = fd;
+        ds->m_tee_fd = sb->m_tee_fd;
+        ds->m_ring.m_size = sb->m_ring_size;
+    } else {
+        ds->m_fd = -1;
+        ds->m_tee_fd = -1;
+    }
+}
+
+static
+bool
+drainer_stream_send(const struct drainer_stream *ds, const int fd)
+{
+    const struct ring_buffer *rb = &ds->m_ring;
+    const unsigned long long header[2] = { rb->m_dropped, rb->m_length };
+    const size_t first = rb->m_size - rb->m_start < rb->m_length ?
+        rb->m_size - rb->m_start : rb->m_length;
+
+    return write_all(fd, header, sizeof(header)) &&
+           write_all(fd, rb->m_buf + rb->m_start, first) &&
+           write_all(fd, rb->m_buf, rb->m_length - first);
+}
+
+static void drainer_main(struct drainer_stream *, const int)
+    ATF_DEFS_ATTRIBUTE_NORETURN;
+
+/** Body of the drainer process.
+ *
+ * This runs in a forked copy of the caller, so it leaves through _exit to
+ * avoid flushing the stdio buffers of the caller a second time. */
+static
+void
+drainer_main(struct drainer_stream *streams, const int resultfd)
+{
+    char buf[65536];
+    size_t i;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (i = 0; i < 2; i++) {
+        if (streams[i].m_ring.m_size > 0) {
+            streams[i].m_ring.m_buf = malloc(streams[i].m_ring.m_size);
+            if (streams[i].m_ring.m_buf == NULL)
+                _exit(EXIT_FAILURE);
+        }
+    }
+
+    while (streams[0].m_fd != -1 || streams[1].m_fd != -1) {
+        struct pollfd pfds[2];
+
+        for (i = 0; i < 2; i++) {
+            pfds[i].fd = streams[i].m_fd;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            _exit(EXIT_FAILURE);
+        }
+
+        for (i = 0; i < 2; i++) {
+            struct drainer_stream *ds = &streams[i];
+            ssize_t n;
+
+            if (pfds[i].revents == 0)
+                continue;
+
+            n = read(ds->m_fd, buf, sizeof(buf));
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                close(ds->m_fd);
+                ds->m_fd = -1;
+                continue;
+            }
+
+            if (ds->m_tee_fd != -1 && !write_all(ds->m_tee_fd, buf, n))
+                ds->m_tee_fd = -1;
+            ring_buffer_append(&ds->m_ring, buf, n);
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (!drainer_stream_send(&streams[i], resultfd))
+            _exit(EXIT_FAILURE);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/** Hands the ring streams of a child over to a new drainer process. */
+static
+atf_error_t
+start_drainer(atf_process_child_t *c, const atf_process_stream_t *outsb,
+              const atf_process_stream_t *errsb)
+{
+    atf_error_t err;
+    struct drainer_stream streams[2];
+    int fds[2];
+    pid_t pid;
+
+    drainer_stream_init(&streams[0], outsb, c->m_stdout);
+    drainer_stream_init(&streams[1], errsb, c->m_stderr);
+
+    if (pipe(fds) == -1) {
+        err = atf_libc_error(errno, "Failed to create pipe");
+        goto out;
+    }
+
+    pid = fork();
+    if (pid == -1) {
+        err = atf_libc_error(errno, "Failed to fork");
+        close(fds[0]);
+        close(fds[1]);
+        goto out;
+    } else if (pid == 0) {
+        close(fds[0]);
+        drainer_main(streams, fds[1]);
+        UNREACHABLE;
+    }
+
+    close(fds[1]);
+    c->m_drainer_pid = pid;
+    c->m_drainer_fd = fds[0];
+
+    /* The drainer owns the read ends of the ring streams from now on. */
+    if (streams[0].m_fd != -1) {
+        close(c->m_stdout);
+        c->m_stdout = -1;
+    }
+    if (streams[1].m_fd != -1) {
+        close(c->m_stderr);
+        c->m_stderr = -1;
+    }
+    err = atf_no_error();
+
+out:
+    return err;
+}
+
+/** Reads the data of one stream sent by the drainer.
+ *
+ * If r is NULL, the data is read and discarded. */
+static
+atf_error_t
+receive_ring(const int fd, atf_process_ring_t *r)
+{
+    atf_error_t err;
+    unsigned long long header[2];
+    char *data;
+
+    err = read_all(fd, header, sizeof(header));
+    if (atf_is_error(err))
+        goto out;
+
+    data = malloc(header[1] + 1);
+    if (data == NULL) {
+        err = atf_no_memory_error();
+        goto out;
+    }
+
+    err = read_all(fd, data, header[1]);
+    if (atf_is_error(err)) {
+        free(data);
+        goto out;
+    }
+    data[header[1]] = '\0';
+
+    if (r == NULL)
+        free(data);
+    else {
+        free(r->m_data);
+        r->m_data = data;
+        r->m_length = header[1];
+        r->m_dropped = header[0];
+    }
+
+out:
+    return err;
+}
+
+/* ---------------------------------------------------------------------
+ * The "atf_process_child" type.
+ * --------------------------------------------------------------------- */
+
+static
+atf_error_t
+atf_process_child_init(atf_process_child_t *c)
+{
+    c->m_pid = 0;
+    c->m_pidfd = -1;
+    c->m_stdin = -1;
+    c->m_stdout = -1;
+    c->m_stderr = -1;
+    c->m_drainer_pid = 0;
+    c->m_drainer_fd = -1;
+
+    return atf_no_error();
+}
+
+/** Releases the descriptors of a child once it has been reaped.
+ *
+ * The drainer, if any, is left alone so that the output of the child can
+ * still be collected after waiting for it. */
+static
+void
+release_child(atf_process_child_t *c)
+{
+    if (c->m_pidfd != -1) {
+        close(c->m_pidfd);
+        c->m_pidfd = -1;
+    }
+    if (c->m_stdin != -1) {
+        close(c->m_stdin);
+        c->m_stdin = -1;
+    }
+    if (c->m_stdout != -1) {
+        close(c->m_stdout);
+        c->m_stdout = -1;
+    }
+    if (c->m_stderr != -1) {
+        close(c->m_stderr);
+        c->m_stderr = -1;
+    }
+}
+
+/** Releases all the resources held by a child that has been waited for.
+ *
+ * If the output of the ring streams of the child was never collected with
+ * atf_process_child_drain, the drainer is terminated and its output is
+ * discarded. */
+void
+atf_process_child_fini(atf_process_child_t *c)
+{
+    release_child(c);
+
+    if (c->m_drainer_pid != 0) {
+        int status;
+
+        close(c->m_drainer_fd);
+        c->m_drainer_fd = -1;
+        (void)kill(c->m_drainer_pid, SIGKILL);
+        (void)waitpid(c->m_drainer_pid, &status, 0);
+        c->m_drainer_pid = 0;
+    }
+}
+
+/** Opens a descriptor that becomes readable when the child terminates.
+ *
+ * Returns -1 if the system does not support process descriptors, in which
+ * case the functions below fall back to checking the child periodically. */
+static
+int
+open_pidfd(const pid_t pid)
+{
+#if HAVE_DECL_SYS_PIDFD_OPEN
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+/** Reaps the child if it has already terminated, without blocking. */
+static
+atf_error_t
+try_reap(const atf_process_child_t *c, bool *done, int *status)
+{
+    atf_error_t err;
+    pid_t pid;
+
+    pid = waitpid(c->m_pid, status, WNOHANG);
+    if (pid == -1)
+        err = atf_libc_error(errno, "Failed waiting for process %d",
+                             c->m_pid);
+    else {
+        *done = pid != 0;
+        err = atf_no_error();
+    }
+
+    return err;
+}
+
+static
+void
+sleep_ms(const int ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    (void)nanosleep(&ts, NULL);
+}
+
+atf_error_t
+atf_process_child_wait(atf_process_child_t *c, atf_process_status_t *s)
+{
+    atf_error_t err;
+    int status;
+
+    if (waitpid(c->m_pid, &status, 0) == -1)
+        err = atf_libc_error(errno, "Failed waiting for process %d",
+                             c->m_pid);
+    else {
+        release_child(c);
+        err = atf_process_status_init(s, status);
+    }
+
+    return err;
+}
+
+/** Waits for the termination of any of the given children.
+ *
+ * Entries in the children array may be NULL, in which case they are
+ * ignored.  On success, index is set to the position in the array of the
+ * child that terminated.  Only the given children are reaped: when they
+ * all have process descriptors, this sleeps until one of them becomes
+ * readable, and otherwise it checks them periodically. */
+atf_error_t
+atf_process_child_wait_any(atf_process_child_t *const *children,
+                           const size_t nchildren, size_t *index,
+                           atf_process_status_t *s)
+{
+    atf_error_t err;
+    struct pollfd *pfds;
+    bool done, pollable;
+    int delay = 1;
+    int status;
+    size_t i, npfds;
+
+    PRE(nchildren > 0);
+
+    pfds = malloc(sizeof(*pfds) * nchildren);
+    if (pfds == NULL)
+        return atf_no_memory_error();
+
+    for (;;) {
+        done = false;
+        pollable = true;
+        npfds = 0;
+        for (i = 0; i < nchildren; i++) {
+            if (children[i] == NULL)
+                continue;
+
+            err = try_reap(children[i], &done, &status);
+            if (atf_is_error(err) || done)
+                break;
+
+            if (children[i]->m_pidfd == -1)
+                pollable = false;
+            else {
+                pfds[npfds].fd = children[i]->m_pidfd;
+                pfds[npfds].events = POLLIN;
+                pfds[npfds].revents = 0;
+                npfds++;
+            }
+        }
+        if (i < nchildren)
+            break;
+        INV(npfds > 0 || !pollable);
+
+        if (pollable) {
+            if (poll(pfds, npfds, -1) == -1) {
+                err = atf_libc_error(errno, "Failed waiting for any "
+                                     "process");
+                goto out;
+            }
+        } else
+            sleep_ms(next_delay_ms(-1, &delay));
+    }
+
+    if (!atf_is_error(err)) {
+        release_child(children[i]);
+        *index = i;
+        err = atf_process_status_init(s, status);
+    }
+
+out:
+    free(pfds);
+    return err;
+}
+
+/** Waits for the termination of a child for at most timeout milliseconds.
+ *
+ * A negative timeout waits forever.  done is set to false if the child did
+ * not terminate in time; otherwise, it is set to true and the child is
+ * reaped as atf_process_child_wait does. */
+atf_error_t
+atf_process_child_wait_for(atf_process_child_t *c, const int timeout,
+                           bool *done, atf_process_status_t *s)
+{
+    atf_error_t err;
+    const long long deadline = deadline_ms(timeout);
+    int delay = 1;
+    int remaining, status;
+
+    for (;;) {
+        err = try_reap(c, done, &status);
+        if (atf_is_error(err) || *done)
+            break;
+
+        remaining = remaining_ms(deadline);
+        if (remaining == 0)
+            break;
+
+        if (c->m_pidfd != -1) {
+            struct pollfd pfd;
+
+            pfd.fd = c->m_pidfd;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, remaining) == -1) {
+                err = atf_libc_error(errno, "Failed waiting for process %d",
+                                     c->m_pid);
+                break;
+            }
+        } else
+            sleep_ms(next_delay_ms(remaining, &delay));
+    }
+
+    if (!atf_is_error(err) && *done) {
+        release_child(c);
+        err = atf_process_status_init(s, status);
+    }
+
+    return err;
+}
+
+static
+atf_error_t
+add_child(const pid_t child, pid_t **children, size_t *nchildren,
+          size_t *capacity)
+{
+    if (*nchildren == *capacity) {
+        pid_t *aux;
+
+        *capacity = *capacity == 0 ? 8 : *capacity * 2;
+        aux = realloc(*children, *capacity * sizeof(pid_t));
+        if (aux == NULL)
+            return atf_no_memory_error();
+        *children = aux;
+    }
+    (*children)[(*nchildren)++] = child;
+    return atf_no_error();
+}
+
+/** Gets the children of a process from the children lists of its
+ * threads.
+ *
+ * found is set to false if the kernel does not provide these lists. */
+static
+atf_error_t
+get_children_lists(const pid_t pid, pid_t **children, size_t *nchildren,
+                   size_t *capacity, bool *found)
+{
+    atf_error_t err;
+    char path[512];
+    DIR *dir;
+    struct dirent *de;
+
+    *found = false;
+    err = atf_no_error();
+
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    dir = opendir(path);
+    if (dir == NULL)
+        goto out;
+
+    while (!atf_is_error(err) && (de = readdir(dir)) != NULL) {
+        FILE *f;
+        int child;
+
+        if (de->d_name[0] == '.')
+            continue;
+
+        snprintf(path, sizeof(path), "/proc/%d/task/%s/children", (int)pid,
+                 de->d_name);
+        f = fopen(path, "r");
+        if (f == NULL)
+            continue;
+        *found = true;
+
+        while (!atf_is_error(err) && fscanf(f, "%d", &child) == 1)
+            err = add_child(child, children, nchildren, capacity);
+        fclose(f);
+    }
+    closedir(dir);
+
+out:
+    return err;
+}
+
+/** Gets the children of a process by looking for all processes whose
+ * parent it is.
+ *
+ * This is much slower than get_children_lists, but works on kernels
+ * built without support for the children lists. */
+static
+atf_error_t
+get_children_scan(const pid_t pid, pid_t **children, size_t *nchildren,
+                  size_t *capacity)
+{
+    atf_error_t err;
+    char path[512], buf[1024];
+    DIR *dir;
+    struct dirent *de;
+
+    err = atf_no_error();
+
+    dir = opendir("/proc");
+    if (dir == NULL)
+        goto out;
+
+    while (!atf_is_error(err) && (de = readdir(dir)) != NULL) {
+        const char *ptr;
+        ssize_t len;
+        int fd, ppid;
+
+        if (de->d_name[0] < '0' || de->d_name[0] > '9')
+            continue;
+
+        snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+        fd = open(path, O_RDONLY);
+        if (fd == -1)
+            continue;
+        len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len <= 0)
+            continue;
+        buf[len] = '\0';
+
+        /* The command name may contain anything, so skip it backwards. */
+        ptr = strrchr(buf, ')');
+        if (ptr != NULL && sscanf(ptr + 1, " %*c %d", &ppid) == 1 &&
+            ppid == pid)
+            err = add_child(atoi(de->d_name), children, nchildren, capacity);
+    }
+    closedir(dir);
+
+out:
+    return err;
+}
+
+/** Gets the children of a process as listed by procfs.
+ *
+ * Returns an empty list on systems without procfs, where the descendants
+ * of a process cannot be discovered. */
+static
+atf_error_t
+get_children(const pid_t pid, pid_t **children, size_t *nchildren)
+{
+    atf_error_t err;
+    size_t capacity;
+    bool found;
+
+    *children = NULL;
+    *nchildren = 0;
+    capacity = 0;
+
+    err = get_children_lists(pid, children, nchildren, &capacity, &found);
+    if (!atf_is_error(err) && !found)
+        err = get_children_scan(pid, children, nchildren, &capacity);
+
+    if (atf_is_error(err)) {
+        free(*children);
+        *children = NULL;
+        *nchildren = 0;
+    }
+    return err;
+}
+
+/** Sends a signal to a process and all of its descendants.
+ *
+ * Each process is stopped before its children are looked up so that it
+ * cannot spawn new ones behind our back, and is resumed once signaled so
+ * that the signal is delivered. */
+static
+atf_error_t
+signal_tree(const pid_t pid, const int signo)
+{
+    atf_error_t err;
+    pid_t *children;
+    size_t i, nchildren;
+
+    if (kill(pid, SIGSTOP) == -1)
+        return atf_libc_error(errno, "Cannot stop process %d", (int)pid);
+
+    err = get_children(pid, &children, &nchildren);
+    for (i = 0; !atf_is_error(err) && i < nchildren; i++) {
+        err = signal_tree(children[i], signo);
+        if (atf_is_error(err) && atf_error_is(err, "libc") &&
+            atf_libc_error_code(err) == ESRCH) {
+            /* The descendant terminated on its own; nothing to do. */
+            atf_error_free(err);
+            err = atf_no_error();
+        }
+    }
+    free(children);
+
+    if (kill(pid, signo) == -1 && !atf_is_error(err))
+        err = atf_libc_error(errno, "Cannot signal process %d", (int)pid);
+    (void)kill(pid, SIGCONT);
+
+    return err;
+}
+
+/** Sends a signal to a child and to all of its descendants.
+ *
+ * Descendants can only be found on systems with procfs; elsewhere, only
+ * the child itself is signaled. */
+atf_error_t
+atf_process_child_kill_tree(atf_process_child_t *c, const int signo)
+{
+    return signal_tree(c->m_pid, signo);
+}
+
+/** Collects the output of the ring streams of a child.
+ *
+ * This waits until the child, and any descendant that inherited its
+ * streams, closes them, and stores the retained output of stdout and
+ * stderr in out and err, which must have been initialized.  Any of them
+ * may be NULL to discard the corresponding stream.  This can be called at
+ * most once, either before or after waiting for the child; otherwise, the
+ * output is discarded by atf_process_child_fini. */
+atf_error_t
+atf_process_child_drain(atf_process_child_t *c, atf_process_ring_t *out,
+                        atf_process_ring_t *err)
+{
+    atf_error_t error;
+    int status;
+
+    PRE(c->m_drainer_pid != 0);
+
+    error = receive_ring(c->m_drainer_fd, out);
+    if (!atf_is_error(error))
+        error = receive_ring(c->m_drainer_fd, err);
+
+    close(c->m_drainer_fd);
+    c->m_drainer_fd = -1;
+    if (atf_is_error(error))
+        (void)kill(c->m_drainer_pid, SIGKILL);
+    (void)waitpid(c->m_drainer_pid, &status, 0);
+    c->m_drainer_pid = 0;
+
+    return error;
+}
+
+pid_t
+atf_process_child_pid(const atf_process_child_t *c)
+{
+    return c->m_pid;
+}
+
+/** Returns the descriptor to feed the stdin of the child through.
+ *
+ * Only valid if stdin is a capture stream.  Use atf_process_child_close_stdin
+ * to signal the end of the input; if the child terminates first, writes to
+ * the descriptor raise SIGPIPE. */
+int
+atf_process_child_stdin(atf_process_child_t *c)
+{
+    PRE(c->m_stdin != -1);
+    return c->m_stdin;
+}
+
+void
+atf_process_child_close_stdin(atf_process_child_t *c)
+{
+    PRE(c->m_stdin != -1);
+    close(c->m_stdin);
+    c->m_stdin = -1;
+}
+
+int
+atf_process_child_stdout(atf_process_child_t *c)
+{
+    PRE(c->m_stdout != -1);
+    return c->m_stdout;
+}
+
+int
+atf_process_child_stderr(atf_process_child_t *c)
+{
+    PRE(c->m_stderr != -1);
+    return c->m_stderr;
+}
+
+/* ---------------------------------------------------------------------
+ * The "atf_process_mux" type.
+ * --------------------------------------------------------------------- */
+
+const int atf_process_mux_event_timeout = 1;
+const int atf_process_mux_event_stdout = 2;
+const int atf_process_mux_event_stderr = 3;
+const int atf_process_mux_event_exited = 4;
+
+struct mux_entry {
+    atf_process_child_t *m_child;
+
+    bool m_stdout_eof;
+    bool m_stderr_eof;
+
+    /* Valid if m_exited is true. */
+    bool m_exited;
+    int m_status;
+};
+
+struct mux_pollfd_owner {
+    size_t m_entry;
+    int m_type;
+};
+
+struct atf_process_mux_impl {
+    struct mux_entry *m_entries;
+    size_t m_nentries;
+    size_t m_capacity;
+
+    /* Scratch space for the descriptors to poll, three per entry. */
+    struct pollfd *m_pollfds;
+    struct mux_pollfd_owner *m_owners;
+};
+
+atf_error_t
+atf_process_mux_init(atf_process_mux_t *mux)
+{
+    mux->pimpl = malloc(sizeof(struct atf_process_mux_impl));
+    if (mux->pimpl == NULL)
+        return atf_no_memory_error();
+
+    mux->pimpl->m_entries = NULL;
+    mux->pimpl->m_nentries = 0;
+    mux->pimpl->m_capacity = 0;
+    mux->pimpl->m_pollfds = NULL;
+    mux->pimpl->m_owners = NULL;
+
+    return atf_no_error();
+}
+
+/** Destroys a multiplexer.
+ *
+ * The children still in the multiplexer are not waited for: they remain
+ * owned by the caller. */
+void
+atf_process_mux_fini(atf_process_mux_t *mux)
+{
+    free(mux->pimpl->m_owners);
+    free(mux->pimpl->m_pollfds);
+    free(mux->pimpl->m_entries);
+    free(mux->pimpl);
+}
+
+size_t
+atf_process_mux_size(const atf_process_mux_t *mux)
+{
+    return mux->pimpl->m_nentries;
+}
+
+/** Adds a child to the multiplexer.
+ *
+ * The child must remain valid until the multiplexer reports its
+ * termination, at which point it is reaped and removed from it. */
+atf_error_t
+atf_process_mux_add(atf_process_mux_t *mux, atf_process_child_t *c)
+{
+    struct atf_process_mux_impl *pimpl = mux->pimpl;
+    struct mux_entry *e;
+
+    if (pimpl->m_nentries == pimpl->m_capacity) {
+        const size_t capacity = pimpl->m_capacity == 0 ?
+            8 : pimpl->m_capacity * 2;
+        struct mux_entry *entries;
+        struct pollfd *pollfds;
+        struct mux_pollfd_owner *owners;
+
+        entries = realloc(pimpl->m_entries, capacity * sizeof(*entries));
+        if (entries == NULL)
+            return atf_no_memory_error();
+        pimpl->m_entries = entries;
+
+        pollfds = realloc(pimpl->m_pollfds, 3 * capacity * sizeof(*pollfds));
+        if (pollfds == NULL)
+            return atf_no_memory_error();
+        pimpl->m_pollfds = pollfds;
+
+        owners = realloc(pimpl->m_owners, 3 * capacity * sizeof(*owners));
+        if (owners == NULL)
+            return atf_no_memory_error();
+        pimpl->m_owners = owners;
+
+        pimpl->m_capacity = capacity;
+    }
+
+    e = &pimpl->m_entries[pimpl->m_nentries++];
+    e->m_child = c;
+    e->m_stdout_eof = (c->m_stdout == -1);
+    e->m_stderr_eof = (c->m_stderr == -1);
+    e->m_exited = false;
+    e->m_status = 0;
+
+    return atf_no_error();
+}
+
+static
+void
+mux_add_pollfd(struct atf_process_mux_impl *pimpl, size_t *npollfds,
+               const int fd, const size_t entry, const int type)
+{
+    pimpl->m_pollfds[*npollfds].fd = fd;
+    pimpl->m_pollfds[*npollfds].events = POLLIN;
+    pimpl->m_pollfds[*npollfds].revents = 0;
+    pimpl->m_owners[*npollfds].m_entry = entry;
+    pimpl->m_owners[*npollfds].m_type = type;
+    (*npollfds)++;
 }
 
-int
-atf_process_status_termsig(const atf_process_status_t *s)
+/** Builds the set of descriptors to poll.
+ *
+ * needs_polling is set if any live child lacks a process descriptor, in
+ * which case its termination has to be checked for periodically. */
+static
+size_t
+mux_prepare(struct atf_process_mux_impl *pimpl, bool *needs_polling,
+            bool *has_exited)
 {
-    PRE(atf_process_status_signaled(s));
-    int mutable_status = s->m_status;
-    return WTERMSIG(mutable_status);
+    size_t i, npollfds;
+
+    npollfds = 0;
+    *needs_polling = false;
+    *has_exited = false;
+    for (i = 0; i < pimpl->m_nentries; i++) {
+        const struct mux_entry *e = &pimpl->m_entries[i];
+
+        if (!e->m_stdout_eof)
+            mux_add_pollfd(pimpl, &npollfds, e->m_child->m_stdout, i,
+                           atf_process_mux_event_stdout);
+        if (!e->m_stderr_eof)
+            mux_add_pollfd(pimpl, &npollfds, e->m_child->m_stderr, i,
+                           atf_process_mux_event_stderr);
+        if (e->m_exited)
+            *has_exited = true;
+        else if (e->m_child->m_pidfd != -1)
+            mux_add_pollfd(pimpl, &npollfds, e->m_child->m_pidfd, i,
+                           atf_process_mux_event_exited);
+        else
+            *needs_polling = true;
+    }
+
+    return npollfds;
 }
 
+/** Reports an event on a capture pipe, if any.
+ *
+ * Pipes that have been closed by the child and drained by the caller are
+ * no longer polled. */
+static
 bool
-atf_process_status_coredump(const atf_process_status_t *s)
+mux_pipe_event(struct atf_process_mux_impl *pimpl, const size_t npollfds,
+               atf_process_mux_event_t *ev)
 {
-    PRE(atf_process_status_signaled(s));
-#if defined(WCOREDUMP)
-    int mutable_status = s->m_status;
-    return WCOREDUMP(mutable_status);
-#else
+    size_t i;
+
+    for (i = 0; i < npollfds; i++) {
+        const struct mux_pollfd_owner *o = &pimpl->m_owners[i];
+        const short revents = pimpl->m_pollfds[i].revents;
+        struct mux_entry *e = &pimpl->m_entries[o->m_entry];
+
+        if (o->m_type == atf_process_mux_event_exited || revents == 0)
+            continue;
+
+        if (revents & POLLIN) {
+            ev->m_type = o->m_type;
+            ev->m_child = e->m_child;
+            return true;
+        }
+
+        if (o->m_type == atf_process_mux_event_stdout)
+            e->m_stdout_eof = true;
+        else
+            e->m_stderr_eof = true;
+    }
+
     return false;
-#endif
 }
 
-/* ---------------------------------------------------------------------
- * The "atf_process_child" type.
- * --------------------------------------------------------------------- */
-
+/** Reports the termination of a child reaped in an earlier iteration.
+ *
+ * Reaping closes the capture pipes of the child, so a termination is only
+ * reported once a poll has seen no pending output in them. */
 static
 atf_error_t
-atf_process_child_init(atf_process_child_t *c)
+mux_exit_event(struct atf_process_mux_impl *pimpl, bool *found,
+               atf_process_mux_event_t *ev)
 {
-    c->m_pid = 0;
-    c->m_stdout = -1;
-    c->m_stderr = -1;
+    size_t i;
+
+    *found = false;
+    for (i = 0; i < pimpl->m_nentries; i++) {
+        struct mux_entry *e = &pimpl->m_entries[i];
+
+        if (e->m_exited) {
+            const int status = e->m_status;
+
+            ev->m_type = atf_process_mux_event_exited;
+            ev->m_child = e->m_child;
+            release_child(e->m_child);
+            *found = true;
+
+            pimpl->m_entries[i] = pimpl->m_entries[--pimpl->m_nentries];
+            return atf_process_status_init(&ev->m_status, status);
+        }
+    }
 
     return atf_no_error();
 }
 
+/** Reaps all the children that have terminated. */
 static
-void
-atf_process_child_fini(atf_process_child_t *c)
-{
-    if (c->m_stdout != -1)
-        close(c->m_stdout);
-    if (c->m_stderr != -1)
-        close(c->m_stderr);
-}
-
 atf_error_t
-atf_process_child_wait(atf_process_child_t *c, atf_process_status_t *s)
+mux_reap(struct atf_process_mux_impl *pimpl, bool *reaped)
 {
     atf_error_t err;
-    int status;
+    size_t i;
 
-    if (waitpid(c->m_pid, &status, 0) == -1)
-        err = atf_libc_error(errno, "Failed waiting for process %d",
-                             c->m_pid);
-    else {
-        atf_process_child_fini(c);
-        err = atf_process_status_init(s, status);
+    err = atf_no_error();
+    *reaped = false;
+    for (i = 0; !atf_is_error(err) && i < pimpl->m_nentries; i++) {
+        struct mux_entry *e = &pimpl->m_entries[i];
+
+        if (!e->m_exited) {
+            err = try_reap(e->m_child, &e->m_exited, &e->m_status);
+            if (e->m_exited)
+                *reaped = true;
+        }
     }
 
     return err;
 }
 
-pid_t
-atf_process_child_pid(const atf_process_child_t *c)
+/** Waits for the next event in any of the children of the multiplexer.
+ *
+ * An event is either that a capture pipe of a child is readable, which the
+ * caller must then read from, or that a child terminated.  Output pending
+ * in the pipes of a child is always reported before its termination: once
+ * the latter is returned, the child has been reaped, its descriptors are
+ * closed and it is no longer part of the multiplexer.  If nothing happens
+ * in timeout milliseconds, a timeout event is returned instead; a negative
+ * timeout waits forever.
+ *
+ * Process descriptors are used to learn about terminations where
+ * available, so this does not wake up until there is something to report;
+ * elsewhere, the children are checked with exponential backoff. */
+atf_error_t
+atf_process_mux_wait(atf_process_mux_t *mux, const int timeout,
+                     atf_process_mux_event_t *ev)
 {
-    return c->m_pid;
-}
+    atf_error_t err;
+    struct atf_process_mux_impl *pimpl = mux->pimpl;
+    const long long deadline = deadline_ms(timeout);
+    int delay = 1;
+
+    PRE(pimpl->m_nentries > 0);
+
+    for (;;) {
+        bool needs_polling, has_exited, found, reaped;
+        size_t npollfds;
+        int remaining, polltimeout;
+
+        npollfds = mux_prepare(pimpl, &needs_polling, &has_exited);
+        remaining = remaining_ms(deadline);
+        if (has_exited)
+            polltimeout = 0;
+        else if (needs_polling)
+            polltimeout = next_delay_ms(remaining, &delay);
+        else
+            polltimeout = remaining;
 
-int
-atf_process_child_stdout(atf_process_child_t *c)
-{
-    PRE(c->m_stdout != -1);
-    return c->m_stdout;
-}
+        if (poll(pimpl->m_pollfds, npollfds, polltimeout) == -1) {
+            err = atf_libc_error(errno, "Failed waiting for any process");
+            break;
+        }
 
-int
-atf_process_child_stderr(atf_process_child_t *c)
-{
-    PRE(c->m_stderr != -1);
-    return c->m_stderr;
+        if (mux_pipe_event(pimpl, npollfds, ev)) {
+            err = atf_no_error();
+            break;
+        }
+
+        err = mux_exit_event(pimpl, &found, ev);
+        if (atf_is_error(err) || found)
+            break;
+
+        err = mux_reap(pimpl, &reaped);
+        if (atf_is_error(err))
+            break;
+
+        if (!reaped && remaining_ms(deadline) == 0) {
+            ev->m_type = atf_process_mux_event_timeout;
+            ev->m_child = NULL;
+            break;
+        }
+    }
+
+    return err;
 }
 
 /* ---------------------------------------------------------------------
@@ -325,6 +1566,17 @@ safe_dup(const int oldfd, const int newfd)
     return err;
 }
 
+/** Computes the flags to open the file of a redirect_path stream with. */
+static
+int
+redirect_path_flags(const int procfd)
+{
+    if (procfd == STDIN_FILENO)
+        return O_RDONLY;
+    else
+        return O_WRONLY | O_CREAT | O_TRUNC;
+}
+
 static
 atf_error_t
 child_connect(const stream_prepare_t *sp, int procfd)
@@ -332,9 +1584,12 @@ child_connect(const stream_prepare_t *sp, int procfd)
     atf_error_t err;
     const int type = atf_process_stream_type(sp->m_sb);
 
-    if (type == atf_process_stream_type_capture) {
-        close(sp->m_pipefds[0]);
-        err = safe_dup(sp->m_pipefds[1], procfd);
+    if (type == atf_process_stream_type_capture ||
+        type == atf_process_stream_type_ring) {
+        const int end = procfd == STDIN_FILENO ? 0 : 1;
+
+        close(sp->m_pipefds[1 - end]);
+        err = safe_dup(sp->m_pipefds[end], procfd);
     } else if (type == atf_process_stream_type_connect) {
         if (dup2(sp->m_sb->m_tgt_fd, sp->m_sb->m_src_fd) == -1)
             err = atf_libc_error(errno, "Cannot connect descriptor %d to %d",
@@ -347,15 +1602,17 @@ child_connect(const stream_prepare_t *sp, int procfd)
         err = safe_dup(sp->m_sb->m_fd, procfd);
     } else if (type == atf_process_stream_type_redirect_path) {
         int aux = open(atf_fs_path_cstring(sp->m_sb->m_path),
-                       O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                       redirect_path_flags(procfd), 0644);
         if (aux == -1)
-            err = atf_libc_error(errno, "Could not create %s",
+            err = atf_libc_error(errno, "Could not open %s",
                                  atf_fs_path_cstring(sp->m_sb->m_path));
         else {
             err = safe_dup(aux, procfd);
             if (atf_is_error(err))
                 close(aux);
         }
+    } else if (type == atf_process_stream_type_inline) {
+        err = safe_dup(sp->m_datafd, procfd);
     } else {
         UNREACHABLE;
         err = atf_no_error();
@@ -366,13 +1623,18 @@ child_connect(const stream_prepare_t *sp, int procfd)
 
 static
 void
-parent_connect(const stream_prepare_t *sp, int *fd)
+parent_connect(const stream_prepare_t *sp, const int procfd, int *fd)
 {
     const int type = atf_process_stream_type(sp->m_sb);
 
-    if (type == atf_process_stream_type_capture) {
-        close(sp->m_pipefds[1]);
-        *fd = sp->m_pipefds[0];
+    if (type == atf_process_stream_type_capture ||
+        type == atf_process_stream_type_ring) {
+        const int end = procfd == STDIN_FILENO ? 1 : 0;
+
+        close(sp->m_pipefds[1 - end]);
+        *fd = sp->m_pipefds[end];
+    } else if (type == atf_process_stream_type_inline) {
+        close(sp->m_datafd);
     } else if (type == atf_process_stream_type_connect) {
         /* Do nothing. */
     } else if (type == atf_process_stream_type_inherit) {
@@ -386,10 +1648,38 @@ parent_connect(const stream_prepare_t *sp, int *fd)
     }
 }
 
+/** Starts the drainer of a new child if any of its streams is a ring.
+ *
+ * If this fails, the child is killed and reaped so that the caller does
+ * not get back a child it cannot use. */
+static
+atf_error_t
+connect_drainer(atf_process_child_t *c, const atf_process_stream_t *outsb,
+                const atf_process_stream_t *errsb)
+{
+    atf_error_t err;
+
+    if (atf_process_stream_type(outsb) != atf_process_stream_type_ring &&
+        atf_process_stream_type(errsb) != atf_process_stream_type_ring)
+        return atf_no_error();
+
+    err = start_drainer(c, outsb, errsb);
+    if (atf_is_error(err)) {
+        int status;
+
+        (void)kill(c->m_pid, SIGKILL);
+        (void)waitpid(c->m_pid, &status, 0);
+        atf_process_child_fini(c);
+    }
+
+    return err;
+}
+
 static
 atf_error_t
 do_parent(atf_process_child_t *c,
           const pid_t pid,
+          const stream_prepare_t *insp,
           const stream_prepare_t *outsp,
           const stream_prepare_t *errsp)
 {
@@ -400,9 +1690,11 @@ do_parent(atf_process_child_t *c,
         goto out;
 
     c->m_pid = pid;
+    c->m_pidfd = open_pidfd(pid);
 
-    parent_connect(outsp, &c->m_stdout);
-    parent_connect(errsp, &c->m_stderr);
+    parent_connect(insp, STDIN_FILENO, &c->m_stdin);
+    parent_connect(outsp, STDOUT_FILENO, &c->m_stdout);
+    parent_connect(errsp, STDERR_FILENO, &c->m_stderr);
 
 out:
     return err;
@@ -413,17 +1705,23 @@ void
 do_child(void (*)(void *),
          void *,
          const stream_prepare_t *,
+         const stream_prepare_t *,
          const stream_prepare_t *) ATF_DEFS_ATTRIBUTE_NORETURN;
 
 static
 void
 do_child(void (*start)(void *),
          void *v,
+         const stream_prepare_t *insp,
          const stream_prepare_t *outsp,
          const stream_prepare_t *errsp)
 {
     atf_error_t err;
 
+    err = child_connect(insp, STDIN_FILENO);
+    if (atf_is_error(err))
+        goto out;
+
     err = child_connect(outsp, STDOUT_FILENO);
     if (atf_is_error(err))
         goto out;
@@ -448,27 +1746,147 @@ out:
         exit(EXIT_SUCCESS);
 }
 
+#if defined(HAVE_POSIX_SPAWNP)
+extern char **environ;
+
+/** Adds the file actions that connect a stream of a spawned child.
+ *
+ * These are the posix_spawn equivalent of what child_connect does in a
+ * forked child.  Returns 0 on success or an errno value otherwise. */
+static
+int
+spawn_connect(posix_spawn_file_actions_t *fa, const stream_prepare_t *sp,
+              const int procfd)
+{
+    int ret;
+    const int type = atf_process_stream_type(sp->m_sb);
+
+    if (type == atf_process_stream_type_capture ||
+        type == atf_process_stream_type_ring) {
+        const int end = procfd == STDIN_FILENO ? 0 : 1;
+
+        ret = posix_spawn_file_actions_addclose(fa, sp->m_pipefds[1 - end]);
+        if (ret == 0 && sp->m_pipefds[end] != procfd) {
+            ret = posix_spawn_file_actions_adddup2(fa, sp->m_pipefds[end],
+                                                   procfd);
+            if (ret == 0)
+                ret = posix_spawn_file_actions_addclose(fa,
+                                                        sp->m_pipefds[end]);
+        }
+    } else if (type == atf_process_stream_type_connect) {
+        ret = posix_spawn_file_actions_adddup2(fa, sp->m_sb->m_tgt_fd,
+                                               sp->m_sb->m_src_fd);
+    } else if (type == atf_process_stream_type_inherit) {
+        ret = 0;
+    } else if (type == atf_process_stream_type_redirect_fd) {
+        ret = 0;
+        if (sp->m_sb->m_fd != procfd) {
+            ret = posix_spawn_file_actions_adddup2(fa, sp->m_sb->m_fd,
+                                                   procfd);
+            if (ret == 0)
+                ret = posix_spawn_file_actions_addclose(fa, sp->m_sb->m_fd);
+        }
+    } else if (type == atf_process_stream_type_redirect_path) {
+        ret = posix_spawn_file_actions_addopen(
+            fa, procfd, atf_fs_path_cstring(sp->m_sb->m_path),
+            redirect_path_flags(procfd), 0644);
+    } else if (type == atf_process_stream_type_inline) {
+        ret = posix_spawn_file_actions_adddup2(fa, sp->m_datafd, procfd);
+        if (ret == 0)
+            ret = posix_spawn_file_actions_addclose(fa, sp->m_datafd);
+    } else {
+        UNREACHABLE;
+        ret = EINVAL;
+    }
+
+    return ret;
+}
+
+/** Spawns a child that executes the given program without forking.
+ *
+ * posix_spawnp does not duplicate the address space of the caller, which
+ * fork does at a cost proportional to the size of the heap.  Returns true
+ * if the child was spawned; if it was not, the caller must fall back to
+ * fork so that the child can report the problem as it always has. */
+static
+bool
+spawn_child(pid_t *pid, const char *prog, const char *const *argv,
+            const stream_prepare_t *insp, const stream_prepare_t *outsp,
+            const stream_prepare_t *errsp)
+{
+#define UNCONST(a) ((void *)(uintptr_t)(const void *)(a))
+    posix_spawn_file_actions_t fa;
+    int ret;
+
+    if (posix_spawn_file_actions_init(&fa) != 0)
+        return false;
+
+    ret = spawn_connect(&fa, insp, STDIN_FILENO);
+    if (ret == 0)
+        ret = spawn_connect(&fa, outsp, STDOUT_FILENO);
+    if (ret == 0)
+        ret = spawn_connect(&fa, errsp, STDERR_FILENO);
+    if (ret == 0)
+        ret = posix_spawnp(pid, prog, &fa, NULL, UNCONST(argv), environ);
+
+    posix_spawn_file_actions_destroy(&fa);
+    return ret == 0;
+#undef UNCONST
+}
+#endif /* defined(HAVE_POSIX_SPAWNP) */
+
+/** Starts a child process with its streams connected as requested.
+ *
+ * If prog is not NULL, the child is only meant to execute prog with argv,
+ * so it is spawned without forking when the system allows it; start is
+ * then only run in a forked child if spawning fails. */
 static
 atf_error_t
 fork_with_streams(atf_process_child_t *c,
+                  const char *prog,
+                  const char *const *argv,
                   void (*start)(void *),
+                  const atf_process_stream_t *insb,
                   const atf_process_stream_t *outsb,
                   const atf_process_stream_t *errsb,
                   void *v)
 {
     atf_error_t err;
+    stream_prepare_t insp;
     stream_prepare_t outsp;
     stream_prepare_t errsp;
     pid_t pid;
 
-    err = stream_prepare_init(&outsp, outsb);
+    PRE(atf_process_stream_type(insb) != atf_process_stream_type_ring);
+    PRE(atf_process_stream_type(outsb) != atf_process_stream_type_inline);
+    PRE(atf_process_stream_type(errsb) != atf_process_stream_type_inline);
+
+    err = stream_prepare_init(&insp, insb);
     if (atf_is_error(err))
         goto out;
 
+    err = stream_prepare_init(&outsp, outsb);
+    if (atf_is_error(err))
+        goto err_inpipe;
+
     err = stream_prepare_init(&errsp, errsb);
     if (atf_is_error(err))
         goto err_outpipe;
 
+#if defined(HAVE_POSIX_SPAWNP)
+    if (prog != NULL &&
+        spawn_child(&pid, prog, argv, &insp, &outsp, &errsp)) {
+        err = do_parent(c, pid, &insp, &outsp, &errsp);
+        if (atf_is_error(err))
+            goto err_errpipe;
+        err = connect_drainer(c, outsb, errsb);
+        goto out;
+    }
+#else
+    (void)prog;
+    (void)argv;
+#endif
+
     pid = fork();
     if (pid == -1) {
         err = atf_libc_error(errno, "Failed to fork");
@@ -476,14 +1894,15 @@ fork_with_streams(atf_process_child_t *c,
     }
 
     if (pid == 0) {
-        do_child(start, v, &outsp, &errsp);
+        do_child(start, v, &insp, &outsp, &errsp);
         UNREACHABLE;
         abort();
         err = atf_no_error();
     } else {
-        err = do_parent(c, pid, &outsp, &errsp);
+        err = do_parent(c, pid, &insp, &outsp, &errsp);
         if (atf_is_error(err))
             goto err_errpipe;
+        err = connect_drainer(c, outsb, errsb);
     }
 
     goto out;
@@ -492,6 +1911,8 @@ err_errpipe:
     stream_prepare_fini(&errsp);
 err_outpipe:
     stream_prepare_fini(&outsp);
+err_inpipe:
+    stream_prepare_fini(&insp);
 
 out:
     return err;
@@ -517,38 +1938,117 @@ init_stream_w_default(const atf_process_stream_t *usersb,
     return err;
 }
 
+static
 atf_error_t
-atf_process_fork(atf_process_child_t *c,
-                 void (*start)(void *),
-                 const atf_process_stream_t *outsb,
-                 const atf_process_stream_t *errsb,
-                 void *v)
+fork_w_default_streams(atf_process_child_t *c,
+                       const char *prog,
+                       const char *const *argv,
+                       void (*start)(void *),
+                       const atf_process_stream_t *insb,
+                       const atf_process_stream_t *outsb,
+                       const atf_process_stream_t *errsb,
+                       void *v)
 {
     atf_error_t err;
-    atf_process_stream_t inherit_outsb, inherit_errsb;
-    const atf_process_stream_t *real_outsb, *real_errsb;
+    atf_process_stream_t inherit_insb, inherit_outsb, inherit_errsb;
+    const atf_process_stream_t *real_insb, *real_outsb, *real_errsb;
+
+    real_insb = NULL;  /* Shut up GCC warning. */
+    err = init_stream_w_default(insb, &inherit_insb, &real_insb);
+    if (atf_is_error(err))
+        goto out;
 
     real_outsb = NULL;  /* Shut up GCC warning. */
     err = init_stream_w_default(outsb, &inherit_outsb, &real_outsb);
     if (atf_is_error(err))
-        goto out;
+        goto out_in;
 
     real_errsb = NULL;  /* Shut up GCC warning. */
     err = init_stream_w_default(errsb, &inherit_errsb, &real_errsb);
     if (atf_is_error(err))
         goto out_out;
 
-    err = fork_with_streams(c, start, real_outsb, real_errsb, v);
+    err = fork_with_streams(c, prog, argv, start, real_insb, real_outsb,
+                            real_errsb, v);
 
     if (errsb == NULL)
         atf_process_stream_fini(&inherit_errsb);
 out_out:
     if (outsb == NULL)
         atf_process_stream_fini(&inherit_outsb);
+out_in:
+    if (insb == NULL)
+        atf_process_stream_fini(&inherit_insb);
 out:
     return err;
 }
 
+atf_error_t
+atf_process_fork(atf_process_child_t *c,
+                 void (*start)(void *),
+                 const atf_process_stream_t *insb,
+                 const atf_process_stream_t *outsb,
+                 const atf_process_stream_t *errsb,
+                 void *v)
+{
+    return fork_w_default_streams(c, NULL, NULL, start, insb, outsb, errsb,
+                                  v);
+}
+
+/** Starts a child process that executes prog with argv.
+ *
+ * This is equivalent to calling atf_process_fork with a start routine
+ * that just calls execvp, but avoids the cost of fork when possible.  start
+ * must execute prog with argv as well: it is only run, in a forked child,
+ * if the program could not be spawned directly, and is thus in charge of
+ * reporting why the execution failed. */
+atf_error_t
+atf_process_spawn(atf_process_child_t *c,
+                  const char *prog,
+                  const char *const *argv,
+                  void (*start)(void *),
+                  const atf_process_stream_t *insb,
+                  const atf_process_stream_t *outsb,
+                  const atf_process_stream_t *errsb,
+                  void *v)
+{
+    atf_error_t err;
+    atf_fs_path_t resolved;
+
+    PRE(prog != NULL);
+    PRE(argv != NULL);
+
+    err = atf_process_resolve_prog(prog, &resolved);
+    if (atf_is_error(err))
+        return err;
+
+    err = fork_w_default_streams(c, atf_fs_path_cstring(&resolved), argv,
+                                 start, insb, outsb, errsb, v);
+    atf_fs_path_fini(&resolved);
+    return err;
+}
+
+/** Determines the file that executing prog would run.
+ *
+ * A program name without slashes is looked for in the PATH through
+ * atf_fs_find_prog, so that its location is cached, and the result can be
+ * given to execvp or posix_spawnp without making them walk the PATH
+ * again.  Any other name, or one that cannot be found, is returned as is
+ * so that the execution reports the problem as usual. */
+atf_error_t
+atf_process_resolve_prog(const char *prog, atf_fs_path_t *resolved)
+{
+    atf_error_t err;
+    bool found;
+
+    if (strchr(prog, '/') == NULL) {
+        err = atf_fs_find_prog(prog, resolved, &found);
+        if (atf_is_error(err) || found)
+            return err;
+    }
+    return atf_fs_path_init_fmt(resolved, "%s", prog);
+}
+
 static
 int
 const_execvp(const char *file, const char *const *argv)
@@ -613,20 +2113,35 @@ atf_error_t
 atf_process_exec_array(atf_process_status_t *s,
                        const atf_fs_path_t *prog,
                        const char *const *argv,
+                       const atf_process_stream_t *insb,
                        const atf_process_stream_t *outsb,
                        const atf_process_stream_t *errsb,
                        void (*prehook)(void))
 {
     atf_error_t err;
     atf_process_child_t c;
-    struct exec_args ea = { prog, argv, prehook };
+    atf_fs_path_t resolved;
+    struct exec_args ea = { &resolved, argv, prehook };
 
+    PRE(insb == NULL ||
+        atf_process_stream_type(insb) != atf_process_stream_type_capture);
     PRE(outsb == NULL ||
-        atf_process_stream_type(outsb) != atf_process_stream_type_capture);
+        (atf_process_stream_type(outsb) != atf_process_stream_type_capture &&
+         atf_process_stream_type(outsb) != atf_process_stream_type_ring));
     PRE(errsb == NULL ||
-        atf_process_stream_type(errsb) != atf_process_stream_type_capture);
+        (atf_process_stream_type(errsb) != atf_process_stream_type_capture &&
+         atf_process_stream_type(errsb) != atf_process_stream_type_ring));
 
-    err = atf_process_fork(&c, do_exec, outsb, errsb, &ea);
+    err = atf_process_resolve_prog(atf_fs_path_cstring(prog), &resolved);
+    if (atf_is_error(err))
+        goto out;
+
+    if (prehook == NULL)
+        err = atf_process_spawn(&c, atf_fs_path_cstring(&resolved), argv,
+                                do_exec, insb, outsb, errsb, &ea);
+    else
+        err = atf_process_fork(&c, do_exec, insb, outsb, errsb, &ea);
+    atf_fs_path_fini(&resolved);
     if (atf_is_error(err))
         goto out;
 
@@ -646,6 +2161,7 @@ atf_error_t
 atf_process_exec_list(atf_process_status_t *s,
                       const atf_fs_path_t *prog,
                       const atf_list_t *argv,
+                      const atf_process_stream_t *insb,
                       const atf_process_stream_t *outsb,
                       const atf_process_stream_t *errsb,
                       void (*prehook)(void))
@@ -653,6 +2169,8 @@ atf_process_exec_list(atf_process_status_t *s,
     atf_error_t err;
     const char **argv2;
 
+    PRE(insb == NULL ||
+        atf_process_stream_type(insb) != atf_process_stream_type_capture);
     PRE(outsb == NULL ||
         atf_process_stream_type(outsb) != atf_process_stream_type_capture);
     PRE(errsb == NULL ||
@@ -663,9 +2181,130 @@ atf_process_exec_list(atf_process_status_t *s,
     if (atf_is_error(err))
         goto out;
 
-    err = atf_process_exec_array(s, prog, argv2, outsb, errsb, prehook);
+    err = atf_process_exec_array(s, prog, argv2, insb, outsb, errsb,
+                                 prehook);
 
     free(argv2);
 out:
     return err;
 }
+
+/** Creates an anonymous file and opens it for reading and writing.
+ *
+ * The file lives in memory where the system supports it, and is an
+ * unlinked temporary file otherwise.  The descriptor is closed on exec,
+ * so it is only passed to children through redirections. */
+atf_error_t
+atf_process_create_anon_fd(const char *name, int *fd)
+{
+    atf_error_t err;
+
+#if HAVE_DECL_SYS_MEMFD_CREATE
+    *fd = (int)syscall(SYS_memfd_create, name, 1 /* MFD_CLOEXEC */);
+    if (*fd != -1)
+        return atf_no_error();
+#endif
+
+    {
+        atf_fs_path_t path;
+
+        err = atf_fs_path_init_fmt(&path, "%s/%s.XXXXXX",
+                                   atf_env_get_with_default("TMPDIR", "/tmp"),
+                                   name);
+        if (atf_is_error(err))
+            goto out;
+
+        err = atf_fs_mkstemp(&path, fd);
+        if (!atf_is_error(err))
+            (void)unlink(atf_fs_path_cstring(&path));
+        atf_fs_path_fini(&path);
+        if (atf_is_error(err))
+            goto out;
+    }
+
+    if (fcntl(*fd, F_SETFD, FD_CLOEXEC) == -1) {
+        err = atf_libc_error(errno, "Cannot set close-on-exec on %s", name);
+        close(*fd);
+        goto out;
+    }
+
+    INV(!atf_is_error(err));
+out:
+    return err;
+}
+
+/** Makes the current process adopt its orphaned descendants.
+ *
+ * Once this is done, any process started by the caller that outlives its
+ * parent is reparented to the caller instead of to init, so that it can
+ * still be found by atf_process_reap_descendants.  supported is set to
+ * false on systems that cannot do this, in which case only the direct
+ * children of the caller are visible to it. */
+atf_error_t
+atf_process_become_subreaper(bool *supported)
+{
+#if HAVE_DECL_PR_SET_CHILD_SUBREAPER
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0) == -1) {
+        if (errno != EINVAL)
+            return atf_libc_error(errno, "Cannot become a subreaper");
+        *supported = false;
+    } else
+        *supported = true;
+#else
+    *supported = false;
+#endif
+    return atf_no_error();
+}
+
+/** Kills and waits for all the descendants of the current process.
+ *
+ * Children that already terminated are only collected.  leaked is set to
+ * the number of children that were still running and had to be killed,
+ * together with their own descendants, which are not counted separately.
+ * Killing a child may make its descendants orphans, so this repeats until
+ * no children remain. */
+atf_error_t
+atf_process_reap_descendants(size_t *leaked)
+{
+    atf_error_t err;
+    bool first;
+
+    *leaked = 0;
+    err = atf_no_error();
+    first = true;
+    do {
+        pid_t *children;
+        size_t i, nchildren;
+
+        while (waitpid(-1, NULL, WNOHANG) > 0)
+            continue;
+
+        err = get_children(getpid(), &children, &nchildren);
+        if (atf_is_error(err))
+            break;
+
+        for (i = 0; i < nchildren; i++) {
+            err = signal_tree(children[i], SIGKILL);
+            if (atf_is_error(err) && atf_error_is(err, "libc") &&
+                atf_libc_error_code(err) == ESRCH) {
+                /* The child terminated on its own; nothing to do. */
+                atf_error_free(err);
+                err = atf_no_error();
+            } else if (atf_is_error(err))
+                break;
+            else if (first)
+                (*leaked)++;
+        }
+        for (i = 0; !atf_is_error(err) && i < nchildren; i++) {
+            while (waitpid(children[i], NULL, 0) == -1 && errno == EINTR)
+                continue;
+        }
+        free(children);
+
+        if (nchildren == 0)
+            break;
+        first = false;
+    } while (!atf_is_error(err));
+
+    return err;
+}
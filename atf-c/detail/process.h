@@ -50,6 +50,14 @@ struct atf_process_stream {
 
     /* Valid if m_type == redirect_path. */
     const atf_fs_path_t *m_path;
+
+    /* Valid if m_type == ring. */
+    size_t m_ring_size;
+    int m_tee_fd;
+
+    /* Valid if m_type == inline. */
+    const void *m_data;
+    size_t m_length;
 };
 typedef struct atf_process_stream atf_process_stream_t;
 
@@ -58,15 +66,21 @@ extern const int atf_process_stream_type_connect;
 extern const int atf_process_stream_type_inherit;
 extern const int atf_process_stream_type_redirect_fd;
 extern const int atf_process_stream_type_redirect_path;
+extern const int atf_process_stream_type_ring;
+extern const int atf_process_stream_type_inline;
 
 atf_error_t atf_process_stream_init_capture(atf_process_stream_t *);
 atf_error_t atf_process_stream_init_connect(atf_process_stream_t *,
                                             const int, const int);
 atf_error_t atf_process_stream_init_inherit(atf_process_stream_t *);
+atf_error_t atf_process_stream_init_inline(atf_process_stream_t *,
+                                           const void *, const size_t);
 atf_error_t atf_process_stream_init_redirect_fd(atf_process_stream_t *,
                                                 const int fd);
 atf_error_t atf_process_stream_init_redirect_path(atf_process_stream_t *,
                                                   const atf_fs_path_t *);
+atf_error_t atf_process_stream_init_ring(atf_process_stream_t *,
+                                         const size_t, const int);
 void atf_process_stream_fini(atf_process_stream_t *);
 
 int atf_process_stream_type(const atf_process_stream_t *);
@@ -88,24 +102,94 @@ bool atf_process_status_signaled(const atf_process_status_t *);
 int atf_process_status_termsig(const atf_process_status_t *);
 bool atf_process_status_coredump(const atf_process_status_t *);
 
+/* ---------------------------------------------------------------------
+ * The "atf_process_ring" type.
+ * --------------------------------------------------------------------- */
+
+struct atf_process_ring {
+    char *m_data;
+    size_t m_length;
+    unsigned long long m_dropped;
+};
+typedef struct atf_process_ring atf_process_ring_t;
+
+atf_error_t atf_process_ring_init(atf_process_ring_t *);
+void atf_process_ring_fini(atf_process_ring_t *);
+
+const char *atf_process_ring_data(const atf_process_ring_t *, size_t *);
+unsigned long long atf_process_ring_dropped(const atf_process_ring_t *);
+bool atf_process_ring_truncated(const atf_process_ring_t *);
+
 /* ---------------------------------------------------------------------
  * The "atf_process_child" type.
  * --------------------------------------------------------------------- */
 
 struct atf_process_child {
     pid_t m_pid;
+    int m_pidfd;
 
+    int m_stdin;
     int m_stdout;
     int m_stderr;
+
+    /* Valid if any stream is of the ring type. */
+    pid_t m_drainer_pid;
+    int m_drainer_fd;
 };
 typedef struct atf_process_child atf_process_child_t;
 
+void atf_process_child_fini(atf_process_child_t *);
 atf_error_t atf_process_child_wait(atf_process_child_t *,
                                    atf_process_status_t *);
+atf_error_t atf_process_child_wait_any(atf_process_child_t *const *,
+                                       const size_t, size_t *,
+                                       atf_process_status_t *);
+atf_error_t atf_process_child_wait_for(atf_process_child_t *, const int,
+                                       bool *, atf_process_status_t *);
+atf_error_t atf_process_child_kill_tree(atf_process_child_t *, const int);
+atf_error_t atf_process_child_drain(atf_process_child_t *,
+                                    atf_process_ring_t *,
+                                    atf_process_ring_t *);
 pid_t atf_process_child_pid(const atf_process_child_t *);
+int atf_process_child_stdin(atf_process_child_t *);
+void atf_process_child_close_stdin(atf_process_child_t *);
 int atf_process_child_stdout(atf_process_child_t *);
 int atf_process_child_stderr(atf_process_child_t *);
 
+/* ---------------------------------------------------------------------
+ * The "atf_process_mux" type.
+ * --------------------------------------------------------------------- */
+
+struct atf_process_mux_impl;
+struct atf_process_mux {
+    struct atf_process_mux_impl *pimpl;
+};
+typedef struct atf_process_mux atf_process_mux_t;
+
+struct atf_process_mux_event {
+    int m_type;
+
+    /* Valid unless m_type == timeout. */
+    atf_process_child_t *m_child;
+
+    /* Valid if m_type == exited. */
+    atf_process_status_t m_status;
+};
+typedef struct atf_process_mux_event atf_process_mux_event_t;
+
+extern const int atf_process_mux_event_timeout;
+extern const int atf_process_mux_event_stdout;
+extern const int atf_process_mux_event_stderr;
+extern const int atf_process_mux_event_exited;
+
+atf_error_t atf_process_mux_init(atf_process_mux_t *);
+void atf_process_mux_fini(atf_process_mux_t *);
+
+atf_error_t atf_process_mux_add(atf_process_mux_t *, atf_process_child_t *);
+size_t atf_process_mux_size(const atf_process_mux_t *);
+atf_error_t atf_process_mux_wait(atf_process_mux_t *, const int,
+                                 atf_process_mux_event_t *);
+
 /* ---------------------------------------------------------------------
  * Free functions.
  * --------------------------------------------------------------------- */
@@ -114,18 +198,33 @@ atf_error_t atf_process_fork(atf_process_child_t *,
                              void (*)(void *),
                              const atf_process_stream_t *,
                              const atf_process_stream_t *,
+                             const atf_process_stream_t *,
                              void *);
+atf_error_t atf_process_spawn(atf_process_child_t *,
+                              const char *,
+                              const char *const *,
+                              void (*)(void *),
+                              const atf_process_stream_t *,
+                              const atf_process_stream_t *,
+                              const atf_process_stream_t *,
+                              void *);
 atf_error_t atf_process_exec_array(atf_process_status_t *,
                                    const atf_fs_path_t *,
                                    const char *const *,
                                    const atf_process_stream_t *,
                                    const atf_process_stream_t *,
+                                   const atf_process_stream_t *,
                                    void (*)(void));
 atf_error_t atf_process_exec_list(atf_process_status_t *,
                                   const atf_fs_path_t *,
                                   const atf_list_t *,
                                   const atf_process_stream_t *,
                                   const atf_process_stream_t *,
+                                  const atf_process_stream_t *,
                                   void (*)(void));
+atf_error_t atf_process_resolve_prog(const char *, atf_fs_path_t *);
+atf_error_t atf_process_create_anon_fd(const char *, int *);
+atf_error_t atf_process_become_subreaper(bool *);
+atf_error_t atf_process_reap_descendants(size_t *);
 
 #endif /* !defined(ATF_C_DETAIL_PROCESS_H) */
@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #include <errno.h>
@@ -418,7 +419,7 @@ do_fork(const struct base_stream *outfs, void *out,
     outfs->init(out);
     errfs->init(err);
 
-    RE(atf_process_fork(&child, child_print, outfs->m_sb_ptr,
+    RE(atf_process_fork(&child, child_print, NULL, outfs->m_sb_ptr,
                         errfs->m_sb_ptr, &cpd));
     if (outfs->process != NULL)
         outfs->process(out, &child);
@@ -432,6 +433,37 @@ do_fork(const struct base_stream *outfs, void *out,
     atf_process_status_fini(&status);
 }
 
+static
+void
+do_spawn(const struct base_stream *outfs, void *out,
+         const struct base_stream *errfs, void *err)
+{
+    atf_process_child_t child;
+    atf_process_status_t status;
+    struct child_print_data cpd = { "msg" };
+    const char *argv[] = { "sh", "-c",
+                           "echo 'stdout: msg'; echo 'stderr: msg' 1>&2",
+                           NULL };
+
+    outfs->init(out);
+    errfs->init(err);
+
+    RE(atf_process_spawn(&child, argv[0], argv, child_print, NULL,
+                         outfs->m_sb_ptr, errfs->m_sb_ptr, &cpd));
+    if (outfs->process != NULL)
+        outfs->process(out, &child);
+    if (errfs->process != NULL)
+        errfs->process(err, &child);
+    RE(atf_process_child_wait(&child, &status));
+    ATF_CHECK(atf_process_status_exited(&status));
+    ATF_CHECK_EQ(atf_process_status_exitstatus(&status), EXIT_SUCCESS);
+
+    outfs->fini(out);
+    errfs->fini(err);
+
+    atf_process_status_fini(&status);
+}
+
 /* ---------------------------------------------------------------------
  * Test cases for the "stream" type.
  * --------------------------------------------------------------------- */
@@ -529,6 +561,24 @@ ATF_TC_BODY(stream_init_redirect_path, tc)
     atf_fs_path_fini(&path);
 }
 
+ATF_TC(stream_init_inline);
+ATF_TC_HEAD(stream_init_inline, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests the "
+                      "atf_process_stream_init_inline function");
+}
+ATF_TC_BODY(stream_init_inline, tc)
+{
+    atf_process_stream_t sb;
+
+    RE(atf_process_stream_init_inline(&sb, "foo", 3));
+
+    ATF_CHECK_EQ(atf_process_stream_type(&sb),
+                 atf_process_stream_type_inline);
+
+    atf_process_stream_fini(&sb);
+}
+
 /* ---------------------------------------------------------------------
  * Test cases for the "status" type.
  * --------------------------------------------------------------------- */
@@ -710,7 +760,7 @@ ATF_TC_BODY(child_pid, tc)
     RE(atf_process_stream_init_capture(&outsb));
     RE(atf_process_stream_init_inherit(&errsb));
 
-    RE(atf_process_fork(&child, child_report_pid, &outsb, &errsb, NULL));
+    RE(atf_process_fork(&child, child_report_pid, NULL, &outsb, &errsb, NULL));
     ATF_CHECK_EQ(read(atf_process_child_stdout(&child), &pid, sizeof(pid)),
                  sizeof(pid));
     printf("Expected PID: %d\n", (int)atf_process_child_pid(&child));
@@ -760,7 +810,8 @@ child_spawn_loop_and_wait_eintr(void *v ATF_DEFS_ATTRIBUTE_UNUSED)
 
         RE_ABORT(atf_process_stream_init_capture(&outsb));
         RE_ABORT(atf_process_stream_init_inherit(&errsb));
-        RE_ABORT(atf_process_fork(&child, child_loop, &outsb, &errsb, NULL));
+        RE_ABORT(atf_process_fork(&child, child_loop, NULL, &outsb, &errsb,
+                                  NULL));
         atf_process_stream_fini(&outsb);
         atf_process_stream_fini(&errsb);
     }
@@ -822,7 +873,7 @@ ATF_TC_BODY(child_wait_eintr, tc)
 
         RE(atf_process_stream_init_capture(&outsb));
         RE(atf_process_stream_init_inherit(&errsb));
-        RE(atf_process_fork(&child, child_spawn_loop_and_wait_eintr,
+        RE(atf_process_fork(&child, child_spawn_loop_and_wait_eintr, NULL,
                             &outsb, &errsb, NULL));
         atf_process_stream_fini(&outsb);
         atf_process_stream_fini(&errsb);
@@ -850,6 +901,495 @@ ATF_TC_BODY(child_wait_eintr, tc)
     atf_process_status_fini(&status);
 }
 
+static
+void
+child_exit_cookie(void *v)
+{
+    const int *exitcode = v;
+
+    if (*exitcode != 0)
+        sleep(1);
+    exit(*exitcode);
+}
+
+ATF_TC(child_wait_any);
+ATF_TC_HEAD(child_wait_any, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests waiting for the termination of "
+                      "any child in a set of children");
+}
+ATF_TC_BODY(child_wait_any, tc)
+{
+    atf_process_child_t child1, child2;
+    atf_process_child_t *children[3];
+    atf_process_status_t status;
+    int exitcode1 = 5, exitcode2 = 0;
+    size_t index;
+
+    RE(atf_process_fork(&child1, child_exit_cookie, NULL, NULL, NULL,
+                        &exitcode1));
+    RE(atf_process_fork(&child2, child_exit_cookie, NULL, NULL, NULL,
+                        &exitcode2));
+    children[0] = &child1;
+    children[1] = NULL;
+    children[2] = &child2;
+
+    RE(atf_process_child_wait_any(children, 3, &index, &status));
+    ATF_REQUIRE_EQ(2, index);
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    ATF_REQUIRE_EQ(exitcode2, atf_process_status_exitstatus(&status));
+    atf_process_status_fini(&status);
+    children[2] = NULL;
+
+    RE(atf_process_child_wait_any(children, 3, &index, &status));
+    ATF_REQUIRE_EQ(0, index);
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    ATF_REQUIRE_EQ(exitcode1, atf_process_status_exitstatus(&status));
+    atf_process_status_fini(&status);
+}
+
+ATF_TC(child_wait_any_others);
+ATF_TC_HEAD(child_wait_any_others, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that waiting for any child in a "
+                      "set does not reap children outside of the set");
+}
+ATF_TC_BODY(child_wait_any_others, tc)
+{
+    atf_process_child_t child1, child2;
+    atf_process_child_t *children[1];
+    atf_process_status_t status;
+    int exitcode1 = 5, exitcode2 = 0;
+    size_t index;
+
+    /* The child outside of the set terminates first. */
+    RE(atf_process_fork(&child1, child_exit_cookie, NULL, NULL, NULL,
+                        &exitcode1));
+    RE(atf_process_fork(&child2, child_exit_cookie, NULL, NULL, NULL,
+                        &exitcode2));
+    children[0] = &child1;
+
+    RE(atf_process_child_wait_any(children, 1, &index, &status));
+    ATF_REQUIRE_EQ(0, index);
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    ATF_REQUIRE_EQ(exitcode1, atf_process_status_exitstatus(&status));
+    atf_process_status_fini(&status);
+
+    RE(atf_process_child_wait(&child2, &status));
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    ATF_REQUIRE_EQ(exitcode2, atf_process_status_exitstatus(&status));
+    atf_process_status_fini(&status);
+}
+
+static
+void
+child_wait_for_eof(void *v)
+{
+    const int *fds = v;
+    char ch;
+
+    close(fds[1]);
+    exit(read(fds[0], &ch, 1) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+ATF_TC(child_wait_for);
+ATF_TC_HEAD(child_wait_for, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests waiting for the termination of "
+                      "a child with a timeout");
+}
+ATF_TC_BODY(child_wait_for, tc)
+{
+    atf_process_child_t child;
+    atf_process_status_t status;
+    bool done;
+    int fds[2];
+
+    ATF_REQUIRE(pipe(fds) != -1);
+    RE(atf_process_fork(&child, child_wait_for_eof, NULL, NULL, NULL, fds));
+    close(fds[0]);
+
+    RE(atf_process_child_wait_for(&child, 0, &done, &status));
+    ATF_REQUIRE(!done);
+    RE(atf_process_child_wait_for(&child, 50, &done, &status));
+    ATF_REQUIRE(!done);
+
+    close(fds[1]);
+    RE(atf_process_child_wait_for(&child, -1, &done, &status));
+    ATF_REQUIRE(done);
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    ATF_REQUIRE_EQ(EXIT_SUCCESS, atf_process_status_exitstatus(&status));
+    atf_process_status_fini(&status);
+}
+
+static
+void
+child_spawn_grandchild(void *v)
+{
+    const int *fds = v;
+    pid_t pid;
+
+    close(fds[0]);
+    pid = fork();
+    if (pid == -1)
+        exit(EXIT_FAILURE);
+    else if (pid == 0) {
+        /* Tell the parent that the whole tree exists. */
+        if (write(fds[1], "x", 1) != 1)
+            exit(EXIT_FAILURE);
+    }
+    for (;;)
+        pause();
+}
+
+ATF_TC(child_kill_tree);
+ATF_TC_HEAD(child_kill_tree, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that killing a child also kills "
+                      "its descendants");
+}
+ATF_TC_BODY(child_kill_tree, tc)
+{
+    atf_process_child_t child;
+    atf_process_status_t status;
+    struct stat sb;
+    char ch;
+    int fds[2];
+
+    if (stat("/proc/self/task", &sb) == -1)
+        atf_tc_skip("Cannot discover descendants without /proc");
+
+    ATF_REQUIRE(pipe(fds) != -1);
+    RE(atf_process_fork(&child, child_spawn_grandchild, NULL, NULL, NULL,
+                        fds));
+    close(fds[1]);
+    ATF_REQUIRE_EQ(1, read(fds[0], &ch, 1));
+
+    RE(atf_process_child_kill_tree(&child, SIGKILL));
+    RE(atf_process_child_wait(&child, &status));
+    ATF_REQUIRE(atf_process_status_signaled(&status));
+    ATF_REQUIRE_EQ(SIGKILL, atf_process_status_termsig(&status));
+    atf_process_status_fini(&status);
+
+    /* The pipe only reports EOF once the grandchild is gone too. */
+    ATF_REQUIRE_EQ(0, read(fds[0], &ch, 1));
+    close(fds[0]);
+}
+
+static
+void
+child_print_cookie(void *v)
+{
+    const char *msg = v;
+
+    printf("%s\n", msg);
+    exit(msg[0] == 'a' ? 1 : 2);
+}
+
+ATF_TC(mux_wait);
+ATF_TC_HEAD(mux_wait, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests waiting for the output and "
+                      "termination of several children at once");
+}
+ATF_TC_BODY(mux_wait, tc)
+{
+    atf_process_child_t child1, child2;
+    atf_process_stream_t outsb;
+    atf_process_mux_t mux;
+    atf_process_mux_event_t ev;
+    char msg1[] = "a", msg2[] = "b";
+    char output1[16], output2[16];
+    size_t len1 = 0, len2 = 0;
+    bool exited1 = false, exited2 = false;
+
+    RE(atf_process_stream_init_capture(&outsb));
+    RE(atf_process_fork(&child1, child_print_cookie, NULL, &outsb, NULL,
+                        msg1));
+    RE(atf_process_fork(&child2, child_print_cookie, NULL, &outsb, NULL,
+                        msg2));
+    atf_process_stream_fini(&outsb);
+
+    RE(atf_process_mux_init(&mux));
+    RE(atf_process_mux_add(&mux, &child1));
+    RE(atf_process_mux_add(&mux, &child2));
+    ATF_REQUIRE_EQ(2, atf_process_mux_size(&mux));
+
+    while (atf_process_mux_size(&mux) > 0) {
+        RE(atf_process_mux_wait(&mux, -1, &ev));
+        if (ev.m_type == atf_process_mux_event_stdout) {
+            char *output = ev.m_child == &child1 ? output1 : output2;
+            size_t *len = ev.m_child == &child1 ? &len1 : &len2;
+            ssize_t n;
+
+            ATF_REQUIRE(*len < sizeof(output1));
+            n = read(atf_process_child_stdout(ev.m_child), output + *len,
+                     sizeof(output1) - *len);
+            ATF_REQUIRE(n != -1);
+            *len += n;
+        } else {
+            ATF_REQUIRE_EQ(atf_process_mux_event_exited, ev.m_type);
+            ATF_REQUIRE(atf_process_status_exited(&ev.m_status));
+            if (ev.m_child == &child1) {
+                ATF_REQUIRE_EQ(1, atf_process_status_exitstatus(&ev.m_status));
+                exited1 = true;
+            } else {
+                ATF_REQUIRE_EQ(2, atf_process_status_exitstatus(&ev.m_status));
+                exited2 = true;
+            }
+            atf_process_status_fini(&ev.m_status);
+        }
+    }
+    atf_process_mux_fini(&mux);
+
+    ATF_REQUIRE(exited1 && exited2);
+    ATF_REQUIRE_EQ(2, len1);
+    ATF_REQUIRE(memcmp(output1, "a\n", 2) == 0);
+    ATF_REQUIRE_EQ(2, len2);
+    ATF_REQUIRE(memcmp(output2, "b\n", 2) == 0);
+}
+
+ATF_TC(mux_wait_timeout);
+ATF_TC_HEAD(mux_wait_timeout, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that waiting on a multiplexer "
+                      "times out if no child does anything");
+}
+ATF_TC_BODY(mux_wait_timeout, tc)
+{
+    atf_process_child_t child;
+    atf_process_status_t status;
+    atf_process_mux_t mux;
+    atf_process_mux_event_t ev;
+    int fds[2];
+
+    ATF_REQUIRE(pipe(fds) != -1);
+    RE(atf_process_fork(&child, child_wait_for_eof, NULL, NULL, NULL, fds));
+    close(fds[0]);
+
+    RE(atf_process_mux_init(&mux));
+    RE(atf_process_mux_add(&mux, &child));
+    RE(atf_process_mux_wait(&mux, 50, &ev));
+    ATF_REQUIRE_EQ(atf_process_mux_event_timeout, ev.m_type);
+
+    close(fds[1]);
+    RE(atf_process_mux_wait(&mux, -1, &ev));
+    ATF_REQUIRE_EQ(atf_process_mux_event_exited, ev.m_type);
+    ATF_REQUIRE(ev.m_child == &child);
+    status = ev.m_status;
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    ATF_REQUIRE_EQ(EXIT_SUCCESS, atf_process_status_exitstatus(&status));
+    atf_process_status_fini(&status);
+    ATF_REQUIRE_EQ(0, atf_process_mux_size(&mux));
+    atf_process_mux_fini(&mux);
+}
+
+static
+void
+child_write_pattern(void *v)
+{
+    const size_t *size = v;
+    char buf[1000];
+    size_t i;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = '0' + i % 10;
+    for (i = 0; i < *size; i += sizeof(buf)) {
+        if (write(STDOUT_FILENO, buf, sizeof(buf)) != sizeof(buf))
+            exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "short\n");
+    exit(EXIT_SUCCESS);
+}
+
+ATF_TC(child_drain);
+ATF_TC_HEAD(child_drain, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that ring streams keep the most "
+                      "recent output of a child and report truncation");
+}
+ATF_TC_BODY(child_drain, tc)
+{
+    atf_process_child_t child;
+    atf_process_status_t status;
+    atf_process_stream_t outsb, errsb;
+    atf_process_ring_t out, err;
+    size_t size = 100000, length;
+    const char *data;
+
+    RE(atf_process_stream_init_ring(&outsb, 1000, -1));
+    RE(atf_process_stream_init_ring(&errsb, 100, -1));
+    RE(atf_process_fork(&child, child_write_pattern, NULL, &outsb, &errsb,
+                        &size));
+    atf_process_stream_fini(&errsb);
+    atf_process_stream_fini(&outsb);
+
+    /* The output exceeds the capacity of a pipe, so this only terminates if
+     * something reads it while we are not looking. */
+    RE(atf_process_child_wait(&child, &status));
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    ATF_REQUIRE_EQ(EXIT_SUCCESS, atf_process_status_exitstatus(&status));
+    atf_process_status_fini(&status);
+
+    RE(atf_process_ring_init(&out));
+    RE(atf_process_ring_init(&err));
+    RE(atf_process_child_drain(&child, &out, &err));
+
+    data = atf_process_ring_data(&out, &length);
+    ATF_REQUIRE_EQ(1000, length);
+    ATF_REQUIRE_EQ('0', data[0]);
+    ATF_REQUIRE_EQ('9', data[999]);
+    ATF_REQUIRE(atf_process_ring_truncated(&out));
+    ATF_REQUIRE_EQ(99000, atf_process_ring_dropped(&out));
+
+    ATF_REQUIRE_STREQ("short\n", atf_process_ring_data(&err, &length));
+    ATF_REQUIRE(!atf_process_ring_truncated(&err));
+
+    atf_process_ring_fini(&err);
+    atf_process_ring_fini(&out);
+}
+
+ATF_TC(child_fini_drainer);
+ATF_TC_HEAD(child_fini_drainer, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that atf_process_child_fini "
+                      "releases the drainer of a child that was not drained");
+}
+ATF_TC_BODY(child_fini_drainer, tc)
+{
+    atf_process_child_t child;
+    atf_process_status_t status;
+    atf_process_stream_t outsb, errsb;
+    size_t size = 3000;
+    int dummy;
+
+    RE(atf_process_stream_init_ring(&outsb, 10, -1));
+    RE(atf_process_stream_init_ring(&errsb, 10, -1));
+    RE(atf_process_fork(&child, child_write_pattern, NULL, &outsb, &errsb,
+                        &size));
+    atf_process_stream_fini(&errsb);
+    atf_process_stream_fini(&outsb);
+
+    RE(atf_process_child_wait(&child, &status));
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    atf_process_status_fini(&status);
+
+    atf_process_child_fini(&child);
+    ATF_REQUIRE_EQ(-1, child.m_drainer_fd);
+    ATF_REQUIRE(waitpid(-1, &dummy, WNOHANG) == -1);
+    ATF_REQUIRE_EQ(ECHILD, errno);
+
+    /* Releasing a child a second time is harmless. */
+    atf_process_child_fini(&child);
+}
+
+ATF_TC(child_drain_tee);
+ATF_TC_HEAD(child_drain_tee, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that ring streams copy all the "
+                      "output of a child to their tee descriptor");
+}
+ATF_TC_BODY(child_drain_tee, tc)
+{
+    atf_process_child_t child;
+    atf_process_status_t status;
+    atf_process_stream_t outsb, errsb;
+    atf_process_ring_t out;
+    size_t size = 3000, length;
+    char *line;
+    int fd;
+
+    fd = open("tee", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ATF_REQUIRE(fd != -1);
+    RE(atf_process_stream_init_ring(&outsb, 10, fd));
+    RE(atf_process_stream_init_capture(&errsb));
+    RE(atf_process_fork(&child, child_write_pattern, NULL, &outsb, &errsb,
+                        &size));
+    atf_process_stream_fini(&errsb);
+    atf_process_stream_fini(&outsb);
+    close(fd);
+
+    line = atf_utils_readline(atf_process_child_stderr(&child));
+    ATF_REQUIRE_STREQ("short", line);
+    free(line);
+
+    RE(atf_process_ring_init(&out));
+    RE(atf_process_child_drain(&child, &out, NULL));
+    ATF_REQUIRE_STREQ("0123456789", atf_process_ring_data(&out, &length));
+    ATF_REQUIRE_EQ(2990, atf_process_ring_dropped(&out));
+    atf_process_ring_fini(&out);
+
+    RE(atf_process_child_wait(&child, &status));
+    atf_process_status_fini(&status);
+
+    {
+        struct stat sb;
+        ATF_REQUIRE(stat("tee", &sb) != -1);
+        ATF_REQUIRE_EQ(3000, sb.st_size);
+    }
+}
+
+static
+void
+child_copy_stdin(void *v ATF_DEFS_ATTRIBUTE_UNUSED)
+{
+    char buf[1024];
+    ssize_t n;
+
+    while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+        if (write(STDOUT_FILENO, buf, n) != n)
+            exit(EXIT_FAILURE);
+    }
+    exit(n == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static
+void
+check_copied_stdin(atf_process_child_t *child, const char *exp)
+{
+    atf_process_status_t status;
+    char buf[1024];
+    ssize_t n;
+    size_t length = 0;
+
+    while ((n = read(atf_process_child_stdout(child), buf + length,
+                     sizeof(buf) - length - 1)) > 0)
+        length += n;
+    ATF_REQUIRE(n == 0);
+    buf[length] = '\0';
+    ATF_REQUIRE_STREQ(exp, buf);
+
+    RE(atf_process_child_wait(child, &status));
+    ATF_REQUIRE(atf_process_status_exited(&status));
+    ATF_REQUIRE_EQ(EXIT_SUCCESS, atf_process_status_exitstatus(&status));
+    atf_process_status_fini(&status);
+}
+
+ATF_TC(child_stdin);
+ATF_TC_HEAD(child_stdin, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests feeding the stdin of a child "
+                      "through a capture stream");
+}
+ATF_TC_BODY(child_stdin, tc)
+{
+    atf_process_child_t child;
+    atf_process_stream_t insb, outsb;
+    const char *msg = "first line\nsecond line\n";
+
+    RE(atf_process_stream_init_capture(&insb));
+    RE(atf_process_stream_init_capture(&outsb));
+    RE(atf_process_fork(&child, child_copy_stdin, &insb, &outsb, NULL, NULL));
+    atf_process_stream_fini(&outsb);
+    atf_process_stream_fini(&insb);
+
+    ATF_REQUIRE_EQ((ssize_t)strlen(msg),
+                   write(atf_process_child_stdin(&child), msg, strlen(msg)));
+    atf_process_child_close_stdin(&child);
+
+    check_copied_stdin(&child, msg);
+}
+
 /* ---------------------------------------------------------------------
  * Tests cases for the free functions.
  * --------------------------------------------------------------------- */
@@ -869,7 +1409,8 @@ do_exec(const atf_tc_t *tc, const char *helper_name, atf_process_status_t *s,
     argv[2] = NULL;
     printf("Executing %s %s\n", argv[0], argv[1]);
 
-    RE(atf_process_exec_array(s, &process_helpers, argv, NULL, NULL, prehook));
+    RE(atf_process_exec_array(s, &process_helpers, argv, NULL, NULL, NULL,
+                              prehook));
     atf_fs_path_fini(&process_helpers);
 }
 
@@ -921,8 +1462,8 @@ ATF_TC_BODY(exec_list, tc)
 
         RE(atf_fs_path_init_fmt(&outpath, "stdout"));
         RE(atf_process_stream_init_redirect_path(&outsb, &outpath));
-        RE(atf_process_exec_list(&status, &process_helpers, &argv, &outsb,
-                                 NULL, NULL));
+        RE(atf_process_exec_list(&status, &process_helpers, &argv, NULL,
+                                 &outsb, NULL, NULL));
         atf_process_stream_fini(&outsb);
         atf_fs_path_fini(&outpath);
     }
@@ -1010,7 +1551,7 @@ ATF_TC_BODY(fork_cookie, tc)
         atf_process_child_t child;
         atf_process_status_t status;
 
-        RE(atf_process_fork(&child, child_cookie, &outsb, &errsb, NULL));
+        RE(atf_process_fork(&child, child_cookie, NULL, &outsb, &errsb, NULL));
         RE(atf_process_child_wait(&child, &status));
 
         ATF_CHECK(atf_process_status_exited(&status));
@@ -1024,7 +1565,8 @@ ATF_TC_BODY(fork_cookie, tc)
         atf_process_status_t status;
         int dummy_int;
 
-        RE(atf_process_fork(&child, child_cookie, &outsb, &errsb, &dummy_int));
+        RE(atf_process_fork(&child, child_cookie, NULL, &outsb, &errsb,
+                            &dummy_int));
         RE(atf_process_child_wait(&child, &status));
 
         ATF_CHECK(atf_process_status_exited(&status));
@@ -1037,6 +1579,51 @@ ATF_TC_BODY(fork_cookie, tc)
     atf_process_stream_fini(&outsb);
 }
 
+ATF_TC(fork_in_inline);
+ATF_TC_HEAD(fork_in_inline, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests forking a child, with stdin "
+                      "fed from inline data");
+}
+ATF_TC_BODY(fork_in_inline, tc)
+{
+    atf_process_child_t child;
+    atf_process_stream_t insb, outsb;
+    const char *msg = "inline line\n";
+
+    RE(atf_process_stream_init_inline(&insb, msg, strlen(msg)));
+    RE(atf_process_stream_init_capture(&outsb));
+    RE(atf_process_fork(&child, child_copy_stdin, &insb, &outsb, NULL, NULL));
+    atf_process_stream_fini(&outsb);
+    atf_process_stream_fini(&insb);
+
+    check_copied_stdin(&child, msg);
+}
+
+ATF_TC(fork_in_redirect_path);
+ATF_TC_HEAD(fork_in_redirect_path, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests forking a child, with stdin "
+                      "redirected from a file");
+}
+ATF_TC_BODY(fork_in_redirect_path, tc)
+{
+    atf_process_child_t child;
+    atf_process_stream_t insb, outsb;
+    atf_fs_path_t inpath;
+
+    atf_utils_create_file("input", "file line\n");
+    RE(atf_fs_path_init_fmt(&inpath, "input"));
+    RE(atf_process_stream_init_redirect_path(&insb, &inpath));
+    RE(atf_process_stream_init_capture(&outsb));
+    RE(atf_process_fork(&child, child_copy_stdin, &insb, &outsb, NULL, NULL));
+    atf_process_stream_fini(&outsb);
+    atf_process_stream_fini(&insb);
+    atf_fs_path_fini(&inpath);
+
+    check_copied_stdin(&child, "file line\n");
+}
+
 #define TC_FORK_STREAMS(outlc, outuc, errlc, erruc) \
     ATF_TC(fork_out_ ## outlc ## _err_ ## errlc); \
     ATF_TC_HEAD(fork_out_ ## outlc ## _err_ ## errlc, tc) \
@@ -1090,6 +1677,159 @@ TC_FORK_STREAMS(redirect_path, REDIRECT_PATH, redirect_path, REDIRECT_PATH);
 
 #undef TC_FORK_STREAMS
 
+static
+void
+child_exit_fallback(void *v ATF_DEFS_ATTRIBUTE_UNUSED)
+{
+    exit(90);
+}
+
+ATF_TC(reap_descendants);
+ATF_TC_HEAD(reap_descendants, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that reaping the descendants of "
+                      "a process kills those still running and only counts "
+                      "these as leaked");
+}
+ATF_TC_BODY(reap_descendants, tc)
+{
+    atf_process_child_t child1, child2;
+    struct stat sb;
+    siginfo_t info;
+    bool supported;
+    size_t leaked;
+    char ch;
+    int fds[2], ret;
+
+    if (stat("/proc/self/task", &sb) == -1)
+        atf_tc_skip("Cannot discover descendants without /proc");
+
+    RE(atf_process_become_subreaper(&supported));
+
+    ATF_REQUIRE(pipe(fds) != -1);
+    RE(atf_process_fork(&child1, child_spawn_grandchild, NULL, NULL, NULL,
+                        fds));
+    RE(atf_process_fork(&child2, child_exit_fallback, NULL, NULL, NULL,
+                        NULL));
+    close(fds[1]);
+    ATF_REQUIRE_EQ(1, read(fds[0], &ch, 1));
+
+    /* Wait for the second child to exit but leave it to be collected. */
+    while ((ret = waitid(P_PID, atf_process_child_pid(&child2), &info,
+                         WEXITED | WNOWAIT)) == -1 && errno == EINTR)
+        continue;
+    ATF_REQUIRE_EQ(0, ret);
+
+    RE(atf_process_reap_descendants(&leaked));
+    ATF_REQUIRE_EQ(1, leaked);
+    ATF_REQUIRE_EQ(-1, waitpid(-1, NULL, WNOHANG));
+    ATF_REQUIRE_EQ(ECHILD, errno);
+
+    /* The pipe only reports EOF once the grandchild is gone too. */
+    ATF_REQUIRE_EQ(0, read(fds[0], &ch, 1));
+    close(fds[0]);
+
+    RE(atf_process_reap_descendants(&leaked));
+    ATF_REQUIRE_EQ(0, leaked);
+}
+
+ATF_TC(spawn_fallback);
+ATF_TC_HEAD(spawn_fallback, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that the start routine given to "
+                      "atf_process_spawn is run when the program cannot be "
+                      "spawned");
+}
+ATF_TC_BODY(spawn_fallback, tc)
+{
+    atf_process_child_t child;
+    atf_process_status_t status;
+    const char *argv[] = { "/non-existent/program", NULL };
+
+    RE(atf_process_spawn(&child, argv[0], argv, child_exit_fallback, NULL,
+                         NULL, NULL, NULL));
+    RE(atf_process_child_wait(&child, &status));
+    ATF_CHECK(atf_process_status_exited(&status));
+    ATF_CHECK_EQ(atf_process_status_exitstatus(&status), 90);
+    atf_process_status_fini(&status);
+}
+
+ATF_TC(spawn_in_inline);
+ATF_TC_HEAD(spawn_in_inline, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests spawning a child, with stdin "
+                      "fed from inline data");
+}
+ATF_TC_BODY(spawn_in_inline, tc)
+{
+    atf_process_child_t child;
+    atf_process_stream_t insb, outsb;
+    const char *argv[] = { "cat", NULL };
+    const char *msg = "spawned line\n";
+
+    RE(atf_process_stream_init_inline(&insb, msg, strlen(msg)));
+    RE(atf_process_stream_init_capture(&outsb));
+    RE(atf_process_spawn(&child, argv[0], argv, child_copy_stdin, &insb,
+                         &outsb, NULL, NULL));
+    atf_process_stream_fini(&outsb);
+    atf_process_stream_fini(&insb);
+
+    check_copied_stdin(&child, msg);
+}
+
+#define TC_SPAWN_STREAMS(outlc, outuc, errlc, erruc) \
+    ATF_TC(spawn_out_ ## outlc ## _err_ ## errlc); \
+    ATF_TC_HEAD(spawn_out_ ## outlc ## _err_ ## errlc, tc) \
+    { \
+        atf_tc_set_md_var(tc, "descr", "Tests spawning a child, with " \
+                          "stdout " #outlc " and stderr " #errlc); \
+    } \
+    ATF_TC_BODY(spawn_out_ ## outlc ## _err_ ## errlc, tc) \
+    { \
+        struct outlc ## _stream out = outuc ## _STREAM(stdout_type); \
+        struct errlc ## _stream err = erruc ## _STREAM(stderr_type); \
+        do_spawn(&out.m_base, &out, &err.m_base, &err); \
+    }
+
+TC_SPAWN_STREAMS(capture, CAPTURE, capture, CAPTURE);
+TC_SPAWN_STREAMS(capture, CAPTURE, connect, CONNECT);
+TC_SPAWN_STREAMS(capture, CAPTURE, default, DEFAULT);
+TC_SPAWN_STREAMS(capture, CAPTURE, inherit, INHERIT);
+TC_SPAWN_STREAMS(capture, CAPTURE, redirect_fd, REDIRECT_FD);
+TC_SPAWN_STREAMS(capture, CAPTURE, redirect_path, REDIRECT_PATH);
+TC_SPAWN_STREAMS(connect, CONNECT, capture, CAPTURE);
+TC_SPAWN_STREAMS(connect, CONNECT, connect, CONNECT);
+TC_SPAWN_STREAMS(connect, CONNECT, default, DEFAULT);
+TC_SPAWN_STREAMS(connect, CONNECT, inherit, INHERIT);
+TC_SPAWN_STREAMS(connect, CONNECT, redirect_fd, REDIRECT_FD);
+TC_SPAWN_STREAMS(connect, CONNECT, redirect_path, REDIRECT_PATH);
+TC_SPAWN_STREAMS(default, DEFAULT, capture, CAPTURE);
+TC_SPAWN_STREAMS(default, DEFAULT, connect, CONNECT);
+TC_SPAWN_STREAMS(default, DEFAULT, default, DEFAULT);
+TC_SPAWN_STREAMS(default, DEFAULT, inherit, INHERIT);
+TC_SPAWN_STREAMS(default, DEFAULT, redirect_fd, REDIRECT_FD);
+TC_SPAWN_STREAMS(default, DEFAULT, redirect_path, REDIRECT_PATH);
+TC_SPAWN_STREAMS(inherit, INHERIT, capture, CAPTURE);
+TC_SPAWN_STREAMS(inherit, INHERIT, connect, CONNECT);
+TC_SPAWN_STREAMS(inherit, INHERIT, default, DEFAULT);
+TC_SPAWN_STREAMS(inherit, INHERIT, inherit, INHERIT);
+TC_SPAWN_STREAMS(inherit, INHERIT, redirect_fd, REDIRECT_FD);
+TC_SPAWN_STREAMS(inherit, INHERIT, redirect_path, REDIRECT_PATH);
+TC_SPAWN_STREAMS(redirect_fd, REDIRECT_FD, capture, CAPTURE);
+TC_SPAWN_STREAMS(redirect_fd, REDIRECT_FD, connect, CONNECT);
+TC_SPAWN_STREAMS(redirect_fd, REDIRECT_FD, default, DEFAULT);
+TC_SPAWN_STREAMS(redirect_fd, REDIRECT_FD, inherit, INHERIT);
+TC_SPAWN_STREAMS(redirect_fd, REDIRECT_FD, redirect_fd, REDIRECT_FD);
+TC_SPAWN_STREAMS(redirect_fd, REDIRECT_FD, redirect_path, REDIRECT_PATH);
+TC_SPAWN_STREAMS(redirect_path, REDIRECT_PATH, capture, CAPTURE);
+TC_SPAWN_STREAMS(redirect_path, REDIRECT_PATH, connect, CONNECT);
+TC_SPAWN_STREAMS(redirect_path, REDIRECT_PATH, default, DEFAULT);
+TC_SPAWN_STREAMS(redirect_path, REDIRECT_PATH, inherit, INHERIT);
+TC_SPAWN_STREAMS(redirect_path, REDIRECT_PATH, redirect_fd, REDIRECT_FD);
+TC_SPAWN_STREAMS(redirect_path, REDIRECT_PATH, redirect_path, REDIRECT_PATH);
+
+#undef TC_SPAWN_STREAMS
+
 /* ---------------------------------------------------------------------
  * Main.
  * --------------------------------------------------------------------- */
@@ -1102,6 +1842,7 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, stream_init_inherit);
     ATF_TP_ADD_TC(tp, stream_init_redirect_fd);
     ATF_TP_ADD_TC(tp, stream_init_redirect_path);
+    ATF_TP_ADD_TC(tp, stream_init_inline);
 
     /* Add the tests for the "status" type. */
     ATF_TP_ADD_TC(tp, status_exited);
@@ -1111,6 +1852,16 @@ ATF_TP_ADD_TCS(tp)
     /* Add the tests for the "child" type. */
     ATF_TP_ADD_TC(tp, child_pid);
     ATF_TP_ADD_TC(tp, child_wait_eintr);
+    ATF_TP_ADD_TC(tp, child_wait_any);
+    ATF_TP_ADD_TC(tp, child_wait_any_others);
+    ATF_TP_ADD_TC(tp, child_wait_for);
+    ATF_TP_ADD_TC(tp, child_kill_tree);
+    ATF_TP_ADD_TC(tp, child_drain);
+    ATF_TP_ADD_TC(tp, child_drain_tee);
+    ATF_TP_ADD_TC(tp, child_fini_drainer);
+    ATF_TP_ADD_TC(tp, child_stdin);
+    ATF_TP_ADD_TC(tp, mux_wait);
+    ATF_TP_ADD_TC(tp, mux_wait_timeout);
 
     /* Add the tests for the free functions. */
     ATF_TP_ADD_TC(tp, exec_failure);
@@ -1118,6 +1869,8 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, exec_prehook);
     ATF_TP_ADD_TC(tp, exec_success);
     ATF_TP_ADD_TC(tp, fork_cookie);
+    ATF_TP_ADD_TC(tp, fork_in_inline);
+    ATF_TP_ADD_TC(tp, fork_in_redirect_path);
     ATF_TP_ADD_TC(tp, fork_out_capture_err_capture);
     ATF_TP_ADD_TC(tp, fork_out_capture_err_connect);
     ATF_TP_ADD_TC(tp, fork_out_capture_err_default);
@@ -1154,6 +1907,45 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, fork_out_redirect_path_err_inherit);
     ATF_TP_ADD_TC(tp, fork_out_redirect_path_err_redirect_fd);
     ATF_TP_ADD_TC(tp, fork_out_redirect_path_err_redirect_path);
+    ATF_TP_ADD_TC(tp, reap_descendants);
+    ATF_TP_ADD_TC(tp, spawn_fallback);
+    ATF_TP_ADD_TC(tp, spawn_in_inline);
+    ATF_TP_ADD_TC(tp, spawn_out_capture_err_capture);
+    ATF_TP_ADD_TC(tp, spawn_out_capture_err_connect);
+    ATF_TP_ADD_TC(tp, spawn_out_capture_err_default);
+    ATF_TP_ADD_TC(tp, spawn_out_capture_err_inherit);
+    ATF_TP_ADD_TC(tp, spawn_out_capture_err_redirect_fd);
+    ATF_TP_ADD_TC(tp, spawn_out_capture_err_redirect_path);
+    ATF_TP_ADD_TC(tp, spawn_out_connect_err_capture);
+    ATF_TP_ADD_TC(tp, spawn_out_connect_err_connect);
+    ATF_TP_ADD_TC(tp, spawn_out_connect_err_default);
+    ATF_TP_ADD_TC(tp, spawn_out_connect_err_inherit);
+    ATF_TP_ADD_TC(tp, spawn_out_connect_err_redirect_fd);
+    ATF_TP_ADD_TC(tp, spawn_out_connect_err_redirect_path);
+    ATF_TP_ADD_TC(tp, spawn_out_default_err_capture);
+    ATF_TP_ADD_TC(tp, spawn_out_default_err_connect);
+    ATF_TP_ADD_TC(tp, spawn_out_default_err_default);
+    ATF_TP_ADD_TC(tp, spawn_out_default_err_inherit);
+    ATF_TP_ADD_TC(tp, spawn_out_default_err_redirect_fd);
+    ATF_TP_ADD_TC(tp, spawn_out_default_err_redirect_path);
+    ATF_TP_ADD_TC(tp, spawn_out_inherit_err_capture);
+    ATF_TP_ADD_TC(tp, spawn_out_inherit_err_connect);
+    ATF_TP_ADD_TC(tp, spawn_out_inherit_err_default);
+    ATF_TP_ADD_TC(tp, spawn_out_inherit_err_inherit);
+    ATF_TP_ADD_TC(tp, spawn_out_inherit_err_redirect_fd);
+    ATF_TP_ADD_TC(tp, spawn_out_inherit_err_redirect_path);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_fd_err_capture);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_fd_err_connect);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_fd_err_default);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_fd_err_inherit);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_fd_err_redirect_fd);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_fd_err_redirect_path);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_path_err_capture);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_path_err_connect);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_path_err_default);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_path_err_inherit);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_path_err_redirect_fd);
+    ATF_TP_ADD_TC(tp, spawn_out_redirect_path_err_redirect_path);
 
     return atf_no_error();
 }
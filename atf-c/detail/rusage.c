@@ -0,0 +1,212 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include "atf-c/detail/rusage.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "atf-c/detail/sanity.h"
+#include "atf-c/error.h"
+
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+static
+long long
+timeval_to_us(const struct timeval *tv)
+{
+    return (long long)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static
+long long
+elapsed_us(const struct timespec *start, const struct timespec *end)
+{
+    return ((long long)end->tv_sec - start->tv_sec) * 1000000 +
+        (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+static
+void
+get_rusage(const int who, struct rusage *ru)
+{
+    if (getrusage(who, ru) == -1)
+        UNREACHABLE;
+}
+
+static
+void
+get_time(struct timespec *ts)
+{
+    if (clock_gettime(CLOCK_MONOTONIC, ts) == -1)
+        UNREACHABLE;
+}
+
+/** Accumulates the resources consumed between two rusage snapshots. */
+static
+void
+add_delta(const struct rusage *before, const struct rusage *after,
+          atf_rusage_record_t *rec)
+{
+    rec->m_utime += timeval_to_us(&after->ru_utime) -
+        timeval_to_us(&before->ru_utime);
+    rec->m_stime += timeval_to_us(&after->ru_stime) -
+        timeval_to_us(&before->ru_stime);
+    if (after->ru_maxrss > rec->m_maxrss)
+        rec->m_maxrss = after->ru_maxrss;
+    rec->m_nvcsw += after->ru_nvcsw - before->ru_nvcsw;
+    rec->m_nivcsw += after->ru_nivcsw - before->ru_nivcsw;
+    rec->m_inblock += after->ru_inblock - before->ru_inblock;
+    rec->m_oublock += after->ru_oublock - before->ru_oublock;
+}
+
+static
+atf_error_t
+write_all(const int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        const ssize_t ret = write(fd, buf, len);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            return atf_libc_error(errno, "Failed to write resource usage "
+                                  "record");
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return atf_no_error();
+}
+
+/* ---------------------------------------------------------------------
+ * The "atf_rusage" type.
+ * --------------------------------------------------------------------- */
+
+void
+atf_rusage_start(atf_rusage_t *ru)
+{
+    get_rusage(RUSAGE_SELF, &ru->m_self);
+    get_rusage(RUSAGE_CHILDREN, &ru->m_children);
+    get_time(&ru->m_start);
+}
+
+/** Computes the resources consumed since atf_rusage_start was called.
+ *
+ * The counters add up the usage of the current process and that of the
+ * children it has waited for, so that the cost of the helper programs run
+ * by a test case is accounted to it.  The maximum resident set size is the
+ * largest of the two, as getrusage(2) does not provide a sum. */
+void
+atf_rusage_stop(const atf_rusage_t *ru, atf_rusage_record_t *rec)
+{
+    struct rusage self, children;
+    struct timespec now;
+
+    get_time(&now);
+    get_rusage(RUSAGE_SELF, &self);
+    get_rusage(RUSAGE_CHILDREN, &children);
+
+    memset(rec, 0, sizeof(*rec));
+    rec->m_wall = elapsed_us(&ru->m_start, &now);
+    add_delta(&ru->m_self, &self, rec);
+    add_delta(&ru->m_children, &children, rec);
+}
+
+/** Formats a resource usage record.
+ *
+ * Every property takes a line of the form "<part>.<name>: <value>", which
+ * is what gets appended to the results file after the result itself. */
+atf_error_t
+atf_rusage_format(const atf_rusage_record_t *rec, const char *part,
+                  atf_dynstr_t *dest)
+{
+    return atf_dynstr_init_fmt(dest,
+        "%s.wall: %lld.%06lld\n"
+        "%s.utime: %lld.%06lld\n"
+        "%s.stime: %lld.%06lld\n"
+        "%s.maxrss: %ld\n"
+        "%s.nvcsw: %ld\n"
+        "%s.nivcsw: %ld\n"
+        "%s.inblock: %ld\n"
+        "%s.oublock: %ld\n",
+        part, rec->m_wall / 1000000, rec->m_wall % 1000000,
+        part, rec->m_utime / 1000000, rec->m_utime % 1000000,
+        part, rec->m_stime / 1000000, rec->m_stime % 1000000,
+        part, rec->m_maxrss, part, rec->m_nvcsw, part, rec->m_nivcsw,
+        part, rec->m_inblock, part, rec->m_oublock);
+}
+
+/** Writes the resources consumed since a snapshot to a file descriptor. */
+atf_error_t
+atf_rusage_write(const atf_rusage_t *ru, const char *part, const int fd)
+{
+    atf_error_t err;
+    atf_rusage_record_t rec;
+    atf_dynstr_t str;
+
+    atf_rusage_stop(ru, &rec);
+
+    err = atf_rusage_format(&rec, part, &str);
+    if (atf_is_error(err))
+        goto out;
+
+    err = write_all(fd, atf_dynstr_cstring(&str), atf_dynstr_length(&str));
+
+    atf_dynstr_fini(&str);
+out:
+    return err;
+}
+
+/** Appends the resources consumed since a snapshot to a file.
+ *
+ * /dev/stdout and /dev/stderr are handled specially, as is done for the
+ * results file, so that they are not reopened. */
+atf_error_t
+atf_rusage_append(const atf_rusage_t *ru, const char *part, const char *file)
+{
+    atf_error_t err;
+    int fd;
+
+    if (strcmp(file, "/dev/stdout") == 0)
+        return atf_rusage_write(ru, part, STDOUT_FILENO);
+    else if (strcmp(file, "/dev/stderr") == 0)
+        return atf_rusage_write(ru, part, STDERR_FILENO);
+
+    fd = open(file, O_WRONLY | O_APPEND | O_CREAT,
+              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1)
+        return atf_libc_error(errno, "Cannot open results file '%s'", file);
+
+    err = atf_rusage_write(ru, part, fd);
+    close(fd);
+    return err;
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#if !defined(ATF_C_DETAIL_RUSAGE_H)
+#define ATF_C_DETAIL_RUSAGE_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <time.h>
+
+#include <atf-c/detail/dynstr.h>
+#include <atf-c/error_fwd.h>
+
+/* ---------------------------------------------------------------------
+ * The "atf_rusage" type.
+ * --------------------------------------------------------------------- */
+
+/* A snapshot of the resources consumed by the current process and by its
+ * terminated children, taken when a test case part starts running. */
+struct atf_rusage {
+    struct timespec m_start;
+    struct rusage m_self;
+    struct rusage m_children;
+};
+typedef struct atf_rusage atf_rusage_t;
+
+/* The resources consumed since a snapshot was taken.  Times are in
+ * microseconds and the maximum resident set size in kilobytes. */
+struct atf_rusage_record {
+    long long m_wall;
+    long long m_utime;
+    long long m_stime;
+    long m_maxrss;
+    long m_nvcsw;
+    long m_nivcsw;
+    long m_inblock;
+    long m_oublock;
+};
+typedef struct atf_rusage_record atf_rusage_record_t;
+
+void atf_rusage_start(atf_rusage_t *);
+void atf_rusage_stop(const atf_rusage_t *, atf_rusage_record_t *);
+
+atf_error_t atf_rusage_format(const atf_rusage_record_t *, const char *,
+                              atf_dynstr_t *);
+atf_error_t atf_rusage_write(const atf_rusage_t *, const char *, const int);
+atf_error_t atf_rusage_append(const atf_rusage_t *, const char *,
+                              const char *);
+
+#endif /* !defined(ATF_C_DETAIL_RUSAGE_H) */
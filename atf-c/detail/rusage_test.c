@@ -0,0 +1,153 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include "atf-c/detail/rusage.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atf-c.h>
+
+#include "atf-c/detail/test_helpers.h"
+
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+/** Spins until the current process has used the given amount of CPU. */
+static
+void
+burn_cpu(const long long us)
+{
+    struct rusage ru;
+
+    do {
+        ATF_REQUIRE(getrusage(RUSAGE_SELF, &ru) != -1);
+    } while ((long long)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+             ru.ru_utime.tv_usec + ru.ru_stime.tv_usec < us);
+}
+
+/* ---------------------------------------------------------------------
+ * Tests for the "atf_rusage" type.
+ * --------------------------------------------------------------------- */
+
+ATF_TC_WITHOUT_HEAD(stop_wall);
+ATF_TC_BODY(stop_wall, tc)
+{
+    atf_rusage_t ru;
+    atf_rusage_record_t rec;
+
+    atf_rusage_start(&ru);
+    usleep(100000);
+    atf_rusage_stop(&ru, &rec);
+
+    ATF_REQUIRE(rec.m_wall >= 100000);
+    ATF_REQUIRE(rec.m_maxrss > 0);
+}
+
+ATF_TC_WITHOUT_HEAD(stop_children);
+ATF_TC_BODY(stop_children, tc)
+{
+    atf_rusage_t ru;
+    atf_rusage_record_t rec;
+    pid_t pid;
+    int status;
+
+    atf_rusage_start(&ru);
+
+    pid = fork();
+    ATF_REQUIRE(pid != -1);
+    if (pid == 0) {
+        burn_cpu(200000);
+        exit(EXIT_SUCCESS);
+    }
+    ATF_REQUIRE(waitpid(pid, &status, 0) != -1);
+
+    atf_rusage_stop(&ru, &rec);
+    ATF_REQUIRE(rec.m_utime + rec.m_stime >= 200000);
+}
+
+ATF_TC_WITHOUT_HEAD(format);
+ATF_TC_BODY(format, tc)
+{
+    atf_rusage_record_t rec;
+    atf_dynstr_t str;
+
+    rec.m_wall = 1500000;
+    rec.m_utime = 250;
+    rec.m_stime = 12000000;
+    rec.m_maxrss = 2048;
+    rec.m_nvcsw = 3;
+    rec.m_nivcsw = 4;
+    rec.m_inblock = 5;
+    rec.m_oublock = 6;
+
+    RE(atf_rusage_format(&rec, "body", &str));
+    ATF_REQUIRE_STREQ(
+        "body.wall: 1.500000\n"
+        "body.utime: 0.000250\n"
+        "body.stime: 12.000000\n"
+        "body.maxrss: 2048\n"
+        "body.nvcsw: 3\n"
+        "body.nivcsw: 4\n"
+        "body.inblock: 5\n"
+        "body.oublock: 6\n", atf_dynstr_cstring(&str));
+    atf_dynstr_fini(&str);
+}
+
+ATF_TC_WITHOUT_HEAD(append);
+ATF_TC_BODY(append, tc)
+{
+    atf_rusage_t ru;
+
+    atf_utils_create_file("resfile", "passed\n");
+
+    atf_rusage_start(&ru);
+    RE(atf_rusage_append(&ru, "cleanup", "resfile"));
+
+    ATF_REQUIRE(atf_utils_grep_file("^passed$", "resfile"));
+    ATF_REQUIRE(atf_utils_grep_file("^cleanup\\.wall: [0-9]+\\.[0-9]{6}$",
+                                    "resfile"));
+    ATF_REQUIRE(atf_utils_grep_file("^cleanup\\.oublock: [0-9]+$",
+                                    "resfile"));
+}
+
+/* ---------------------------------------------------------------------
+ * Main.
+ * --------------------------------------------------------------------- */
+
+ATF_TP_ADD_TCS(tp)
+{
+    ATF_TP_ADD_TC(tp, stop_wall);
+    ATF_TP_ADD_TC(tp, stop_children);
+    ATF_TP_ADD_TC(tp, format);
+    ATF_TP_ADD_TC(tp, append);
+
+    return atf_no_error();
+}
@@ -100,7 +100,7 @@ do_test(enum type t, bool cond)
 
         RE(atf_process_stream_init_inherit(&outsb));
         RE(atf_process_stream_init_capture(&errsb));
-        RE(atf_process_fork(&child, do_test_child, &outsb, &errsb, &td));
+        RE(atf_process_fork(&child, do_test_child, NULL, &outsb, &errsb, &td));
         atf_process_stream_fini(&errsb);
         atf_process_stream_fini(&outsb);
     }
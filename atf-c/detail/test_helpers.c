@@ -134,7 +134,7 @@ run_h_tc(atf_tc_t *tc, const char *outname, const char *errname,
 
     RE(atf_process_stream_init_redirect_path(&outb, &outpath));
     RE(atf_process_stream_init_redirect_path(&errb, &errpath));
-    RE(atf_process_fork(&child, run_h_tc_child, &outb, &errb, &data));
+    RE(atf_process_fork(&child, run_h_tc_child, NULL, &outb, &errb, &data));
     atf_process_stream_fini(&errb);
     atf_process_stream_fini(&outb);
 
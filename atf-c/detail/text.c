@@ -89,6 +89,19 @@ atf_text_format_ap(char **dest, const char *fmt, va_list ap)
     return err;
 }
 
+/** Computes the FNV-1a hash of a string, for use in hash tables. */
+size_t
+atf_text_hash(const char *str)
+{
+    size_t hash = 2166136261u;
+
+    for (; *str != '\0'; str++) {
+        hash ^= (unsigned char)*str;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 atf_error_t
 atf_text_split(const char *str, const char *delim, atf_list_t *words)
 {
@@ -28,6 +28,7 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include <atf-c/detail/list.h>
 #include <atf-c/error_fwd.h>
@@ -37,6 +38,7 @@ atf_error_t atf_text_for_each_word(const char *, const char *,
                                    void *);
 atf_error_t atf_text_format(char **, const char *, ...);
 atf_error_t atf_text_format_ap(char **, const char *, va_list);
+size_t atf_text_hash(const char *);
 atf_error_t atf_text_split(const char *, const char *, atf_list_t *);
 atf_error_t atf_text_to_bool(const char *, bool *);
 atf_error_t atf_text_to_long(const char *, long *);
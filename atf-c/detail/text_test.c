@@ -227,6 +227,19 @@ ATF_TC_BODY(format_ap, tc)
     free(str);
 }
 
+ATF_TC(hash);
+ATF_TC_HEAD(hash, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks the atf_text_hash function");
+}
+ATF_TC_BODY(hash, tc)
+{
+    ATF_REQUIRE_EQ(atf_text_hash("foo"), atf_text_hash("foo"));
+    ATF_REQUIRE(atf_text_hash("foo") != atf_text_hash("bar"));
+    ATF_REQUIRE(atf_text_hash("ab") != atf_text_hash("ba"));
+    ATF_REQUIRE(atf_text_hash("") != atf_text_hash("a"));
+}
+
 ATF_TC(split);
 ATF_TC_HEAD(split, tc)
 {
@@ -412,6 +425,7 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, for_each_word);
     ATF_TP_ADD_TC(tp, format);
     ATF_TP_ADD_TC(tp, format_ap);
+    ATF_TP_ADD_TC(tp, hash);
     ATF_TP_ADD_TC(tp, split);
     ATF_TP_ADD_TC(tp, split_delims);
     ATF_TP_ADD_TC(tp, to_bool);
@@ -27,17 +27,26 @@
 #include "config.h"
 #endif
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "atf-c/defs.h"
 #include "atf-c/detail/dynstr.h"
 #include "atf-c/detail/env.h"
 #include "atf-c/detail/fs.h"
+#include "atf-c/detail/list.h"
 #include "atf-c/detail/map.h"
+#include "atf-c/detail/process.h"
+#include "atf-c/detail/rusage.h"
 #include "atf-c/detail/sanity.h"
 #include "atf-c/error.h"
 #include "atf-c/tc.h"
@@ -51,12 +60,28 @@
 #endif
 
 static const char *progname = NULL;
+static bool report_rusage = false;
 
 /* This prototype is provided by macros.h during instantiation of the test
  * program, so it can be kept private.  Don't know if that's the best idea
  * though. */
 int atf_tp_main(int, char **, atf_error_t (*)(atf_tp_t *));
 
+/* No prototype in header for this one, it's a little sketchy (internal). */
+atf_error_t atf_tp_set_config_var(atf_tp_t *, const char *, const char *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+void atf_tc_set_report_rusage(const bool);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+void atf_tc_set_cgroup_root(const char *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+bool atf_tc_has_cleanup(const atf_tc_t *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+const atf_tc_t *const *atf_tp_get_tcs_ref(const atf_tp_t *);
+
 enum tc_part {
     BODY,
     CLEANUP,
@@ -134,12 +159,59 @@ print_warning(const char *message)
  * Options handling.
  * --------------------------------------------------------------------- */
 
+enum list_format {
+    LIST_ATF,
+    LIST_JSON,
+};
+
+static
+atf_error_t
+parse_list_format(const char *arg, enum list_format *format)
+{
+    atf_error_t err;
+
+    err = atf_no_error();
+    if (strcmp(arg, "atf") == 0)
+        *format = LIST_ATF;
+    else if (strcmp(arg, "json") == 0)
+        *format = LIST_JSON;
+    else
+        err = usage_error("Unknown listing format `%s'", arg);
+
+    return err;
+}
+
+static
+const char *
+list_format_name(const enum list_format format)
+{
+    switch (format) {
+    case LIST_ATF:
+        return "atf";
+    case LIST_JSON:
+        return "json";
+    default:
+        UNREACHABLE;
+        return NULL;
+    }
+}
+
 struct params {
     bool m_do_list;
+    enum list_format m_list_format;
+    const char *m_cachedir;
     atf_fs_path_t m_srcdir;
     char *m_tcname;
     enum tc_part m_tcpart;
     atf_fs_path_t m_resfile;
+    bool m_resfile_set;
+    bool m_report_rusage;
+    const char *m_cgroup_root;
+    bool m_do_batch;
+    const char *m_batch_file;
+    bool m_do_server;
+    long m_jobs;
+    atf_list_t m_batch_tcargs;
     atf_map_t m_config;
 };
 
@@ -168,8 +240,17 @@ params_init(struct params *p, const char *argv0)
     atf_error_t err;
 
     p->m_do_list = false;
+    p->m_list_format = LIST_ATF;
+    p->m_cachedir = NULL;
     p->m_tcname = NULL;
     p->m_tcpart = BODY;
+    p->m_resfile_set = false;
+    p->m_report_rusage = false;
+    p->m_cgroup_root = NULL;
+    p->m_do_batch = false;
+    p->m_batch_file = NULL;
+    p->m_do_server = false;
+    p->m_jobs = 0;
 
     err = argv0_to_dir(argv0, &p->m_srcdir);
     if (atf_is_error(err))
@@ -181,8 +262,16 @@ params_init(struct params *p, const char *argv0)
         return err;
     }
 
+    err = atf_list_init(&p->m_batch_tcargs);
+    if (atf_is_error(err)) {
+        atf_fs_path_fini(&p->m_resfile);
+        atf_fs_path_fini(&p->m_srcdir);
+        return err;
+    }
+
     err = atf_map_init(&p->m_config);
     if (atf_is_error(err)) {
+        atf_list_fini(&p->m_batch_tcargs);
         atf_fs_path_fini(&p->m_resfile);
         atf_fs_path_fini(&p->m_srcdir);
         return err;
@@ -196,6 +285,7 @@ void
 params_fini(struct params *p)
 {
     atf_map_fini(&p->m_config);
+    atf_list_fini(&p->m_batch_tcargs);
     atf_fs_path_fini(&p->m_resfile);
     atf_fs_path_fini(&p->m_srcdir);
     if (p->m_tcname != NULL)
@@ -224,6 +314,20 @@ out:
     return err;
 }
 
+static
+atf_error_t
+parse_jflag(const char *arg, long *jobs)
+{
+    char *end;
+
+    errno = 0;
+    *jobs = strtol(arg, &end, 10);
+    if (arg[0] == '\0' || *end != '\0' || errno != 0 || *jobs < 1)
+        return usage_error("Invalid number of jobs `%s'; must be a positive "
+                           "integer", arg);
+    return atf_no_error();
+}
+
 static
 atf_error_t
 replace_path_param(atf_fs_path_t *param, const char *value)
@@ -240,21 +344,175 @@ replace_path_param(atf_fs_path_t *param, const char *value)
     return err;
 }
 
+static
+atf_error_t
+append_batch_tcarg(atf_list_t *tcargs, const char *tcarg)
+{
+    atf_error_t err;
+    char *copy;
+
+    copy = strdup(tcarg);
+    if (copy == NULL)
+        err = atf_no_memory_error();
+    else
+        err = atf_list_append(tcargs, copy, true);
+
+    return err;
+}
+
+/** Reads a single line from a stream into a dynamic string.
+ *
+ * The trailing newline character, if any, is not stored in the output
+ * string.  eof is set to true only if the end of the stream is reached
+ * before reading any character. */
+static
+atf_error_t
+read_line(FILE *f, atf_dynstr_t *line, bool *eof)
+{
+    atf_error_t err;
+    char buf[1024];
+    char *end;
+
+    atf_dynstr_clear(line);
+    *eof = false;
+
+    err = atf_no_error();
+    for (;;) {
+        if (fgets(buf, sizeof(buf), f) == NULL) {
+            if (ferror(f))
+                err = atf_libc_error(errno, "Failed to read line");
+            else if (atf_dynstr_length(line) == 0)
+                *eof = true;
+            break;
+        }
+
+        end = strchr(buf, '\n');
+        if (end != NULL)
+            *end = '\0';
+
+        err = atf_dynstr_append_fmt(line, "%s", buf);
+        if (atf_is_error(err) || end != NULL)
+            break;
+    }
+
+    return err;
+}
+
+/** Loads the test cases to run in batch mode from a file.
+ *
+ * The file contains one test case argument per line, in the same format
+ * accepted on the command line.  Empty lines and lines starting with a
+ * '#' sign are ignored. */
+static
+atf_error_t
+parse_fflag(const char *file, atf_list_t *tcargs)
+{
+    atf_error_t err;
+    FILE *f;
+    atf_dynstr_t line;
+    bool eof;
+
+    f = fopen(file, "r");
+    if (f == NULL) {
+        err = user_error("Cannot open test case list `%s': %s", file,
+                         strerror(errno));
+        goto out;
+    }
+
+    err = atf_dynstr_init(&line);
+    if (atf_is_error(err))
+        goto out_f;
+
+    for (;;) {
+        const char *str;
+
+        err = read_line(f, &line, &eof);
+        if (atf_is_error(err) || eof)
+            break;
+
+        str = atf_dynstr_cstring(&line);
+        if (str[0] == '\0' || str[0] == '#')
+            continue;
+
+        err = append_batch_tcarg(tcargs, str);
+        if (atf_is_error(err))
+            break;
+    }
+
+    atf_dynstr_fini(&line);
+out_f:
+    fclose(f);
+out:
+    return err;
+}
+
 /* ---------------------------------------------------------------------
  * Test case listing.
  * --------------------------------------------------------------------- */
 
 static
 void
-list_tcs(const atf_tp_t *tp)
+print_json_string(FILE *f, const char *str)
+{
+    const char *ptr;
+
+    fputc('"', f);
+    for (ptr = str; *ptr != '\0'; ptr++) {
+        const unsigned char ch = *ptr;
+
+        if (ch == '"' || ch == '\\')
+            fprintf(f, "\\%c", ch);
+        else if (ch == '\n')
+            fprintf(f, "\\n");
+        else if (ch == '\t')
+            fprintf(f, "\\t");
+        else if (ch < 0x20)
+            fprintf(f, "\\u%04x", ch);
+        else
+            fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+static
+void
+print_md_var(FILE *f, const enum list_format format, const bool first,
+             const char *name, const char *value)
+{
+    switch (format) {
+    case LIST_ATF:
+        fprintf(f, "%s: %s\n", name, value);
+        break;
+
+    case LIST_JSON:
+        fputc(first ? '{' : ',', f);
+        print_json_string(f, name);
+        fputc(':', f);
+        print_json_string(f, value);
+        break;
+
+    default:
+        UNREACHABLE;
+    }
+}
+
+/** Describes all test cases in the given format.
+ *
+ * The "atf" format is the application/X-atf-tp text format understood by
+ * kyua(1).  The "json" format prints one JSON object per test case and
+ * line, with the test case's meta-data properties as its members and the
+ * identifier always first. */
+static
+void
+list_tcs(const atf_tp_t *tp, const enum list_format format, FILE *f)
 {
     const atf_tc_t *const *tcs;
     const atf_tc_t *const *tcsptr;
 
-    printf("Content-Type: application/X-atf-tp; version=\"1\"\n\n");
+    if (format == LIST_ATF)
+        fprintf(f, "Content-Type: application/X-atf-tp; version=\"1\"\n\n");
 
-    tcs = atf_tp_get_tcs(tp);
-    INV(tcs != NULL);  /* Should be checked. */
+    tcs = atf_tp_get_tcs_ref(tp);
     for (tcsptr = tcs; *tcsptr != NULL; tcsptr++) {
         const atf_tc_t *tc = *tcsptr;
         char **vars = atf_tc_get_md_vars(tc);
@@ -262,26 +520,254 @@ list_tcs(const atf_tp_t *tp)
 
         INV(vars != NULL);  /* Should be checked. */
 
-        if (tcsptr != tcs)  /* Not first. */
-            printf("\n");
+        if (format == LIST_ATF && tcsptr != tcs)  /* Not first. */
+            fprintf(f, "\n");
 
         for (ptr = vars; *ptr != NULL; ptr += 2) {
             if (strcmp(*ptr, "ident") == 0) {
-                printf("ident: %s\n", *(ptr + 1));
+                print_md_var(f, format, true, "ident", *(ptr + 1));
                 break;
             }
         }
 
         for (ptr = vars; *ptr != NULL; ptr += 2) {
             if (strcmp(*ptr, "ident") != 0) {
-                printf("%s: %s\n", *ptr, *(ptr + 1));
+                print_md_var(f, format, false, *ptr, *(ptr + 1));
             }
         }
 
+        if (format == LIST_JSON)
+            fprintf(f, "}\n");
+
         atf_utils_free_charpp(vars);
     }
 }
 
+/** Computes the key that identifies a cached listing.
+ *
+ * The key captures the identity of the test program binary (its device,
+ * inode, modification time and size) and the configuration variables given
+ * to it, as any of these may change the output of the test case heads.
+ * The modification time includes nanoseconds where available, so that a
+ * binary rebuilt within the same second with the same size is noticed. */
+static
+atf_error_t
+list_cache_key(const atf_map_t *config, atf_dynstr_t *key)
+{
+    atf_error_t err;
+    atf_map_citer_t iter;
+    atf_fs_path_t exe;
+    struct stat sb;
+    long mtime_nsec;
+
+    iter = atf_map_find_c(config, "srcdir");
+    INV(!atf_equal_map_citer_map_citer(iter, atf_map_end_c(config)));
+    err = atf_fs_path_init_fmt(&exe, "%s/%s",
+                               (const char *)atf_map_citer_data(iter),
+                               progname);
+    if (atf_is_error(err))
+        goto out;
+
+    if (stat(atf_fs_path_cstring(&exe), &sb) == -1) {
+        err = atf_libc_error(errno, "Cannot stat '%s'",
+                             atf_fs_path_cstring(&exe));
+        goto out_exe;
+    }
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    mtime_nsec = (long)sb.st_mtim.tv_nsec;
+#else
+    mtime_nsec = 0;
+#endif
+
+    err = atf_dynstr_init_fmt(key, "exe=%s dev=%lld ino=%lld "
+                              "mtime=%lld.%09ld size=%lld",
+                              atf_fs_path_cstring(&exe),
+                              (long long)sb.st_dev, (long long)sb.st_ino,
+                              (long long)sb.st_mtime, mtime_nsec,
+                              (long long)sb.st_size);
+    if (atf_is_error(err))
+        goto out_exe;
+
+    atf_map_for_each_c(iter, config) {
+        err = atf_dynstr_append_fmt(key, " %s=%s", atf_map_citer_key(iter),
+                                    (const char *)atf_map_citer_data(iter));
+        if (atf_is_error(err)) {
+            atf_dynstr_fini(key);
+            break;
+        }
+    }
+
+out_exe:
+    atf_fs_path_fini(&exe);
+out:
+    return err;
+}
+
+/** Copies the contents of a stream to stdout. */
+static
+atf_error_t
+copy_to_stdout(FILE *f)
+{
+    char buf[4096];
+    size_t n;
+
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        if (fwrite(buf, 1, n, stdout) != n)
+            return atf_libc_error(errno, "Failed to write listing");
+    }
+    if (ferror(f))
+        return atf_libc_error(errno, "Failed to read cached listing");
+    return atf_no_error();
+}
+
+static
+atf_error_t
+list_cache_file(const struct params *p, atf_fs_path_t *cachefile)
+{
+    return atf_fs_path_init_fmt(cachefile, "%s/%s.%s", p->m_cachedir,
+                                progname, list_format_name(p->m_list_format));
+}
+
+/** Prints a cached listing if it is still valid.
+ *
+ * The first line of a cache file holds the key it was generated for, and
+ * the rest of the file holds the listing itself.  hit is set to true only
+ * if the cache file exists and its key matches the current one. */
+static
+atf_error_t
+list_from_cache(const struct params *p, bool *hit)
+{
+    atf_error_t err;
+    atf_fs_path_t cachefile;
+    atf_dynstr_t key, line;
+    FILE *f;
+    bool eof;
+
+    *hit = false;
+
+    err = list_cache_file(p, &cachefile);
+    if (atf_is_error(err))
+        goto out;
+
+    f = fopen(atf_fs_path_cstring(&cachefile), "r");
+    if (f == NULL)
+        goto out_cachefile;
+
+    err = list_cache_key(&p->m_config, &key);
+    if (atf_is_error(err))
+        goto out_f;
+
+    err = atf_dynstr_init(&line);
+    if (atf_is_error(err))
+        goto out_key;
+
+    err = read_line(f, &line, &eof);
+    if (!atf_is_error(err) && !eof &&
+        atf_equal_dynstr_dynstr(&line, &key)) {
+        err = copy_to_stdout(f);
+        *hit = !atf_is_error(err);
+    }
+
+    atf_dynstr_fini(&line);
+out_key:
+    atf_dynstr_fini(&key);
+out_f:
+    fclose(f);
+out_cachefile:
+    atf_fs_path_fini(&cachefile);
+out:
+    return err;
+}
+
+/** Stores the listing in the cache.
+ *
+ * The cache file is replaced atomically so that concurrent invocations of
+ * the test program never see a partially-written listing.  It gets the
+ * permissions of a regular file, instead of the owner-only ones given by
+ * mkstemp, so that a cache directory can be shared. */
+static
+atf_error_t
+list_to_cache(const atf_tp_t *tp, const struct params *p)
+{
+    atf_error_t err;
+    atf_fs_path_t cachefile, tmpfile;
+    atf_dynstr_t key;
+    mode_t mask;
+    FILE *f;
+    int fd;
+
+    err = list_cache_file(p, &cachefile);
+    if (atf_is_error(err))
+        goto out;
+
+    err = list_cache_key(&p->m_config, &key);
+    if (atf_is_error(err))
+        goto out_cachefile;
+
+    err = atf_fs_path_init_fmt(&tmpfile, "%s.XXXXXX",
+                               atf_fs_path_cstring(&cachefile));
+    if (atf_is_error(err))
+        goto out_key;
+
+    err = atf_fs_mkstemp(&tmpfile, &fd);
+    if (atf_is_error(err))
+        goto out_tmpfile;
+
+    mask = umask(0);
+    (void)umask(mask);
+    if (fchmod(fd, 0644 & ~mask) == -1) {
+        err = atf_libc_error(errno, "Cannot set the permissions of '%s'",
+                             atf_fs_path_cstring(&tmpfile));
+        close(fd);
+        unlink(atf_fs_path_cstring(&tmpfile));
+        goto out_tmpfile;
+    }
+
+    f = fdopen(fd, "w");
+    if (f == NULL) {
+        err = atf_libc_error(errno, "Cannot open '%s'",
+                             atf_fs_path_cstring(&tmpfile));
+        close(fd);
+        unlink(atf_fs_path_cstring(&tmpfile));
+        goto out_tmpfile;
+    }
+
+    fprintf(f, "%s\n", atf_dynstr_cstring(&key));
+    list_tcs(tp, p->m_list_format, f);
+    if (fclose(f) == EOF || rename(atf_fs_path_cstring(&tmpfile),
+                                   atf_fs_path_cstring(&cachefile)) == -1) {
+        err = atf_libc_error(errno, "Cannot update listing cache '%s'",
+                             atf_fs_path_cstring(&cachefile));
+        unlink(atf_fs_path_cstring(&tmpfile));
+    }
+
+out_tmpfile:
+    atf_fs_path_fini(&tmpfile);
+out_key:
+    atf_dynstr_fini(&key);
+out_cachefile:
+    atf_fs_path_fini(&cachefile);
+out:
+    return err;
+}
+
+/** Reports a failure to use the listing cache.
+ *
+ * The cache is only an optimization, so problems with it are never fatal:
+ * the listing is generated from the test case heads instead. */
+static
+void
+warn_list_cache_error(atf_error_t err)
+{
+    char buf[4096];
+    char message[4096 + 32];
+
+    atf_error_format(err, buf, sizeof(buf));
+    snprintf(message, sizeof(message), "Cannot use listing cache: %s", buf);
+    print_warning(message);
+    atf_error_free(err);
+}
+
 /* ---------------------------------------------------------------------
  * Main.
  * --------------------------------------------------------------------- */
@@ -334,20 +820,49 @@ process_params(int argc, char **argv, struct params *p)
     old_opterr = opterr;
     opterr = 0;
     while (!atf_is_error(err) &&
-           (ch = getopt(argc, argv, GETOPT_POSIX ":lr:s:v:")) != -1) {
+           (ch = getopt(argc, argv, GETOPT_POSIX ":C:f:F:g:j:lr:s:Suv:")) != -1) {
         switch (ch) {
+        case 'C':
+            p->m_cachedir = optarg;
+            break;
+
+        case 'f':
+            p->m_batch_file = optarg;
+            break;
+
+        case 'F':
+            err = parse_list_format(optarg, &p->m_list_format);
+            break;
+
+        case 'g':
+            p->m_cgroup_root = optarg;
+            break;
+
+        case 'j':
+            err = parse_jflag(optarg, &p->m_jobs);
+            break;
+
         case 'l':
             p->m_do_list = true;
             break;
 
         case 'r':
             err = replace_path_param(&p->m_resfile, optarg);
+            p->m_resfile_set = true;
             break;
 
         case 's':
             err = replace_path_param(&p->m_srcdir, optarg);
             break;
 
+        case 'S':
+            p->m_do_server = true;
+            break;
+
+        case 'u':
+            p->m_report_rusage = true;
+            break;
+
         case 'v':
             err = parse_vflag(optarg, &p->m_config);
             break;
@@ -372,18 +887,44 @@ process_params(int argc, char **argv, struct params *p)
 #endif
 
     if (!atf_is_error(err)) {
-        if (p->m_do_list) {
-            if (argc > 0)
+        if (!p->m_do_list && (p->m_cachedir != NULL ||
+                              p->m_list_format != LIST_ATF))
+            err = usage_error("Cannot use -C or -F without -l");
+        else if (p->m_do_list) {
+            if (argc > 0 || p->m_batch_file != NULL)
                 err = usage_error("Cannot provide test case names with -l");
+            else if (p->m_do_server)
+                err = usage_error("Cannot use -l and -S at the same time");
+            else if (p->m_jobs > 0)
+                err = usage_error("Cannot use -l and -j at the same time");
+        } else if (p->m_do_server) {
+            if (argc > 0 || p->m_batch_file != NULL)
+                err = usage_error("Cannot provide test case names with -S");
+            else if (p->m_jobs > 0)
+                err = usage_error("Cannot use -S and -j at the same time");
+        } else if (p->m_batch_file != NULL || argc > 1 || p->m_jobs > 0) {
+            p->m_do_batch = true;
+            if (p->m_batch_file != NULL)
+                err = parse_fflag(p->m_batch_file, &p->m_batch_tcargs);
+            for (; !atf_is_error(err) && argc > 0; argc--, argv++)
+                err = append_batch_tcarg(&p->m_batch_tcargs, argv[0]);
+            if (!atf_is_error(err)) {
+                if (atf_list_size(&p->m_batch_tcargs) == 0 && p->m_jobs == 0)
+                    err = usage_error("Must provide a test case name");
+                else if (!p->m_resfile_set && p->m_jobs > 0)
+                    err = usage_error("Running test cases in parallel "
+                                      "requires -r to name a results "
+                                      "directory");
+                else if (!p->m_resfile_set)
+                    err = usage_error("Running more than one test case "
+                                      "requires -r to name a results "
+                                      "directory");
+            }
         } else {
             if (argc == 0)
                 err = usage_error("Must provide a test case name");
-            else if (argc == 1)
+            else
                 err = handle_tcarg(argv[0], &p->m_tcname, &p->m_tcpart);
-            else if (argc > 1) {
-                err = usage_error("Cannot provide more than one test case "
-                                  "name");
-            }
         }
     }
 
@@ -478,6 +1019,37 @@ out:
     return err;
 }
 
+static
+void
+warn_if_not_controlled(void)
+{
+    if (!atf_env_has("__RUNNING_INSIDE_ATF_RUN") || strcmp(atf_env_get(
+        "__RUNNING_INSIDE_ATF_RUN"), "internal-yes-value") != 0)
+    {
+        print_warning("Running test cases outside of kyua(1) is unsupported");
+        print_warning("No isolation nor timeout control is being applied; you "
+                      "may get unexpected failures; see atf-test-case(4)");
+    }
+}
+
+/** Runs the cleanup routine of a test case.
+ *
+ * If -u was given, the resources consumed by the cleanup routine are
+ * appended to the results file, where the body already left its own. */
+static
+atf_error_t
+cleanup_tc(const atf_tp_t *tp, const char *tcname, const char *resfile)
+{
+    atf_error_t err;
+    atf_rusage_t ru;
+
+    atf_rusage_start(&ru);
+    err = atf_tp_cleanup(tp, tcname);
+    if (!atf_is_error(err) && report_rusage)
+        err = atf_rusage_append(&ru, "cleanup", resfile);
+    return err;
+}
+
 static
 atf_error_t
 run_tc(const atf_tp_t *tp, struct params *p, int *exitcode)
@@ -491,13 +1063,7 @@ run_tc(const atf_tp_t *tp, struct params *p, int *exitcode)
         goto out;
     }
 
-    if (!atf_env_has("__RUNNING_INSIDE_ATF_RUN") || strcmp(atf_env_get(
-        "__RUNNING_INSIDE_ATF_RUN"), "internal-yes-value") != 0)
-    {
-        print_warning("Running test cases outside of kyua(1) is unsupported");
-        print_warning("No isolation nor timeout control is being applied; you "
-                      "may get unexpected failures; see atf-test-case(4)");
-    }
+    warn_if_not_controlled();
 
     switch (p->m_tcpart) {
     case BODY:
@@ -513,7 +1079,8 @@ run_tc(const atf_tp_t *tp, struct params *p, int *exitcode)
         break;
 
     case CLEANUP:
-        err = atf_tp_cleanup(tp, p->m_tcname);
+        err = cleanup_tc(tp, p->m_tcname,
+                         atf_fs_path_cstring(&p->m_resfile));
         if (atf_is_error(err)) {
             /* TODO: Handle error */
             *exitcode = EXIT_FAILURE;
@@ -533,9 +1100,832 @@ out:
     return err;
 }
 
+/* ---------------------------------------------------------------------
+ * Batch mode.
+ * --------------------------------------------------------------------- */
+
+struct batch_part {
+    atf_tp_t *m_tp;
+    const char *m_tcname;
+    enum tc_part m_tcpart;
+    const char *m_resfile;
+    const atf_map_t *m_config;
+    bool m_detach_stdin;
+    const char *m_workdir;
+};
+
+static void run_batch_part(void *) ATF_DEFS_ATTRIBUTE_NORETURN;
+
+/** Runs a single test case part in a subprocess of the test program.
+ *
+ * This is the entry point of the child process spawned for every test case
+ * part in batch and server modes.  The test program has already been
+ * initialized by the parent, so all we have to do is apply any per-request
+ * configuration variables and delegate to the same routines used when a
+ * single test case is requested on the command line. */
 static
-atf_error_t
-controlled_main(int argc, char **argv,
+void
+run_batch_part(void *v)
+{
+    const struct batch_part *bp = v;
+    atf_error_t err;
+
+    err = atf_no_error();
+    if (bp->m_detach_stdin) {
+        const int fd = open("/dev/null", O_RDONLY);
+        if (fd == -1)
+            err = atf_libc_error(errno, "Cannot open /dev/null");
+        else {
+            if (fd != STDIN_FILENO) {
+                if (dup2(fd, STDIN_FILENO) == -1)
+                    err = atf_libc_error(errno, "Cannot redirect stdin");
+                close(fd);
+            }
+        }
+    }
+    if (!atf_is_error(err) && bp->m_workdir != NULL) {
+        if (chdir(bp->m_workdir) == -1)
+            err = atf_libc_error(errno, "Cannot enter work directory '%s'",
+                                 bp->m_workdir);
+        else
+            err = atf_env_set("TMPDIR", bp->m_workdir);
+    }
+    if (!atf_is_error(err) && bp->m_config != NULL) {
+        atf_map_citer_t iter;
+
+        atf_map_for_each_c(iter, bp->m_config) {
+            err = atf_tp_set_config_var(bp->m_tp, atf_map_citer_key(iter),
+                                        atf_map_citer_data(iter));
+            if (atf_is_error(err))
+                break;
+        }
+    }
+
+    if (!atf_is_error(err)) {
+        switch (bp->m_tcpart) {
+        case BODY:
+            err = atf_tp_run(bp->m_tp, bp->m_tcname, bp->m_resfile);
+            break;
+
+        case CLEANUP:
+            err = cleanup_tc(bp->m_tp, bp->m_tcname, bp->m_resfile);
+            break;
+
+        default:
+            UNREACHABLE;
+        }
+    }
+
+    if (atf_is_error(err)) {
+        print_error(err);
+        atf_error_free(err);
+        exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}
+
+/** Forks a subprocess to run a test case part.
+ *
+ * outsb, if not NULL, specifies where the stdout of the subprocess goes. */
+static
+atf_error_t
+start_part(struct batch_part *bp, const atf_process_stream_t *outsb,
+           atf_process_child_t *child)
+{
+    fflush(stdout);
+    fflush(stderr);
+    return atf_process_fork(child, run_batch_part, NULL, outsb, NULL, bp);
+}
+
+/** Forks a subprocess to run a test case part and waits for its
+ * termination. */
+static
+atf_error_t
+fork_part(struct batch_part *bp, const atf_process_stream_t *outsb,
+          atf_process_status_t *status)
+{
+    atf_error_t err;
+    atf_process_child_t child;
+
+    err = start_part(bp, outsb, &child);
+    if (atf_is_error(err))
+        goto out;
+
+    while (atf_is_error(err = atf_process_child_wait(&child, status))) {
+        INV(atf_error_is(err, "libc") && atf_libc_error_code(err) == EINTR);
+        atf_error_free(err);
+    }
+
+out:
+    return err;
+}
+
+/** Creates the work directory of a test case part.
+ *
+ * The directory is reused if it already exists, so that the cleanup
+ * routine of the test case runs in the same place as its body. */
+static
+atf_error_t
+make_workdir(const atf_fs_path_t *workdir)
+{
+    if (mkdir(atf_fs_path_cstring(workdir), 0755) == -1 && errno != EEXIST)
+        return atf_libc_error(errno, "Cannot create work directory '%s'",
+                              atf_fs_path_cstring(workdir));
+    return atf_no_error();
+}
+
+/** Writes the completion record of a test case part to the status file.
+ *
+ * Every record takes a single line and has the form "<tcarg> exited <code>"
+ * or "<tcarg> signaled <signo>", so that the caller can tell apart test
+ * cases that terminated on their own from those that crashed. */
+static
+atf_error_t
+write_status_record(FILE *f, const char *tcarg,
+                    const atf_process_status_t *status)
+{
+    int ret;
+
+    if (atf_process_status_exited(status))
+        ret = fprintf(f, "%s exited %d\n", tcarg,
+                      atf_process_status_exitstatus(status));
+    else if (atf_process_status_signaled(status))
+        ret = fprintf(f, "%s signaled %d\n", tcarg,
+                      atf_process_status_termsig(status));
+    else
+        ret = fprintf(f, "%s unknown\n", tcarg);
+
+    if (ret < 0 || fflush(f) == EOF)
+        return atf_libc_error(errno, "Failed to write status record for %s",
+                              tcarg);
+    return atf_no_error();
+}
+
+static
+atf_error_t
+run_batch_tcarg(atf_tp_t *tp, const atf_fs_path_t *resdir, const char *tcarg,
+                FILE *statusf, bool *success)
+{
+    atf_error_t err;
+    struct batch_part bp;
+    char *tcname;
+    enum tc_part tcpart;
+    atf_fs_path_t resfile, workdir;
+    atf_process_status_t status;
+
+    tcpart = BODY;
+    err = handle_tcarg(tcarg, &tcname, &tcpart);
+    if (atf_is_error(err))
+        goto out_tcname;
+
+    err = atf_fs_path_init_fmt(&resfile, "%s/%s.result",
+                               atf_fs_path_cstring(resdir), tcname);
+    if (atf_is_error(err))
+        goto out_tcname;
+
+    err = atf_fs_path_init_fmt(&workdir, "%s/%s.work",
+                               atf_fs_path_cstring(resdir), tcname);
+    if (atf_is_error(err))
+        goto out_resfile;
+
+    err = make_workdir(&workdir);
+    if (atf_is_error(err))
+        goto out_workdir;
+
+    bp.m_tp = tp;
+    bp.m_tcname = tcname;
+    bp.m_tcpart = tcpart;
+    bp.m_resfile = atf_fs_path_cstring(&resfile);
+    bp.m_config = NULL;
+    bp.m_detach_stdin = false;
+    bp.m_workdir = atf_fs_path_cstring(&workdir);
+
+    err = fork_part(&bp, NULL, &status);
+    if (atf_is_error(err))
+        goto out_workdir;
+
+    if (!atf_process_status_exited(&status) ||
+        atf_process_status_exitstatus(&status) != EXIT_SUCCESS)
+        *success = false;
+
+    err = write_status_record(statusf, tcarg, &status);
+    atf_process_status_fini(&status);
+
+out_workdir:
+    atf_fs_path_fini(&workdir);
+out_resfile:
+    atf_fs_path_fini(&resfile);
+out_tcname:
+    free(tcname);
+    return err;
+}
+
+/** Runs a collection of test case parts, one after the other.
+ *
+ * Each test case part is executed in its own subprocess, forked from the
+ * already-initialized test program, so that the cost of starting the test
+ * program is only paid once.  The results of the test cases are stored in
+ * the directory given by -r, in a file named after each test case, and the
+ * termination status of every subprocess is recorded in the "status" file
+ * of the same directory.  Every test case runs within its own work
+ * directory in there, as in parallel mode. */
+static
+atf_error_t
+run_batch(atf_tp_t *tp, struct params *p, int *exitcode)
+{
+    atf_error_t err;
+    atf_list_citer_t iter;
+    atf_fs_path_t resdir, statuspath;
+    FILE *statusf;
+    bool success;
+
+    err = atf_no_error();
+
+    atf_list_for_each_c(iter, &p->m_batch_tcargs) {
+        const char *tcarg = atf_list_citer_data(iter);
+        char *tcname;
+        enum tc_part tcpart = BODY;
+
+        err = handle_tcarg(tcarg, &tcname, &tcpart);
+        if (!atf_is_error(err) && !atf_tp_has_tc(tp, tcname))
+            err = usage_error("Unknown test case `%s'", tcname);
+        free(tcname);
+        if (atf_is_error(err))
+            goto out;
+    }
+
+    if (atf_fs_path_is_absolute(&p->m_resfile))
+        err = atf_fs_path_copy(&resdir, &p->m_resfile);
+    else
+        err = atf_fs_path_to_absolute(&p->m_resfile, &resdir);
+    if (atf_is_error(err))
+        goto out;
+
+    err = atf_fs_path_init_fmt(&statuspath, "%s/status",
+                               atf_fs_path_cstring(&resdir));
+    if (atf_is_error(err))
+        goto out_resdir;
+
+    statusf = fopen(atf_fs_path_cstring(&statuspath), "w");
+    if (statusf == NULL) {
+        err = atf_libc_error(errno, "Cannot create status file '%s'",
+                             atf_fs_path_cstring(&statuspath));
+        goto out_statuspath;
+    }
+
+    warn_if_not_controlled();
+
+    success = true;
+    atf_list_for_each_c(iter, &p->m_batch_tcargs) {
+        err = run_batch_tcarg(tp, &resdir, atf_list_citer_data(iter), statusf,
+                              &success);
+        if (atf_is_error(err))
+            break;
+    }
+    *exitcode = success ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    fclose(statusf);
+out_statuspath:
+    atf_fs_path_fini(&statuspath);
+out_resdir:
+    atf_fs_path_fini(&resdir);
+out:
+    return err;
+}
+
+/* ---------------------------------------------------------------------
+ * Parallel execution.
+ * --------------------------------------------------------------------- */
+
+struct parallel_job {
+    const char *m_tcname;
+    bool m_has_cleanup;
+    atf_fs_path_t m_workdir;
+    atf_fs_path_t m_resfile;
+};
+
+/** Initializes the jobs to run in parallel mode.
+ *
+ * If no test cases were provided by the user, all the test cases in the
+ * test program are run.  Each test case gets its own work directory and
+ * results file within resdir. */
+static
+atf_error_t
+parallel_jobs_init(const atf_tp_t *tp, const atf_list_t *tcargs,
+                   const atf_fs_path_t *resdir, struct parallel_job **jobsp,
+                   size_t *njobsp)
+{
+    atf_error_t err;
+    const atf_tc_t *const *tcs;
+    atf_list_citer_t iter;
+    struct parallel_job *jobs;
+    size_t njobs, i;
+
+    err = atf_no_error();
+    tcs = NULL;
+
+    if (atf_list_size(tcargs) == 0) {
+        tcs = atf_tp_get_tcs_ref(tp);
+        for (njobs = 0; tcs[njobs] != NULL; njobs++)
+            ;
+    } else {
+        atf_list_for_each_c(iter, tcargs) {
+            const char *tcarg = atf_list_citer_data(iter);
+
+            if (strchr(tcarg, ':') != NULL)
+                return usage_error("Cannot specify test case parts with -j");
+            if (!atf_tp_has_tc(tp, tcarg))
+                return usage_error("Unknown test case `%s'", tcarg);
+        }
+        njobs = atf_list_size(tcargs);
+    }
+
+    jobs = malloc(sizeof(struct parallel_job) * (njobs == 0 ? 1 : njobs));
+    if (jobs == NULL) {
+        err = atf_no_memory_error();
+        goto out;
+    }
+
+    iter = atf_list_begin_c(tcargs);
+    for (i = 0; i < njobs; i++) {
+        const atf_tc_t *tc;
+
+        if (tcs != NULL)
+            tc = tcs[i];
+        else {
+            tc = atf_tp_get_tc(tp, atf_list_citer_data(iter));
+            iter = atf_list_citer_next(iter);
+        }
+
+        jobs[i].m_tcname = atf_tc_get_ident(tc);
+        jobs[i].m_has_cleanup = atf_tc_has_cleanup(tc);
+
+        err = atf_fs_path_init_fmt(&jobs[i].m_workdir, "%s/%s.work",
+                                   atf_fs_path_cstring(resdir),
+                                   jobs[i].m_tcname);
+        if (atf_is_error(err))
+            break;
+
+        err = atf_fs_path_init_fmt(&jobs[i].m_resfile, "%s/%s.result",
+                                   atf_fs_path_cstring(resdir),
+                                   jobs[i].m_tcname);
+        if (atf_is_error(err)) {
+            atf_fs_path_fini(&jobs[i].m_workdir);
+            break;
+        }
+    }
+    if (atf_is_error(err)) {
+        while (i > 0) {
+            i--;
+            atf_fs_path_fini(&jobs[i].m_resfile);
+            atf_fs_path_fini(&jobs[i].m_workdir);
+        }
+        free(jobs);
+        goto out;
+    }
+
+    *jobsp = jobs;
+    *njobsp = njobs;
+out:
+    return err;
+}
+
+static
+void
+parallel_jobs_fini(struct parallel_job *jobs, const size_t njobs)
+{
+    size_t i;
+
+    for (i = 0; i < njobs; i++) {
+        atf_fs_path_fini(&jobs[i].m_resfile);
+        atf_fs_path_fini(&jobs[i].m_workdir);
+    }
+    free(jobs);
+}
+
+/** Starts the subprocess for a part of a job. */
+static
+atf_error_t
+start_job(atf_tp_t *tp, const struct parallel_job *job,
+          const enum tc_part tcpart, atf_process_child_t *child)
+{
+    atf_error_t err;
+    struct batch_part bp;
+
+    err = make_workdir(&job->m_workdir);
+    if (atf_is_error(err))
+        return err;
+
+    bp.m_tp = tp;
+    bp.m_tcname = job->m_tcname;
+    bp.m_tcpart = tcpart;
+    bp.m_resfile = atf_fs_path_cstring(&job->m_resfile);
+    bp.m_config = NULL;
+    bp.m_detach_stdin = false;
+    bp.m_workdir = atf_fs_path_cstring(&job->m_workdir);
+
+    return start_part(&bp, NULL, child);
+}
+
+/** Waits for any of the running subprocesses to terminate.
+ *
+ * The slot of the subprocess is released and its index returned in slot. */
+static
+atf_error_t
+wait_any_job(atf_process_child_t **running, const size_t nslots,
+             size_t *slot, atf_process_status_t *status)
+{
+    atf_error_t err;
+
+    while (atf_is_error(err = atf_process_child_wait_any(running, nslots,
+                                                         slot, status))) {
+        if (!atf_error_is(err, "libc") || atf_libc_error_code(err) != EINTR)
+            return err;
+        atf_error_free(err);
+    }
+    running[*slot] = NULL;
+    return err;
+}
+
+/** Runs all the requested test cases concurrently.
+ *
+ * Up to p->m_jobs test cases run at any given time, each in a subprocess
+ * forked from the already-initialized test program.  Every test case runs
+ * within its own work directory, which is also used as its TMPDIR, and its
+ * cleanup routine, if any, is run in the same directory right after the
+ * body finishes.  Results and status records are stored in the same layout
+ * as in batch mode, except that the latter appear in completion order. */
+static
+atf_error_t
+run_parallel(atf_tp_t *tp, struct params *p, int *exitcode)
+{
+    atf_error_t err;
+    atf_fs_path_t resdir, statuspath;
+    struct parallel_job *jobs;
+    atf_process_child_t *children;
+    atf_process_child_t **running;
+    size_t *slot_job;
+    enum tc_part *slot_part;
+    size_t njobs, nslots, next, active, slot, i;
+    FILE *statusf;
+    bool success;
+
+    if (atf_fs_path_is_absolute(&p->m_resfile))
+        err = atf_fs_path_copy(&resdir, &p->m_resfile);
+    else
+        err = atf_fs_path_to_absolute(&p->m_resfile, &resdir);
+    if (atf_is_error(err))
+        goto out;
+
+    jobs = NULL;
+    njobs = 0;
+    err = parallel_jobs_init(tp, &p->m_batch_tcargs, &resdir, &jobs,
+                             &njobs);
+    if (atf_is_error(err))
+        goto out_resdir;
+
+    nslots = (size_t)p->m_jobs < njobs ? (size_t)p->m_jobs : njobs;
+    if (nslots == 0)
+        nslots = 1;
+    children = malloc(sizeof(atf_process_child_t) * nslots);
+    running = malloc(sizeof(atf_process_child_t *) * nslots);
+    slot_job = malloc(sizeof(size_t) * nslots);
+    slot_part = malloc(sizeof(enum tc_part) * nslots);
+    if (children == NULL || running == NULL || slot_job == NULL ||
+        slot_part == NULL) {
+        err = atf_no_memory_error();
+        goto out_slots;
+    }
+    for (i = 0; i < nslots; i++)
+        running[i] = NULL;
+
+    err = atf_fs_path_init_fmt(&statuspath, "%s/status",
+                               atf_fs_path_cstring(&resdir));
+    if (atf_is_error(err))
+        goto out_slots;
+
+    statusf = fopen(atf_fs_path_cstring(&statuspath), "w");
+    if (statusf == NULL) {
+        err = atf_libc_error(errno, "Cannot create status file '%s'",
+                             atf_fs_path_cstring(&statuspath));
+        goto out_statuspath;
+    }
+
+    warn_if_not_controlled();
+
+    success = true;
+    next = 0;
+    active = 0;
+    while (!atf_is_error(err) && (next < njobs || active > 0)) {
+        atf_process_status_t status;
+        const struct parallel_job *job;
+
+        for (slot = 0; slot < nslots && next < njobs; slot++) {
+            if (running[slot] != NULL)
+                continue;
+
+            err = start_job(tp, &jobs[next], BODY, &children[slot]);
+            if (atf_is_error(err))
+                break;
+            running[slot] = &children[slot];
+            slot_job[slot] = next;
+            slot_part[slot] = BODY;
+            next++;
+            active++;
+        }
+        if (atf_is_error(err) || active == 0)
+            break;
+
+        err = wait_any_job(running, nslots, &slot, &status);
+        if (atf_is_error(err))
+            break;
+        active--;
+
+        if (!atf_process_status_exited(&status) ||
+            atf_process_status_exitstatus(&status) != EXIT_SUCCESS)
+            success = false;
+
+        job = &jobs[slot_job[slot]];
+        if (slot_part[slot] == BODY) {
+            err = write_status_record(statusf, job->m_tcname, &status);
+        } else {
+            atf_dynstr_t tcarg;
+
+            err = atf_dynstr_init_fmt(&tcarg, "%s:cleanup", job->m_tcname);
+            if (!atf_is_error(err)) {
+                err = write_status_record(statusf, atf_dynstr_cstring(&tcarg),
+                                          &status);
+                atf_dynstr_fini(&tcarg);
+            }
+        }
+        atf_process_status_fini(&status);
+
+        if (!atf_is_error(err) && slot_part[slot] == BODY &&
+            job->m_has_cleanup) {
+            err = start_job(tp, job, CLEANUP, &children[slot]);
+            if (!atf_is_error(err)) {
+                running[slot] = &children[slot];
+                slot_part[slot] = CLEANUP;
+                active++;
+            }
+        }
+    }
+
+    /* Do not leave any subprocesses behind if we had to bail out early. */
+    while (active > 0) {
+        atf_process_status_t status;
+        atf_error_t err2;
+
+        err2 = wait_any_job(running, nslots, &slot, &status);
+        if (atf_is_error(err2)) {
+            atf_error_free(err2);
+            break;
+        }
+        atf_process_status_fini(&status);
+        active--;
+    }
+
+    *exitcode = success ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    fclose(statusf);
+out_statuspath:
+    atf_fs_path_fini(&statuspath);
+out_slots:
+    free(slot_part);
+    free(slot_job);
+    free(running);
+    free(children);
+    parallel_jobs_fini(jobs, njobs);
+out_resdir:
+    atf_fs_path_fini(&resdir);
+out:
+    return err;
+}
+
+/* ---------------------------------------------------------------------
+ * Server mode.
+ * --------------------------------------------------------------------- */
+
+/** Splits the next tab-separated field off a request.
+ *
+ * Returns NULL once all fields have been consumed. */
+static
+char *
+next_field(char **cursor)
+{
+    char *field;
+    char *tab;
+
+    field = *cursor;
+    if (field != NULL) {
+        tab = strchr(field, '\t');
+        if (tab == NULL)
+            *cursor = NULL;
+        else {
+            *tab = '\0';
+            *cursor = tab + 1;
+        }
+    }
+    return field;
+}
+
+/** Writes the completion record of a request that could not be served. */
+static
+atf_error_t
+write_error_record(FILE *f, const char *tcarg, const atf_error_t reqerr)
+{
+    char buf[4096];
+
+    atf_error_format(reqerr, buf, sizeof(buf));
+    if (fprintf(f, "%s error %s\n", tcarg, buf) < 0 || fflush(f) == EOF)
+        return atf_libc_error(errno, "Failed to write status record for %s",
+                              tcarg);
+    return atf_no_error();
+}
+
+/** Computes where the test case of a request runs and stores its result.
+ *
+ * Both paths are absolute, as the test case does not run in the current
+ * directory of the server.  The work directory is created if needed. */
+static
+atf_error_t
+request_paths(const char *resfile, const char *tcname, atf_fs_path_t *respath,
+              atf_fs_path_t *workdir)
+{
+    atf_error_t err;
+    atf_fs_path_t aux, resdir;
+
+    err = atf_fs_path_init_fmt(&aux, "%s", resfile);
+    if (atf_is_error(err))
+        goto out;
+
+    if (atf_fs_path_is_absolute(&aux))
+        err = atf_fs_path_copy(respath, &aux);
+    else
+        err = atf_fs_path_to_absolute(&aux, respath);
+    atf_fs_path_fini(&aux);
+    if (atf_is_error(err))
+        goto out;
+
+    err = atf_fs_path_branch_path(respath, &resdir);
+    if (atf_is_error(err))
+        goto err_respath;
+
+    err = atf_fs_path_init_fmt(workdir, "%s/%s.work",
+                               atf_fs_path_cstring(&resdir), tcname);
+    atf_fs_path_fini(&resdir);
+    if (atf_is_error(err))
+        goto err_respath;
+
+    err = make_workdir(workdir);
+    if (atf_is_error(err))
+        goto err_workdir;
+
+    INV(!atf_is_error(err));
+    goto out;
+
+err_workdir:
+    atf_fs_path_fini(workdir);
+err_respath:
+    atf_fs_path_fini(respath);
+out:
+    return err;
+}
+
+/** Serves a single request received in server mode.
+ *
+ * A request is a line of tab-separated fields: the test case to run, with
+ * an optional part suffix, the path to its results file and zero or more
+ * var=value configuration variables.  Malformed requests are answered with
+ * an error record and do not terminate the server.  The test case runs
+ * within a work directory named after it, next to its results file. */
+static
+atf_error_t
+serve_request(atf_tp_t *tp, char *request, FILE *replyf)
+{
+    atf_error_t err;
+    atf_error_t reqerr;
+    struct batch_part bp;
+    atf_fs_path_t respath, workdir;
+    atf_map_t config;
+    atf_process_stream_t outsb;
+    atf_process_status_t status;
+    char *cursor, *tcarg, *resfile, *field;
+    char *tcname;
+    enum tc_part tcpart;
+
+    err = atf_map_init(&config);
+    if (atf_is_error(err))
+        goto out;
+
+    cursor = request;
+    tcarg = next_field(&cursor);
+    resfile = next_field(&cursor);
+
+    tcname = NULL;
+    tcpart = BODY;
+    if (resfile == NULL || resfile[0] == '\0')
+        reqerr = usage_error("Request does not provide a results file");
+    else
+        reqerr = handle_tcarg(tcarg, &tcname, &tcpart);
+    if (!atf_is_error(reqerr) && !atf_tp_has_tc(tp, tcname))
+        reqerr = usage_error("Unknown test case `%s'", tcname);
+    while (!atf_is_error(reqerr) && (field = next_field(&cursor)) != NULL)
+        reqerr = parse_vflag(field, &config);
+
+    if (!atf_is_error(reqerr))
+        reqerr = request_paths(resfile, tcname, &respath, &workdir);
+
+    if (atf_is_error(reqerr)) {
+        err = write_error_record(replyf, tcarg, reqerr);
+        atf_error_free(reqerr);
+        goto out_tcname;
+    }
+
+    bp.m_tp = tp;
+    bp.m_tcname = tcname;
+    bp.m_tcpart = tcpart;
+    bp.m_resfile = atf_fs_path_cstring(&respath);
+    bp.m_config = &config;
+    /* The request stream is our stdin; the test case must not consume it. */
+    bp.m_detach_stdin = true;
+    bp.m_workdir = atf_fs_path_cstring(&workdir);
+
+    /* The reply stream is our stdout; keep the test case from writing to
+     * it by sending its output to stderr instead. */
+    err = atf_process_stream_init_connect(&outsb, STDOUT_FILENO,
+                                          STDERR_FILENO);
+    if (atf_is_error(err))
+        goto out_paths;
+
+    err = fork_part(&bp, &outsb, &status);
+    if (!atf_is_error(err)) {
+        err = write_status_record(replyf, tcarg, &status);
+        atf_process_status_fini(&status);
+    }
+
+    atf_process_stream_fini(&outsb);
+out_paths:
+    atf_fs_path_fini(&workdir);
+    atf_fs_path_fini(&respath);
+out_tcname:
+    if (tcname != NULL)
+        free(tcname);
+    atf_map_fini(&config);
+out:
+    return err;
+}
+
+/** Serves requests to run test cases until the end of stdin is reached.
+ *
+ * The test program is initialized only once and every request is run in a
+ * subprocess forked from it, which lets a long-lived runner dispatch test
+ * cases without paying the cost of starting the test program each time.
+ * One completion record is written to stdout for every request read, in
+ * the same format as the status file of batch mode. */
+static
+atf_error_t
+run_server(atf_tp_t *tp, int *exitcode)
+{
+    atf_error_t err;
+    atf_dynstr_t line;
+    bool eof;
+
+    err = atf_dynstr_init(&line);
+    if (atf_is_error(err))
+        goto out;
+
+    warn_if_not_controlled();
+
+    for (;;) {
+        char *request;
+
+        err = read_line(stdin, &line, &eof);
+        if (atf_is_error(err) || eof)
+            break;
+        if (atf_dynstr_length(&line) == 0)
+            continue;
+
+        request = strdup(atf_dynstr_cstring(&line));
+        if (request == NULL) {
+            err = atf_no_memory_error();
+            break;
+        }
+        err = serve_request(tp, request, stdout);
+        free(request);
+        if (atf_is_error(err))
+            break;
+    }
+    *exitcode = EXIT_SUCCESS;
+
+    atf_dynstr_fini(&line);
+out:
+    return err;
+}
+
+static
+atf_error_t
+controlled_main(int argc, char **argv,
                 atf_error_t (*add_tcs_hook)(atf_tp_t *),
                 int *exitcode)
 {
@@ -552,6 +1942,26 @@ controlled_main(int argc, char **argv,
     if (atf_is_error(err))
         goto out_p;
 
+    if (p.m_report_rusage) {
+        report_rusage = true;
+        atf_tc_set_report_rusage(true);
+    }
+    if (p.m_cgroup_root != NULL)
+        atf_tc_set_cgroup_root(p.m_cgroup_root);
+
+    if (p.m_do_list && p.m_cachedir != NULL) {
+        bool hit;
+
+        err = list_from_cache(&p, &hit);
+        if (atf_is_error(err)) {
+            warn_list_cache_error(err);
+            err = atf_no_error();
+        } else if (hit) {
+            *exitcode = EXIT_SUCCESS;
+            goto out_p;
+        }
+    }
+
     raw_config = atf_map_to_charpp(&p.m_config);
     if (raw_config == NULL) {
         err = atf_no_memory_error();
@@ -567,9 +1977,22 @@ controlled_main(int argc, char **argv,
         goto out_tp;
 
     if (p.m_do_list) {
-        list_tcs(&tp);
+        if (p.m_cachedir != NULL) {
+            err = list_to_cache(&tp, &p);
+            if (atf_is_error(err)) {
+                warn_list_cache_error(err);
+                err = atf_no_error();
+            }
+        }
+        list_tcs(&tp, p.m_list_format, stdout);
         INV(!atf_is_error(err));
         *exitcode = EXIT_SUCCESS;
+    } else if (p.m_do_batch && p.m_jobs > 0) {
+        err = run_parallel(&tp, &p, exitcode);
+    } else if (p.m_do_batch) {
+        err = run_batch(&tp, &p, exitcode);
+    } else if (p.m_do_server) {
+        err = run_server(&tp, exitcode);
     } else {
         err = run_tc(&tp, &p, exitcode);
     }
@@ -0,0 +1,305 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include "atf-c/detail/vars.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atf-c/detail/sanity.h"
+#include "atf-c/detail/text.h"
+#include "atf-c/error.h"
+#include "atf-c/utils.h"
+
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+struct var {
+    char *m_name;
+    char *m_value;
+    size_t m_hash;
+};
+
+struct atf_vars {
+    size_t m_refcount;
+
+    /* The variables, in the order in which they were first defined. */
+    struct var *m_vars;
+    size_t m_nvars;
+
+    /* Open-addressing hash table over m_vars.  Every slot holds an index
+     * into m_vars plus one, or zero if the slot is empty.  The table is
+     * sized when the configuration is created and is never more than half
+     * full. */
+    size_t *m_index;
+    size_t m_index_capacity;
+};
+
+static
+size_t *
+find_slot(const atf_vars_t *c, const size_t hash, const char *name)
+{
+    size_t i;
+
+    for (i = hash & (c->m_index_capacity - 1); c->m_index[i] != 0;
+         i = (i + 1) & (c->m_index_capacity - 1)) {
+        const struct var *var = &c->m_vars[c->m_index[i] - 1];
+
+        if (var->m_hash == hash && strcmp(var->m_name, name) == 0)
+            break;
+    }
+    return &c->m_index[i];
+}
+
+/** Allocates an empty configuration with room for nvars variables. */
+static
+atf_error_t
+vars_alloc(atf_vars_t **cp, const size_t nvars)
+{
+    atf_vars_t *c;
+
+    c = malloc(sizeof(*c));
+    if (c == NULL)
+        goto err;
+
+    c->m_refcount = 1;
+    c->m_nvars = 0;
+
+    c->m_vars = malloc(sizeof(struct var) * (nvars + 1));
+    if (c->m_vars == NULL)
+        goto err_c;
+
+    c->m_index_capacity = 8;
+    while (c->m_index_capacity < nvars * 2)
+        c->m_index_capacity *= 2;
+    c->m_index = calloc(c->m_index_capacity, sizeof(size_t));
+    if (c->m_index == NULL)
+        goto err_vars;
+
+    *cp = c;
+    return atf_no_error();
+
+err_vars:
+    free(c->m_vars);
+err_c:
+    free(c);
+err:
+    return atf_no_memory_error();
+}
+
+static
+void
+vars_free(atf_vars_t *c)
+{
+    size_t i;
+
+    for (i = 0; i < c->m_nvars; i++) {
+        free(c->m_vars[i].m_name);
+        free(c->m_vars[i].m_value);
+    }
+    free(c->m_index);
+    free(c->m_vars);
+    free(c);
+}
+
+/** Defines a variable in a configuration that is still being built.
+ *
+ * Redefining a variable replaces its value but keeps its original
+ * position.  The caller must have reserved room for the variable when
+ * allocating the configuration. */
+static
+atf_error_t
+vars_put(atf_vars_t *c, const char *name, const char *value)
+{
+    const size_t hash = atf_text_hash(name);
+    size_t *slot;
+    char *copy;
+
+    copy = strdup(value);
+    if (copy == NULL)
+        return atf_no_memory_error();
+
+    slot = find_slot(c, hash, name);
+    if (*slot != 0) {
+        struct var *var = &c->m_vars[*slot - 1];
+
+        free(var->m_value);
+        var->m_value = copy;
+    } else {
+        struct var *var = &c->m_vars[c->m_nvars];
+
+        var->m_name = strdup(name);
+        if (var->m_name == NULL) {
+            free(copy);
+            return atf_no_memory_error();
+        }
+        var->m_value = copy;
+        var->m_hash = hash;
+
+        c->m_nvars++;
+        *slot = c->m_nvars;
+    }
+
+    return atf_no_error();
+}
+
+/* ---------------------------------------------------------------------
+ * The "atf_vars" type.
+ * --------------------------------------------------------------------- */
+
+/*
+ * Constructors and destructors.
+ */
+
+/** Creates a configuration out of a NULL-terminated array of name/value
+ * pairs, which may be NULL itself to denote an empty configuration. */
+atf_error_t
+atf_vars_new_charpp(atf_vars_t **cp, const char *const *array)
+{
+    atf_error_t err;
+    const char *const *ptr;
+    size_t nvars;
+
+    nvars = 0;
+    if (array != NULL) {
+        for (ptr = array; *ptr != NULL; ptr += 2) {
+            if (*(ptr + 1) == NULL)
+                return atf_libc_error(EINVAL, "List too short; no value for "
+                    "key '%s' provided", *ptr);  /* XXX: Not really libc_error */
+            nvars++;
+        }
+    }
+
+    err = vars_alloc(cp, nvars);
+    if (atf_is_error(err))
+        return err;
+
+    for (ptr = array; !atf_is_error(err) && nvars > 0; ptr += 2, nvars--)
+        err = vars_put(*cp, *ptr, *(ptr + 1));
+
+    if (atf_is_error(err))
+        vars_free(*cp);
+
+    return err;
+}
+
+/** Creates a copy of a configuration in which a variable is set to a new
+ * value. */
+atf_error_t
+atf_vars_new_override(atf_vars_t **cp, const atf_vars_t *base,
+                      const char *name, const char *value)
+{
+    atf_error_t err;
+    size_t i;
+
+    err = vars_alloc(cp, base->m_nvars + 1);
+    if (atf_is_error(err))
+        return err;
+
+    for (i = 0; !atf_is_error(err) && i < base->m_nvars; i++)
+        err = vars_put(*cp, base->m_vars[i].m_name, base->m_vars[i].m_value);
+    if (!atf_is_error(err))
+        err = vars_put(*cp, name, value);
+
+    if (atf_is_error(err))
+        vars_free(*cp);
+
+    return err;
+}
+
+atf_vars_t *
+atf_vars_ref(atf_vars_t *c)
+{
+    PRE(c->m_refcount > 0);
+    c->m_refcount++;
+    return c;
+}
+
+void
+atf_vars_unref(atf_vars_t *c)
+{
+    PRE(c->m_refcount > 0);
+    c->m_refcount--;
+    if (c->m_refcount == 0)
+        vars_free(c);
+}
+
+/*
+ * Getters.
+ */
+
+/** Returns the value of a variable, or NULL if it is not defined. */
+const char *
+atf_vars_get(const atf_vars_t *c, const char *name)
+{
+    const size_t *slot;
+
+    slot = find_slot(c, atf_text_hash(name), name);
+    return *slot == 0 ? NULL : c->m_vars[*slot - 1].m_value;
+}
+
+size_t
+atf_vars_size(const atf_vars_t *c)
+{
+    return c->m_nvars;
+}
+
+char **
+atf_vars_to_charpp(const atf_vars_t *c)
+{
+    char **array;
+    size_t i;
+
+    array = malloc(sizeof(char *) * (c->m_nvars * 2 + 1));
+    if (array == NULL)
+        goto out;
+
+    for (i = 0; i < c->m_nvars; i++) {
+        /* Keep the array terminated so that it can be released at any
+         * point. */
+        array[i * 2] = NULL;
+
+        array[i * 2 + 1] = strdup(c->m_vars[i].m_value);
+        if (array[i * 2 + 1] == NULL)
+            goto err;
+
+        array[i * 2] = strdup(c->m_vars[i].m_name);
+        if (array[i * 2] == NULL) {
+            free(array[i * 2 + 1]);
+            goto err;
+        }
+    }
+    array[c->m_nvars * 2] = NULL;
+
+out:
+    return array;
+
+err:
+    atf_utils_free_charpp(array);
+    return NULL;
+}
@@ -0,0 +1,58 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#if !defined(ATF_C_DETAIL_VARS_H)
+#define ATF_C_DETAIL_VARS_H
+
+#include <stddef.h>
+
+#include <atf-c/error_fwd.h>
+
+/* ---------------------------------------------------------------------
+ * The "atf_vars" type.
+ * --------------------------------------------------------------------- */
+
+/* An immutable and reference-counted set of configuration variables.
+ *
+ * A test program builds a single instance out of its command line and all
+ * of its test cases hold a reference to it, so registering a test case does
+ * not need to copy the variables.  Lookups are served by a hash table.
+ * Changing a variable means creating a new instance. */
+struct atf_vars;
+typedef struct atf_vars atf_vars_t;
+
+/* Constructors and destructors. */
+atf_error_t atf_vars_new_charpp(atf_vars_t **, const char *const *);
+atf_error_t atf_vars_new_override(atf_vars_t **, const atf_vars_t *,
+                                  const char *, const char *);
+atf_vars_t *atf_vars_ref(atf_vars_t *);
+void atf_vars_unref(atf_vars_t *);
+
+/* Getters. */
+const char *atf_vars_get(const atf_vars_t *, const char *);
+size_t atf_vars_size(const atf_vars_t *);
+char **atf_vars_to_charpp(const atf_vars_t *);
+
+#endif /* !defined(ATF_C_DETAIL_VARS_H) */
@@ -0,0 +1,206 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include "atf-c/detail/vars.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atf-c.h>
+
+#include "atf-c/detail/test_helpers.h"
+#include "atf-c/utils.h"
+
+/* ---------------------------------------------------------------------
+ * Tests for the "atf_vars" type.
+ * --------------------------------------------------------------------- */
+
+/*
+ * Constructors and destructors.
+ */
+
+ATF_TC_WITHOUT_HEAD(new_charpp_null);
+ATF_TC_BODY(new_charpp_null, tc)
+{
+    atf_vars_t *vars;
+
+    RE(atf_vars_new_charpp(&vars, NULL));
+    ATF_REQUIRE_EQ(atf_vars_size(vars), 0);
+    ATF_REQUIRE(atf_vars_get(vars, "foo") == NULL);
+    atf_vars_unref(vars);
+}
+
+ATF_TC_WITHOUT_HEAD(new_charpp_some);
+ATF_TC_BODY(new_charpp_some, tc)
+{
+    const char *const array[] = { "K1", "V1", "K2", "V2", "K1", "V3", NULL };
+    atf_vars_t *vars;
+
+    RE(atf_vars_new_charpp(&vars, array));
+    ATF_REQUIRE_EQ(atf_vars_size(vars), 2);
+    ATF_REQUIRE_STREQ(atf_vars_get(vars, "K1"), "V3");
+    ATF_REQUIRE_STREQ(atf_vars_get(vars, "K2"), "V2");
+    ATF_REQUIRE(atf_vars_get(vars, "K3") == NULL);
+    atf_vars_unref(vars);
+}
+
+ATF_TC_WITHOUT_HEAD(new_charpp_short);
+ATF_TC_BODY(new_charpp_short, tc)
+{
+    const char *const array[] = { "K1", "V1", "K2", NULL };
+    atf_vars_t *vars;
+
+    atf_error_t err = atf_vars_new_charpp(&vars, array);
+    ATF_REQUIRE(atf_is_error(err));
+    ATF_REQUIRE(atf_error_is(err, "libc"));
+    atf_error_free(err);
+}
+
+ATF_TC(new_override);
+ATF_TC_HEAD(new_override, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks that overriding a variable "
+                      "creates a new configuration and leaves the original "
+                      "one untouched");
+}
+ATF_TC_BODY(new_override, tc)
+{
+    const char *const array[] = { "K1", "V1", "K2", "V2", NULL };
+    atf_vars_t *vars, *vars2, *vars3;
+
+    RE(atf_vars_new_charpp(&vars, array));
+
+    RE(atf_vars_new_override(&vars2, vars, "K1", "new"));
+    ATF_REQUIRE_EQ(atf_vars_size(vars2), 2);
+    ATF_REQUIRE_STREQ(atf_vars_get(vars2, "K1"), "new");
+    ATF_REQUIRE_STREQ(atf_vars_get(vars2, "K2"), "V2");
+
+    RE(atf_vars_new_override(&vars3, vars2, "K3", "V3"));
+    ATF_REQUIRE_EQ(atf_vars_size(vars3), 3);
+    ATF_REQUIRE_STREQ(atf_vars_get(vars3, "K3"), "V3");
+
+    ATF_REQUIRE_STREQ(atf_vars_get(vars, "K1"), "V1");
+    ATF_REQUIRE(atf_vars_get(vars2, "K3") == NULL);
+
+    atf_vars_unref(vars3);
+    atf_vars_unref(vars2);
+    atf_vars_unref(vars);
+}
+
+ATF_TC(ref_unref);
+ATF_TC_HEAD(ref_unref, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks that a configuration remains "
+                      "valid while references to it exist");
+}
+ATF_TC_BODY(ref_unref, tc)
+{
+    const char *const array[] = { "K1", "V1", NULL };
+    atf_vars_t *vars, *ref;
+
+    RE(atf_vars_new_charpp(&vars, array));
+    ref = atf_vars_ref(vars);
+    ATF_REQUIRE(ref == vars);
+    atf_vars_unref(vars);
+    ATF_REQUIRE_STREQ(atf_vars_get(ref, "K1"), "V1");
+    atf_vars_unref(ref);
+}
+
+/*
+ * Getters.
+ */
+
+ATF_TC(get_many);
+ATF_TC_HEAD(get_many, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks the atf_vars_get function "
+                      "with enough variables to exercise collisions");
+}
+ATF_TC_BODY(get_many, tc)
+{
+    const char *array[1001];
+    char names[500][16], values[500][16];
+    atf_vars_t *vars;
+    size_t i;
+
+    for (i = 0; i < 500; i++) {
+        snprintf(names[i], sizeof(names[i]), "var%zd", i);
+        snprintf(values[i], sizeof(values[i]), "value%zd", i);
+        array[i * 2] = names[i];
+        array[i * 2 + 1] = values[i];
+    }
+    array[1000] = NULL;
+
+    RE(atf_vars_new_charpp(&vars, array));
+    ATF_REQUIRE_EQ(atf_vars_size(vars), 500);
+    for (i = 0; i < 500; i++)
+        ATF_REQUIRE_STREQ(atf_vars_get(vars, names[i]), values[i]);
+    ATF_REQUIRE(atf_vars_get(vars, "var500") == NULL);
+    atf_vars_unref(vars);
+}
+
+ATF_TC(to_charpp);
+ATF_TC_HEAD(to_charpp, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks the atf_vars_to_charpp "
+                      "function");
+}
+ATF_TC_BODY(to_charpp, tc)
+{
+    const char *const array[] = { "K1", "V1", "K2", "V2", "K1", "V3", NULL };
+    atf_vars_t *vars;
+    char **out;
+
+    RE(atf_vars_new_charpp(&vars, array));
+    out = atf_vars_to_charpp(vars);
+    ATF_REQUIRE(out != NULL);
+    ATF_REQUIRE_STREQ(out[0], "K1");
+    ATF_REQUIRE_STREQ(out[1], "V3");
+    ATF_REQUIRE_STREQ(out[2], "K2");
+    ATF_REQUIRE_STREQ(out[3], "V2");
+    ATF_REQUIRE(out[4] == NULL);
+    atf_utils_free_charpp(out);
+    atf_vars_unref(vars);
+}
+
+/* ---------------------------------------------------------------------
+ * Main.
+ * --------------------------------------------------------------------- */
+
+ATF_TP_ADD_TCS(tp)
+{
+    /* Constructors and destructors. */
+    ATF_TP_ADD_TC(tp, new_charpp_null);
+    ATF_TP_ADD_TC(tp, new_charpp_some);
+    ATF_TP_ADD_TC(tp, new_charpp_short);
+    ATF_TP_ADD_TC(tp, new_override);
+    ATF_TP_ADD_TC(tp, ref_unref);
+
+    /* Getters. */
+    ATF_TP_ADD_TC(tp, get_many);
+    ATF_TP_ADD_TC(tp, to_charpp);
+
+    return atf_no_error();
+}
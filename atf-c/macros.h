@@ -28,6 +28,7 @@
 
 #include <string.h>
 
+#include <atf-c/bench.h>
 #include <atf-c/defs.h>
 #include <atf-c/error.h>
 #include <atf-c/tc.h>
@@ -97,6 +98,39 @@
 #define ATF_TC_CLEANUP_NAME(tc) \
     (atfu_ ## tc ## _cleanup)
 
+#define ATF_BENCH(tc) \
+    static void atfu_ ## tc ## _head(atf_tc_t *); \
+    static void atfu_ ## tc ## _bench(const atf_tc_t *, const size_t); \
+    static \
+    void \
+    atfu_ ## tc ## _bench_head(atf_tc_t *tcptr) \
+    { \
+        atf_bench_head(tcptr); \
+        atfu_ ## tc ## _head(tcptr); \
+    } \
+    static \
+    void \
+    atfu_ ## tc ## _body(const atf_tc_t *tcptr) \
+    { \
+        atf_bench_run(tcptr, atfu_ ## tc ## _bench); \
+    } \
+    static atf_tc_t atfu_ ## tc ## _tc; \
+    static atf_tc_pack_t atfu_ ## tc ## _tc_pack = { \
+        .m_ident = #tc, \
+        .m_head = atfu_ ## tc ## _bench_head, \
+        .m_body = atfu_ ## tc ## _body, \
+        .m_cleanup = NULL, \
+    }
+
+#define ATF_BENCH_HEAD(tc, tcptr) \
+    ATF_TC_HEAD(tc, tcptr)
+
+#define ATF_BENCH_BODY(tc, tcptr, iterations) \
+    static \
+    void \
+    atfu_ ## tc ## _bench(const atf_tc_t *tcptr ATF_DEFS_ATTRIBUTE_UNUSED, \
+                          const size_t iterations)
+
 #define ATF_TP_ADD_TCS(tps) \
     static atf_error_t atfu_tp_add_tcs(atf_tp_t *); \
     int atf_tp_main(int, char **, atf_error_t (*)(atf_tp_t *)); \
@@ -113,13 +147,8 @@
 #define ATF_TP_ADD_TC(tp, tc) \
     do { \
         atf_error_t atfu_err; \
-        char **atfu_config = atf_tp_get_config(tp); \
-        if (atfu_config == NULL) \
-            return atf_no_memory_error(); \
-        atfu_err = atf_tc_init_pack(&atfu_ ## tc ## _tc, \
-                                    &atfu_ ## tc ## _tc_pack, \
-                                    (const char *const *)atfu_config); \
-        atf_utils_free_charpp(atfu_config); \
+        atfu_err = atf_tp_init_tc(tp, &atfu_ ## tc ## _tc, \
+                                  &atfu_ ## tc ## _tc_pack); \
         if (atf_is_error(atfu_err)) \
             return atfu_err; \
         atfu_err = atf_tp_add_tc(tp, &atfu_ ## tc ## _tc); \
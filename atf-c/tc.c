@@ -31,6 +31,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -40,11 +41,15 @@
 #include <unistd.h>
 
 #include "atf-c/defs.h"
+#include "atf-c/detail/cgroup.h"
 #include "atf-c/detail/env.h"
 #include "atf-c/detail/fs.h"
 #include "atf-c/detail/map.h"
+#include "atf-c/detail/process.h"
+#include "atf-c/detail/rusage.h"
 #include "atf-c/detail/sanity.h"
 #include "atf-c/detail/text.h"
+#include "atf-c/detail/vars.h"
 #include "atf-c/error.h"
 
 /* ---------------------------------------------------------------------
@@ -72,8 +77,13 @@ struct context {
     size_t expect_fail_count;
     int expect_exitcode;
     int expect_signo;
+
+    atf_dynstr_t record;
 };
 
+static bool Report_Rusage = false;
+static const char *Cgroup_Root = NULL;
+
 static void context_init(struct context *, const atf_tc_t *, const char *);
 static void context_set_resfile(struct context *, const char *);
 static void context_close_resfile(struct context *);
@@ -84,6 +94,9 @@ static atf_error_t write_resfile(const int, const char *, const int,
                                  const atf_dynstr_t *);
 static void create_resfile(struct context *, const char *, const int,
                            atf_dynstr_t *);
+static void finish_resfile(struct context *);
+static atf_error_t get_kill_leftovers(const atf_tc_t *, bool *);
+static void reap_leftovers(const char *, size_t *);
 static void error_in_expect(struct context *, const char *, ...)
     ATF_DEFS_ATTRIBUTE_NORETURN;
 static void validate_expect(struct context *);
@@ -103,12 +116,37 @@ static void format_reason_fmt(atf_dynstr_t *, const char *, const size_t,
 static void errno_test(struct context *, const char *, const size_t,
                        const int, const char *, const bool,
                        void (*)(struct context *, atf_dynstr_t *));
-static atf_error_t check_prog_in_dir(const char *, void *);
 static atf_error_t check_prog(struct context *, const char *);
 
 /* No prototype in header for this one, it's a little sketchy (internal). */
 void atf_tc_set_resultsfile(const char *);
 
+/* No prototype in header for this one, it's a little sketchy (internal). */
+void atf_tc_set_report_rusage(const bool);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+void atf_tc_set_cgroup_root(const char *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+void atf_tc_add_result_record(const char *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+atf_error_t atf_tc_set_config_var(atf_tc_t *, const char *, const char *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+atf_error_t atf_tc_init_config(atf_tc_t *, const char *, atf_tc_head_t,
+                               atf_tc_body_t, atf_tc_cleanup_t,
+                               atf_vars_t *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+atf_vars_t *atf_tc_get_config(const atf_tc_t *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+void atf_tc_set_config(atf_tc_t *, atf_vars_t *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+bool atf_tc_has_cleanup(const atf_tc_t *);
+
 static void
 context_init(struct context *ctx, const atf_tc_t *tc, const char *resfile)
 {
@@ -123,6 +161,7 @@ context_init(struct context *ctx, const atf_tc_t *tc, const char *resfile)
     ctx->expect_fail_count = 0;
     ctx->expect_exitcode = 0;
     ctx->expect_signo = 0;
+    check_fatal_error(atf_dynstr_init(&ctx->record));
 }
 
 static void
@@ -270,6 +309,84 @@ create_resfile(struct context *ctx, const char *result, const int arg,
     check_fatal_error(err);
 }
 
+/** Checks if the test case asks for its leftover processes to be killed.
+ *
+ * This is opt-in through the kill.leftovers metadata variable because a
+ * body may legitimately leave a daemon running for its cleanup routine to
+ * stop. */
+static atf_error_t
+get_kill_leftovers(const atf_tc_t *tc, bool *kill_leftovers)
+{
+    atf_error_t err;
+
+    if (!atf_tc_has_md_var(tc, "kill.leftovers")) {
+        *kill_leftovers = false;
+        return atf_no_error();
+    }
+
+    err = atf_text_to_bool(atf_tc_get_md_var(tc, "kill.leftovers"),
+                           kill_leftovers);
+    if (atf_is_error(err)) {
+        atf_error_free(err);
+        err = atf_libc_error(EINVAL, "Invalid value '%s' for kill.leftovers",
+                             atf_tc_get_md_var(tc, "kill.leftovers"));
+    }
+    return err;
+}
+
+/** Kills any process left behind by a test case part.
+ *
+ * The part is done by now, so any descendant still running has leaked and
+ * would otherwise keep competing for resources with later test cases.
+ * Problems while doing so are only reported, as they do not change the
+ * outcome of the part. */
+static void
+reap_leftovers(const char *part, size_t *leaked)
+{
+    atf_error_t err;
+
+    err = atf_process_reap_descendants(leaked);
+    if (atf_is_error(err)) {
+        char buf[1024];
+        atf_error_format(err, buf, sizeof(buf));
+        atf_error_free(err);
+        fprintf(stderr, "WARNING: Cannot kill leftover processes of the "
+                "test case %s: %s\n", part, buf);
+    } else if (*leaked > 0)
+        fprintf(stderr, "WARNING: Killed %zu leftover processes of the "
+                "test case %s\n", *leaked, part);
+}
+
+/** Completes a results file once the test case has reached its final
+ * result.
+ *
+ * If requested, any lines added by the test case (such as benchmark
+ * statistics) are appended to the results file, after the result itself;
+ * the resources consumed by the body and the number of processes it
+ * leaked are appended later on by supervise_body. */
+static void
+finish_resfile(struct context *ctx)
+{
+    if (Report_Rusage) {
+        const char *record;
+        size_t len;
+
+        record = atf_dynstr_cstring(&ctx->record);
+        len = atf_dynstr_length(&ctx->record);
+        while (len > 0) {
+            const ssize_t ret = write(ctx->resfilefd, record, len);
+            if (ret == -1 && errno == EINTR)
+                continue; /* Retry. */
+            if (ret == -1)
+                check_fatal_error(atf_libc_error(errno, "Failed to write "
+                                                 "results file"));
+            record += ret;
+            len -= ret;
+        }
+    }
+    context_close_resfile(ctx);
+}
+
 /** Fails a test case if validate_expect fails. */
 static void
 error_in_expect(struct context *ctx, const char *fmt, ...)
@@ -322,7 +439,7 @@ expected_failure(struct context *ctx, atf_dynstr_t *reason)
     check_fatal_error(atf_dynstr_prepend_fmt(reason, "%s: ",
         atf_dynstr_cstring(&ctx->expect_reason)));
     create_resfile(ctx, "expected_failure", -1, reason);
-    context_close_resfile(ctx);
+    finish_resfile(ctx);
     exit(EXIT_SUCCESS);
 }
 
@@ -333,7 +450,7 @@ fail_requirement(struct context *ctx, atf_dynstr_t *reason)
         expected_failure(ctx, reason);
     } else if (ctx->expect == EXPECT_PASS) {
         create_resfile(ctx, "failed", -1, reason);
-        context_close_resfile(ctx);
+        finish_resfile(ctx);
         exit(EXIT_FAILURE);
     } else {
         error_in_expect(ctx, "Test case raised a failure but was not "
@@ -369,7 +486,7 @@ pass(struct context *ctx)
             "a pass instead");
     } else if (ctx->expect == EXPECT_PASS) {
         create_resfile(ctx, "passed", -1, NULL);
-        context_close_resfile(ctx);
+        finish_resfile(ctx);
         exit(EXIT_SUCCESS);
     } else {
         error_in_expect(ctx, "Test case asked to explicitly pass but was "
@@ -383,7 +500,7 @@ skip(struct context *ctx, atf_dynstr_t *reason)
 {
     if (ctx->expect == EXPECT_PASS) {
         create_resfile(ctx, "skipped", -1, reason);
-        context_close_resfile(ctx);
+        finish_resfile(ctx);
         exit(EXIT_SUCCESS);
     } else {
         error_in_expect(ctx, "Can only skip a test case when running in "
@@ -466,42 +583,6 @@ errno_test(struct context *ctx, const char *file, const size_t line,
     }
 }
 
-struct prog_found_pair {
-    const char *prog;
-    bool found;
-};
-
-static atf_error_t
-check_prog_in_dir(const char *dir, void *data)
-{
-    struct prog_found_pair *pf = data;
-    atf_error_t err;
-
-    if (pf->found)
-        err = atf_no_error();
-    else {
-        atf_fs_path_t p;
-
-        err = atf_fs_path_init_fmt(&p, "%s/%s", dir, pf->prog);
-        if (atf_is_error(err))
-            goto out_p;
-
-        err = atf_fs_eaccess(&p, atf_fs_access_x);
-        if (!atf_is_error(err))
-            pf->found = true;
-        else {
-            atf_error_free(err);
-            INV(!pf->found);
-            err = atf_no_error();
-        }
-
-out_p:
-        atf_fs_path_fini(&p);
-    }
-
-    return err;
-}
-
 static atf_error_t
 check_prog(struct context *ctx, const char *prog)
 {
@@ -524,9 +605,9 @@ check_prog(struct context *ctx, const char *prog)
             skip(ctx, &reason);
         }
     } else {
-        const char *path = atf_env_get("PATH");
-        struct prog_found_pair pf;
-        atf_fs_path_t bp;
+        atf_fs_path_t bp, found_path;
+        const char *name;
+        bool found;
 
         err = atf_fs_path_branch_path(&p, &bp);
         if (atf_is_error(err))
@@ -541,13 +622,17 @@ check_prog(struct context *ctx, const char *prog)
             UNREACHABLE;
         }
 
-        pf.prog = prog;
-        pf.found = false;
-        err = atf_text_for_each_word(path, ":", check_prog_in_dir, &pf);
+        /* The branch path can only be "." at this point, so the program
+         * is looked for by its leaf name. */
+        name = strrchr(prog, '/');
+        err = atf_fs_find_prog(name == NULL ? prog : name + 1, &found_path,
+                               &found);
         if (atf_is_error(err))
             goto out_bp;
 
-        if (!pf.found) {
+        if (found)
+            atf_fs_path_fini(&found_path);
+        else {
             atf_dynstr_t reason;
 
             atf_fs_path_fini(&bp);
@@ -575,21 +660,59 @@ struct atf_tc_impl {
     const char *m_ident;
 
     atf_map_t m_vars;
-    atf_map_t m_config;
+    atf_vars_t *m_config;
 
     atf_tc_head_t m_head;
     atf_tc_body_t m_body;
     atf_tc_cleanup_t m_cleanup;
+
+    bool m_head_done;
 };
 
+/** Evaluates the head of the test case if it has not been done yet.
+ *
+ * Heads are run on demand, the first time the meta-data of the test case
+ * is queried or the test case is run, so that registering a test case is
+ * cheap and test programs only pay for the heads they actually need. */
+static
+void
+ensure_head(const atf_tc_t *tc)
+{
+    atf_tc_t *mtc = (atf_tc_t *)(uintptr_t)tc;
+    struct atf_tc_impl *pimpl = tc->pimpl;
+
+    if (pimpl->m_head_done)
+        return;
+    pimpl->m_head_done = true;  /* Set early; the head sets variables. */
+
+    check_fatal_error(atf_tc_set_md_var(mtc, "ident", pimpl->m_ident));
+    if (pimpl->m_cleanup != NULL)
+        check_fatal_error(atf_tc_set_md_var(mtc, "has.cleanup", "true"));
+
+    /* XXX Should the head be able to return error codes? */
+    if (pimpl->m_head != NULL)
+        pimpl->m_head(mtc);
+
+    if (strcmp(atf_tc_get_md_var(tc, "ident"), pimpl->m_ident) != 0) {
+        report_fatal_error("Test case head modified the read-only 'ident' "
+            "property");
+        UNREACHABLE;
+    }
+}
+
 /*
  * Constructors/destructors.
  */
 
+/** Initializes a test case that shares an existing configuration.
+ *
+ * The test case takes a new reference to the configuration, so the caller
+ * keeps its own.  This is how test programs register their test cases, as
+ * it avoids copying all configuration variables into every test case. */
 atf_error_t
-atf_tc_init(atf_tc_t *tc, const char *ident, atf_tc_head_t head,
-            atf_tc_body_t body, atf_tc_cleanup_t cleanup,
-            const char *const *config)
+atf_tc_init_config(atf_tc_t *tc, const char *ident, atf_tc_head_t head,
+                   atf_tc_body_t body, atf_tc_cleanup_t cleanup,
+                   atf_vars_t *config)
 {
     atf_error_t err;
 
@@ -603,46 +726,40 @@ atf_tc_init(atf_tc_t *tc, const char *ident, atf_tc_head_t head,
     tc->pimpl->m_head = head;
     tc->pimpl->m_body = body;
     tc->pimpl->m_cleanup = cleanup;
-
-    err = atf_map_init_charpp(&tc->pimpl->m_config, config);
-    if (atf_is_error(err))
-        goto err;
+    tc->pimpl->m_config = atf_vars_ref(config);
+    tc->pimpl->m_head_done = false;
 
     err = atf_map_init(&tc->pimpl->m_vars);
     if (atf_is_error(err))
         goto err_vars;
 
-    err = atf_tc_set_md_var(tc, "ident", ident);
-    if (atf_is_error(err))
-        goto err_map;
-
-    if (cleanup != NULL) {
-        err = atf_tc_set_md_var(tc, "has.cleanup", "true");
-        if (atf_is_error(err))
-            goto err_map;
-    }
-
-    /* XXX Should the head be able to return error codes? */
-    if (tc->pimpl->m_head != NULL)
-        tc->pimpl->m_head(tc);
-
-    if (strcmp(atf_tc_get_md_var(tc, "ident"), ident) != 0) {
-        report_fatal_error("Test case head modified the read-only 'ident' "
-            "property");
-        UNREACHABLE;
-    }
-
     INV(!atf_is_error(err));
     return err;
 
-err_map:
-    atf_map_fini(&tc->pimpl->m_vars);
 err_vars:
-    atf_map_fini(&tc->pimpl->m_config);
+    atf_vars_unref(tc->pimpl->m_config);
+    free(tc->pimpl);
 err:
     return err;
 }
 
+atf_error_t
+atf_tc_init(atf_tc_t *tc, const char *ident, atf_tc_head_t head,
+            atf_tc_body_t body, atf_tc_cleanup_t cleanup,
+            const char *const *config)
+{
+    atf_error_t err;
+    atf_vars_t *c;
+
+    err = atf_vars_new_charpp(&c, config);
+    if (atf_is_error(err))
+        return err;
+
+    err = atf_tc_init_config(tc, ident, head, body, cleanup, c);
+    atf_vars_unref(c);
+    return err;
+}
+
 atf_error_t
 atf_tc_init_pack(atf_tc_t *tc, const atf_tc_pack_t *pack,
                  const char *const *config)
@@ -655,6 +772,7 @@ void
 atf_tc_fini(atf_tc_t *tc)
 {
     atf_map_fini(&tc->pimpl->m_vars);
+    atf_vars_unref(tc->pimpl->m_config);
     free(tc->pimpl);
 }
 
@@ -668,16 +786,29 @@ atf_tc_get_ident(const atf_tc_t *tc)
     return tc->pimpl->m_ident;
 }
 
+atf_vars_t *
+atf_tc_get_config(const atf_tc_t *tc)
+{
+    return tc->pimpl->m_config;
+}
+
+/** Checks if the test case has a cleanup routine.
+ *
+ * Unlike the has.cleanup metadata variable, this does not need the head
+ * of the test case to be evaluated. */
+bool
+atf_tc_has_cleanup(const atf_tc_t *tc)
+{
+    return tc->pimpl->m_cleanup != NULL;
+}
+
 const char *
 atf_tc_get_config_var(const atf_tc_t *tc, const char *name)
 {
     const char *val;
-    atf_map_citer_t iter;
 
-    PRE(atf_tc_has_config_var(tc, name));
-    iter = atf_map_find_c(&tc->pimpl->m_config, name);
-    val = atf_map_citer_data(iter);
-    INV(val != NULL);
+    val = atf_vars_get(tc->pimpl->m_config, name);
+    PRE(val != NULL);
 
     return val;
 }
@@ -766,6 +897,7 @@ atf_tc_get_md_var(const atf_tc_t *tc, const char *name)
     const char *val;
     atf_map_citer_t iter;
 
+    ensure_head(tc);
     PRE(atf_tc_has_md_var(tc, name));
     iter = atf_map_find_c(&tc->pimpl->m_vars, name);
     val = atf_map_citer_data(iter);
@@ -777,17 +909,14 @@ atf_tc_get_md_var(const atf_tc_t *tc, const char *name)
 char **
 atf_tc_get_md_vars(const atf_tc_t *tc)
 {
+    ensure_head(tc);
     return atf_map_to_charpp(&tc->pimpl->m_vars);
 }
 
 bool
 atf_tc_has_config_var(const atf_tc_t *tc, const char *name)
 {
-    atf_map_citer_t end, iter;
-
-    iter = atf_map_find_c(&tc->pimpl->m_config, name);
-    end = atf_map_end_c(&tc->pimpl->m_config);
-    return !atf_equal_map_citer_map_citer(iter, end);
+    return atf_vars_get(tc->pimpl->m_config, name) != NULL;
 }
 
 bool
@@ -795,6 +924,7 @@ atf_tc_has_md_var(const atf_tc_t *tc, const char *name)
 {
     atf_map_citer_t end, iter;
 
+    ensure_head(tc);
     iter = atf_map_find_c(&tc->pimpl->m_vars, name);
     end = atf_map_end_c(&tc->pimpl->m_vars);
     return !atf_equal_map_citer_map_citer(iter, end);
@@ -811,6 +941,8 @@ atf_tc_set_md_var(atf_tc_t *tc, const char *name, const char *fmt, ...)
     char *value;
     va_list ap;
 
+    ensure_head(tc);
+
     va_start(ap, fmt);
     err = atf_text_format_ap(&value, fmt, ap);
     va_end(ap);
@@ -823,6 +955,30 @@ atf_tc_set_md_var(atf_tc_t *tc, const char *name, const char *fmt, ...)
     return err;
 }
 
+atf_error_t
+atf_tc_set_config_var(atf_tc_t *tc, const char *name, const char *value)
+{
+    atf_error_t err;
+    atf_vars_t *c;
+
+    err = atf_vars_new_override(&c, tc->pimpl->m_config, name, value);
+    if (!atf_is_error(err)) {
+        atf_tc_set_config(tc, c);
+        atf_vars_unref(c);
+    }
+
+    return err;
+}
+
+/** Replaces the configuration of the test case with a shared one. */
+void
+atf_tc_set_config(atf_tc_t *tc, atf_vars_t *config)
+{
+    atf_vars_ref(config);
+    atf_vars_unref(tc->pimpl->m_config);
+    tc->pimpl->m_config = config;
+}
+
 /* ---------------------------------------------------------------------
  * Free functions, as they should be publicly but they can't.
  * --------------------------------------------------------------------- */
@@ -1052,8 +1208,27 @@ _atf_tc_set_resultsfile(struct context *ctx, const char *file)
 
 static struct context Current;
 
-atf_error_t
-atf_tc_run(const atf_tc_t *tc, const char *resfile)
+struct supervised_body {
+    const atf_tc_t *tc;
+    const char *resfile;
+    const atf_cgroup_t *cg;
+};
+
+static void run_body(const atf_tc_t *, const char *)
+    ATF_DEFS_ATTRIBUTE_NORETURN;
+static void fail_cgroup(const atf_tc_t *, const char *, atf_error_t)
+    ATF_DEFS_ATTRIBUTE_NORETURN;
+static void supervised_body(void *)
+    ATF_DEFS_ATTRIBUTE_NORETURN;
+static void terminate_like(atf_process_status_t *)
+    ATF_DEFS_ATTRIBUTE_NORETURN;
+static void supervise_body(const atf_tc_t *, const char *,
+                           const atf_cgroup_limits_t *, bool)
+    ATF_DEFS_ATTRIBUTE_NORETURN;
+
+/** Runs the body of a test case and terminates with its result. */
+static void
+run_body(const atf_tc_t *tc, const char *resfile)
 {
     context_init(&Current, tc, resfile);
 
@@ -1077,14 +1252,278 @@ atf_tc_run(const atf_tc_t *tc, const char *resfile)
         pass(&Current);
     }
     UNREACHABLE;
+}
+
+static const char *
+get_md_var_or_null(const atf_tc_t *tc, const char *name)
+{
+    return atf_tc_has_md_var(tc, name) ? atf_tc_get_md_var(tc, name) : NULL;
+}
+
+/** Reports a problem with the cgroup of a test case as its result. */
+static void
+fail_cgroup(const atf_tc_t *tc, const char *resfile, atf_error_t err)
+{
+    char buf[1024];
+
+    atf_error_format(err, buf, sizeof(buf));
+    atf_error_free(err);
+    context_init(&Current, tc, resfile);
+    atf_tc_fail("Cannot run the body in a cgroup: %s", buf);
+}
+
+static void
+supervised_body(void *v)
+{
+    const struct supervised_body *sb = v;
+    atf_error_t err;
+
+    if (sb->cg != NULL) {
+        err = atf_cgroup_attach(sb->cg, getpid());
+        if (atf_is_error(err))
+            fail_cgroup(sb->tc, sb->resfile, err);
+    }
+    run_body(sb->tc, sb->resfile);
+}
+
+/** Appends a record to the results file left behind by the body.
+ *
+ * Nothing is appended if the body died without leaving a result behind,
+ * as the record would otherwise be taken for the result itself. */
+static atf_error_t
+append_record(const char *resfile, const atf_dynstr_t *record)
+{
+    atf_error_t err;
+    struct stat sb;
+    ssize_t len;
+    int fd;
+
+    if (strcmp(resfile, "/dev/stdout") == 0)
+        fd = STDOUT_FILENO;
+    else if (strcmp(resfile, "/dev/stderr") == 0)
+        fd = STDERR_FILENO;
+    else {
+        fd = open(resfile, O_WRONLY | O_APPEND);
+        if (fd == -1)
+            return atf_libc_error(errno, "Cannot open results file '%s'",
+                                  resfile);
+        if (fstat(fd, &sb) == -1 || sb.st_size == 0) {
+            close(fd);
+            return atf_no_error();
+        }
+    }
+
+    err = atf_no_error();
+    len = atf_dynstr_length(record);
+    if (write(fd, atf_dynstr_cstring(record), len) != len)
+        err = atf_libc_error(errno, "Failed to write results file");
+
+    if (fd != STDOUT_FILENO && fd != STDERR_FILENO)
+        close(fd);
+    return err;
+}
+
+/** Terminates in the same way as the given subprocess did, so that the
+ * caller cannot tell the difference. */
+static void
+terminate_like(atf_process_status_t *status)
+{
+    int code;
+
+    if (atf_process_status_exited(status)) {
+        code = atf_process_status_exitstatus(status);
+        atf_process_status_fini(status);
+        exit(code);
+    } else {
+        INV(atf_process_status_signaled(status));
+        code = atf_process_status_termsig(status);
+        atf_process_status_fini(status);
+        signal(code, SIG_DFL);
+        kill(getpid(), code);
+        abort();
+    }
+}
+
+/** Runs the body of a test case in a subprocess and records the resources
+ * it consumed.
+ *
+ * This is done when the resources are to be reported, so that they are
+ * recorded however the body terminates, even if it is expected to exit or
+ * to die, and when limits is not NULL, in which case the subprocess moves
+ * itself into a transient cgroup with those limits that can be removed
+ * once it is done.  It is also done when kill_leftovers is true: this
+ * process then adopts anything that the body leaves behind and kills it
+ * once the body is done, for the same reason.  If the resources are to be
+ * reported, the records are appended to the results file, and this process
+ * then terminates in the same way as the subprocess did. */
+static void
+supervise_body(const atf_tc_t *tc, const char *resfile,
+               const atf_cgroup_limits_t *limits, bool kill_leftovers)
+{
+    atf_error_t err;
+    atf_cgroup_t cg;
+    atf_cgroup_stats_t stats;
+    atf_process_child_t child;
+    atf_process_status_t status;
+    atf_rusage_t ru;
+    atf_rusage_record_t rec;
+    atf_dynstr_t record;
+    struct supervised_body sb;
+    char name[64];
+    size_t leaked = 0;
+
+    if (kill_leftovers) {
+        bool supported;
+
+        check_fatal_error(atf_process_become_subreaper(&supported));
+    }
+
+    if (limits != NULL) {
+        snprintf(name, sizeof(name), "atf-%ld", (long)getpid());
+        err = atf_cgroup_init(&cg, Cgroup_Root, name);
+        if (atf_is_error(err))
+            fail_cgroup(tc, resfile, err);
+
+        err = atf_cgroup_set_limits(&cg, limits);
+        if (atf_is_error(err))
+            goto err_cg;
+    }
+
+    sb.tc = tc;
+    sb.resfile = resfile;
+    sb.cg = limits != NULL ? &cg : NULL;
+    fflush(stdout);
+    fflush(stderr);
+    atf_rusage_start(&ru);
+    err = atf_process_fork(&child, supervised_body, NULL, NULL, NULL, &sb);
+    if (atf_is_error(err))
+        goto err_cg;
+
+    err = atf_process_child_wait(&child, &status);
+    if (atf_is_error(err))
+        goto err_cg;
+    atf_rusage_stop(&ru, &rec);
+
+    if (kill_leftovers)
+        reap_leftovers("body", &leaked);
+
+    if (limits != NULL) {
+        err = atf_cgroup_stats(&cg, &stats);
+        check_fatal_error(err);
+        err = atf_cgroup_destroy(&cg);
+        if (atf_is_error(err)) {
+            char buf[1024];
+            atf_error_format(err, buf, sizeof(buf));
+            atf_error_free(err);
+            fprintf(stderr, "WARNING: %s\n", buf);
+        }
+
+        if (atf_process_status_signaled(&status) &&
+            atf_process_status_termsig(&status) == SIGKILL &&
+            stats.m_oom_kills > 0) {
+            atf_process_status_fini(&status);
+            context_init(&Current, tc, resfile);
+            atf_tc_fail("Test case body exceeded its memory limit of %lld "
+                        "bytes", limits->m_memory_max);
+        }
+    }
+
+    if (Report_Rusage) {
+        check_fatal_error(atf_rusage_format(&rec, "body", &record));
+        if (kill_leftovers)
+            check_fatal_error(atf_dynstr_append_fmt(&record,
+                "body.leaked: %zu\n", leaked));
+        err = append_record(resfile, &record);
+        atf_dynstr_fini(&record);
+        check_fatal_error(err);
+    }
+
+    if (Report_Rusage && limits != NULL) {
+        check_fatal_error(atf_cgroup_stats_format(&stats, &record));
+        err = append_record(resfile, &record);
+        atf_dynstr_fini(&record);
+        check_fatal_error(err);
+    }
+
+    terminate_like(&status);
+
+err_cg:
+    if (limits == NULL)
+        check_fatal_error(err);
+    {
+        atf_error_t err2 = atf_cgroup_destroy(&cg);
+        if (atf_is_error(err2))
+            atf_error_free(err2);
+    }
+    fail_cgroup(tc, resfile, err);
+}
+
+atf_error_t
+atf_tc_run(const atf_tc_t *tc, const char *resfile)
+{
+    atf_error_t err;
+    bool kill_leftovers;
+
+    ensure_head(tc);
+
+    err = get_kill_leftovers(tc, &kill_leftovers);
+    if (atf_is_error(err)) {
+        char buf[1024];
+
+        atf_error_format(err, buf, sizeof(buf));
+        atf_error_free(err);
+        context_init(&Current, tc, resfile);
+        atf_tc_fail("%s", buf);
+    }
+
+    if (Cgroup_Root != NULL) {
+        atf_cgroup_limits_t limits;
+
+        err = atf_cgroup_limits_parse(&limits,
+            get_md_var_or_null(tc, "require.memory"),
+            get_md_var_or_null(tc, "limit.cpu"),
+            get_md_var_or_null(tc, "limit.pids"));
+        if (atf_is_error(err))
+            fail_cgroup(tc, resfile, err);
+        if (atf_cgroup_limits_any(&limits))
+            supervise_body(tc, resfile, &limits, kill_leftovers);
+    }
+
+    if (Report_Rusage || kill_leftovers)
+        supervise_body(tc, resfile, NULL, kill_leftovers);
+
+    run_body(tc, resfile);
+    UNREACHABLE;
     return atf_no_error();
 }
 
 atf_error_t
 atf_tc_cleanup(const atf_tc_t *tc)
 {
-    if (tc->pimpl->m_cleanup != NULL)
+    ensure_head(tc);
+    if (tc->pimpl->m_cleanup != NULL) {
+        bool kill_leftovers;
+        atf_error_t err;
+
+        /* An invalid value was already reported as the result of the body. */
+        err = get_kill_leftovers(tc, &kill_leftovers);
+        if (atf_is_error(err)) {
+            atf_error_free(err);
+            kill_leftovers = false;
+        }
+
+        if (kill_leftovers) {
+            bool supported;
+
+            check_fatal_error(atf_process_become_subreaper(&supported));
+        }
         tc->pimpl->m_cleanup(tc);
+        if (kill_leftovers) {
+            size_t leaked;
+
+            reap_leftovers("cleanup", &leaked);
+        }
+    }
     return atf_no_error(); /* XXX */
 }
 
@@ -1277,3 +1716,27 @@ atf_tc_set_resultsfile(const char *file)
 
     _atf_tc_set_resultsfile(&Current, file);
 }
+
+/* Internal! */
+void
+atf_tc_set_report_rusage(const bool report)
+{
+    Report_Rusage = report;
+}
+
+/* Internal! */
+void
+atf_tc_set_cgroup_root(const char *root)
+{
+    Cgroup_Root = root;
+}
+
+/* Internal! */
+void
+atf_tc_add_result_record(const char *lines)
+{
+
+    PRE(Current.tc != NULL);
+
+    check_fatal_error(atf_dynstr_append_fmt(&Current.record, "%s", lines));
+}
@@ -32,6 +32,9 @@
 
 #include "atf-c/detail/test_helpers.h"
 
+/* No prototype in header for this one, it's a little sketchy (internal). */
+bool atf_tc_has_cleanup(const atf_tc_t *);
+
 /* ---------------------------------------------------------------------
  * Auxiliary test cases.
  * --------------------------------------------------------------------- */
@@ -43,12 +46,23 @@ ATF_TC_HEAD(empty, tc)
 ATF_TC_BODY(empty, tc)
 {
 }
+ATF_TC_CLEANUP(empty, tc)
+{
+}
 
 ATF_TC_HEAD(test_var, tc)
 {
     atf_tc_set_md_var(tc, "test-var", "Test text");
 }
 
+static int counted_heads = 0;
+
+ATF_TC_HEAD(counted, tc)
+{
+    counted_heads++;
+    atf_tc_set_md_var(tc, "test-var", "Test text");
+}
+
 /* ---------------------------------------------------------------------
  * Test cases for the "atf_tc_t" type.
  * --------------------------------------------------------------------- */
@@ -107,6 +121,40 @@ ATF_TC_BODY(init_pack, tcin)
     atf_tc_fini(&tc);
 }
 
+ATF_TC(lazy_head);
+ATF_TC_HEAD(lazy_head, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Tests that the head of a test case is "
+                      "only evaluated, and only once, when its meta-data is "
+                      "first needed");
+}
+ATF_TC_BODY(lazy_head, tcin)
+{
+    atf_tc_t tc;
+    char **vars;
+
+    counted_heads = 0;
+    RE(atf_tc_init(&tc, "test1", ATF_TC_HEAD_NAME(counted),
+                   ATF_TC_BODY_NAME(empty), NULL, NULL));
+    ATF_REQUIRE_EQ(0, counted_heads);
+    ATF_REQUIRE(strcmp(atf_tc_get_ident(&tc), "test1") == 0);
+    ATF_REQUIRE(!atf_tc_has_cleanup(&tc));
+    ATF_REQUIRE_EQ(0, counted_heads);
+    ATF_REQUIRE(strcmp(atf_tc_get_md_var(&tc, "test-var"), "Test text") == 0);
+    ATF_REQUIRE_EQ(1, counted_heads);
+    vars = atf_tc_get_md_vars(&tc);
+    ATF_REQUIRE(vars != NULL);
+    atf_utils_free_charpp(vars);
+    ATF_REQUIRE_EQ(1, counted_heads);
+    atf_tc_fini(&tc);
+
+    RE(atf_tc_init(&tc, "test2", ATF_TC_HEAD_NAME(counted),
+                   ATF_TC_BODY_NAME(empty), ATF_TC_CLEANUP_NAME(empty), NULL));
+    ATF_REQUIRE(atf_tc_has_cleanup(&tc));
+    atf_tc_fini(&tc);
+    ATF_REQUIRE_EQ(1, counted_heads);
+}
+
 ATF_TC(vars);
 ATF_TC_HEAD(vars, tc)
 {
@@ -173,6 +221,7 @@ ATF_TP_ADD_TCS(tp)
     /* Add the test cases for the "atf_tcr_t" type. */
     ATF_TP_ADD_TC(tp, init);
     ATF_TP_ADD_TC(tp, init_pack);
+    ATF_TP_ADD_TC(tp, lazy_head);
     ATF_TP_ADD_TC(tp, vars);
     ATF_TP_ADD_TC(tp, config);
 
@@ -30,38 +30,133 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "atf-c/detail/vars.h"
 #include "atf-c/detail/fs.h"
-#include "atf-c/detail/map.h"
 #include "atf-c/detail/sanity.h"
+#include "atf-c/detail/text.h"
 #include "atf-c/error.h"
 #include "atf-c/tc.h"
 
+/* No prototype in header for this one, it's a little sketchy (internal). */
+atf_error_t atf_tc_set_config_var(atf_tc_t *, const char *, const char *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+atf_error_t atf_tc_init_config(atf_tc_t *, const char *, atf_tc_head_t,
+                               atf_tc_body_t, atf_tc_cleanup_t,
+                               atf_vars_t *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+atf_vars_t *atf_tc_get_config(const atf_tc_t *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+void atf_tc_set_config(atf_tc_t *, atf_vars_t *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+atf_error_t atf_tp_set_config_var(atf_tp_t *, const char *, const char *);
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+const atf_tc_t *const *atf_tp_get_tcs_ref(const atf_tp_t *);
+
+/* The test cases are kept in two structures: an array that preserves the
+ * registration order, which is the order used when listing them, and an
+ * open-addressing hash table indexed by their identifiers, which makes
+ * lookups take constant time.  Test programs may register many thousands
+ * of test cases, so a linear scan per lookup would make their registration
+ * quadratic. */
+struct tc_slot {
+    size_t m_hash;
+    atf_tc_t *m_tc;
+};
+
 struct atf_tp_impl {
-    atf_list_t m_tcs;
-    atf_map_t m_config;
+    atf_tc_t **m_tcs;
+    size_t m_ntcs;
+    size_t m_tcs_capacity;
+
+    struct tc_slot *m_index;
+    size_t m_index_capacity;
+
+    atf_vars_t *m_config;
 };
 
 /* ---------------------------------------------------------------------
  * Auxiliary functions.
  * --------------------------------------------------------------------- */
 
+/** Locates the slot of the index that holds, or would hold, a test case.
+ *
+ * The index is never full, so this always terminates. */
 static
-const atf_tc_t *
-find_tc(const atf_tp_t *tp, const char *ident)
+struct tc_slot *
+find_slot(struct tc_slot *index, const size_t capacity, const size_t hash,
+          const char *ident)
 {
-    const atf_tc_t *tc;
-    atf_list_citer_t iter;
-
-    tc = NULL;
-    atf_list_for_each_c(iter, &tp->pimpl->m_tcs) {
-        const atf_tc_t *tc2;
-        tc2 = atf_list_citer_data(iter);
-        if (strcmp(atf_tc_get_ident(tc2), ident) == 0) {
-            tc = tc2;
+    size_t i;
+
+    PRE(capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+    for (i = hash & (capacity - 1); index[i].m_tc != NULL;
+         i = (i + 1) & (capacity - 1)) {
+        if (index[i].m_hash == hash &&
+            strcmp(atf_tc_get_ident(index[i].m_tc), ident) == 0)
             break;
+    }
+    return &index[i];
+}
+
+/** Makes room for one more test case in the array and in the index.
+ *
+ * Both structures are grown geometrically so that registering N test cases
+ * takes O(N) time overall.  The index is kept at most half full. */
+static
+atf_error_t
+reserve_tc(struct atf_tp_impl *pimpl)
+{
+    if (pimpl->m_ntcs + 1 >= pimpl->m_tcs_capacity) {
+        const size_t capacity = pimpl->m_tcs_capacity * 2;
+        atf_tc_t **tcs;
+
+        tcs = realloc(pimpl->m_tcs, sizeof(atf_tc_t *) * capacity);
+        if (tcs == NULL)
+            return atf_no_memory_error();
+        pimpl->m_tcs = tcs;
+        pimpl->m_tcs_capacity = capacity;
+    }
+
+    if ((pimpl->m_ntcs + 1) * 2 > pimpl->m_index_capacity) {
+        const size_t capacity = pimpl->m_index_capacity * 2;
+        struct tc_slot *index;
+        size_t i;
+
+        index = calloc(capacity, sizeof(struct tc_slot));
+        if (index == NULL)
+            return atf_no_memory_error();
+
+        for (i = 0; i < pimpl->m_index_capacity; i++) {
+            const struct tc_slot *slot = &pimpl->m_index[i];
+
+            if (slot->m_tc != NULL)
+                *find_slot(index, capacity, slot->m_hash,
+                           atf_tc_get_ident(slot->m_tc)) = *slot;
         }
+
+        free(pimpl->m_index);
+        pimpl->m_index = index;
+        pimpl->m_index_capacity = capacity;
     }
-    return tc;
+
+    return atf_no_error();
+}
+
+static
+const atf_tc_t *
+find_tc(const atf_tp_t *tp, const char *ident)
+{
+    const struct tc_slot *slot;
+
+    slot = find_slot(tp->pimpl->m_index, tp->pimpl->m_index_capacity,
+                     atf_text_hash(ident), ident);
+    return slot->m_tc;
 }
 
 /* ---------------------------------------------------------------------
@@ -76,40 +171,58 @@ atf_error_t
 atf_tp_init(atf_tp_t *tp, const char *const *config)
 {
     atf_error_t err;
+    struct atf_tp_impl *pimpl;
 
     PRE(config != NULL);
 
-    tp->pimpl = malloc(sizeof(struct atf_tp_impl));
-    if (tp->pimpl == NULL)
+    pimpl = malloc(sizeof(struct atf_tp_impl));
+    if (pimpl == NULL)
         return atf_no_memory_error();
 
-    err = atf_list_init(&tp->pimpl->m_tcs);
-    if (atf_is_error(err))
-        goto out;
+    pimpl->m_ntcs = 0;
+    pimpl->m_tcs_capacity = 16;
+    pimpl->m_tcs = malloc(sizeof(atf_tc_t *) * pimpl->m_tcs_capacity);
+    if (pimpl->m_tcs == NULL) {
+        err = atf_no_memory_error();
+        goto err_pimpl;
+    }
+    pimpl->m_tcs[0] = NULL;
 
-    err = atf_map_init_charpp(&tp->pimpl->m_config, config);
-    if (atf_is_error(err)) {
-        atf_list_fini(&tp->pimpl->m_tcs);
-        goto out;
+    pimpl->m_index_capacity = 32;
+    pimpl->m_index = calloc(pimpl->m_index_capacity, sizeof(struct tc_slot));
+    if (pimpl->m_index == NULL) {
+        err = atf_no_memory_error();
+        goto err_tcs;
     }
 
+    err = atf_vars_new_charpp(&pimpl->m_config, config);
+    if (atf_is_error(err))
+        goto err_index;
+
+    tp->pimpl = pimpl;
     INV(!atf_is_error(err));
-out:
+    return err;
+
+err_index:
+    free(pimpl->m_index);
+err_tcs:
+    free(pimpl->m_tcs);
+err_pimpl:
+    free(pimpl);
     return err;
 }
 
 void
 atf_tp_fini(atf_tp_t *tp)
 {
-    atf_list_iter_t iter;
+    size_t i;
 
-    atf_map_fini(&tp->pimpl->m_config);
+    for (i = 0; i < tp->pimpl->m_ntcs; i++)
+        atf_tc_fini(tp->pimpl->m_tcs[i]);
+    free(tp->pimpl->m_index);
+    free(tp->pimpl->m_tcs);
 
-    atf_list_for_each(iter, &tp->pimpl->m_tcs) {
-        atf_tc_t *tc = atf_list_iter_data(iter);
-        atf_tc_fini(tc);
-    }
-    atf_list_fini(&tp->pimpl->m_tcs);
+    atf_vars_unref(tp->pimpl->m_config);
 
     free(tp->pimpl);
 }
@@ -121,7 +234,7 @@ atf_tp_fini(atf_tp_t *tp)
 char **
 atf_tp_get_config(const atf_tp_t *tp)
 {
-    return atf_map_to_charpp(&tp->pimpl->m_config);
+    return atf_vars_to_charpp(tp->pimpl->m_config);
 }
 
 bool
@@ -139,35 +252,33 @@ atf_tp_get_tc(const atf_tp_t *tp, const char *id)
     return tc;
 }
 
+/** Returns the test cases in the order in which they were registered.
+ *
+ * The returned NULL-terminated array is a copy owned by the caller, who
+ * must free it, or NULL if there is not enough memory to allocate it. */
 const atf_tc_t *const *
 atf_tp_get_tcs(const atf_tp_t *tp)
 {
     const atf_tc_t **array;
-    atf_list_citer_t iter;
-    size_t i;
-
-    array = malloc(sizeof(atf_tc_t *) *
-                   (atf_list_size(&tp->pimpl->m_tcs) + 1));
-    if (array == NULL)
-        goto out;
-
-    i = 0;
-    atf_list_for_each_c(iter, &tp->pimpl->m_tcs) {
-        array[i] = atf_list_citer_data(iter);
-        if (array[i] == NULL) {
-            free(array);
-            array = NULL;
-            goto out;
-        }
+    const size_t size = sizeof(atf_tc_t *) * (tp->pimpl->m_ntcs + 1);
 
-        i++;
-    }
-    array[i] = NULL;
-
-out:
+    array = malloc(size);
+    if (array != NULL)
+        memcpy(array, tp->pimpl->m_tcs, size);
     return array;
 }
 
+/** Returns the test cases in the order in which they were registered,
+ * without copying them.
+ *
+ * The returned NULL-terminated array is owned by the test program and
+ * remains valid until the next test case is added to it. */
+const atf_tc_t *const *
+atf_tp_get_tcs_ref(const atf_tp_t *tp)
+{
+    return (const atf_tc_t *const *)tp->pimpl->m_tcs;
+}
+
 /*
  * Modifiers.
  */
@@ -176,12 +287,70 @@ atf_error_t
 atf_tp_add_tc(atf_tp_t *tp, atf_tc_t *tc)
 {
     atf_error_t err;
+    struct atf_tp_impl *pimpl = tp->pimpl;
+    const char *ident = atf_tc_get_ident(tc);
+    const size_t hash = atf_text_hash(ident);
+    struct tc_slot *slot;
+
+    PRE(find_tc(tp, ident) == NULL);
+
+    err = reserve_tc(pimpl);
+    if (atf_is_error(err))
+        goto out;
+
+    pimpl->m_tcs[pimpl->m_ntcs++] = tc;
+    pimpl->m_tcs[pimpl->m_ntcs] = NULL;
+
+    slot = find_slot(pimpl->m_index, pimpl->m_index_capacity, hash, ident);
+    slot->m_hash = hash;
+    slot->m_tc = tc;
+
+    POST(find_tc(tp, ident) == tc);
+
+out:
+    return err;
+}
+
+/** Initializes a test case that shares the configuration of the test
+ * program.
+ *
+ * This is cheaper than initializing the test case with the result of
+ * atf_tp_get_config, which copies all the configuration variables. */
+atf_error_t
+atf_tp_init_tc(atf_tp_t *tp, atf_tc_t *tc, const atf_tc_pack_t *pack)
+{
+    return atf_tc_init_config(tc, pack->m_ident, pack->m_head, pack->m_body,
+                              pack->m_cleanup, tp->pimpl->m_config);
+}
+
+/** Overrides a configuration variable after the test cases are registered.
+ *
+ * The new value is propagated to all the test cases in the test program.
+ * Those that share the configuration of the test program are switched to
+ * the new configuration, which is built only once. */
+atf_error_t
+atf_tp_set_config_var(atf_tp_t *tp, const char *name, const char *value)
+{
+    atf_error_t err;
+    atf_vars_t *oldconfig, *newconfig;
+    size_t i;
 
-    PRE(find_tc(tp, atf_tc_get_ident(tc)) == NULL);
+    oldconfig = tp->pimpl->m_config;
+    err = atf_vars_new_override(&newconfig, oldconfig, name, value);
+    if (atf_is_error(err))
+        return err;
 
-    err = atf_list_append(&tp->pimpl->m_tcs, tc, false);
+    for (i = 0; !atf_is_error(err) && i < tp->pimpl->m_ntcs; i++) {
+        atf_tc_t *tc = tp->pimpl->m_tcs[i];
+
+        if (atf_tc_get_config(tc) == oldconfig)
+            atf_tc_set_config(tc, newconfig);
+        else
+            err = atf_tc_set_config_var(tc, name, value);
+    }
 
-    POST(find_tc(tp, atf_tc_get_ident(tc)) != NULL);
+    tp->pimpl->m_config = newconfig;
+    atf_vars_unref(oldconfig);
 
     return err;
 }
@@ -25,11 +25,97 @@
 
 #include "atf-c/tp.h"
 
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <atf-c.h>
 
+#include "atf-c/detail/test_helpers.h"
+
+/* No prototype in header for this one, it's a little sketchy (internal). */
+const atf_tc_t *const *atf_tp_get_tcs_ref(const atf_tp_t *);
+
+/* ---------------------------------------------------------------------
+ * Auxiliary test cases.
+ * --------------------------------------------------------------------- */
+
+ATF_TC_HEAD(empty, tc)
+{
+    if (tc != NULL) {}
+}
+ATF_TC_BODY(empty, tc)
+{
+}
+
+/* ---------------------------------------------------------------------
+ * Test cases for the "atf_tp_t" type.
+ * --------------------------------------------------------------------- */
+
+ATF_TC(add_many_tcs);
+ATF_TC_HEAD(add_many_tcs, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Checks that many test cases can be "
+        "registered and looked up, and that they are listed in registration "
+        "order");
+}
+ATF_TC_BODY(add_many_tcs, tc)
+{
+    const size_t ntcs = 5000;
+    const char *const config[] = { NULL };
+    const atf_tc_t *const *tcs;
+    atf_tc_t *tcsarray;
+    atf_tp_t tp;
+    char ident[32];
+    size_t i;
+
+    tcsarray = malloc(sizeof(atf_tc_t) * ntcs);
+    ATF_REQUIRE(tcsarray != NULL);
+
+    RE(atf_tp_init(&tp, config));
+    for (i = 0; i < ntcs; i++) {
+        snprintf(ident, sizeof(ident), "tc_%zu", ntcs - i);
+        RE(atf_tc_init(&tcsarray[i], ident, ATF_TC_HEAD_NAME(empty),
+                       ATF_TC_BODY_NAME(empty), NULL, config));
+        RE(atf_tp_add_tc(&tp, &tcsarray[i]));
+    }
+
+    tcs = atf_tp_get_tcs_ref(&tp);
+    ATF_REQUIRE(tcs == atf_tp_get_tcs_ref(&tp));
+    for (i = 0; i < ntcs; i++)
+        ATF_REQUIRE(tcs[i] == &tcsarray[i]);
+    ATF_REQUIRE(tcs[ntcs] == NULL);
+
+    /* The public getter returns a copy that the caller owns. */
+    tcs = atf_tp_get_tcs(&tp);
+    ATF_REQUIRE(tcs != NULL);
+    ATF_REQUIRE(tcs != atf_tp_get_tcs_ref(&tp));
+    for (i = 0; i < ntcs; i++)
+        ATF_REQUIRE(tcs[i] == &tcsarray[i]);
+    ATF_REQUIRE(tcs[ntcs] == NULL);
+#define UNCONST(a) ((void *)(uintptr_t)(const void *)(a))
+    free(UNCONST(tcs));
+#undef UNCONST
+
+    for (i = 0; i < ntcs; i++) {
+        snprintf(ident, sizeof(ident), "tc_%zu", ntcs - i);
+        ATF_REQUIRE(atf_tp_has_tc(&tp, ident));
+        ATF_REQUIRE(atf_tp_get_tc(&tp, ident) == &tcsarray[i]);
+    }
+    ATF_REQUIRE(!atf_tp_has_tc(&tp, "tc_0"));
+    ATF_REQUIRE(!atf_tp_has_tc(&tp, "tc_"));
+    ATF_REQUIRE(!atf_tp_has_tc(&tp, ""));
+
+    atf_tp_fini(&tp);
+    free(tcsarray);
+}
+
+/* ---------------------------------------------------------------------
+ * Other test cases.
+ * --------------------------------------------------------------------- */
+
 ATF_TC(getopt);
 ATF_TC_HEAD(getopt, tc)
 {
@@ -82,6 +168,7 @@ ATF_TC_BODY(getopt, tc)
 
 ATF_TP_ADD_TCS(tp)
 {
+    ATF_TP_ADD_TC(tp, add_many_tcs);
     ATF_TP_ADD_TC(tp, getopt);
 
     return atf_no_error();
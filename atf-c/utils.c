@@ -40,6 +40,7 @@
 #include <atf-c.h>
 
 #include "atf-c/detail/dynstr.h"
+#include "atf-c/detail/fs.h"
 
 /* No prototype in header for this one, it's a little sketchy (internal). */
 void atf_tc_set_resultsfile(const char *);
@@ -72,6 +73,36 @@ init_out_filename(atf_dynstr_t *name, const pid_t pid, const char *suffix,
     }
 }
 
+/** Compiles an extended regexp, failing the test case if it is invalid.
+ *
+ * \param [out] preg The compiled regexp; must be released with regfree.
+ * \param regex The regexp to compile. */
+static
+void
+compile_regex(regex_t *preg, const char *regex)
+{
+    ATF_REQUIRE_MSG(regcomp(preg, regex, REG_EXTENDED) == 0,
+                    "Invalid regular expression '%s'", regex);
+}
+
+/** Matches a compiled regexp against a string.
+ *
+ * \param preg The regexp to look for, as returned by compile_regex.
+ * \param str The string in which to look for the expression.
+ *
+ * \return True if there is a match; false otherwise. */
+static
+bool
+match_regex(const regex_t *preg, const char *str)
+{
+    int res;
+
+    res = regexec(preg, str, 0, NULL, 0);
+    ATF_REQUIRE(res == 0 || res == REG_NOMATCH);
+
+    return res == 0;
+}
+
 /** Searches for a regexp in a string.
  *
  * \param regex The regexp to look for.
@@ -82,21 +113,21 @@ static
 bool
 grep_string(const char *regex, const char *str)
 {
-    int res;
+    bool res;
     regex_t preg;
 
     printf("Looking for '%s' in '%s'\n", regex, str);
-    ATF_REQUIRE(regcomp(&preg, regex, REG_EXTENDED) == 0);
-
-    res = regexec(&preg, str, 0, NULL, 0);
-    ATF_REQUIRE(res == 0 || res == REG_NOMATCH);
-
+    compile_regex(&preg, regex);
+    res = match_regex(&preg, str);
     regfree(&preg);
 
-    return res == 0;
+    return res;
 }
 
 /** Prints the contents of a file to stdout.
+ *
+ * Without a prefix, the file is copied as is and the data does not need to
+ * go through this process at all.
  *
  * \param name The name of the file to be printed.
  * \param prefix An string to be prepended to every line of the printed
@@ -107,6 +138,14 @@ atf_utils_cat_file(const char *name, const char *prefix)
     const int fd = open(name, O_RDONLY);
     ATF_REQUIRE_MSG(fd != -1, "Cannot open %s", name);
 
+    if (prefix[0] == '\0') {
+        fflush(stdout);
+        const atf_error_t error = atf_fs_copy_fd(fd, STDOUT_FILENO);
+        close(fd);
+        ATF_REQUIRE_MSG(!atf_is_error(error), "Failed to print %s", name);
+        return;
+    }
+
     char buffer[1024];
     ssize_t count;
     bool continued = false;
@@ -133,6 +172,7 @@ atf_utils_cat_file(const char *name, const char *prefix)
             continued = true;
         }
     }
+    close(fd);
     ATF_REQUIRE(count == 0);
 }
 
@@ -181,12 +221,9 @@ atf_utils_copy_file(const char *source, const char *destination)
     ATF_REQUIRE_MSG(output != -1, "Failed to open destination file during "
                     "copy (%s)", destination);
 
-    char buffer[1024];
-    ssize_t length;
-    while ((length = read(input, buffer, sizeof(buffer))) > 0)
-        ATF_REQUIRE_MSG(write(output, buffer, length) == length,
-                        "Failed to write to %s during copy", destination);
-    ATF_REQUIRE_MSG(length != -1, "Failed to read from %s during copy", source);
+    const atf_error_t error = atf_fs_copy_fd(input, output);
+    ATF_REQUIRE_MSG(!atf_is_error(error), "Failed to copy %s to %s", source,
+                    destination);
 
     struct stat sb;
     ATF_REQUIRE_MSG(fstat(input, &sb) != -1,
@@ -316,15 +353,22 @@ atf_utils_grep_file(const char *regex, const char *file, ...)
     va_end(ap);
     ATF_REQUIRE(!atf_is_error(error));
 
+    /* Compile the regexp only once, not for every line. */
+    printf("Looking for '%s' in file '%s'\n", atf_dynstr_cstring(&formatted),
+           file);
+    regex_t preg;
+    compile_regex(&preg, atf_dynstr_cstring(&formatted));
+
     ATF_REQUIRE((fd = open(file, O_RDONLY)) != -1);
     bool found = false;
     char *line = NULL;
     while (!found && (line = atf_utils_readline(fd)) != NULL) {
-        found = grep_string(atf_dynstr_cstring(&formatted), line);
+        found = match_regex(&preg, line);
         free(line);
     }
     close(fd);
 
+    regfree(&preg);
     atf_dynstr_fini(&formatted);
 
     return found;
@@ -23,30 +23,40 @@
 // OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
 // IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#if defined(HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
 extern "C" {
+#if defined(HAVE_SYS_INOTIFY_H)
+#include <sys/inotify.h>
+#endif
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include <limits.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdint.h>
 #include <unistd.h>
 }
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <ios>
 #include <iostream>
-#include <iterator>
 #include <list>
 #include <memory>
+#include <sstream>
 #include <utility>
 
 #include "atf-c++/check.hpp"
 #include "atf-c++/detail/application.hpp"
-#include "atf-c++/detail/auto_array.hpp"
+#include "atf-c++/detail/diff.hpp"
 #include "atf-c++/detail/env.hpp"
 #include "atf-c++/detail/exceptions.hpp"
 #include "atf-c++/detail/fs.hpp"
@@ -58,6 +68,9 @@ static const useconds_t seconds_in_useconds = (1000 * 1000);
 static const useconds_t mseconds_in_useconds = 1000;
 static const useconds_t useconds_in_nseconds = 1000;
 
+// Longest delay between executions of the command when watching a path.
+static const useconds_t max_watch_backoff = seconds_in_useconds;
+
 // ------------------------------------------------------------------------
 // Auxiliary functions.
 // ------------------------------------------------------------------------
@@ -107,64 +120,6 @@ struct output_check {
     }
 };
 
-class temp_file : public std::ostream {
-    std::auto_ptr< atf::fs::path > m_path;
-    int m_fd;
-
-public:
-    temp_file(const char* pattern) :
-        std::ostream(NULL),
-        m_fd(-1)
-    {
-        const atf::fs::path file = atf::fs::path(
-            atf::env::get("TMPDIR", "/tmp")) / pattern;
-
-        atf::auto_array< char > buf(new char[file.str().length() + 1]);
-        std::strcpy(buf.get(), file.c_str());
-
-        m_fd = ::mkstemp(buf.get());
-        if (m_fd == -1)
-            throw atf::system_error("atf_check::temp_file::temp_file(" +
-                                    file.str() + ")", "mkstemp(3) failed",
-                                    errno);
-
-        m_path.reset(new atf::fs::path(buf.get()));
-    }
-
-    ~temp_file(void)
-    {
-        close();
-        try {
-            remove(*m_path);
-        } catch (const atf::system_error&) {
-            // Ignore deletion errors.
-        }
-    }
-
-    const atf::fs::path&
-    get_path(void) const
-    {
-        return *m_path;
-    }
-
-    void
-    write(const std::string& text)
-    {
-        if (::write(m_fd, text.c_str(), text.size()) == -1)
-            throw atf::system_error("atf_check", "write(2) failed", errno);
-    }
-
-    void
-    close(void)
-    {
-        if (m_fd != -1) {
-            flush();
-            ::close(m_fd);
-            m_fd = -1;
-        }
-    }
-};
-
 } // anonymous namespace
 
 static useconds_t
@@ -340,7 +295,7 @@ parse_output_check_arg(const std::string& arg)
 
 static void
 parse_repeat_check_arg(const std::string& arg, useconds_t *m_timo,
-    useconds_t *m_interval)
+    useconds_t *m_interval, std::string *m_watch)
 {
     const std::string::size_type delimiter = arg.find(':');
     const bool has_interval = (delimiter != std::string::npos);
@@ -377,6 +332,13 @@ parse_repeat_check_arg(const std::string& arg, useconds_t *m_timo,
 
     const std::string intv_str = arg.substr(delimiter + 1, std::string::npos);
 
+    if (intv_str.compare(0, 6, "watch=") == 0) {
+        *m_watch = intv_str.substr(6);
+        if (m_watch->empty())
+            throw atf::application::usage_error("Missing path to watch");
+        return;
+    }
+
     // Same -- this could be non-integer milliseconds.
     errno = 0;
     l = strtol(intv_str.c_str(), &end, 10);
@@ -394,6 +356,117 @@ parse_repeat_check_arg(const std::string& arg, useconds_t *m_timo,
     *m_interval = l * mseconds_in_useconds;
 }
 
+namespace {
+
+//!
+//! \brief Waits for a path to change between executions of a command.
+//!
+//! If inotify is available, any change to the path, or to the entries of
+//! the directory holding it if it is not a directory itself, counts; for a
+//! FIFO, this includes data being written to it.  The FIFO is never opened
+//! so that its data, and its end of file, are left to the command.
+//! Because some changes go unnoticed, such as those on remote file systems,
+//! the command is also run again when nothing happens for a while, with a
+//! delay that doubles every time up to max_watch_backoff.
+//!
+class watcher {
+    // Non-copyable.
+    watcher(const watcher&);
+    watcher& operator=(const watcher&);
+
+    int m_fd;
+    const useconds_t m_interval;
+    useconds_t m_backoff;
+
+    void
+    drain(void)
+    {
+        char buf[4096];
+        while (::read(m_fd, buf, sizeof(buf)) > 0)
+            continue;
+    }
+
+public:
+    watcher(const std::string& path, const useconds_t interval) :
+        m_fd(-1),
+        m_interval(interval),
+        m_backoff(interval)
+    {
+#if defined(HAVE_SYS_INOTIFY_H)
+        struct stat sb;
+        const bool exists = ::stat(path.c_str(), &sb) != -1;
+
+        m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd == -1)
+            return;
+
+        int ret;
+        if (exists && S_ISFIFO(sb.st_mode))
+            ret = ::inotify_add_watch(m_fd, path.c_str(), IN_ATTRIB |
+                                      IN_DELETE_SELF | IN_MODIFY |
+                                      IN_MOVE_SELF);
+        else {
+            const std::string dir = (exists && S_ISDIR(sb.st_mode)) ? path :
+                atf::fs::path(path).branch_path().str();
+            ret = ::inotify_add_watch(m_fd, dir.c_str(), IN_ATTRIB |
+                                      IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                      IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO);
+        }
+        if (ret == -1) {
+            // Fall back to polling; the directory may not exist yet.
+            ::close(m_fd);
+            m_fd = -1;
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    ~watcher(void)
+    {
+        if (m_fd != -1)
+            ::close(m_fd);
+    }
+
+    //!
+    //! \brief Waits until the path changes, the backoff delay elapses or
+    //! the given deadline is reached.
+    //!
+    //! Changes that happened since the previous call, and thus possibly
+    //! while the command was running, make this return immediately.
+    //!
+    void
+    wait(const useconds_t deadline)
+    {
+        const useconds_t now = get_monotonic_useconds();
+        if (now >= deadline)
+            return;
+        const useconds_t delay = std::min(m_backoff, deadline - now);
+
+        if (m_fd == -1)
+            ::usleep(delay);
+        else {
+            struct pollfd pfd;
+            pfd.fd = m_fd;
+            pfd.events = POLLIN;
+            const int ret = ::poll(&pfd, 1, (delay + mseconds_in_useconds - 1)
+                                   / mseconds_in_useconds);
+            if (ret == -1 && errno != EINTR)
+                throw atf::system_error("atf_check::watcher::wait",
+                                        "poll(2) failed", errno);
+            if (ret > 0) {
+                drain();
+                m_backoff = m_interval;
+                return;
+            }
+        }
+
+        m_backoff = std::min(m_backoff * 2, max_watch_backoff);
+    }
+};
+
+} // anonymous namespace
+
 static
 std::string
 flatten_argv(char* const* argv)
@@ -444,106 +517,41 @@ execute_with_shell(char* const* argv)
 }
 
 static
-void
-cat_file(const atf::fs::path& path)
+std::string
+read_file(const atf::fs::path& p)
 {
-    std::ifstream stream(path.c_str());
-    if (!stream)
-        throw std::runtime_error("Failed to open " + path.str());
+    std::ifstream f(p.c_str());
+    if (!f)
+        throw std::runtime_error("Failed to open " + p.str());
 
-    stream >> std::noskipws;
-    std::istream_iterator< char > begin(stream), end;
-    std::ostream_iterator< char > out(std::cerr);
-    std::copy(begin, end, out);
+    std::ostringstream contents;
+    contents << f.rdbuf();
+    if (f.bad())
+        throw std::runtime_error("Failed to read from " + p.str());
 
-    stream.close();
+    return contents.str();
 }
 
 static
-bool
-grep_file(const atf::fs::path& path, const std::string& regexp)
+void
+print_diff(const std::string& label1, const std::string& text1,
+           const std::string& label2, const std::string& text2)
 {
-    std::ifstream stream(path.c_str());
-    if (!stream)
-        throw std::runtime_error("Failed to open " + path.str());
-
-    bool found = false;
-
-    std::string line;
-    while (!found && !std::getline(stream, line).fail()) {
-        if (atf::text::match(line, regexp))
-            found = true;
-    }
-
-    stream.close();
-
-    return found;
-}
-
-static
-bool
-file_empty(const atf::fs::path& p)
-{
-    atf::fs::file_info f(p);
-
-    return (f.get_size() == 0);
-}
-
-static bool
-compare_files(const atf::fs::path& p1, const atf::fs::path& p2)
-{
-    bool equal = false;
-
-    std::ifstream f1(p1.c_str());
-    if (!f1)
-        throw std::runtime_error("Failed to open " + p1.str());
-
-    std::ifstream f2(p2.c_str());
-    if (!f2)
-        throw std::runtime_error("Failed to open " + p2.str());
-
-    for (;;) {
-        char buf1[512], buf2[512];
-
-        f1.read(buf1, sizeof(buf1));
-        if (f1.bad())
-            throw std::runtime_error("Failed to read from " + p1.str());
-
-        f2.read(buf2, sizeof(buf2));
-        if (f2.bad())
-            throw std::runtime_error("Failed to read from " + p2.str());
-
-        if ((f1.gcount() == 0) && (f2.gcount() == 0)) {
-            equal = true;
-            break;
-        }
-
-        if ((f1.gcount() != f2.gcount()) ||
-            (std::memcmp(buf1, buf2, f1.gcount()) != 0)) {
-            break;
-        }
-    }
-
-    return equal;
+    (void)atf::diff::unified(std::cerr, label1, text1, label2, text2);
 }
 
 static
 void
-print_diff(const atf::fs::path& p1, const atf::fs::path& p2)
+write_file(const atf::fs::path& p, const std::string& contents)
 {
-    const atf::process::status s =
-        atf::process::exec(atf::fs::path("diff"),
-                           atf::process::argv_array("diff", "-u", p1.c_str(),
-                                                    p2.c_str(), NULL),
-                           atf::process::stream_connect(STDOUT_FILENO,
-                                                        STDERR_FILENO),
-                           atf::process::stream_inherit());
-
-    if (!s.exited())
-        std::cerr << "Failed to run diff(3)\n";
-
-    if (s.exitstatus() != 1)
-        std::cerr << "Error while running diff(3)\n";
+    std::ofstream f(p.c_str(), std::ios::binary | std::ios::trunc);
+    if (!f)
+        throw std::runtime_error("Failed to open " + p.str());
+
+    f.write(contents.data(), contents.length());
+    f.close();
+    if (!f)
+        throw std::runtime_error("Failed to write to " + p.str());
 }
 
 static
@@ -593,7 +601,8 @@ decode(const std::string& s)
 
 static
 bool
-run_status_check(const status_check& sc, const atf::check::check_result& cr)
+run_status_check(const status_check& sc, const atf::check::check_result& cr,
+                 std::ostream& failures)
 {
     bool result;
 
@@ -602,12 +611,12 @@ run_status_check(const status_check& sc, const atf::check::check_result& cr)
             const int status = cr.exitcode();
 
             if (!sc.negated && sc.value != status) {
-                std::cerr << "Fail: incorrect exit status: "
+                failures << "Fail: incorrect exit status: "
                           << status << ", expected: "
                           << sc.value << "\n";
                 result = false;
             } else if (sc.negated && sc.value == status) {
-                std::cerr << "Fail: incorrect exit status: "
+                failures << "Fail: incorrect exit status: "
                           << status << ", expected: "
                           << "anything else\n";
                 result = false;
@@ -616,7 +625,7 @@ run_status_check(const status_check& sc, const atf::check::check_result& cr)
         } else if (cr.exited() && sc.value == INT_MIN) {
             result = true;
         } else {
-            std::cerr << "Fail: program did not exit cleanly\n";
+            failures << "Fail: program did not exit cleanly\n";
             result = false;
         }
     } else if (sc.type == sc_ignore) {
@@ -626,11 +635,11 @@ run_status_check(const status_check& sc, const atf::check::check_result& cr)
             const int status = cr.termsig();
 
             if (!sc.negated && sc.value != status) {
-                std::cerr << "Fail: incorrect signal received: "
+                failures << "Fail: incorrect signal received: "
                           << status << ", expected: " << sc.value << "\n";
                 result = false;
             } else if (sc.negated && sc.value == status) {
-                std::cerr << "Fail: incorrect signal received: "
+                failures << "Fail: incorrect signal received: "
                           << status << ", expected: "
                           << "anything else\n";
                 result = false;
@@ -639,7 +648,7 @@ run_status_check(const status_check& sc, const atf::check::check_result& cr)
         } else if (cr.signaled() && sc.value == INT_MIN) {
             result = true;
         } else {
-            std::cerr << "Fail: program did not receive a signal\n";
+            failures << "Fail: program did not receive a signal\n";
             result = false;
         }
     } else {
@@ -647,29 +656,48 @@ run_status_check(const status_check& sc, const atf::check::check_result& cr)
         result = false;
     }
 
-    if (result == false) {
-        std::cerr << "stdout:\n";
-        cat_file(atf::fs::path(cr.stdout_path()));
-        std::cerr << "\n";
-
-        std::cerr << "stderr:\n";
-        cat_file(atf::fs::path(cr.stderr_path()));
-        std::cerr << "\n";
-    }
-
     return result;
 }
 
+//!
+//! \brief Runs all the status checks against the result of a command.
+//!
+//! The command must pass any of the plain checks, which describe the
+//! acceptable outcomes, and all of the negated ones, which describe the
+//! outcomes to reject.  Failures are only reported if the checks do not
+//! pass as a whole.
+//!
 static
 bool
 run_status_checks(const std::vector< status_check >& checks,
                   const atf::check::check_result& result)
 {
-    bool ok = false;
+    std::ostringstream plain_failures, negated_failures;
+    bool has_plain = false, plain_ok = false, negated_ok = true;
 
     for (std::vector< status_check >::const_iterator iter = checks.begin();
-         !ok && iter != checks.end(); iter++) {
-         ok |= run_status_check(*iter, result);
+         iter != checks.end(); iter++) {
+        if (iter->negated) {
+            negated_ok &= run_status_check(*iter, result, negated_failures);
+        } else {
+            has_plain = true;
+            plain_ok |= run_status_check(*iter, result, plain_failures);
+        }
+    }
+
+    const bool ok = (!has_plain || plain_ok) && negated_ok;
+    if (!ok) {
+        if (has_plain && !plain_ok)
+            std::cerr << plain_failures.str();
+        std::cerr << negated_failures.str();
+
+        std::cerr << "stdout:\n";
+        std::cerr << result.stdout_data();
+        std::cerr << "\n";
+
+        std::cerr << "stderr:\n";
+        std::cerr << result.stderr_data();
+        std::cerr << "\n";
     }
 
     return ok;
@@ -677,16 +705,16 @@ run_status_checks(const std::vector< status_check >& checks,
 
 static
 bool
-run_output_check(const output_check oc, const atf::fs::path& path,
-                 const std::string& stdxxx)
+run_output_check(const output_check oc, const std::string& output,
+                 const bool matches, const std::string& stdxxx)
 {
     bool result;
 
     if (oc.type == oc_empty) {
-        const bool is_empty = file_empty(path);
+        const bool is_empty = output.empty();
         if (!oc.negated && !is_empty) {
             std::cerr << "Fail: " << stdxxx << " not empty\n";
-            print_diff(atf::fs::path("/dev/null"), path);
+            print_diff("/dev/null", "", stdxxx, output);
             result = false;
         } else if (oc.negated && is_empty) {
             std::cerr << "Fail: " << stdxxx << " is empty\n";
@@ -694,62 +722,51 @@ run_output_check(const output_check oc, const atf::fs::path& path,
         } else
             result = true;
     } else if (oc.type == oc_file) {
-        const bool equals = compare_files(path, atf::fs::path(oc.value));
+        const std::string golden = read_file(atf::fs::path(oc.value));
+        const bool equals = output == golden;
         if (!oc.negated && !equals) {
             std::cerr << "Fail: " << stdxxx << " does not match golden "
                 "output\n";
-            print_diff(atf::fs::path(oc.value), path);
+            print_diff(oc.value, golden, stdxxx, output);
             result = false;
         } else if (oc.negated && equals) {
             std::cerr << "Fail: " << stdxxx << " matches golden output\n";
-            cat_file(atf::fs::path(oc.value));
+            std::cerr << golden;
             result = false;
         } else
             result = true;
     } else if (oc.type == oc_ignore) {
         result = true;
     } else if (oc.type == oc_inline) {
-        temp_file temp("atf-check.XXXXXX");
-        temp.write(decode(oc.value));
-        temp.close();
-
-        const bool equals = compare_files(path, temp.get_path());
+        const std::string expected = decode(oc.value);
+        const bool equals = output == expected;
         if (!oc.negated && !equals) {
             std::cerr << "Fail: " << stdxxx << " does not match expected "
                 "value\n";
-            print_diff(temp.get_path(), path);
+            print_diff("expected", expected, stdxxx, output);
             result = false;
         } else if (oc.negated && equals) {
             std::cerr << "Fail: " << stdxxx << " matches expected value\n";
-            cat_file(temp.get_path());
+            std::cerr << expected;
             result = false;
         } else
             result = true;
     } else if (oc.type == oc_match) {
-        const bool matches = grep_file(path, oc.value);
         if (!oc.negated && !matches) {
             std::cerr << "Fail: regexp " + oc.value + " not in " << stdxxx
                       << "\n";
-            cat_file(path);
+            std::cerr << output;
             result = false;
         } else if (oc.negated && matches) {
             std::cerr << "Fail: regexp " + oc.value + " is in " << stdxxx
                       << "\n";
-            cat_file(path);
+            std::cerr << output;
             result = false;
         } else
             result = true;
     } else if (oc.type == oc_save) {
         INV(!oc.negated);
-        std::ifstream ifs(path.c_str(), std::fstream::binary);
-        ifs >> std::noskipws;
-        std::istream_iterator< char > begin(ifs), end;
-
-        std::ofstream ofs(oc.value.c_str(), std::fstream::binary
-                                     | std::fstream::trunc);
-        std::ostream_iterator <char> obegin(ofs);
-
-        std::copy(begin, end, obegin);
+        write_file(atf::fs::path(oc.value), output);
         result = true;
     } else {
         UNREACHABLE;
@@ -759,16 +776,35 @@ run_output_check(const output_check oc, const atf::fs::path& path,
     return result;
 }
 
+//!
+//! \brief Runs all the checks of an output stream.
+//!
+//! The output is only held in memory once and all the regular expressions
+//! of the match checks are looked for in a single pass over it.
+//!
 static
 bool
 run_output_checks(const std::vector< output_check >& checks,
-                  const atf::fs::path& path, const std::string& stdxxx)
+                  const std::string& output, const std::string& stdxxx)
 {
+    std::vector< std::string > regexps;
+    for (std::vector< output_check >::const_iterator iter = checks.begin();
+         iter != checks.end(); iter++) {
+        if (iter->type == oc_match)
+            regexps.push_back(iter->value);
+    }
+    const std::vector< bool > matches = atf::text::grep_lines(regexps,
+                                                               output);
+
     bool ok = true;
 
+    std::vector< bool >::const_iterator match = matches.begin();
     for (std::vector< output_check >::const_iterator iter = checks.begin();
          iter != checks.end(); iter++) {
-         ok &= run_output_check(*iter, path, stdxxx);
+        bool matched = false;
+        if (iter->type == oc_match)
+            matched = *match++;
+        ok &= run_output_check(*iter, output, matched, stdxxx);
     }
 
     return ok;
@@ -786,6 +822,7 @@ class atf_check : public atf::application::app {
 
     useconds_t m_timo;
     useconds_t m_interval;
+    std::string m_watch;
 
     std::vector< status_check > m_status_checks;
     std::vector< output_check > m_stdout_checks;
@@ -824,11 +861,11 @@ atf_check::run_output_checks(const atf::check::check_result& r,
     const
 {
     if (stdxxx == "stdout") {
-        return ::run_output_checks(m_stdout_checks,
-            atf::fs::path(r.stdout_path()), "stdout");
+        return ::run_output_checks(m_stdout_checks, r.stdout_data(),
+                                   "stdout");
     } else if (stdxxx == "stderr") {
-        return ::run_output_checks(m_stderr_checks,
-            atf::fs::path(r.stderr_path()), "stderr");
+        return ::run_output_checks(m_stderr_checks, r.stderr_data(),
+                                   "stderr");
     } else {
         UNREACHABLE;
         return false;
@@ -857,8 +894,9 @@ atf_check::specific_options(void)
     opts.insert(option('e', "action:arg", "Handle stderr. Action must be "
                 "one of: empty ignore file:<path> inline:<val> match:regexp "
                 "save:<path>"));
-    opts.insert(option('r', "timeout[:interval]", "Repeat failed check until "
-                "the timeout expires."));
+    opts.insert(option('r', "timeout[:interval|:watch=path]", "Repeat failed "
+                "check until the timeout expires, optionally only when "
+                "path changes."));
     opts.insert(option('x', "", "Execute command as a shell command"));
 
     return opts;
@@ -882,7 +920,7 @@ atf_check::process_option(int ch, const char* arg)
 
     case 'r':
         m_rflag = true;
-        parse_repeat_check_arg(arg, &m_timo, &m_interval);
+        parse_repeat_check_arg(arg, &m_timo, &m_interval, &m_watch);
         break;
 
     case 'x':
@@ -904,16 +942,18 @@ atf_check::main(void)
 
     if (m_status_checks.empty())
         m_status_checks.push_back(status_check(sc_exit, false, EXIT_SUCCESS));
-    else if (m_status_checks.size() > 1) {
-        // TODO: Remove this restriction.
-        throw atf::application::usage_error("Cannot specify -s more than once");
-    }
 
     if (m_stdout_checks.empty())
         m_stdout_checks.push_back(output_check(oc_empty, false, ""));
     if (m_stderr_checks.empty())
         m_stderr_checks.push_back(output_check(oc_empty, false, ""));
 
+    // The watcher must exist before the first execution of the command so
+    // that no change happening during it is missed.
+    std::auto_ptr< watcher > w;
+    if (m_rflag && !m_watch.empty())
+        w.reset(new watcher(m_watch, m_interval));
+
     do {
         std::auto_ptr< atf::check::check_result > r =
             m_xflag ? execute_with_shell(m_argv) : execute(m_argv);
@@ -928,7 +968,10 @@ atf_check::main(void)
         if (m_rflag && status == EXIT_FAILURE) {
             if (timo_expired(m_timo))
                 break;
-            usleep(m_interval);
+            if (w.get() != NULL)
+                w->wait(m_timo);
+            else
+                usleep(m_interval);
         }
     } while (m_rflag && status == EXIT_FAILURE);
 
@@ -139,6 +139,36 @@ sflag_signal_body()
     h_fail 'false' -s signal
 }
 
+atf_test_case sflag_multiple
+sflag_multiple_head()
+{
+    atf_set "descr" "Tests for multiple occurrences of the -s option"
+}
+sflag_multiple_body()
+{
+    h_pass 'exit 0' -s exit:0 -s exit:1
+    h_pass 'exit 1' -s exit:0 -s exit:1
+    h_fail 'exit 2' -s exit:0 -s exit:1
+    grep 'expected: 0' tmp >/dev/null || \
+        atf_fail "Failure of the first check not reported"
+    grep 'expected: 1' tmp >/dev/null || \
+        atf_fail "Failure of the second check not reported"
+
+    h_pass 'exit 4' -s exit -s not-exit:2 -s not-exit:3
+    h_fail 'exit 3' -s exit -s not-exit:2 -s not-exit:3
+    grep 'expected: 0' tmp >/dev/null && \
+        atf_fail "Failure of a passing check reported"
+    ${Atf_Check} -s exit -s not-exit:2 -x 'kill -1 $$' 2>/dev/null && \
+        atf_fail "Signal accepted as a clean exit"
+    ${Atf_Check} -s exit:0 -s signal:hup -x 'kill -1 $$' || \
+        atf_fail "Signal not accepted by the second check"
+
+    h_pass 'exit 1' -s not-exit:0 -s not-exit:2
+    h_fail 'exit 2' -s not-exit:0 -s not-exit:2
+    h_pass 'exit 5' -s ignore -s not-exit:2
+    h_fail 'exit 2' -s ignore -s not-exit:2
+}
+
 atf_test_case xflag
 xflag_head()
 {
@@ -156,6 +186,51 @@ xflag_body()
         atf_fail "Using -x does not respect all provided arguments"
 }
 
+atf_test_case rflag_watch
+rflag_watch_head()
+{
+    atf_set "descr" "Tests for the -r option with a path to watch"
+}
+rflag_watch_body()
+{
+    # The first run creates the file, which must make the command run again
+    # and succeed.
+    mkdir dir
+    ${Atf_Check} -r 10:watch=dir/file -x 'echo >>count; test -f dir/file ||
+        { touch dir/file; false; }' || \
+        atf_fail "atf-check did not see the file being created"
+    atf_check -o inline:"2\n" -x 'wc -l <count | tr -d " "'
+
+    # The directory of a missing path cannot be watched, so the command is
+    # run again with a growing delay.  Without the cap on this delay, the
+    # twelfth run would only happen after more than 100 seconds.
+    ${Atf_Check} -r 30:watch=missing/file -x 'echo >>polls;
+        [ $(wc -l <polls) -ge 12 ]' || \
+        atf_fail "The polling delay was not capped"
+
+    # Keep the FIFO open so that writing to it does not block.
+    mkfifo fifo
+    exec 3<>fifo
+    ( sleep 1; touch done; echo >fifo ) &
+    ${Atf_Check} -r 10:watch=fifo test -f done || \
+        atf_fail "atf-check did not see the FIFO being written to"
+    wait
+    exec 3>&-
+
+    # The data written to the FIFO, and its end, must reach the command.
+    ( echo notyet >fifo; sleep 1; echo ready >fifo ) &
+    ${Atf_Check} -r 10:watch=fifo -o match:ready cat fifo || \
+        atf_fail "The command did not see the data written to the FIFO"
+    wait
+
+    ${Atf_Check} -r 1:watch=missing/file false 2>/dev/null && \
+        atf_fail "atf-check succeeded but should fail"
+
+    h_fail 'true' -r 1:watch=
+    grep 'Missing path to watch' tmp >/dev/null || \
+        atf_fail "Missing path not reported"
+}
+
 atf_test_case oflag_empty
 oflag_empty_head()
 {
@@ -251,6 +326,11 @@ oflag_multiple_body()
     h_pass "echo foo; echo bar" -o match:foo -o match:bar
     h_fail "echo foo baz" -o match:bar -o match:foo
     h_fail "echo foo; echo baz" -o match:bar -o match:foo
+    h_pass "echo foo; echo bar" -o match:bar -o not-match:baz \
+        -o inline:"foo\nbar\n" -o save:out -o match:^foo
+    printf "foo\nbar\n" >exp
+    cmp -s out exp || atf_fail "Saved output does not match expected results"
+    h_fail "echo foo; echo bar" -o match:bar -o match:baz -o save:out
 }
 
 atf_test_case oflag_negated
@@ -389,21 +469,21 @@ stdin_body()
         atf_fail "atf-check does not seem to respect stdin"
 }
 
-atf_test_case invalid_umask
-invalid_umask_head()
+atf_test_case restrictive_umask
+restrictive_umask_head()
 {
-    atf_set "descr" "Tests for a correct error condition if the umask is" \
-            "too restrictive"
+    atf_set "descr" "Tests that a restrictive umask does not prevent" \
+            "atf-check from checking the output of a command"
 }
-invalid_umask_body()
+restrictive_umask_body()
 {
     umask 0222
-    ${Atf_Check} false 2>stderr && \
+    ${Atf_Check} -o inline:"foo\n" -e empty echo foo || \
+        atf_fail "atf-check failed with a restrictive umask"
+    ${Atf_Check} -o match:bar echo foo 2>stderr && \
         atf_fail "atf-check returned 0 but it should have failed"
-    cat stderr
-    grep 'temporary.*current umask.*0222' stderr >/dev/null || \
-        atf_fail "atf-check did not report an error related to the" \
-                 "current umask"
+    grep 'regexp bar not in stdout' stderr >/dev/null || \
+        atf_fail "atf-check did not report the failed check"
 }
 
 atf_init_test_cases()
@@ -412,9 +492,12 @@ atf_init_test_cases()
     atf_add_test_case sflag_exit
     atf_add_test_case sflag_ignore
     atf_add_test_case sflag_signal
+    atf_add_test_case sflag_multiple
 
     atf_add_test_case xflag
 
+    atf_add_test_case rflag_watch
+
     atf_add_test_case oflag_empty
     atf_add_test_case oflag_ignore
     atf_add_test_case oflag_file
@@ -435,7 +518,7 @@ atf_init_test_cases()
 
     atf_add_test_case stdin
 
-    atf_add_test_case invalid_umask
+    atf_add_test_case restrictive_umask
 }
 
 # vim: syntax=sh:expandtab:shiftwidth=4:softtabstop=4
@@ -0,0 +1,427 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atf-c.h>
+
+#include "atf-c/check.h"
+#include "atf-c/detail/dynstr.h"
+#include "atf-c/detail/fs.h"
+#include "atf-c/detail/list.h"
+#include "atf-c/detail/map.h"
+#include "atf-c/detail/test_helpers.h"
+#include "atf-c/utils.h"
+
+/* ---------------------------------------------------------------------
+ * Auxiliary functions.
+ * --------------------------------------------------------------------- */
+
+static const char *no_config[] = { NULL };
+
+/** Runs a command and fails the benchmark if it does not exit cleanly.
+ *
+ * The output of the command is captured by atf_check_exec_array and
+ * discarded, so the cost of capturing it is part of the measurement. */
+static
+void
+run_command(const char *const *argv)
+{
+    atf_check_result_t result;
+
+    RE(atf_check_exec_array(argv, &result));
+    if (!atf_check_result_exited(&result) ||
+        atf_check_result_exitcode(&result) != EXIT_SUCCESS) {
+        RE(atf_check_result_materialize(&result));
+        atf_utils_cat_file(atf_check_result_stderr(&result), "stderr: ");
+        atf_check_result_fini(&result);
+        atf_tc_fail("Command '%s' did not exit successfully", argv[0]);
+    }
+    atf_check_result_fini(&result);
+}
+
+/** Builds the path to a helper that lives next to the benchmark program. */
+static
+void
+helper_path(const atf_tc_t *tc, const char *name, atf_fs_path_t *path)
+{
+    RE(atf_fs_path_init_fmt(path, "%s/%s",
+                            atf_tc_get_config_var(tc, "srcdir"), name));
+}
+
+/* ---------------------------------------------------------------------
+ * Benchmarks for the "atf_dynstr" type.
+ * --------------------------------------------------------------------- */
+
+ATF_BENCH(dynstr_init_fmt);
+ATF_BENCH_HEAD(dynstr_init_fmt, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Measures the formatting of a short "
+                      "string into a new dynstr");
+}
+ATF_BENCH_BODY(dynstr_init_fmt, tc, iterations)
+{
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        atf_dynstr_t str;
+
+        RE(atf_dynstr_init_fmt(&str, "%s/%s.%zu", "srcdir", "tc", i));
+        atf_dynstr_fini(&str);
+    }
+}
+
+ATF_BENCH(dynstr_append_fmt);
+ATF_BENCH_HEAD(dynstr_append_fmt, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Measures the construction of a string "
+                      "by appending 100 formatted fragments to a dynstr");
+}
+ATF_BENCH_BODY(dynstr_append_fmt, tc, iterations)
+{
+    size_t i, j;
+
+    for (i = 0; i < iterations; i++) {
+        atf_dynstr_t str;
+
+        RE(atf_dynstr_init(&str));
+        for (j = 0; j < 100; j++)
+            RE(atf_dynstr_append_fmt(&str, " var%zu=%zu", j, i));
+        atf_dynstr_fini(&str);
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Benchmarks for the "atf_list" type.
+ * --------------------------------------------------------------------- */
+
+ATF_BENCH(list_append_iterate);
+ATF_BENCH_HEAD(list_append_iterate, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Measures the construction of a list "
+                      "of 100 elements and a walk over it");
+}
+ATF_BENCH_BODY(list_append_iterate, tc, iterations)
+{
+    static int values[100];
+    size_t i, j;
+
+    for (i = 0; i < iterations; i++) {
+        atf_list_t list;
+        atf_list_citer_t iter;
+        volatile int sum;
+
+        RE(atf_list_init(&list));
+        for (j = 0; j < 100; j++)
+            RE(atf_list_append(&list, &values[j], false));
+        sum = 0;
+        atf_list_for_each_c(iter, &list)
+            sum += *(const int *)atf_list_citer_data(iter);
+        atf_list_fini(&list);
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Benchmarks for the "atf_map" type.
+ * --------------------------------------------------------------------- */
+
+ATF_BENCH(map_insert);
+ATF_BENCH_HEAD(map_insert, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Measures the construction of a map "
+                      "of 100 configuration-like variables");
+}
+ATF_BENCH_BODY(map_insert, tc, iterations)
+{
+    char keys[100][16];
+    size_t i, j;
+
+    for (j = 0; j < 100; j++)
+        snprintf(keys[j], sizeof(keys[j]), "var%zu", j);
+
+    for (i = 0; i < iterations; i++) {
+        atf_map_t map;
+
+        RE(atf_map_init(&map));
+        for (j = 0; j < 100; j++)
+            RE(atf_map_insert(&map, keys[j], keys[j], false));
+        atf_map_fini(&map);
+    }
+}
+
+ATF_BENCH(map_find);
+ATF_BENCH_HEAD(map_find, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Measures lookups in a map of 100 "
+                      "configuration-like variables");
+}
+ATF_BENCH_BODY(map_find, tc, iterations)
+{
+    char keys[100][16];
+    atf_map_t map;
+    size_t i, j;
+
+    RE(atf_map_init(&map));
+    for (j = 0; j < 100; j++) {
+        snprintf(keys[j], sizeof(keys[j]), "var%zu", j);
+        RE(atf_map_insert(&map, keys[j], keys[j], false));
+    }
+
+    for (i = 0; i < iterations; i++) {
+        atf_map_citer_t iter = atf_map_find_c(&map, keys[i % 100]);
+        if (atf_equal_map_citer_map_citer(iter, atf_map_end_c(&map)))
+            atf_tc_fail("Key %s not found", keys[i % 100]);
+    }
+
+    atf_map_fini(&map);
+}
+
+/* ---------------------------------------------------------------------
+ * Benchmarks for test case registration.
+ * --------------------------------------------------------------------- */
+
+static
+void
+generated_head(atf_tc_t *tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Generated test case");
+}
+
+static
+void
+generated_body(const atf_tc_t *tc ATF_DEFS_ATTRIBUTE_UNUSED)
+{
+}
+
+/** Registers ntcs test cases in a fresh test program once per iteration. */
+static
+void
+register_tcs(const size_t ntcs, const size_t iterations)
+{
+    atf_tc_t *tcs;
+    char (*idents)[32];
+    size_t i, j;
+
+    tcs = malloc(sizeof(*tcs) * ntcs);
+    idents = malloc(sizeof(*idents) * ntcs);
+    if (tcs == NULL || idents == NULL)
+        atf_tc_fail("Not enough memory for %zu test cases", ntcs);
+    for (j = 0; j < ntcs; j++)
+        snprintf(idents[j], sizeof(idents[j]), "tc_%zu", j);
+
+    for (i = 0; i < iterations; i++) {
+        atf_tp_t tp;
+
+        RE(atf_tp_init(&tp, no_config));
+        for (j = 0; j < ntcs; j++) {
+            atf_tc_pack_t pack = {
+                .m_ident = idents[j],
+                .m_head = generated_head,
+                .m_body = generated_body,
+                .m_cleanup = NULL,
+            };
+
+            RE(atf_tp_init_tc(&tp, &tcs[j], &pack));
+            RE(atf_tp_add_tc(&tp, &tcs[j]));
+        }
+        atf_tp_fini(&tp);
+    }
+
+    free(idents);
+    free(tcs);
+}
+
+#define REGISTER_BENCH(ntcs) \
+    ATF_BENCH(tp_add_tc_ ## ntcs); \
+    ATF_BENCH_HEAD(tp_add_tc_ ## ntcs, tc) \
+    { \
+        atf_tc_set_md_var(tc, "descr", "Measures the registration of " \
+                          #ntcs " test cases with atf_tp_add_tc"); \
+    } \
+    ATF_BENCH_BODY(tp_add_tc_ ## ntcs, tc, iterations) \
+    { \
+        register_tcs(ntcs, iterations); \
+    }
+
+REGISTER_BENCH(10);
+REGISTER_BENCH(1000);
+REGISTER_BENCH(10000);
+
+/* ---------------------------------------------------------------------
+ * Benchmarks for test program startup.
+ * --------------------------------------------------------------------- */
+
+/** Lists the test cases of the h_many_tcs_c helper once per iteration. */
+static
+void
+list_tcs(const atf_tc_t *tc, const char *ntcs, const bool cached,
+         const size_t iterations)
+{
+    atf_fs_path_t helper;
+    char ntcsarg[64];
+    const char *argv[] = { NULL, "-v", ntcsarg, "-l", NULL, NULL, NULL };
+    size_t i;
+
+    helper_path(tc, "h_many_tcs_c", &helper);
+    argv[0] = atf_fs_path_cstring(&helper);
+    snprintf(ntcsarg, sizeof(ntcsarg), "ntcs=%s", ntcs);
+    if (cached) {
+        argv[4] = "-C";
+        argv[5] = ".";
+    }
+
+    for (i = 0; i < iterations; i++)
+        run_command(argv);
+
+    atf_fs_path_fini(&helper);
+}
+
+#define LIST_BENCH(ntcs) \
+    ATF_BENCH(tp_list_ ## ntcs); \
+    ATF_BENCH_HEAD(tp_list_ ## ntcs, tc) \
+    { \
+        atf_tc_set_md_var(tc, "descr", "Measures the startup and listing " \
+                          "of a C test program with " #ntcs " test cases"); \
+    } \
+    ATF_BENCH_BODY(tp_list_ ## ntcs, tc, iterations) \
+    { \
+        list_tcs(tc, #ntcs, false, iterations); \
+    }
+
+LIST_BENCH(10);
+LIST_BENCH(1000);
+LIST_BENCH(10000);
+
+ATF_BENCH(tp_list_cached_10000);
+ATF_BENCH_HEAD(tp_list_cached_10000, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Measures the startup and listing of a "
+                      "C test program with 10000 test cases when the "
+                      "listing cache is warm");
+}
+ATF_BENCH_BODY(tp_list_cached_10000, tc, iterations)
+{
+    list_tcs(tc, "10000", true, iterations);
+}
+
+/** Lists the test cases of the generated h_many_tcs_sh_* helpers once per
+ * iteration. */
+static
+void
+list_sh_tcs(const atf_tc_t *tc, const char *ntcs, const size_t iterations)
+{
+    atf_fs_path_t helper;
+    char name[64];
+    const char *argv[] = { NULL, NULL, "-l", NULL };
+    size_t i;
+
+    argv[0] = atf_tc_get_config_var_wd(tc, "atf_sh", "atf-sh");
+    atf_tc_require_prog(argv[0]);
+
+    snprintf(name, sizeof(name), "h_many_tcs_sh_%s", ntcs);
+    helper_path(tc, name, &helper);
+    argv[1] = atf_fs_path_cstring(&helper);
+
+    for (i = 0; i < iterations; i++)
+        run_command(argv);
+
+    atf_fs_path_fini(&helper);
+}
+
+#define SH_LIST_BENCH(ntcs) \
+    ATF_BENCH(sh_list_ ## ntcs); \
+    ATF_BENCH_HEAD(sh_list_ ## ntcs, tc) \
+    { \
+        atf_tc_set_md_var(tc, "descr", "Measures the startup and listing " \
+                          "of an atf-sh test program with " #ntcs " " \
+                          "atf_test_case declarations"); \
+    } \
+    ATF_BENCH_BODY(sh_list_ ## ntcs, tc, iterations) \
+    { \
+        list_sh_tcs(tc, #ntcs, iterations); \
+    }
+
+SH_LIST_BENCH(10);
+SH_LIST_BENCH(100);
+SH_LIST_BENCH(1000);
+
+/* ---------------------------------------------------------------------
+ * Benchmarks for the "atf_check" module.
+ * --------------------------------------------------------------------- */
+
+ATF_BENCH(check_exec_array);
+ATF_BENCH_HEAD(check_exec_array, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Measures the round-trip latency of "
+                      "atf_check_exec_array on a trivial command");
+}
+ATF_BENCH_BODY(check_exec_array, tc, iterations)
+{
+    const char *argv[] = { "true", NULL };
+    size_t i;
+
+    for (i = 0; i < iterations; i++)
+        run_command(argv);
+}
+
+/* ---------------------------------------------------------------------
+ * Main.
+ * --------------------------------------------------------------------- */
+
+ATF_TP_ADD_TCS(tp)
+{
+    /* Add the benchmarks for the "atf_dynstr" type. */
+    ATF_TP_ADD_TC(tp, dynstr_init_fmt);
+    ATF_TP_ADD_TC(tp, dynstr_append_fmt);
+
+    /* Add the benchmarks for the "atf_list" type. */
+    ATF_TP_ADD_TC(tp, list_append_iterate);
+
+    /* Add the benchmarks for the "atf_map" type. */
+    ATF_TP_ADD_TC(tp, map_insert);
+    ATF_TP_ADD_TC(tp, map_find);
+
+    /* Add the benchmarks for test case registration. */
+    ATF_TP_ADD_TC(tp, tp_add_tc_10);
+    ATF_TP_ADD_TC(tp, tp_add_tc_1000);
+    ATF_TP_ADD_TC(tp, tp_add_tc_10000);
+
+    /* Add the benchmarks for test program startup. */
+    ATF_TP_ADD_TC(tp, tp_list_10);
+    ATF_TP_ADD_TC(tp, tp_list_1000);
+    ATF_TP_ADD_TC(tp, tp_list_10000);
+    ATF_TP_ADD_TC(tp, tp_list_cached_10000);
+    ATF_TP_ADD_TC(tp, sh_list_10);
+    ATF_TP_ADD_TC(tp, sh_list_100);
+    ATF_TP_ADD_TC(tp, sh_list_1000);
+
+    /* Add the benchmarks for the "atf_check" module. */
+    ATF_TP_ADD_TC(tp, check_exec_array);
+
+    return atf_no_error();
+}
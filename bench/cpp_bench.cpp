@@ -0,0 +1,221 @@
+// Copyright (c) 2008 The NetBSD Foundation, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+// CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+// OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+// IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <atf-c++.hpp>
+
+#include "atf-c++/check.hpp"
+#include "atf-c++/detail/process.hpp"
+#include "atf-c++/utils.hpp"
+
+// ------------------------------------------------------------------------
+// Auxiliary functions.
+// ------------------------------------------------------------------------
+
+//
+// Runs a command and fails the benchmark if it does not exit cleanly.
+//
+static
+void
+run_command(const std::vector< std::string >& argv)
+{
+    std::auto_ptr< atf::check::check_result > r =
+        atf::check::exec(atf::process::argv_array(argv));
+    if (!r->exited() || r->exitcode() != EXIT_SUCCESS) {
+        atf::utils::cat_file(r->stderr_path(), "stderr: ");
+        ATF_FAIL("Command '" + argv[0] + "' did not exit successfully");
+    }
+}
+
+//
+// Runs atf-check once per iteration to check the output of a shell command
+// with the given stdout and stderr actions.
+//
+static
+void
+run_atf_check(const std::string& atf_check, const std::string& oaction,
+              const std::string& eaction, const std::string& command,
+              const std::size_t iterations)
+{
+    std::vector< std::string > argv;
+    argv.push_back(atf_check);
+    argv.push_back("-o");
+    argv.push_back(oaction);
+    argv.push_back("-e");
+    argv.push_back(eaction);
+    argv.push_back("sh");
+    argv.push_back("-c");
+    argv.push_back(command);
+
+    for (std::size_t i = 0; i < iterations; i++)
+        run_command(argv);
+}
+
+// ------------------------------------------------------------------------
+// Benchmarks for the "atf::check" module.
+// ------------------------------------------------------------------------
+
+ATF_BENCHMARK(check_exec);
+ATF_BENCHMARK_HEAD(check_exec)
+{
+    set_md_var("descr", "Measures the round-trip latency of "
+               "atf::check::exec on a trivial command");
+}
+ATF_BENCHMARK_BODY(check_exec, iterations)
+{
+    std::vector< std::string > argv;
+    argv.push_back("true");
+
+    for (std::size_t i = 0; i < iterations; i++)
+        run_command(argv);
+}
+
+// ------------------------------------------------------------------------
+// Benchmarks for the "atf-check" tool.
+// ------------------------------------------------------------------------
+
+static const char* echo_foo = "echo foo; echo foo 1>&2";
+
+ATF_BENCHMARK(atf_check_ignore);
+ATF_BENCHMARK_HEAD(atf_check_ignore)
+{
+    set_md_var("descr", "Measures an invocation of atf-check that ignores "
+               "the output of the command");
+}
+ATF_BENCHMARK_BODY(atf_check_ignore, iterations)
+{
+    const std::string atf_check = get_config_var("atf_check", "atf-check");
+    require_prog(atf_check);
+    run_atf_check(atf_check, "ignore", "ignore", echo_foo, iterations);
+}
+
+ATF_BENCHMARK(atf_check_empty);
+ATF_BENCHMARK_HEAD(atf_check_empty)
+{
+    set_md_var("descr", "Measures an invocation of atf-check that expects "
+               "no output from the command");
+}
+ATF_BENCHMARK_BODY(atf_check_empty, iterations)
+{
+    const std::string atf_check = get_config_var("atf_check", "atf-check");
+    require_prog(atf_check);
+    run_atf_check(atf_check, "empty", "empty", "true", iterations);
+}
+
+ATF_BENCHMARK(atf_check_inline);
+ATF_BENCHMARK_HEAD(atf_check_inline)
+{
+    set_md_var("descr", "Measures an invocation of atf-check that compares "
+               "the output of the command against an inline string");
+}
+ATF_BENCHMARK_BODY(atf_check_inline, iterations)
+{
+    const std::string atf_check = get_config_var("atf_check", "atf-check");
+    require_prog(atf_check);
+    run_atf_check(atf_check, "inline:foo\\n", "inline:foo\\n",
+                  echo_foo, iterations);
+}
+
+ATF_BENCHMARK(atf_check_file);
+ATF_BENCHMARK_HEAD(atf_check_file)
+{
+    set_md_var("descr", "Measures an invocation of atf-check that compares "
+               "the output of the command against a file");
+}
+ATF_BENCHMARK_BODY(atf_check_file, iterations)
+{
+    const std::string atf_check = get_config_var("atf_check", "atf-check");
+    require_prog(atf_check);
+    atf::utils::create_file("expout", "foo\n");
+    run_atf_check(atf_check, "file:expout", "file:expout",
+                  echo_foo, iterations);
+}
+
+ATF_BENCHMARK(atf_check_match);
+ATF_BENCHMARK_HEAD(atf_check_match)
+{
+    set_md_var("descr", "Measures an invocation of atf-check that matches "
+               "the output of the command against a regular expression");
+}
+ATF_BENCHMARK_BODY(atf_check_match, iterations)
+{
+    const std::string atf_check = get_config_var("atf_check", "atf-check");
+    require_prog(atf_check);
+    run_atf_check(atf_check, "match:^fo+$", "match:^fo+$",
+                  echo_foo, iterations);
+}
+
+ATF_BENCHMARK(atf_check_not_match);
+ATF_BENCHMARK_HEAD(atf_check_not_match)
+{
+    set_md_var("descr", "Measures an invocation of atf-check that checks "
+               "that the output of the command does not match a regular "
+               "expression");
+}
+ATF_BENCHMARK_BODY(atf_check_not_match, iterations)
+{
+    const std::string atf_check = get_config_var("atf_check", "atf-check");
+    require_prog(atf_check);
+    run_atf_check(atf_check, "not-match:^bar$", "not-match:^bar$",
+                  echo_foo, iterations);
+}
+
+ATF_BENCHMARK(atf_check_save);
+ATF_BENCHMARK_HEAD(atf_check_save)
+{
+    set_md_var("descr", "Measures an invocation of atf-check that saves "
+               "the output of the command to a file");
+}
+ATF_BENCHMARK_BODY(atf_check_save, iterations)
+{
+    const std::string atf_check = get_config_var("atf_check", "atf-check");
+    require_prog(atf_check);
+    run_atf_check(atf_check, "save:stdout", "save:stderr",
+                  echo_foo, iterations);
+}
+
+// ------------------------------------------------------------------------
+// Main.
+// ------------------------------------------------------------------------
+
+ATF_INIT_TEST_CASES(tcs)
+{
+    // Add the benchmarks for the "atf::check" module.
+    ATF_ADD_TEST_CASE(tcs, check_exec);
+
+    // Add the benchmarks for the "atf-check" tool.
+    ATF_ADD_TEST_CASE(tcs, atf_check_ignore);
+    ATF_ADD_TEST_CASE(tcs, atf_check_empty);
+    ATF_ADD_TEST_CASE(tcs, atf_check_inline);
+    ATF_ADD_TEST_CASE(tcs, atf_check_file);
+    ATF_ADD_TEST_CASE(tcs, atf_check_match);
+    ATF_ADD_TEST_CASE(tcs, atf_check_not_match);
+    ATF_ADD_TEST_CASE(tcs, atf_check_save);
+}
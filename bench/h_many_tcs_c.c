@@ -0,0 +1,104 @@
+/* Copyright (c) 2008 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+ * CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atf-c.h>
+
+#include "atf-c/utils.h"
+
+/* ---------------------------------------------------------------------
+ * Helper test program with a configurable number of test cases.
+ *
+ * The number of test cases to register is taken from the "ntcs"
+ * configuration variable so that the startup and listing benchmarks can
+ * measure how the test program scales.
+ * --------------------------------------------------------------------- */
+
+static
+void
+generated_head(atf_tc_t *tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Generated test case");
+}
+
+static
+void
+generated_body(const atf_tc_t *tc ATF_DEFS_ATTRIBUTE_UNUSED)
+{
+}
+
+static
+size_t
+get_ntcs(const atf_tp_t *tp)
+{
+    char **config, **ptr;
+    size_t ntcs;
+
+    ntcs = 10;
+    config = atf_tp_get_config(tp);
+    for (ptr = config; *ptr != NULL; ptr += 2) {
+        if (strcmp(*ptr, "ntcs") == 0)
+            ntcs = (size_t)strtoul(*(ptr + 1), NULL, 10);
+    }
+    atf_utils_free_charpp(config);
+
+    return ntcs;
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+    atf_error_t err;
+    atf_tc_t *tcs;
+    char (*idents)[32];
+    size_t i, ntcs;
+
+    ntcs = get_ntcs(tp);
+
+    /* The test program holds on to these until it exits. */
+    tcs = malloc(sizeof(*tcs) * ntcs);
+    idents = malloc(sizeof(*idents) * ntcs);
+    if (tcs == NULL || idents == NULL)
+        return atf_no_memory_error();
+
+    err = atf_no_error();
+    for (i = 0; !atf_is_error(err) && i < ntcs; i++) {
+        atf_tc_pack_t pack = {
+            .m_ident = idents[i],
+            .m_head = generated_head,
+            .m_body = generated_body,
+            .m_cleanup = NULL,
+        };
+
+        snprintf(idents[i], sizeof(idents[i]), "tc_%zu", i);
+        err = atf_tp_init_tc(tp, &tcs[i], &pack);
+        if (!atf_is_error(err))
+            err = atf_tp_add_tc(tp, &tcs[i]);
+    }
+
+    return err;
+}
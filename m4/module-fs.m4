@@ -62,4 +62,10 @@ AC_DEFUN([ATF_MODULE_FS], [
         AC_DEFINE([HAVE_GETCWD_DYN], [1],
                   [Define to 1 if getcwd(NULL, 0) works])
     fi
+
+    AC_CHECK_HEADERS([sys/inotify.h sys/sendfile.h])
+    AC_CHECK_MEMBERS([struct stat.st_mtim], [], [],
+                     [[#include <sys/stat.h>]])
+    AC_CHECK_DECLS([SYS_copy_file_range], [], [],
+                   [[#include <sys/syscall.h>]])
 ])
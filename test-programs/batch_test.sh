@@ -0,0 +1,347 @@
+# Copyright (c) 2007 The NetBSD Foundation, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+# CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+# INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+# GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+# IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+# IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+atf_test_case batch_argv
+batch_argv_head()
+{
+    atf_set "descr" "Tests that more than one test case can be run in a" \
+                    "single invocation of the test program"
+}
+batch_argv_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:1 -o inline:"msg\nmsg\nmsg\n" -e ignore "${h}" \
+            -s "${srcdir}" -r resdir result_pass result_fail result_skip
+        atf_check -o inline:"passed\n" cat resdir/result_pass.result
+        atf_check -o inline:"failed: Failure reason\n" \
+            cat resdir/result_fail.result
+        atf_check -o inline:"skipped: Skipped reason\n" \
+            cat resdir/result_skip.result
+        cat >expout <<EOF
+result_pass exited 0
+result_fail exited 1
+result_skip exited 0
+EOF
+        atf_check -o file:expout cat resdir/status
+    done
+}
+
+atf_test_case batch_file
+batch_file_head()
+{
+    atf_set "descr" "Tests that the test cases to run in batch mode can be" \
+                    "read from a file"
+}
+batch_file_body()
+{
+    cat >list <<EOF
+# Comments and empty lines are ignored.
+result_pass
+
+result_skip
+EOF
+
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:0 -o inline:"msg\nmsg\n" -e ignore "${h}" \
+            -s "${srcdir}" -r resdir -f list
+        atf_check -o inline:"passed\n" cat resdir/result_pass.result
+        atf_check -o inline:"skipped: Skipped reason\n" \
+            cat resdir/result_skip.result
+        atf_check -o inline:"result_pass exited 0\nresult_skip exited 0\n" \
+            cat resdir/status
+    done
+}
+
+atf_test_case batch_cleanup
+batch_cleanup_head()
+{
+    atf_set "descr" "Tests that cleanup routines can be run in batch mode"
+}
+batch_cleanup_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers sh_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:0 -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -r resdir -v tmpfile="$(pwd)/tmpfile" -v cleanup=yes \
+            cleanup_pass cleanup_pass:cleanup
+        test ! -f tmpfile || atf_fail "Cleanup routine not executed"
+        cat >expout <<EOF
+cleanup_pass exited 0
+cleanup_pass:cleanup exited 0
+EOF
+        atf_check -o file:expout cat resdir/status
+    done
+}
+
+atf_test_case batch_workdir
+batch_workdir_head()
+{
+    atf_set "descr" "Tests that every test case runs in its own work" \
+                    "directory in batch mode, together with its cleanup"
+}
+batch_workdir_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:0 -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -r resdir result_pass result_skip
+        for tc in result_pass result_skip; do
+            test -d "resdir/${tc}.work" || atf_fail "No work directory" \
+                "for ${tc} in ${h}"
+        done
+    done
+
+    for h in $(get_helpers c_helpers sh_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:0 -o match:"Old value: 1234" -e ignore "${h}" \
+            -s "${srcdir}" -r resdir cleanup_curdir cleanup_curdir:cleanup
+        test -f resdir/cleanup_curdir.work/oldvalue || \
+            atf_fail "Test case did not run in its work directory"
+        test ! -f oldvalue || atf_fail "Test case ran in the current directory"
+    done
+}
+
+atf_test_case batch_child_error
+batch_child_error_head()
+{
+    atf_set "descr" "Tests that a test case that cannot be started in" \
+                    "batch mode fails on its own without running the" \
+                    "rest of the batch twice"
+}
+batch_child_error_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        for jobs in 1 2; do
+            rm -rf resdir; mkdir resdir
+            touch resdir/result_pass.work
+            atf_check -s eq:1 -o ignore \
+                -e match:"Cannot enter work directory" "${h}" \
+                -s "${srcdir}" -r resdir -j "${jobs}" result_pass result_skip
+            cat >expout <<EOF
+result_pass exited 1
+result_skip exited 0
+EOF
+            atf_check -o file:expout sort resdir/status
+            test ! -f resdir/result_pass.result || \
+                atf_fail "Test case ran without its work directory"
+        done
+    done
+}
+
+atf_test_case batch_isolation
+batch_isolation_head()
+{
+    atf_set "descr" "Tests that a test case that crashes in batch mode" \
+                    "does not affect the ones that follow it"
+}
+batch_isolation_body()
+{
+    # The shell helpers signal themselves through $$, which refers to the
+    # main test program process and not to the subshell running the test.
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:1 -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -r resdir expect_signal_any_and_signal result_pass
+        atf_check -o match:"^expected_signal: Call will signal$" \
+            cat resdir/expect_signal_any_and_signal.result
+        atf_check -o inline:"passed\n" cat resdir/result_pass.result
+        cat >expout <<EOF
+expect_signal_any_and_signal signaled 9
+result_pass exited 0
+EOF
+        atf_check -o file:expout cat resdir/status
+    done
+}
+
+atf_test_case batch_errors
+batch_errors_head()
+{
+    atf_set "descr" "Tests the handling of invalid invocations in batch mode"
+}
+batch_errors_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        atf_check -s eq:1 -o empty -e match:"requires -r" "${h}" \
+            -s "${srcdir}" result_pass result_skip
+
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:1 -o empty \
+            -e match:"Unknown test case .*unknown" "${h}" \
+            -s "${srcdir}" -r resdir result_pass unknown
+        test ! -f resdir/status || atf_fail "Test cases run before" \
+            "validating all names"
+
+        atf_check -s eq:1 -o empty -e match:"test case part .*bogus" "${h}" \
+            -s "${srcdir}" -r resdir result_pass result_skip:bogus
+        test ! -f resdir/status || atf_fail "Test cases run before" \
+            "validating all parts"
+
+        atf_check -s eq:1 -o empty -e match:"Cannot open test case list" \
+            "${h}" -s "${srcdir}" -r resdir -f missing
+        atf_check -s eq:1 -o empty -e match:"Cannot provide test case names" \
+            "${h}" -s "${srcdir}" -l -f missing
+    done
+}
+
+atf_test_case parallel_run
+parallel_run_head()
+{
+    atf_set "descr" "Tests that test cases can be run concurrently with -j"
+}
+parallel_run_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:1 -o inline:"msg\nmsg\nmsg\n" -e ignore "${h}" \
+            -s "${srcdir}" -r resdir -j 2 result_pass result_fail result_skip
+        atf_check -o inline:"passed\n" cat resdir/result_pass.result
+        atf_check -o inline:"failed: Failure reason\n" \
+            cat resdir/result_fail.result
+        atf_check -o inline:"skipped: Skipped reason\n" \
+            cat resdir/result_skip.result
+        for tc in result_pass result_fail result_skip; do
+            test -d "resdir/${tc}.work" || atf_fail "No work directory" \
+                "for ${tc}"
+        done
+        cat >expout <<EOF
+result_fail exited 1
+result_pass exited 0
+result_skip exited 0
+EOF
+        atf_check -o file:expout sort resdir/status
+    done
+}
+
+atf_test_case parallel_cleanup
+parallel_cleanup_head()
+{
+    atf_set "descr" "Tests that cleanup routines are run in the work" \
+                    "directory of their test case in parallel mode"
+}
+parallel_cleanup_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    mkdir resdir
+    atf_check -s eq:0 -o inline:"Old value: 1234" -e ignore \
+        "${srcdir}/c_helpers" -s "${srcdir}" -r resdir -j 4 cleanup_curdir
+    cat >expout <<EOF
+cleanup_curdir exited 0
+cleanup_curdir:cleanup exited 0
+EOF
+    atf_check -o file:expout cat resdir/status
+    test -f resdir/cleanup_curdir.work/oldvalue || \
+        atf_fail "Test case did not run in its work directory"
+}
+
+atf_test_case parallel_all
+parallel_all_head()
+{
+    atf_set "descr" "Tests that -j runs every test case when none is named"
+}
+parallel_all_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:1 -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -r resdir -j 2
+        for tc in $("${h}" -s "${srcdir}" -l | sed -n 's,^ident: ,,p'); do
+            grep "^${tc} " resdir/status >/dev/null || \
+                atf_fail "No status for ${tc} in ${h}"
+            test -f "resdir/${tc}.result" || \
+                atf_fail "No results file for ${tc} in ${h}"
+        done
+    done
+}
+
+atf_test_case parallel_absolute
+parallel_absolute_head()
+{
+    atf_set "descr" "Tests that -j accepts an absolute results directory"
+}
+parallel_absolute_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        rm -rf resdir; mkdir resdir
+        atf_check -s eq:0 -o inline:"msg\n" -e ignore "${h}" \
+            -s "${srcdir}" -r "$(pwd)/resdir" -j 2 result_pass
+        atf_check -o inline:"passed\n" cat resdir/result_pass.result
+        atf_check -o inline:"result_pass exited 0\n" cat resdir/status
+    done
+}
+
+atf_test_case parallel_errors
+parallel_errors_head()
+{
+    atf_set "descr" "Tests the handling of invalid invocations in" \
+                    "parallel mode"
+}
+parallel_errors_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        atf_check -s eq:1 -o empty -e match:"requires -r" "${h}" \
+            -s "${srcdir}" -j 2 result_pass
+
+        rm -rf resdir; mkdir resdir
+        for arg in 0 -1 foo 3x; do
+            atf_check -s eq:1 -o empty -e match:"Invalid number of jobs" \
+                "${h}" -s "${srcdir}" -r resdir -j "${arg}" result_pass
+        done
+        atf_check -s eq:1 -o empty -e match:"Cannot specify test case parts" \
+            "${h}" -s "${srcdir}" -r resdir -j 2 result_pass:cleanup
+        atf_check -s eq:1 -o empty -e match:"Cannot use -l and -j" \
+            "${h}" -s "${srcdir}" -l -j 2
+    done
+}
+
+atf_init_test_cases()
+{
+    atf_add_test_case batch_argv
+    atf_add_test_case batch_file
+    atf_add_test_case batch_cleanup
+    atf_add_test_case batch_workdir
+    atf_add_test_case batch_child_error
+    atf_add_test_case batch_isolation
+    atf_add_test_case batch_errors
+    atf_add_test_case parallel_run
+    atf_add_test_case parallel_all
+    atf_add_test_case parallel_absolute
+    atf_add_test_case parallel_cleanup
+    atf_add_test_case parallel_errors
+}
+
+# vim: syntax=sh:expandtab:shiftwidth=4:softtabstop=4
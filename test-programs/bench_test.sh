@@ -0,0 +1,102 @@
+# Copyright (c) 2007 The NetBSD Foundation, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+# CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+# INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+# GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+# IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+# IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+atf_test_case list
+list_head()
+{
+    atf_set "descr" "Tests that benchmarks are marked as such when listing" \
+                    "the test cases"
+}
+list_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        atf_check -o save:list "${h}" -s "${srcdir}" -l
+        atf_check -o inline:"1\n" grep -c '^X-benchmark: true$' list
+        atf_check -o match:'"ident":"bench_loop".*"X-benchmark":"true"' \
+            "${h}" -s "${srcdir}" -l -F json
+    done
+}
+
+atf_test_case run
+run_head()
+{
+    atf_set "descr" "Tests that running a benchmark reports its statistics" \
+                    "on stdout, in the results file and in the file named" \
+                    "by bench.output"
+}
+run_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        rm -f out.json
+        atf_check -s eq:0 -o save:stdout -e ignore "${h}" -s "${srcdir}" \
+            -v bench.repetitions=5 -v bench.target_time=1 \
+            -v bench.output=out.json -u -r resfile bench_loop
+        atf_check -o match:'^bench_loop: [0-9]+ iterations x 5 repetitions: min' \
+            cat stdout
+        atf_check -o inline:"passed\n" head -n 1 resfile
+        for name in iterations repetitions min median p99 mean stddev; do
+            atf_check -o match:"^bench\\.${name}: [0-9.]+$" \
+                grep "^bench\\.${name}:" resfile
+        done
+        atf_check -o match:'^\{"ident":"bench_loop","iterations":[0-9]+,"repetitions":5,' \
+            cat out.json
+
+        atf_check -s eq:0 -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -v bench.repetitions=1 -v bench.target_time=1 -r resfile bench_loop
+        atf_check -o inline:"passed\n" cat resfile
+    done
+}
+
+atf_test_case invalid_config
+invalid_config_head()
+{
+    atf_set "descr" "Tests that benchmarks fail on invalid settings"
+}
+invalid_config_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        atf_check -s eq:1 -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -v bench.repetitions=0 -r resfile bench_loop
+        atf_check -o match:"failed: .*bench.repetitions must be at least 1" \
+            cat resfile
+
+        atf_check -s eq:1 -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -v bench.target_time=foo -r resfile bench_loop
+        atf_check -o match:"failed: .*bench.target_time.*valid long" \
+            cat resfile
+    done
+}
+
+atf_init_test_cases()
+{
+    atf_add_test_case list
+    atf_add_test_case run
+    atf_add_test_case invalid_config
+}
+
+# vim: syntax=sh:expandtab:shiftwidth=4:softtabstop=4
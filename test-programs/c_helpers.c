@@ -447,6 +447,156 @@ ATF_TC_BODY(result_newlines_skip, tc)
     atf_tc_skip("First line\nSecond line");
 }
 
+ATF_TC(result_cgroup);
+ATF_TC_HEAD(result_cgroup, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Helper test case for the t_result test "
+                      "program");
+    atf_tc_set_md_var(tc, "limit.cpu", "0.5");
+    atf_tc_set_md_var(tc, "limit.pids", "10");
+}
+ATF_TC_BODY(result_cgroup, tc)
+{
+    printf("msg\n");
+}
+
+ATF_TC(result_leak);
+ATF_TC_HEAD(result_leak, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Helper test case for the t_result test "
+                      "program");
+    atf_tc_set_md_var(tc, "kill.leftovers", "true");
+}
+ATF_TC_BODY(result_leak, tc)
+{
+    FILE *f;
+    pid_t child, sleeper;
+
+    f = fopen("pids", "w");
+    ATF_REQUIRE(f != NULL);
+
+    sleeper = atf_utils_fork();
+    if (sleeper == 0) {
+        for (;;)
+            pause();
+    }
+    fprintf(f, "%d\n", (int)sleeper);
+    fflush(f);
+
+    /* The grandchild becomes an orphan as soon as its parent exits. */
+    child = atf_utils_fork();
+    if (child == 0) {
+        const pid_t grandchild = fork();
+        if (grandchild == 0) {
+            for (;;)
+                pause();
+        }
+        fprintf(f, "%d\n", (int)grandchild);
+        exit(EXIT_SUCCESS);
+    }
+    atf_utils_wait(child, EXIT_SUCCESS, "", "");
+    fclose(f);
+
+    printf("msg\n");
+}
+
+ATF_TC(result_leak_exit);
+ATF_TC_HEAD(result_leak_exit, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Helper test case for the t_result test "
+                      "program");
+    atf_tc_set_md_var(tc, "kill.leftovers", "true");
+}
+ATF_TC_BODY(result_leak_exit, tc)
+{
+    FILE *f;
+    pid_t sleeper;
+
+    atf_tc_expect_exit(123, "Body will exit");
+
+    f = fopen("pid", "w");
+    ATF_REQUIRE(f != NULL);
+
+    sleeper = atf_utils_fork();
+    if (sleeper == 0) {
+        for (;;)
+            pause();
+    }
+    fprintf(f, "%d\n", (int)sleeper);
+    fclose(f);
+
+    exit(123);
+}
+
+ATF_TC_WITH_CLEANUP(result_daemon);
+ATF_TC_HEAD(result_daemon, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Helper test case for the t_result test "
+                      "program");
+}
+ATF_TC_BODY(result_daemon, tc)
+{
+    FILE *f;
+    pid_t daemon;
+
+    daemon = fork();
+    ATF_REQUIRE(daemon != -1);
+    if (daemon == 0) {
+        for (;;)
+            pause();
+    }
+
+    f = fopen("pid", "w");
+    ATF_REQUIRE(f != NULL);
+    fprintf(f, "%d\n", (int)daemon);
+    fclose(f);
+
+    printf("msg\n");
+}
+ATF_TC_CLEANUP(result_daemon, tc)
+{
+    FILE *f;
+    int pid;
+
+    f = fopen("pid", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%d", &pid) == 1 && kill(pid, SIGTERM) != -1)
+            printf("Stopped daemon\n");
+        fclose(f);
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Helper tests for "t_bench".
+ * --------------------------------------------------------------------- */
+
+ATF_BENCH(bench_loop);
+ATF_BENCH_HEAD(bench_loop, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Helper benchmark for the t_bench test "
+                      "program");
+}
+ATF_BENCH_BODY(bench_loop, tc, iterations)
+{
+    volatile size_t i;
+
+    for (i = 0; i < iterations; i++)
+        continue;
+}
+
+/* ---------------------------------------------------------------------
+ * Helper tests for "t_list".
+ * --------------------------------------------------------------------- */
+
+ATF_TC(list_escapes);
+ATF_TC_HEAD(list_escapes, tc)
+{
+    atf_tc_set_md_var(tc, "descr", "Quote \" backslash \\ bell \a end");
+}
+ATF_TC_BODY(list_escapes, tc)
+{
+}
+
 /* ---------------------------------------------------------------------
  * Main.
  * --------------------------------------------------------------------- */
@@ -498,6 +648,16 @@ ATF_TP_ADD_TCS(tp)
     ATF_TP_ADD_TC(tp, result_skip);
     ATF_TP_ADD_TC(tp, result_newlines_fail);
     ATF_TP_ADD_TC(tp, result_newlines_skip);
+    ATF_TP_ADD_TC(tp, result_cgroup);
+    ATF_TP_ADD_TC(tp, result_leak);
+    ATF_TP_ADD_TC(tp, result_leak_exit);
+    ATF_TP_ADD_TC(tp, result_daemon);
+
+    /* Add helper tests for t_bench. */
+    ATF_TP_ADD_TC(tp, bench_loop);
+
+    /* Add helper tests for t_list. */
+    ATF_TP_ADD_TC(tp, list_escapes);
 
     return atf_no_error();
 }
@@ -300,6 +300,18 @@ ATF_TEST_CASE_BODY(result_newlines_skip)
     ATF_SKIP("First line\nSecond line");
 }
 
+ATF_TEST_CASE(result_cgroup);
+ATF_TEST_CASE_HEAD(result_cgroup)
+{
+    set_md_var("descr", "Helper test case for the t_result test program");
+    set_md_var("limit.cpu", "0.5");
+    set_md_var("limit.pids", "10");
+}
+ATF_TEST_CASE_BODY(result_cgroup)
+{
+    std::cout << "msg\n";
+}
+
 ATF_TEST_CASE(result_exception);
 ATF_TEST_CASE_HEAD(result_exception) { }
 ATF_TEST_CASE_BODY(result_exception)
@@ -307,6 +319,34 @@ ATF_TEST_CASE_BODY(result_exception)
     throw std::runtime_error("This is unhandled");
 }
 
+// ------------------------------------------------------------------------
+// Helper tests for "t_bench".
+// ------------------------------------------------------------------------
+
+ATF_BENCHMARK(bench_loop);
+ATF_BENCHMARK_HEAD(bench_loop)
+{
+    set_md_var("descr", "Helper benchmark for the t_bench test program");
+}
+ATF_BENCHMARK_BODY(bench_loop, iterations)
+{
+    for (volatile std::size_t i = 0; i < iterations; i++)
+        continue;
+}
+
+// ------------------------------------------------------------------------
+// Helper tests for "t_list".
+// ------------------------------------------------------------------------
+
+ATF_TEST_CASE(list_escapes);
+ATF_TEST_CASE_HEAD(list_escapes)
+{
+    set_md_var("descr", "Quote \" backslash \\ bell \a end");
+}
+ATF_TEST_CASE_BODY(list_escapes)
+{
+}
+
 // ------------------------------------------------------------------------
 // Main.
 // ------------------------------------------------------------------------
@@ -351,5 +391,12 @@ ATF_INIT_TEST_CASES(tcs)
     ATF_ADD_TEST_CASE(tcs, result_skip);
     ATF_ADD_TEST_CASE(tcs, result_newlines_fail);
     ATF_ADD_TEST_CASE(tcs, result_newlines_skip);
+    ATF_ADD_TEST_CASE(tcs, result_cgroup);
     ATF_ADD_TEST_CASE(tcs, result_exception);
+
+    // Add helper tests for t_bench.
+    ATF_ADD_TEST_CASE(tcs, bench_loop);
+
+    // Add helper tests for t_list.
+    ATF_ADD_TEST_CASE(tcs, list_escapes);
 }
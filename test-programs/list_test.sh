@@ -0,0 +1,177 @@
+# Copyright (c) 2007 The NetBSD Foundation, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+# CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+# INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+# GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+# IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+# IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+atf_test_case list_json
+list_json_head()
+{
+    atf_set "descr" "Tests that test cases can be listed in the json format"
+}
+list_json_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        atf_check -o save:atf "${h}" -s "${srcdir}" -l
+        atf_check -o save:json "${h}" -s "${srcdir}" -l -F json
+        atf_check -o inline:"$(grep -c '^ident: ' atf)\n" \
+            -x 'wc -l <json | tr -d " "'
+        atf_check -o ignore grep -F \
+            '{"ident":"config_unset","descr":"Helper test case for' json
+        atf_check -s eq:1 -o empty grep -v '^{"ident":.*}$' json
+        atf_check -o ignore grep -F \
+            '"descr":"Quote \" backslash \\ bell \u0007 end"' json
+    done
+}
+
+atf_test_case list_cache
+list_cache_head()
+{
+    atf_set "descr" "Tests that listings are stored in and read from the" \
+                    "cache directory"
+}
+list_cache_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        rm -rf cache; mkdir cache
+        prog="${h##*/}"
+        for f in atf json; do
+            atf_check -o save:expout "${h}" -s "${srcdir}" -l -F "${f}"
+            atf_check -o file:expout "${h}" -s "${srcdir}" -l -F "${f}" \
+                -C cache
+            test -f "cache/${prog}.${f}" || atf_fail "Cache file not created"
+            atf_check -o file:expout "${h}" -s "${srcdir}" -l -F "${f}" \
+                -C cache
+
+            # Replace the cached listing but keep its key to check that
+            # the listing is really coming from the cache.
+            head -n 1 "cache/${prog}.${f}" >new
+            echo "cached listing" >>new
+            mv new "cache/${prog}.${f}"
+            atf_check -o inline:"cached listing\n" "${h}" -s "${srcdir}" \
+                -l -F "${f}" -C cache
+
+            # A change in the configuration must invalidate the cache.
+            atf_check -o file:expout "${h}" -s "${srcdir}" -l -F "${f}" \
+                -C cache -v foo=bar
+        done
+    done
+}
+
+atf_test_case list_cache_mode
+list_cache_mode_head()
+{
+    atf_set "descr" "Tests that cached listings get the permissions of a" \
+                    "regular file"
+}
+list_cache_mode_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        prog="${h##*/}"
+        for mask in 022 027; do
+            rm -rf cache; mkdir cache
+            ( umask "${mask}"; "${h}" -s "${srcdir}" -l -C cache >/dev/null )
+            case "${mask}" in
+                022) mode="-rw-r--r--" ;;
+                027) mode="-rw-r-----" ;;
+            esac
+            atf_check -o match:"^${mode} " ls -l "cache/${prog}.atf"
+        done
+    done
+}
+
+atf_test_case list_cache_mtime
+list_cache_mtime_head()
+{
+    atf_set "descr" "Tests that the cache is invalidated when the test" \
+                    "program changes within the same second"
+}
+list_cache_mtime_body()
+{
+    # The C and C++ helpers may be libtool wrappers that cannot be copied,
+    # so only the shell helpers are exercised here.
+    srcdir="$(atf_get_srcdir)"
+    cp "${srcdir}/sh_helpers" sh_helpers
+    touch -d "@1000000000.100000000" sh_helpers 2>/dev/null || \
+        atf_skip "touch cannot set sub-second modification times"
+    ls -l --full-time sh_helpers 2>/dev/null | grep '\.100000000' \
+        >/dev/null || atf_skip "The file system lacks sub-second times"
+
+    mkdir cache
+    atf_check -o save:expout ./sh_helpers -s . -l -C cache
+    head -n 1 cache/sh_helpers.atf >new
+    echo "cached listing" >>new
+    mv new cache/sh_helpers.atf
+    atf_check -o inline:"cached listing\n" ./sh_helpers -s . -l -C cache
+
+    touch -d "@1000000000.200000000" sh_helpers
+    atf_check -o file:expout ./sh_helpers -s . -l -C cache
+}
+
+atf_test_case list_cache_unwritable
+list_cache_unwritable_head()
+{
+    atf_set "descr" "Tests that failures to update the cache do not" \
+                    "prevent listing the test cases"
+}
+list_cache_unwritable_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        atf_check -o save:expout "${h}" -s "${srcdir}" -l
+        atf_check -o file:expout -e match:"WARNING.*cache" "${h}" \
+            -s "${srcdir}" -l -C "$(pwd)/missing"
+    done
+}
+
+atf_test_case list_errors
+list_errors_head()
+{
+    atf_set "descr" "Tests the handling of invalid listing options"
+}
+list_errors_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers); do
+        atf_check -s eq:1 -o empty -e match:"Unknown listing format \`foo'" \
+            "${h}" -s "${srcdir}" -l -F foo
+        atf_check -s eq:1 -o empty -e match:"Cannot use -C or -F without -l" \
+            "${h}" -s "${srcdir}" -C . result_pass
+        atf_check -s eq:1 -o empty -e match:"Cannot use -C or -F without -l" \
+            "${h}" -s "${srcdir}" -F json result_pass
+    done
+}
+
+atf_init_test_cases()
+{
+    atf_add_test_case list_json
+    atf_add_test_case list_cache
+    atf_add_test_case list_cache_mode
+    atf_add_test_case list_cache_mtime
+    atf_add_test_case list_cache_unwritable
+    atf_add_test_case list_errors
+}
+
+# vim: syntax=sh:expandtab:shiftwidth=4:softtabstop=4
@@ -110,6 +110,157 @@ result_to_file_fail_body()
     done
 }
 
+atf_test_case result_rusage
+result_rusage_head()
+{
+    atf_set "descr" "Tests that -u appends the resources consumed by the" \
+                    "body and the cleanup routine to the results file," \
+                    "however the body terminates"
+}
+result_rusage_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        atf_check -s eq:1 -o inline:"msg\n" -e ignore "${h}" -s "${srcdir}" \
+            -u -r resfile result_fail
+        atf_check -o inline:"failed: Failure reason\n" head -n 1 resfile
+        for name in wall utime stime maxrss nvcsw nivcsw inblock oublock; do
+            atf_check -o match:"^body\.${name}: [0-9.]+$" \
+                grep "^body\.${name}:" resfile
+        done
+
+        atf_check -s eq:0 -o inline:"msg\n" -e ignore "${h}" -s "${srcdir}" \
+            -r resfile result_pass
+        atf_check -o inline:"passed\n" cat resfile
+
+        atf_check -s eq:123 -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -u -r resfile expect_exit_code_and_exit
+        atf_check -o inline:"expected_exit(123): Call will exit\n" \
+            head -n 1 resfile
+        atf_check -o match:"^body\.wall: [0-9.]+$" grep "^body\.wall:" resfile
+
+        atf_check -s signal:hup -o ignore -e ignore "${h}" -s "${srcdir}" \
+            -u -r resfile expect_signal_no_and_signal
+        atf_check -o match:"^expected_signal" head -n 1 resfile
+        atf_check -o match:"^body\.wall: [0-9.]+$" grep "^body\.wall:" resfile
+    done
+
+    h="$(get_helpers c_helpers)"
+    atf_check -s eq:0 -o empty -e ignore "${h}" -s "${srcdir}" -u \
+        -v tmpfile="$(pwd)/tmpfile" -r resfile cleanup_pass
+    atf_check -s eq:0 -o empty -e ignore "${h}" -s "${srcdir}" -u \
+        -v tmpfile="$(pwd)/tmpfile" -v cleanup=true -r resfile \
+        cleanup_pass:cleanup
+    atf_check -o inline:"passed\n" head -n 1 resfile
+    atf_check -o match:"^cleanup\.wall: [0-9]+\.[0-9]{6}$" \
+        grep "^cleanup\.wall:" resfile
+
+    mkdir resdir
+    atf_check -s eq:0 -o empty -e ignore "${h}" -s "${srcdir}" -u \
+        -v tmpfile="$(pwd)/tmpfile" -v cleanup=true -r resdir -j 2 \
+        cleanup_pass
+    atf_check -o inline:"passed\n" head -n 1 resdir/cleanup_pass.result
+    atf_check -o match:"^body\.wall:" -o match:"^cleanup\.wall:" \
+        cat resdir/cleanup_pass.result
+}
+
+atf_test_case result_cgroup
+result_cgroup_head()
+{
+    atf_set "descr" "Tests that -g runs the bodies with resource limits in" \
+                    "a cgroup and reports when their controllers are missing"
+}
+result_cgroup_body()
+{
+    srcdir="$(atf_get_srcdir)"
+
+    # A plain directory looks like a cgroup without any controller to the
+    # test programs, which lets us check the error paths anywhere.
+    mkdir cgroot
+    touch cgroot/cgroup.controllers cgroot/cgroup.subtree_control
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        atf_check -s eq:0 -o inline:"msg\n" -e ignore "${h}" -s "${srcdir}" \
+            -g "$(pwd)/cgroot" -r resfile result_pass
+        atf_check -o inline:"passed\n" cat resfile
+
+        atf_check -s eq:1 -o empty -e ignore "${h}" -s "${srcdir}" \
+            -g "$(pwd)/cgroot" -r resfile result_cgroup
+        atf_check -o match:"^failed: Cannot run the body in a cgroup: The" \
+            -o match:"cpu controller is not available" cat resfile
+        atf_check -o inline:"cgroup.controllers\ncgroup.subtree_control\n" \
+            ls cgroot
+    done
+}
+
+atf_test_case result_leak
+result_leak_head()
+{
+    atf_set "descr" "Tests that processes left behind by the body are" \
+                    "killed and reported"
+}
+result_leak_body()
+{
+    [ -d /proc/self/task ] || \
+        atf_skip "Cannot discover descendants without /proc"
+
+    srcdir="$(atf_get_srcdir)"
+    h="$(get_helpers c_helpers)"
+    atf_check -s eq:0 -o inline:"msg\n" \
+        -e match:"Killed 2 leftover processes of the test case body" \
+        "${h}" -s "${srcdir}" -u -r resfile result_leak
+    atf_check -o inline:"passed\n" head -n 1 resfile
+    atf_check -o inline:"body.leaked: 2\n" grep "^body\.leaked:" resfile
+
+    atf_check -o inline:"2\n" -x "wc -l <pids | tr -d ' '"
+    for pid in $(cat pids); do
+        ! kill -0 "${pid}" 2>/dev/null || atf_fail "Process ${pid} leaked"
+    done
+}
+
+atf_test_case result_leak_exit
+result_leak_exit_head()
+{
+    atf_set "descr" "Tests that processes left behind by a body that is" \
+                    "expected to exit are killed and reported"
+}
+result_leak_exit_body()
+{
+    [ -d /proc/self/task ] || \
+        atf_skip "Cannot discover descendants without /proc"
+
+    srcdir="$(atf_get_srcdir)"
+    h="$(get_helpers c_helpers)"
+    atf_check -s eq:123 -o empty \
+        -e match:"Killed 1 leftover processes of the test case body" \
+        "${h}" -s "${srcdir}" -u -r resfile result_leak_exit
+    atf_check -o inline:"expected_exit(123): Body will exit\n" \
+        head -n 1 resfile
+    atf_check -o inline:"body.leaked: 1\n" grep "^body\.leaked:" resfile
+
+    pid=$(cat pid)
+    ! kill -0 "${pid}" 2>/dev/null || atf_fail "Process ${pid} leaked"
+}
+
+atf_test_case result_daemon
+result_daemon_head()
+{
+    atf_set "descr" "Tests that processes left behind by the body survive" \
+                    "until the cleanup routine unless asked otherwise"
+}
+result_daemon_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    h="$(get_helpers c_helpers)"
+    atf_check -s eq:0 -o inline:"msg\n" -e empty \
+        "${h}" -s "${srcdir}" -u -r resfile result_daemon
+    atf_check -s eq:1 grep "^body\.leaked:" resfile
+
+    pid=$(cat pid)
+    kill -0 "${pid}" || atf_fail "The daemon did not survive the body"
+    atf_check -s eq:0 -o inline:"Stopped daemon\n" -e empty \
+        "${h}" -s "${srcdir}" result_daemon:cleanup
+}
+
 atf_test_case result_exception
 result_exception_head()
 {
@@ -129,6 +280,11 @@ atf_init_test_cases()
     atf_add_test_case result_on_stdout
     atf_add_test_case result_to_file
     atf_add_test_case result_to_file_fail
+    atf_add_test_case result_rusage
+    atf_add_test_case result_cgroup
+    atf_add_test_case result_leak
+    atf_add_test_case result_leak_exit
+    atf_add_test_case result_daemon
     atf_add_test_case result_exception
 }
 
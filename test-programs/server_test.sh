@@ -0,0 +1,171 @@
+# Copyright (c) 2007 The NetBSD Foundation, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND
+# CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+# INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+# GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+# IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+# IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+atf_test_case server_run
+server_run_head()
+{
+    atf_set "descr" "Tests that test cases can be run by sending requests" \
+                    "to a test program in server mode"
+}
+server_run_body()
+{
+    printf 'result_pass\tres1\nresult_fail\tres2\n\nresult_skip\tres3\n' \
+        >requests
+
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        rm -f res1 res2 res3
+        cat >expout <<EOF
+result_pass exited 0
+result_fail exited 1
+result_skip exited 0
+EOF
+        atf_check -s eq:0 -o file:expout -e match:"^msg$" "${h}" \
+            -s "${srcdir}" -S <requests
+        atf_check -o inline:"passed\n" cat res1
+        atf_check -o inline:"failed: Failure reason\n" cat res2
+        atf_check -o inline:"skipped: Skipped reason\n" cat res3
+    done
+}
+
+atf_test_case server_workdir
+server_workdir_head()
+{
+    atf_set "descr" "Tests that every request in server mode runs in a work" \
+                    "directory next to its results file"
+}
+server_workdir_body()
+{
+    mkdir resdir
+    printf 'cleanup_curdir\tresdir/res\ncleanup_curdir:cleanup\tresdir/res\n' \
+        >requests
+
+    srcdir="$(atf_get_srcdir)"
+    atf_check -s eq:0 -o ignore -e match:"Old value: 1234" \
+        "${srcdir}/c_helpers" -s "${srcdir}" -S <requests
+    atf_check -o inline:"passed\n" cat resdir/res
+    test -f resdir/cleanup_curdir.work/oldvalue || \
+        atf_fail "Test case did not run in its work directory"
+    test ! -f oldvalue || atf_fail "Test case ran in the current directory"
+}
+
+atf_test_case server_child_error
+server_child_error_head()
+{
+    atf_set "descr" "Tests that a request that cannot be started in server" \
+                    "mode fails on its own and the server keeps serving"
+}
+server_child_error_body()
+{
+    mkdir resdir
+    touch resdir/result_pass.work
+    printf 'result_pass\tresdir/result_pass\nresult_skip\tresdir/result_skip\n' \
+        >requests
+
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        atf_check -s eq:0 \
+            -o inline:"result_pass exited 1\nresult_skip exited 0\n" \
+            -e match:"Cannot enter work directory" \
+            "${h}" -s "${srcdir}" -S <requests
+    done
+}
+
+atf_test_case server_config
+server_config_head()
+{
+    atf_set "descr" "Tests that every request in server mode can carry its" \
+                    "own configuration variables"
+}
+server_config_body()
+{
+    printf 'config_value\tres1\ttest=foo\nconfig_unset\tres2\n' >requests
+
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        rm -f res1 res2
+        atf_check -s eq:0 \
+            -o inline:"config_value exited 0\nconfig_unset exited 0\n" \
+            -e ignore "${h}" -s "${srcdir}" -S <requests
+        atf_check -o inline:"passed\n" cat res1
+        atf_check -o inline:"passed\n" cat res2
+    done
+}
+
+atf_test_case server_bad_requests
+server_bad_requests_head()
+{
+    atf_set "descr" "Tests that invalid requests in server mode are answered" \
+                    "with an error and do not stop the server"
+}
+server_bad_requests_body()
+{
+    printf 'unknown\tres\nresult_pass\nresult_pass:foo\tres\n' >requests
+    printf 'result_pass\tres\n' >>requests
+
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        rm -f res
+        cat >expout <<EOF
+unknown error Unknown test case \`unknown'
+result_pass error Request does not provide a results file
+result_pass:foo error Invalid test case part \`foo'
+result_pass exited 0
+EOF
+        atf_check -s eq:0 -o file:expout -e ignore "${h}" \
+            -s "${srcdir}" -S <requests
+        atf_check -o inline:"passed\n" cat res
+    done
+}
+
+atf_test_case server_usage
+server_usage_head()
+{
+    atf_set "descr" "Tests that server mode cannot be combined with other" \
+                    "modes of operation"
+}
+server_usage_body()
+{
+    srcdir="$(atf_get_srcdir)"
+    for h in $(get_helpers c_helpers cpp_helpers); do
+        atf_check -s eq:1 -o empty \
+            -e match:"Cannot provide test case names with -S" "${h}" \
+            -s "${srcdir}" -S result_pass
+        atf_check -s eq:1 -o empty -e match:"Cannot use -l and -S" "${h}" \
+            -s "${srcdir}" -l -S
+    done
+}
+
+atf_init_test_cases()
+{
+    atf_add_test_case server_run
+    atf_add_test_case server_workdir
+    atf_add_test_case server_child_error
+    atf_add_test_case server_config
+    atf_add_test_case server_bad_requests
+    atf_add_test_case server_usage
+}
+
+# vim: syntax=sh:expandtab:shiftwidth=4:softtabstop=4
@@ -336,6 +336,20 @@ result_skip_body()
     atf_skip "Skipped reason"
 }
 
+# -------------------------------------------------------------------------
+# Helper tests for "t_list".
+# -------------------------------------------------------------------------
+
+atf_test_case list_escapes
+list_escapes_head()
+{
+    atf_set "descr" "Quote \" backslash \\ bell $(printf '\a') end"
+}
+list_escapes_body()
+{
+    :
+}
+
 # -------------------------------------------------------------------------
 # Main.
 # -------------------------------------------------------------------------
@@ -385,6 +399,9 @@ atf_init_test_cases()
     atf_add_test_case result_pass
     atf_add_test_case result_fail
     atf_add_test_case result_skip
+
+    # Add helper tests for t_list.
+    atf_add_test_case list_escapes
 }
 
 # vim: syntax=sh:expandtab:shiftwidth=4:softtabstop=4